@@ -118,6 +118,7 @@ CheckpointReader::BuildV2VarMaps() {
   BundleEntryProto entry;
   v2_reader_->Seek(kHeaderEntryKey);
   for (v2_reader_->Next(); v2_reader_->Valid(); v2_reader_->Next()) {
+    if (IsDeltaDataKey(v2_reader_->key())) continue;
     CHECK(entry.ParseFromArray(v2_reader_->value().data(),
                                v2_reader_->value().size()))
         << entry.InitializationErrorString();
@@ -131,14 +132,18 @@ CheckpointReader::BuildV2VarMaps() {
     }
   }
 
-  // Second pass: adds the entries, ignoring the filtered keys.
+  // Second pass: adds the entries, ignoring the filtered keys and the data
+  // of deltas.
   std::unique_ptr<TensorSliceReader::VarToShapeMap> var_to_shape_map(
       new TensorSliceReader::VarToShapeMap);
   std::unique_ptr<TensorSliceReader::VarToDataTypeMap> var_to_data_type_map(
       new TensorSliceReader::VarToDataTypeMap);
   v2_reader_->Seek(kHeaderEntryKey);
   for (v2_reader_->Next(); v2_reader_->Valid(); v2_reader_->Next()) {
-    if (filtered_keys.count(std::string(v2_reader_->key())) > 0) continue;
+    if (filtered_keys.count(std::string(v2_reader_->key())) > 0 ||
+        IsDeltaDataKey(v2_reader_->key())) {
+      continue;
+    }
     CHECK(entry.ParseFromArray(v2_reader_->value().data(),
                                v2_reader_->value().size()))
         << entry.InitializationErrorString();
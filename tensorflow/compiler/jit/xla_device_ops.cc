@@ -76,6 +76,7 @@ void XlaAssignVariableOp::ComputeAsync(OpKernelContext* context,
       value.shape(), DEVICE_MEMORY, attr);
   mutex_lock ml(*variable->mu());
   variable->is_initialized = true;
+  variable->MarkAllRowsDirty();
   if (input_alias) {
     *variable->tensor() = *input_alias;
     done();
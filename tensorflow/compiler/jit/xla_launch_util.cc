@@ -333,11 +333,13 @@ void XlaComputationLaunchContext::PopulateOutputs(
         xla_tensor->SetDefinedOn(stream, std::move(event));
       }
       *variable->tensor() = output_tensor;
+      variable->MarkAllRowsDirty();
     } else {
       Tensor output_tensor = XlaTensorBuffer::MakeTensor(
           write.type, write.shape, buffer, allocator);
       output.set_buffer(xla::OwningDeviceMemory(), {output_num});
       *variable->tensor() = output_tensor;
+      variable->MarkAllRowsDirty();
     }
     ++output_num;
   }
@@ -28,6 +28,11 @@ class CSVDatasetOp : public DatasetOpKernel {
   explicit CSVDatasetOp(OpKernelConstruction* ctx) : DatasetOpKernel(ctx) {
     OP_REQUIRES_OK(ctx, ctx->GetAttr("output_types", &output_types_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("output_shapes", &output_shapes_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("record_batch_size", &record_batch_size_));
+    OP_REQUIRES(
+        ctx, record_batch_size_ >= 0,
+        errors::InvalidArgument("record_batch_size must not be negative"));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("num_epochs", &num_epochs_));
   }
 
   void MakeDataset(OpKernelContext* ctx, DatasetBase** output) override {
@@ -106,7 +111,8 @@ class CSVDatasetOp : public DatasetOpKernel {
     *output = new Dataset(ctx, std::move(filenames), header, buffer_size,
                           output_types_, output_shapes_,
                           std::move(record_defaults), std::move(select_cols),
-                          use_quote_delim, delim[0], std::move(na_value));
+                          use_quote_delim, delim[0], std::move(na_value),
+                          record_batch_size_, num_epochs_);
   }
 
  private:
@@ -116,7 +122,8 @@ class CSVDatasetOp : public DatasetOpKernel {
             int64 buffer_size, const DataTypeVector& output_types,
             const std::vector<PartialTensorShape>& output_shapes,
             std::vector<Tensor> record_defaults, std::vector<int64> select_cols,
-            bool use_quote_delim, char delim, string na_value)
+            bool use_quote_delim, char delim, string na_value,
+            int64 record_batch_size, int64 num_epochs)
         : GraphDatasetBase(ctx),
           filenames_(std::move(filenames)),
           header_(header),
@@ -127,7 +134,9 @@ class CSVDatasetOp : public DatasetOpKernel {
           select_cols_(std::move(select_cols)),
           use_quote_delim_(use_quote_delim),
           delim_(delim),
-          na_value_(std::move(na_value)) {}
+          na_value_(std::move(na_value)),
+          record_batch_size_(record_batch_size),
+          num_epochs_(num_epochs) {}
 
     std::unique_ptr<IteratorBase> MakeIteratorInternal(
         const string& prefix) const override {
@@ -162,18 +171,49 @@ class CSVDatasetOp : public DatasetOpKernel {
                              std::vector<Tensor>* out_tensors,
                              bool* end_of_sequence) override {
         mutex_lock l(mu_);
+        if (dataset()->record_batch_size_ > 0) {
+          return GetNextRecordBatchLocked(ctx, out_tensors, end_of_sequence);
+        }
+        return ReadNextRecordLocked(ctx, out_tensors, end_of_sequence);
+      }
+
+     protected:
+      Status SaveInternal(IteratorStateWriter* writer) override {
+        mutex_lock l(mu_);
+        // TODO(rachelim): Implement save
+        return errors::Unimplemented("CSVDataset: SaveInternal");
+      }
+      Status RestoreInternal(IteratorContext* ctx,
+                             IteratorStateReader* reader) override {
+        mutex_lock l(mu_);
+        // TODO(rachelim): Implement restore
+        return errors::Unimplemented("CSVDataset: RestoreInternal");
+      }
+
+     private:
+      // Reads the next record into `out_tensors`, moving on to the next file
+      // as needed. In record batch mode, `out_tensors` holds the columns of
+      // the batch, and the fields are written to their row `row_`.
+      Status ReadNextRecordLocked(IteratorContext* ctx,
+                                  std::vector<Tensor>* out_tensors,
+                                  bool* end_of_sequence)
+          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
         bool select_all = dataset()->select_cols_.empty();
         do {
           // We are currently processing a file, so try to read the next record
           if (input_stream_) {
+            num_fields_ = 0;
             Status s = ReadRecord(ctx, out_tensors, select_all,
                                   dataset()->select_cols_);
             if (s.ok()) {
               // Validate output
-              if (out_tensors->size() != dataset()->out_type_.size()) {
+              const size_t num_fields = dataset()->record_batch_size_ > 0
+                                            ? num_fields_
+                                            : out_tensors->size();
+              if (num_fields != dataset()->out_type_.size()) {
                 return errors::InvalidArgument(
                     "Expect ", dataset()->out_type_.size(), " fields but have ",
-                    out_tensors->size(), " in record");
+                    num_fields, " in record");
               }
 
               *end_of_sequence = false;
@@ -189,29 +229,56 @@ class CSVDatasetOp : public DatasetOpKernel {
             ResetStreamsLocked();
             ++current_file_index_;
           }
-          // Iteration ends when there are no more files to process.
+          // Each epoch reads all files. Iteration ends when there are no
+          // more files to process in the last epoch.
           if (current_file_index_ == dataset()->filenames_.size()) {
-            *end_of_sequence = true;
-            return Status::OK();
+            if (epoch_ + 1 >= dataset()->num_epochs_) {
+              *end_of_sequence = true;
+              return Status::OK();
+            }
+            ++epoch_;
+            current_file_index_ = 0;
+            continue;
           }
           TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
         } while (true);
       }
 
-     protected:
-      Status SaveInternal(IteratorStateWriter* writer) override {
-        mutex_lock l(mu_);
-        // TODO(rachelim): Implement save
-        return errors::Unimplemented("CSVDataset: SaveInternal");
-      }
-      Status RestoreInternal(IteratorContext* ctx,
-                             IteratorStateReader* reader) override {
-        mutex_lock l(mu_);
-        // TODO(rachelim): Implement restore
-        return errors::Unimplemented("CSVDataset: RestoreInternal");
+      // Reads up to `record_batch_size_` records, which may span several
+      // files, parsing each field directly into its row of a column vector.
+      // An invalid record fails the whole batch.
+      Status GetNextRecordBatchLocked(IteratorContext* ctx,
+                                      std::vector<Tensor>* out_tensors,
+                                      bool* end_of_sequence)
+          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        const int64 batch_size = dataset()->record_batch_size_;
+        out_tensors->reserve(dataset()->out_type_.size());
+        for (DataType dtype : dataset()->out_type_) {
+          out_tensors->emplace_back(ctx->allocator({}), dtype,
+                                    TensorShape({batch_size}));
+        }
+        int64 num_rows = 0;
+        bool end_of_input = false;
+        for (; num_rows < batch_size; ++num_rows) {
+          row_ = num_rows;
+          TF_RETURN_IF_ERROR(
+              ReadNextRecordLocked(ctx, out_tensors, &end_of_input));
+          if (end_of_input) break;
+        }
+        if (num_rows == 0) {
+          out_tensors->clear();
+          *end_of_sequence = true;
+          return Status::OK();
+        }
+        if (num_rows < batch_size) {
+          for (Tensor& column : *out_tensors) {
+            column = column.Slice(0, num_rows);
+          }
+        }
+        *end_of_sequence = false;
+        return Status::OK();
       }
 
-     private:
       // Reads an entire CSV row from the input stream, either from the
       // existing buffer or by filling the buffer as needed. Converts extracted
       // fields to output tensors as we go.
@@ -521,8 +588,10 @@ class CSVDatasetOp : public DatasetOpKernel {
 
       // Given a field, converts it to the right output tensor type
       Status FieldToOutput(IteratorContext* ctx, StringPiece field,
-                           std::vector<Tensor>* out_tensors) {
-        size_t output_idx = out_tensors->size();
+                           std::vector<Tensor>* out_tensors)
+          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        const bool in_record_batch = dataset()->record_batch_size_ > 0;
+        size_t output_idx = in_record_batch ? num_fields_ : out_tensors->size();
         if (output_idx >= dataset()->out_type_.size()) {
           // We can get here if we're selecting all columns, but the number of
           // fields exceeds the number of defaults provided
@@ -530,7 +599,19 @@ class CSVDatasetOp : public DatasetOpKernel {
                                          " fields but have more in record");
         }
         const DataType& dtype = dataset()->out_type_[output_idx];
-        Tensor component(ctx->allocator({}), dtype, {});
+        // The field is written to element `index` of `*component`.
+        Tensor scalar;
+        Tensor* component;
+        int64 index;
+        if (in_record_batch) {
+          component = &(*out_tensors)[output_idx];
+          index = row_;
+          ++num_fields_;
+        } else {
+          scalar = Tensor(ctx->allocator({}), dtype, {});
+          component = &scalar;
+          index = 0;
+        }
         if ((field.empty() || field == dataset()->na_value_) &&
             dataset()->record_defaults_[output_idx].NumElements() != 1) {
           // If the field is empty or NA value, and default is not given,
@@ -544,7 +625,7 @@ class CSVDatasetOp : public DatasetOpKernel {
           // Otherwise, we convert it to the right type.
           case DT_INT32: {
             if (field.empty() || field == dataset()->na_value_) {
-              component.scalar<int32>()() =
+              component->flat<int32>()(index) =
                   dataset()->record_defaults_[output_idx].flat<int32>()(0);
             } else {
               int32 value;
@@ -553,13 +634,13 @@ class CSVDatasetOp : public DatasetOpKernel {
                     "Field ", output_idx,
                     " in record is not a valid int32: ", field);
               }
-              component.scalar<int32>()() = value;
+              component->flat<int32>()(index) = value;
             }
             break;
           }
           case DT_INT64: {
             if (field.empty() || field == dataset()->na_value_) {
-              component.scalar<int64>()() =
+              component->flat<int64>()(index) =
                   dataset()->record_defaults_[output_idx].flat<int64>()(0);
             } else {
               int64 value;
@@ -568,13 +649,13 @@ class CSVDatasetOp : public DatasetOpKernel {
                     "Field ", output_idx,
                     " in record is not a valid int64: ", field);
               }
-              component.scalar<int64>()() = value;
+              component->flat<int64>()(index) = value;
             }
             break;
           }
           case DT_FLOAT: {
             if (field.empty() || field == dataset()->na_value_) {
-              component.scalar<float>()() =
+              component->flat<float>()(index) =
                   dataset()->record_defaults_[output_idx].flat<float>()(0);
             } else {
               float value;
@@ -583,13 +664,13 @@ class CSVDatasetOp : public DatasetOpKernel {
                     "Field ", output_idx,
                     " in record is not a valid float: ", field);
               }
-              component.scalar<float>()() = value;
+              component->flat<float>()(index) = value;
             }
             break;
           }
           case DT_DOUBLE: {
             if (field.empty() || field == dataset()->na_value_) {
-              component.scalar<double>()() =
+              component->flat<double>()(index) =
                   dataset()->record_defaults_[output_idx].flat<double>()(0);
             } else {
               double value;
@@ -598,16 +679,16 @@ class CSVDatasetOp : public DatasetOpKernel {
                     "Field ", output_idx,
                     " in record is not a valid double: ", field);
               }
-              component.scalar<double>()() = value;
+              component->flat<double>()(index) = value;
             }
             break;
           }
           case DT_STRING: {
             if (field.empty() || field == dataset()->na_value_) {
-              component.scalar<string>()() =
+              component->flat<string>()(index) =
                   dataset()->record_defaults_[output_idx].flat<string>()(0);
             } else {
-              component.scalar<string>()() = field.ToString();
+              component->flat<string>()(index) = field.ToString();
             }
             break;
           }
@@ -616,7 +697,9 @@ class CSVDatasetOp : public DatasetOpKernel {
                                            " not supported in field ",
                                            output_idx);
         }
-        out_tensors->push_back(std::move(component));
+        if (!in_record_batch) {
+          out_tensors->push_back(std::move(scalar));
+        }
         return Status::OK();
       }
 
@@ -707,8 +790,13 @@ class CSVDatasetOp : public DatasetOpKernel {
       std::unique_ptr<io::RandomAccessInputStream> input_stream_
           GUARDED_BY(mu_);
       size_t current_file_index_ GUARDED_BY(mu_) = 0;
+      int64 epoch_ GUARDED_BY(mu_) = 0;
       std::unique_ptr<RandomAccessFile> file_
           GUARDED_BY(mu_);  // must outlive input_stream_
+      // In record batch mode, the row of the record being read and the number
+      // of its fields read so far.
+      int64 row_ GUARDED_BY(mu_) = 0;
+      size_t num_fields_ GUARDED_BY(mu_) = 0;
     };                      // class Iterator
 
     const std::vector<string> filenames_;
@@ -721,10 +809,14 @@ class CSVDatasetOp : public DatasetOpKernel {
     const bool use_quote_delim_;
     const char delim_;
     const string na_value_;
+    const int64 record_batch_size_;
+    const int64 num_epochs_;
   };  // class Dataset
 
   DataTypeVector output_types_;
   std::vector<PartialTensorShape> output_shapes_;
+  int64 record_batch_size_;
+  int64 num_epochs_;
 };  // class CSVDatasetOp
 
 // Register the kernel implementation for CSVDataset.
@@ -13,21 +13,116 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <atomic>
+#include <unordered_map>
+
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/framework/stats_aggregator.h"
 #include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace {
 
+// An Env whose threads run only on the CPUs in `cpus`, if it is not empty,
+// and which measures the CPU time that its threads use.
+//
+// A pipeline that uses a private thread pool starts its background threads
+// from this Env, so that they share the CPUs and the accounting of the pool.
+class PipelineThreadEnv : public EnvWrapper {
+ public:
+  PipelineThreadEnv(Env* env, std::vector<int> cpus)
+      : EnvWrapper(env), cpus_(std::move(cpus)) {}
+
+  Thread* StartThread(const ThreadOptions& thread_options, const string& name,
+                      std::function<void()> fn) override {
+    return EnvWrapper::StartThread(thread_options, name, [this, name, fn]() {
+      if (!cpus_.empty() && !port::SetCurrentThreadCPUAffinity(cpus_) &&
+          !affinity_warning_logged_.exchange(true)) {
+        LOG(WARNING) << "Could not restrict thread " << name << " to CPUs "
+                     << str_util::Join(cpus_, ",");
+      }
+      const int64 id = RegisterCurrentThread();
+      fn();
+      UnregisterThread(id);
+    });
+  }
+
+  // Returns the CPU time used so far by the threads started from this Env, in
+  // microseconds, or -1 if it cannot be measured on this platform.
+  int64 CPUTimeMicros() LOCKS_EXCLUDED(mu_) {
+#if defined(__linux__)
+    mutex_lock l(mu_);
+    int64 nanos = finished_threads_nanos_;
+    for (const auto& thread : running_threads_) {
+      struct timespec ts;
+      if (clock_gettime(thread.second, &ts) == 0) {
+        nanos += ts.tv_sec * 1000000000LL + ts.tv_nsec;
+      }
+    }
+    return nanos / 1000;
+#else
+    return -1;
+#endif
+  }
+
+ private:
+  int64 RegisterCurrentThread() LOCKS_EXCLUDED(mu_) {
+    mutex_lock l(mu_);
+    const int64 id = next_thread_id_++;
+#if defined(__linux__)
+    clockid_t clock;
+    if (pthread_getcpuclockid(pthread_self(), &clock) == 0) {
+      running_threads_[id] = clock;
+    }
+#endif
+    return id;
+  }
+
+  // Must be called by the thread `id` itself, since its clock is only valid
+  // while it runs.
+  void UnregisterThread(int64 id) LOCKS_EXCLUDED(mu_) {
+#if defined(__linux__)
+    mutex_lock l(mu_);
+    struct timespec ts;
+    if (running_threads_.erase(id) > 0 &&
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+      finished_threads_nanos_ += ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+#endif
+  }
+
+  const std::vector<int> cpus_;
+  std::atomic<bool> affinity_warning_logged_{false};
+  mutex mu_;
+  int64 next_thread_id_ GUARDED_BY(mu_) = 0;
+#if defined(__linux__)
+  std::unordered_map<int64, clockid_t> running_threads_ GUARDED_BY(mu_);
+  int64 finished_threads_nanos_ GUARDED_BY(mu_) = 0;
+#endif
+};
+
 class ThreadPoolResource : public ResourceBase {
  public:
   ThreadPoolResource(Env* env, const ThreadOptions& thread_options,
                      const string& name, int num_threads, bool low_latency_hint,
-                     int max_intra_op_parallelism)
-      : thread_pool_(env, thread_options, name, num_threads, low_latency_hint),
+                     int max_intra_op_parallelism, std::vector<int> cpus)
+      : env_(env, std::move(cpus)),
+        start_micros_(env->NowMicros()),
+        name_(name),
+        thread_pool_(&env_, thread_options, name, num_threads,
+                     low_latency_hint),
         max_intra_op_parallelism_(max_intra_op_parallelism) {}
 
   // Schedules fn() for execution in the pool of threads.
@@ -46,9 +141,44 @@ class ThreadPoolResource : public ResourceBase {
     }
   }
 
+  // The Env from which pipelines that use the pool start their threads.
+  Env* env() { return &env_; }
+
+  // Adds the CPU time used by the threads of the pool and of the pipelines
+  // that use it to `stats_aggregator`, both in total and as the average
+  // number of CPUs used since the pool was created. Reading the CPU time of
+  // every thread is too costly to do for each element, so this does nothing
+  // unless `force` is true or kCPUUsageIntervalMicros have passed since the
+  // last time.
+  void RecordCPUUsage(StatsAggregator* stats_aggregator, bool force) {
+    const uint64 now_micros = env_.NowMicros();
+    uint64 last_micros = last_record_micros_.load(std::memory_order_relaxed);
+    if (!force && (now_micros < last_micros + kCPUUsageIntervalMicros ||
+                   !last_record_micros_.compare_exchange_strong(
+                       last_micros, now_micros, std::memory_order_relaxed))) {
+      return;
+    }
+    const int64 cpu_micros = env_.CPUTimeMicros();
+    if (cpu_micros < 0) return;
+    const int64 elapsed_micros =
+        std::max(now_micros - start_micros_, uint64{1});
+    stats_aggregator->AddScalar(strings::StrCat(name_, "::cpu_seconds"),
+                                cpu_micros / 1e6);
+    stats_aggregator->AddScalar(
+        strings::StrCat(name_, "::cpu_utilization"),
+        static_cast<double>(cpu_micros) / elapsed_micros);
+  }
+
   string DebugString() override { return "ThreadPoolResource"; }
 
  private:
+  static constexpr uint64 kCPUUsageIntervalMicros = 100000;
+
+  // Must outlive the threads of `thread_pool_`.
+  PipelineThreadEnv env_;
+  const uint64 start_micros_;
+  std::atomic<uint64> last_record_micros_{start_micros_};
+  const string name_;
   thread::ThreadPool thread_pool_;
   const int max_intra_op_parallelism_;
 };
@@ -67,6 +197,21 @@ class ThreadPoolHandleOp : public OpKernel {
     OP_REQUIRES(
         ctx, num_threads_ > 0,
         errors::InvalidArgument("`num_threads` must be greater than zero."));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("cpus", &cpus_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("numa_node", &numa_node_));
+    if (numa_node_ >= 0) {
+      OP_REQUIRES(ctx, cpus_.empty(),
+                  errors::InvalidArgument(
+                      "At most one of `cpus` and `numa_node` may be set."));
+      cpus_ = port::NUMANodeCPUs(numa_node_);
+      OP_REQUIRES(ctx, !cpus_.empty(),
+                  errors::InvalidArgument(
+                      "Cannot determine the CPUs of NUMA node ", numa_node_));
+    }
+    for (int cpu : cpus_) {
+      OP_REQUIRES(ctx, cpu >= 0,
+                  errors::InvalidArgument("Invalid CPU in `cpus`: ", cpu));
+    }
   }
 
   // The resource is deleted from the resource manager only when it is private
@@ -92,10 +237,14 @@ class ThreadPoolHandleOp : public OpKernel {
                               cinfo_.container(), cinfo_.name(), &resource,
                               [this, ctx](ThreadPoolResource** ret)
                                   EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+                                    // The threads are bound to the CPUs
+                                    // of `numa_node_` by the Env of the
+                                    // pool, not by `ThreadOptions`.
                                     *ret = new ThreadPoolResource(
-                                        ctx->env(), {}, display_name_,
-                                        num_threads_, max_intra_op_parallelism_,
-                                        false /* low_latency_hint */);
+                                        ctx->env(), ThreadOptions(),
+                                        display_name_, num_threads_,
+                                        false /* low_latency_hint */,
+                                        max_intra_op_parallelism_, cpus_);
                                     return Status::OK();
                                   }));
       initialized_ = true;
@@ -112,6 +261,8 @@ class ThreadPoolHandleOp : public OpKernel {
   string display_name_;
   int num_threads_;
   int max_intra_op_parallelism_;
+  std::vector<int> cpus_;
+  int numa_node_;
 };
 
 class ThreadPoolDatasetOp : public UnaryDatasetOpKernel {
@@ -183,8 +334,12 @@ class ThreadPoolDatasetOp : public UnaryDatasetOpKernel {
                              std::vector<Tensor>* out_tensors,
                              bool* end_of_sequence) override {
         ThreadPoolResource* pool = dataset()->threadpool_;
+        auto stats_aggregator = ctx->stats_aggregator();
+        if (stats_aggregator) {
+          pool->RecordCPUUsage(stats_aggregator.get(), /*force=*/false);
+        }
         IteratorContext::Params params;
-        params.env = ctx->env();
+        params.env = pool->env();
         params.runner = [pool](std::function<void()> c) {
           pool->Schedule(std::move(c));
         };
@@ -193,8 +348,13 @@ class ThreadPoolDatasetOp : public UnaryDatasetOpKernel {
         params.function_library = ctx->function_library();
         params.allocator_getter = ctx->allocator_getter();
         IteratorContext threadpool_ctx(params);
-        return input_impl_->GetNext(&threadpool_ctx, out_tensors,
-                                    end_of_sequence);
+        Status s = input_impl_->GetNext(&threadpool_ctx, out_tensors,
+                                        end_of_sequence);
+        if (stats_aggregator && *end_of_sequence) {
+          // Records the final usage, however soon after the last record.
+          pool->RecordCPUUsage(stats_aggregator.get(), /*force=*/true);
+        }
+        return s;
       }
 
      private:
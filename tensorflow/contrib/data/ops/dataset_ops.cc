@@ -46,6 +46,8 @@ REGISTER_OP("CSVDataset")
     .Output("handle: variant")
     .Attr("output_types: list({float,double,int32,int64,string}) >= 1")
     .Attr("output_shapes: list(shape) >= 1")
+    .Attr("record_batch_size: int = 0")
+    .Attr("num_epochs: int >= 1 = 1")
     .SetIsStateful()  // TODO(b/65524810): Source dataset ops must be marked
                       // stateful to inhibit constant folding.
     .SetShapeFn([](shape_inference::InferenceContext* c) {
@@ -162,6 +164,8 @@ REGISTER_OP("ThreadPoolHandle")
     .Attr("num_threads: int")
     .Attr("max_intra_op_parallelism: int = 1")
     .Attr("display_name: string")
+    .Attr("cpus: list(int) = []")
+    .Attr("numa_node: int = -1")
     .Attr("container: string = ''")
     .Attr("shared_name: string = ''")
     .Doc(R"doc(
@@ -173,6 +177,10 @@ max_intra_op_parallelism: The maximum degree of parallelism to use within
   operations that execute on this threadpool.
 display_name: A human-readable name for the threads that may be visible in
   some visualizations.
+cpus: If not empty, the CPUs that the threads of the pool, and the background
+  threads of the datasets that use it, may run on.
+numa_node: If not negative, the NUMA node whose CPUs the threads of the pool,
+  and the background threads of the datasets that use it, may run on.
 )doc");
 
 }  // namespace tensorflow
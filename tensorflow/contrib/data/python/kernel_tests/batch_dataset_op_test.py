@@ -18,6 +18,7 @@ from __future__ import division
 from __future__ import print_function
 
 import math
+import threading
 import time
 
 from absl.testing import parameterized
@@ -305,6 +306,43 @@ class BatchDatasetTest(test.TestCase, parameterized.TestCase):
       with self.assertRaises(errors.InvalidArgumentError):
         sess.run(next_element)
 
+  def testFilterRows(self):
+    data = dataset_ops.Dataset.range(10).map(
+        lambda x: (x, string_ops.as_string(x))).batch(4)
+    data = data.apply(batching.filter_rows(lambda x, y: x % 3 > 0))
+    self.assertEqual([None], data.output_shapes[0].as_list())
+
+    iterator = data.make_one_shot_iterator()
+    op = iterator.get_next()
+
+    with self.test_session() as sess:
+      for expected in [[1, 2], [4, 5, 7], [8]]:
+        x, y = sess.run(op)
+        self.assertAllEqual(expected, x)
+        self.assertAllEqual([compat.as_bytes(str(i)) for i in expected], y)
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(op)
+
+  def testFilterRowsDict(self):
+    data = dataset_ops.Dataset.from_tensor_slices({
+        "a": math_ops.range(6),
+        "b": array_ops.reshape(math_ops.range(12), [6, 2])
+    }).batch(3)
+    data = data.apply(batching.filter_rows(lambda d: d["a"] >= 2))
+
+    iterator = data.make_one_shot_iterator()
+    op = iterator.get_next()
+
+    with self.test_session() as sess:
+      element = sess.run(op)
+      self.assertAllEqual([2], element["a"])
+      self.assertAllEqual([[4, 5]], element["b"])
+      element = sess.run(op)
+      self.assertAllEqual([3, 4, 5], element["a"])
+      self.assertAllEqual([[6, 7], [8, 9], [10, 11]], element["b"])
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(op)
+
   def testBatchAndDropRemainder(self):
     components = (np.arange(7),
                   np.array([[1, 2, 3]]) * np.arange(7)[:, np.newaxis],
@@ -580,6 +618,37 @@ class BatchDatasetTest(test.TestCase, parameterized.TestCase):
       with self.assertRaises(errors.OutOfRangeError):
         sess.run(elements)
 
+  def testMapAndBatchSloppySkipsSlowBatch(self):
+    # The call for element 0 blocks until the test has read another batch,
+    # which only a sloppy map_and_batch can return first.
+    read_other_batch = threading.Event()
+
+    def _map_fn(x):
+      if x == 0:
+        read_other_batch.wait()
+      return x
+
+    iterator = (
+        dataset_ops.Dataset.range(9).apply(
+            batching.map_and_batch(
+                lambda x: script_ops.py_func(_map_fn, [x], dtypes.int64),
+                batch_size=2,
+                num_parallel_calls=4,
+                sloppy=True)).make_one_shot_iterator())
+    get_next = iterator.get_next()
+
+    with self.test_session() as sess:
+      results = [sess.run(get_next).tolist()]
+      self.assertNotEqual([0, 1], results[0])
+      read_other_batch.set()
+      for _ in range(4):
+        results.append(sess.run(get_next).tolist())
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_next)
+    # The partial batch at the end of the input comes last.
+    self.assertEqual([8], results[-1])
+    self.assertEqual([[0, 1], [2, 3], [4, 5], [6, 7], [8]], sorted(results))
+
   def testMapAndBatchSparse(self):
 
     def _sparse(i):
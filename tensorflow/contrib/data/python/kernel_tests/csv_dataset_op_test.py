@@ -251,6 +251,47 @@ class CsvDatasetOpTest(test.TestCase):
     inputs = [['1,2,3,4', '5,6,7,8'], ['5,6,7,8']]
     self._test_by_comparison(inputs, record_defaults=record_defaults)
 
+  def testCsvDataset_withRecordBatches(self):
+    record_defaults = [[0], [''], [0.0]]
+    inputs = [['1,a,1.5', '2,,2.5', '3,c,'], ['4,d,4.5'], [], ['5,e,5.5']]
+    filenames = self.setup_files(inputs)
+    for record_batch_size in [1, 2, 3, 10]:
+      with ops.Graph().as_default() as g:
+        dataset_actual = readers.CsvDataset(
+            filenames,
+            record_defaults=record_defaults,
+            record_batch_size=record_batch_size)
+        dataset_expected = readers.CsvDataset(
+            filenames, record_defaults=record_defaults).batch(
+                record_batch_size)
+        self._assert_datasets_equal(g, dataset_actual, dataset_expected)
+
+  def testCsvDataset_withRecordBatchesAndEpochs(self):
+    record_defaults = [[0], [''], [0.0]]
+    inputs = [['1,a,1.5', '2,,2.5', '3,c,'], ['4,d,4.5'], [], ['5,e,5.5']]
+    filenames = self.setup_files(inputs)
+    for num_epochs in [1, 3]:
+      with ops.Graph().as_default() as g:
+        # Batches of 3 records span the ends of the 5-record epochs.
+        dataset_actual = readers.CsvDataset(
+            filenames,
+            record_defaults=record_defaults,
+            record_batch_size=3,
+            num_epochs=num_epochs)
+        dataset_expected = readers.CsvDataset(
+            filenames, record_defaults=record_defaults).repeat(
+                num_epochs).batch(3)
+        self._assert_datasets_equal(g, dataset_actual, dataset_expected)
+
+  def testCsvDataset_errorWithRecordBatches(self):
+    record_defaults = [[0]] * 2
+    inputs = [['1,2', '3', '5,6']]
+    self._test_dataset(
+        inputs,
+        expected_err_re='Expect 2 fields but have 1 in record',
+        record_defaults=record_defaults,
+        record_batch_size=2)
+
   def testCsvDataset_withLeadingAndTrailingSpaces(self):
     record_defaults = [[0.0]] * 4
     inputs = [['0, 1, 2, 3']]
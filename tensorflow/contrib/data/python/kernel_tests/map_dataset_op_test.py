@@ -20,20 +20,24 @@ from __future__ import print_function
 import hashlib
 import itertools
 import os
+import threading
 import time
 
 import numpy as np
 
 from tensorflow.contrib.data.python.ops import batching
 from tensorflow.contrib.data.python.ops import error_ops
+from tensorflow.contrib.data.python.ops import map_ops
 from tensorflow.core.protobuf import config_pb2
 from tensorflow.python.client import session
 from tensorflow.python.data.ops import dataset_ops
+from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import errors
 from tensorflow.python.framework import ops
 from tensorflow.python.ops import array_ops
 from tensorflow.python.ops import io_ops
 from tensorflow.python.ops import math_ops
+from tensorflow.python.ops import script_ops
 from tensorflow.python.platform import test
 from tensorflow.python.util import compat
 
@@ -143,6 +147,53 @@ class MapDatasetTest(test.TestCase):
         with self.assertRaises(errors.OutOfRangeError):
           sess.run(get_next)
 
+  def testSloppyMapSkipsSlowElement(self):
+    # The call for element 0 blocks until the test has read another element,
+    # which only a sloppy map can return first.
+    read_other_element = threading.Event()
+
+    def _map_fn(x):
+      if x == 0:
+        read_other_element.wait()
+      return x
+
+    dataset = dataset_ops.Dataset.range(10).apply(
+        map_ops.sloppy_map(
+            lambda x: script_ops.py_func(_map_fn, [x], dtypes.int64),
+            num_parallel_calls=2))
+    get_next = dataset.make_one_shot_iterator().get_next()
+
+    with self.test_session() as sess:
+      results = [sess.run(get_next)]
+      self.assertNotEqual(0, results[0])
+      read_other_element.set()
+      for _ in range(9):
+        results.append(sess.run(get_next))
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_next)
+    self.assertEqual(list(range(10)), sorted(results))
+
+  def testSloppyMapError(self):
+    components = np.array([1., 2., 3., np.nan, 5.]).astype(np.float32)
+
+    dataset = dataset_ops.Dataset.from_tensor_slices(components).apply(
+        map_ops.sloppy_map(lambda x: array_ops.check_numerics(x, "message"),
+                           num_parallel_calls=2))
+    get_next = dataset.make_one_shot_iterator().get_next()
+
+    with self.test_session() as sess:
+      results = []
+      num_errors = 0
+      while True:
+        try:
+          results.append(sess.run(get_next))
+        except errors.InvalidArgumentError:
+          num_errors += 1
+        except errors.OutOfRangeError:
+          break
+    self.assertEqual(1, num_errors)
+    self.assertEqual([1., 2., 3., 5.], sorted(results))
+
 
 class MapDatasetBenchmark(test.Benchmark):
 
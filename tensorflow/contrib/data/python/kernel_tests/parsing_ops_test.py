@@ -0,0 +1,132 @@
+# Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Tests for tensorflow.contrib.data.python.ops.parsing_ops."""
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+import numpy as np
+
+from tensorflow.contrib.data.python.ops import parsing_ops as contrib_parsing_ops
+from tensorflow.core.example import example_pb2
+from tensorflow.core.example import feature_pb2
+from tensorflow.python.data.ops import dataset_ops
+from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import errors
+from tensorflow.python.framework import sparse_tensor
+from tensorflow.python.ops import parsing_ops
+from tensorflow.python.platform import test
+
+
+def _int64_feature(values):
+  return feature_pb2.Feature(int64_list=feature_pb2.Int64List(value=values))
+
+
+def _float_feature(values):
+  return feature_pb2.Feature(float_list=feature_pb2.FloatList(value=values))
+
+
+def _bytes_feature(values):
+  return feature_pb2.Feature(bytes_list=feature_pb2.BytesList(value=values))
+
+
+def _example(feature):
+  return example_pb2.Example(
+      features=feature_pb2.Features(feature=feature)).SerializeToString()
+
+
+class ParseExampleDatasetTest(test.TestCase):
+
+  def _serialized_examples(self):
+    return [
+        _example({
+            "a": _int64_feature([1, 2]),
+            "b": _float_feature([0.5]),
+            "c": _bytes_feature([b"x"]),
+        }),
+        _example({
+            "a": _int64_feature([3, 4]),
+            "c": _bytes_feature([b"y", b"z"]),
+        }),
+        _example({
+            "a": _int64_feature([5, 6]),
+            "b": _float_feature([1.5]),
+        }),
+    ]
+
+  def _features(self):
+    return {
+        "a": parsing_ops.FixedLenFeature([2], dtypes.int64),
+        "b": parsing_ops.FixedLenFeature([1], dtypes.float32,
+                                         default_value=[-1.0]),
+        "c": parsing_ops.VarLenFeature(dtypes.string),
+    }
+
+  def _parsed_batches(self, batch_size, num_parallel_calls):
+    dataset = dataset_ops.Dataset.from_tensor_slices(
+        self._serialized_examples()).batch(batch_size).apply(
+            contrib_parsing_ops.parse_example_dataset(
+                self._features(), num_parallel_calls=num_parallel_calls))
+    next_element = dataset.make_one_shot_iterator().get_next()
+    batches = []
+    with self.test_session() as sess:
+      while True:
+        try:
+          batches.append(sess.run(next_element))
+        except errors.OutOfRangeError:
+          break
+    return dataset, batches
+
+  def testMatchesParseExample(self):
+    serialized = self._serialized_examples()
+    expected = parsing_ops.parse_example(serialized, self._features())
+    with self.test_session() as sess:
+      expected = sess.run(expected)
+    for num_parallel_calls in [1, 4]:
+      dataset, batches = self._parsed_batches(3, num_parallel_calls)
+      self.assertEqual(1, len(batches))
+      actual = batches[0]
+      self.assertEqual(dtypes.int64, dataset.output_types["a"])
+      self.assertEqual([None, 2], dataset.output_shapes["a"].as_list())
+      self.assertIs(sparse_tensor.SparseTensor, dataset.output_classes["c"])
+      self.assertAllEqual(expected["a"], actual["a"])
+      self.assertAllEqual(expected["b"], actual["b"])
+      self.assertAllEqual(expected["c"].indices, actual["c"].indices)
+      self.assertAllEqual(expected["c"].values, actual["c"].values)
+      self.assertAllEqual(expected["c"].dense_shape, actual["c"].dense_shape)
+
+  def testPartialBatches(self):
+    _, batches = self._parsed_batches(2, 2)
+    self.assertEqual(2, len(batches))
+    self.assertAllEqual([[1, 2], [3, 4]], batches[0]["a"])
+    self.assertAllEqual([[0.5], [-1.0]], batches[0]["b"])
+    self.assertAllEqual([[5, 6]], batches[1]["a"])
+    self.assertAllEqual(np.zeros([0, 2]), batches[1]["c"].indices)
+    self.assertAllEqual([1, 0], batches[1]["c"].dense_shape)
+
+  def testMissingRequiredFeature(self):
+    features = {"d": parsing_ops.FixedLenFeature([1], dtypes.int64)}
+    dataset = dataset_ops.Dataset.from_tensor_slices(
+        self._serialized_examples()).batch(3).apply(
+            contrib_parsing_ops.parse_example_dataset(features))
+    next_element = dataset.make_one_shot_iterator().get_next()
+    with self.test_session() as sess:
+      with self.assertRaisesOpError("Feature: d \\(data type: int64\\) is "
+                                    "required"):
+        sess.run(next_element)
+
+
+if __name__ == "__main__":
+  test.main()
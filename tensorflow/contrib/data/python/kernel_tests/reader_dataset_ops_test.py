@@ -875,5 +875,74 @@ class MakeTFRecordDatasetTest(
                              seed=21345)
 
 
+class ShuffledTFRecordDatasetTest(
+    reader_dataset_ops_test_base.TFRecordDatasetTestBase):
+
+  def _read_epochs(self, dataset, num_epochs):
+    next_element = dataset.make_one_shot_iterator().get_next()
+    records = []
+    with self.test_session() as sess:
+      while True:
+        try:
+          records.append(sess.run(next_element))
+        except errors.OutOfRangeError:
+          break
+    num_records = self._num_files * self._num_records
+    self.assertEqual(num_epochs * num_records, len(records))
+    return [
+        records[i:i + num_records] for i in range(0, len(records), num_records)
+    ]
+
+  def testEmitsEveryRecordOnce(self):
+    expected = [
+        self._record(f, r)
+        for f in range(self._num_files)
+        for r in range(self._num_records)
+    ]
+    for buffer_size in [1, 3, 100]:
+      dataset = readers.ShuffledTFRecordDataset(
+          self.test_filenames, buffer_size=buffer_size, seed=37, count=2)
+      first_epoch, second_epoch = self._read_epochs(dataset, 2)
+      self.assertAllEqual(sorted(expected), sorted(first_epoch))
+      self.assertAllEqual(sorted(expected), sorted(second_epoch))
+      # Records are not left in file order, and each epoch is permuted
+      # differently.
+      self.assertNotEqual(expected, first_epoch)
+      self.assertNotEqual(first_epoch, second_epoch)
+
+  def testRepeatReplaysEpochs(self):
+    dataset = readers.ShuffledTFRecordDataset(self.test_filenames, seed=37)
+    first_epoch, second_epoch = self._read_epochs(dataset.repeat(2), 2)
+    self.assertAllEqual(first_epoch, second_epoch)
+
+  def testSeedDeterminesOrder(self):
+    first = self._read_epochs(
+        readers.ShuffledTFRecordDataset(self.test_filenames, seed=37, count=2),
+        2)
+    second = self._read_epochs(
+        readers.ShuffledTFRecordDataset(self.test_filenames, seed=37, count=2),
+        2)
+    self.assertAllEqual(first, second)
+
+  def testEmptyFile(self):
+    empty_filename = os.path.join(self.get_temp_dir(), "empty.tfrecord")
+    with open(empty_filename, "wb"):
+      pass
+    dataset = readers.ShuffledTFRecordDataset(
+        [empty_filename] + self.test_filenames, seed=37)
+    self._read_epochs(dataset, 1)
+
+  def testTruncatedFile(self):
+    with open(self.test_filenames[0], "rb") as f:
+      contents = f.read()
+    with open(self.test_filenames[0], "wb") as f:
+      f.write(contents[:-1])
+    dataset = readers.ShuffledTFRecordDataset(self.test_filenames)
+    next_element = dataset.make_one_shot_iterator().get_next()
+    with self.test_session() as sess:
+      with self.assertRaisesOpError("truncated record"):
+        sess.run(next_element)
+
+
 if __name__ == "__main__":
   test.main()
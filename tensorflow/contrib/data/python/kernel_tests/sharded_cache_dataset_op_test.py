@@ -0,0 +1,116 @@
+# Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Tests for the experimental input pipeline ops."""
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+from os import path
+import shutil
+import tempfile
+
+import numpy as np
+
+from tensorflow.contrib.data.python.ops import caching
+from tensorflow.python.data.ops import dataset_ops
+from tensorflow.python.framework import constant_op
+from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import errors
+from tensorflow.python.ops import array_ops
+from tensorflow.python.platform import test
+
+
+class ShardedCacheDatasetTest(test.TestCase):
+
+  def setUp(self):
+    self.tmp_dir = tempfile.mkdtemp()
+    self.cache_prefix = path.join(self.tmp_dir, "cache")
+
+  def tearDown(self):
+    if self.tmp_dir:
+      shutil.rmtree(self.tmp_dir, ignore_errors=True)
+
+  def _testCacheAndReplay(self, cache_prefix, components, num_shards,
+                          compression_type):
+    count_placeholder = array_ops.placeholder_with_default(
+        constant_op.constant(1, dtypes.int64), shape=[])
+    dataset = dataset_ops.Dataset.from_tensor_slices(components).repeat(
+        count_placeholder).apply(
+            caching.sharded_cache(cache_prefix, num_shards, compression_type))
+    iterator = dataset.make_initializable_iterator()
+    get_next = iterator.get_next()
+    num_elements = len(components[0])
+
+    with self.test_session() as sess:
+      # The first iteration writes the cache.
+      sess.run(iterator.initializer)
+      for i in range(num_elements):
+        self.assertAllEqual([c[i] for c in components], sess.run(get_next))
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_next)
+      self.assertTrue(path.exists(cache_prefix + ".sharded_index"))
+
+      # Re-initialize with an empty upstream (to throw errors.OutOfRangeError
+      # if we didn't use the cache).
+      for _ in range(2):
+        sess.run(iterator.initializer, feed_dict={count_placeholder: 0})
+        for i in range(num_elements):
+          self.assertAllEqual([c[i] for c in components], sess.run(get_next))
+        with self.assertRaises(errors.OutOfRangeError):
+          sess.run(get_next)
+
+  def testCacheAndReplay(self):
+    components = (np.arange(20), np.arange(20) * 2.0,
+                  np.array([str(i) * i for i in range(20)]))
+    for compression_type in [None, "ZLIB", "SNAPPY"]:
+      for num_shards in [1, 3, 32]:
+        cache_prefix = "%s_%s_%d" % (self.cache_prefix, compression_type,
+                                     num_shards)
+        self._testCacheAndReplay(cache_prefix, components, num_shards,
+                                 compression_type)
+
+  def testElementsSpanningManyChunks(self):
+    # Each element is 1 MB, so that every shard has several chunks.
+    components = (np.random.randint(
+        0, 255, size=[24, 1024, 1024], dtype=np.uint8),)
+    self._testCacheAndReplay(self.cache_prefix, components, 2, "ZLIB")
+
+  def testEmptyInput(self):
+    dataset = dataset_ops.Dataset.range(0).apply(
+        caching.sharded_cache(self.cache_prefix))
+    get_next = dataset.make_one_shot_iterator().get_next()
+    with self.test_session() as sess:
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_next)
+    dataset = dataset_ops.Dataset.range(10).apply(
+        caching.sharded_cache(self.cache_prefix))
+    get_next = dataset.make_one_shot_iterator().get_next()
+    with self.test_session() as sess:
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_next)
+
+  def testInvalidArguments(self):
+    for num_shards, compression_type in [(0, None), (1, "GZIP")]:
+      dataset = dataset_ops.Dataset.range(10).apply(
+          caching.sharded_cache(self.cache_prefix, num_shards,
+                                compression_type))
+      get_next = dataset.make_one_shot_iterator().get_next()
+      with self.test_session() as sess:
+        with self.assertRaises(errors.InvalidArgumentError):
+          sess.run(get_next)
+
+
+if __name__ == "__main__":
+  test.main()
@@ -0,0 +1,164 @@
+# Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Tests for the experimental input pipeline ops."""
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+import os
+import threading
+
+import numpy as np
+
+from tensorflow.contrib.data.python.ops import readers
+from tensorflow.contrib.data.python.ops import writers
+from tensorflow.core.protobuf import config_pb2
+from tensorflow.python.data.ops import dataset_ops
+from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import errors
+from tensorflow.python.ops import array_ops
+from tensorflow.python.ops import script_ops
+from tensorflow.python.platform import test
+
+
+class SharedMemoryDatasetTest(test.TestCase):
+
+  def _ringName(self):
+    return "tf_shared_memory_dataset_test_%d_%s" % (os.getpid(),
+                                                     self._testMethodName)
+
+  def _startWriter(self, dataset, ring_name, **kwargs):
+    write_op = writers.SharedMemoryWriter(ring_name, **kwargs).write(dataset)
+
+    def write():
+      with self.test_session(graph=write_op.graph) as sess:
+        sess.run(write_op)
+
+    return self.checkedThread(write)
+
+  def testReadElements(self):
+    ring_name = self._ringName()
+    components = (np.arange(100), np.arange(100 * 3.0).reshape(100, 3),
+                  np.array([str(i) * (i % 7) for i in range(100)]))
+    dataset = dataset_ops.Dataset.from_tensor_slices(components)
+    writer = self._startWriter(dataset, ring_name, capacity_bytes=4096)
+
+    with self.test_session() as sess:
+      get_next = readers.SharedMemoryDataset(
+          ring_name, dataset.output_types,
+          dataset.output_shapes).make_one_shot_iterator().get_next()
+      writer.start()
+      for i in range(100):
+        self.assertAllEqual([c[i] for c in components], sess.run(get_next))
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_next)
+    writer.join()
+
+  def testMultipleConsumers(self):
+    ring_name = self._ringName()
+    dataset = dataset_ops.Dataset.range(50).map(
+        lambda x: {"x": x, "y": array_ops.fill([x], x)})
+    writer = self._startWriter(dataset, ring_name, num_consumers=2)
+
+    with self.test_session() as sess:
+      get_nexts = [
+          readers.SharedMemoryDataset(
+              ring_name, dataset.output_types,
+              consumer_index=i).make_one_shot_iterator().get_next()
+          for i in range(2)
+      ]
+      writer.start()
+      for i in range(50):
+        for element in sess.run(get_nexts):
+          self.assertEqual(i, element["x"])
+          self.assertAllEqual([i] * i, element["y"])
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_nexts[0])
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_nexts[1])
+    writer.join()
+
+  def testWriterError(self):
+    ring_name = self._ringName()
+    dataset = dataset_ops.Dataset.from_tensor_slices([1.0, 2.0, np.nan]).map(
+        lambda x: array_ops.check_numerics(x, "message"))
+    write_op = writers.SharedMemoryWriter(ring_name).write(dataset)
+
+    def write():
+      with self.test_session(graph=write_op.graph) as sess:
+        with self.assertRaises(errors.InvalidArgumentError):
+          sess.run(write_op)
+
+    writer = self.checkedThread(write)
+    with self.test_session() as sess:
+      get_next = readers.SharedMemoryDataset(
+          ring_name, dtypes.float32).make_one_shot_iterator().get_next()
+      writer.start()
+      self.assertEqual(1.0, sess.run(get_next))
+      self.assertEqual(2.0, sess.run(get_next))
+      with self.assertRaisesRegexp(errors.InvalidArgumentError, "message"):
+        sess.run(get_next)
+    writer.join()
+
+  def testTimeout(self):
+    get_next = readers.SharedMemoryDataset(
+        self._ringName(), dtypes.int64,
+        timeout_ms=100).make_one_shot_iterator().get_next()
+    with self.test_session() as sess:
+      with self.assertRaisesRegexp(errors.NotFoundError, "Timed out"):
+        sess.run(get_next)
+
+  def testCancellation(self):
+    get_next = readers.SharedMemoryDataset(
+        self._ringName(), dtypes.int64,
+        timeout_ms=-1).make_one_shot_iterator().get_next()
+    with self.test_session() as sess:
+      # The step is cancelled when it times out, which stops the wait for the
+      # ring.
+      with self.assertRaises(errors.DeadlineExceededError):
+        sess.run(get_next, options=config_pb2.RunOptions(timeout_in_ms=100))
+
+  def testCancellationWhileReading(self):
+    ring_name = self._ringName()
+    resume = threading.Event()
+
+    def stall(x):
+      if x > 0:
+        resume.wait()
+      return x
+
+    dataset = dataset_ops.Dataset.range(2).map(
+        lambda x: script_ops.py_func(stall, [x], dtypes.int64))
+    writer = self._startWriter(dataset, ring_name)
+
+    with self.test_session() as sess:
+      get_next = readers.SharedMemoryDataset(
+          ring_name, dtypes.int64).make_one_shot_iterator().get_next()
+      writer.start()
+      self.assertEqual(0, sess.run(get_next))
+      # The producer is stalled, so the wait for the next record only ends
+      # when the step is cancelled.
+      with self.assertRaises(errors.DeadlineExceededError):
+        sess.run(get_next, options=config_pb2.RunOptions(timeout_in_ms=100))
+      # Cancelling a step does not cancel the iterator for later steps.
+      resume.set()
+      self.assertEqual(1, sess.run(get_next))
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(get_next)
+    writer.join()
+
+
+if __name__ == "__main__":
+  test.main()
@@ -17,13 +17,16 @@ from __future__ import absolute_import
 from __future__ import division
 from __future__ import print_function
 
+import os
 import threading
 
 from absl.testing import parameterized
 import numpy as np
 
+from tensorflow.contrib.data.python.ops import stats_ops
 from tensorflow.contrib.data.python.ops import threadpool
 from tensorflow.contrib.data.python.ops import unique
+from tensorflow.core.framework import summary_pb2
 from tensorflow.python.data.ops import dataset_ops
 from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import errors
@@ -75,6 +78,77 @@ class OverrideThreadpoolDatasetTest(test.TestCase, parameterized.TestCase):
       # perform work.
       self.assertLessEqual(len(thread_ids), num_threads)
 
+  def testCPUs(self):
+    if not hasattr(os, "sched_getaffinity"):
+      self.skipTest("Thread affinity is not supported on this platform.")
+    cpu = min(os.sched_getaffinity(0))
+
+    def get_cpus(_):
+      return np.array(sorted(os.sched_getaffinity(0))).astype(np.int64)
+
+    dataset = dataset_ops.Dataset.range(10).map(
+        lambda x: script_ops.py_func(get_cpus, [x], dtypes.int64),
+        num_parallel_calls=4).prefetch(1)
+    dataset = threadpool.override_threadpool(
+        dataset,
+        threadpool.PrivateThreadPool(
+            4, display_name="private_thread_pool", cpus=[cpu]))
+    iterator = dataset.make_one_shot_iterator()
+    next_element = iterator.get_next()
+
+    with self.test_session() as sess:
+      for _ in range(10):
+        self.assertAllEqual([cpu], sess.run(next_element))
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(next_element)
+
+  def testInvalidCPUs(self):
+    with self.assertRaisesRegexp(errors.InvalidArgumentError,
+                                 "At most one of"):
+      with self.test_session() as sess:
+        sess.run(
+            threadpool.PrivateThreadPool(
+                1, display_name="private_thread_pool", cpus=[0],
+                numa_node=0)._resource)  # pylint: disable=protected-access
+    with self.assertRaisesRegexp(errors.InvalidArgumentError, "NUMA node"):
+      with self.test_session() as sess:
+        sess.run(
+            threadpool.PrivateThreadPool(
+                1, display_name="private_thread_pool",
+                numa_node=1 << 20)._resource)  # pylint: disable=protected-access
+
+  def testCPUUsage(self):
+
+    def spin(x):
+      total = 0
+      for i in range(10000):
+        total += i
+      return x + total % 1
+
+    stats_aggregator = stats_ops.StatsAggregator()
+    dataset = dataset_ops.Dataset.range(100).map(
+        lambda x: script_ops.py_func(spin, [x], dtypes.int64),
+        num_parallel_calls=2)
+    dataset = threadpool.override_threadpool(
+        dataset, threadpool.PrivateThreadPool(2, display_name="spin_pool"))
+    dataset = dataset.apply(stats_ops.set_stats_aggregator(stats_aggregator))
+    iterator = dataset.make_one_shot_iterator()
+    next_element = iterator.get_next()
+    summary_t = stats_aggregator.get_summary()
+
+    with self.test_session() as sess:
+      for _ in range(100):
+        sess.run(next_element)
+      with self.assertRaises(errors.OutOfRangeError):
+        sess.run(next_element)
+      summary_proto = summary_pb2.Summary()
+      summary_proto.ParseFromString(sess.run(summary_t))
+      values = {value.tag: value.simple_value for value in summary_proto.value}
+      if not values:
+        self.skipTest("CPU time is not measured on this platform.")
+      self.assertGreater(values["spin_pool::cpu_seconds"], 0.0)
+      self.assertGreater(values["spin_pool::cpu_utilization"], 0.0)
+
 
 if __name__ == "__main__":
   test.main()
@@ -439,6 +439,57 @@ def unbatch():
   return _apply_fn
 
 
+def filter_rows(predicate):
+  """Keeps the rows of each batch that satisfy `predicate`.
+
+  This is the vectorized counterpart of @{tf.data.Dataset.filter} for datasets
+  whose elements are batches, such as the record batches of a
+  `tf.contrib.data.CsvDataset`. `predicate` is called once per batch, with the
+  same arguments as a `map()` function, and must return a boolean vector with
+  one entry per row. Every component is then masked along its first
+  dimension, so the rows are never split into separate elements.
+
+  ```python
+  # NOTE: The following example uses `{ ... }` to represent the contents
+  # of a dataset.
+  a = { ([1, 2, 3], ['a', 'b', 'c']), ([4, 5], ['d', 'e']) }
+
+  a.apply(tf.contrib.data.filter_rows(lambda x, y: x % 2 == 1)) == {
+      ([1, 3], ['a', 'c']), ([5], ['e']) }
+  ```
+
+  The batches keep their size after filtering; they may be rebatched with
+  `unbatch()` and `batch()` if a fixed size is needed.
+
+  Args:
+    predicate: A function mapping a batch to a `tf.bool` vector.
+
+  Returns:
+    A `Dataset` transformation function, which can be passed to
+    @{tf.data.Dataset.apply}.
+
+  Raises:
+    TypeError: If the dataset has `SparseTensor` components.
+  """
+
+  def _apply_fn(dataset):
+    """Function from `Dataset` to `Dataset` that applies the transformation."""
+    if sparse.any_sparse(dataset.output_classes):
+      raise TypeError("`filter_rows()` does not support SparseTensor "
+                      "components.")
+
+    def _filter_fn(*args):
+      mask = ops.convert_to_tensor(predicate(*args), dtype=dtypes.bool)
+      mask.get_shape().assert_has_rank(1)
+      element = args if isinstance(dataset.output_types, tuple) else args[0]
+      return nest.map_structure(
+          lambda component: array_ops.boolean_mask(component, mask), element)
+
+    return dataset.map(_filter_fn)
+
+  return _apply_fn
+
+
 def _filter_irregular_batches(batch_size):
   """Transformation that filters out batches that are not of size batch_size."""
 
@@ -735,7 +786,7 @@ class _MapAndBatchDataset(dataset_ops.MapDataset):
   """A `Dataset` that maps a function over a batch of elements."""
 
   def __init__(self, input_dataset, map_func, batch_size, num_parallel_calls,
-               drop_remainder):
+               drop_remainder, sloppy=False):
     """See `Dataset.map()` for details."""
     super(_MapAndBatchDataset, self).__init__(input_dataset, map_func)
     self._batch_size_t = ops.convert_to_tensor(
@@ -747,6 +798,7 @@ class _MapAndBatchDataset(dataset_ops.MapDataset):
 
     self._batch_size = batch_size
     self._drop_remainder = drop_remainder
+    self._sloppy = sloppy
 
   def _as_variant_tensor(self):
     # pylint: disable=protected-access
@@ -758,6 +810,7 @@ class _MapAndBatchDataset(dataset_ops.MapDataset):
         batch_size=self._batch_size_t,
         num_parallel_calls=self._num_parallel_calls_t,
         drop_remainder=self._drop_remainder_t,
+        sloppy=self._sloppy,
         **dataset_ops.flat_structure(self))
     # pylint: enable=protected-access
 
@@ -778,7 +831,8 @@ def map_and_batch(map_func,
                   batch_size,
                   num_parallel_batches=None,
                   drop_remainder=False,
-                  num_parallel_calls=None):
+                  num_parallel_calls=None,
+                  sloppy=False):
   """Fused implementation of `map` and `batch`.
 
   Maps `map_func` across `batch_size` consecutive elements of this dataset
@@ -804,7 +858,13 @@ def map_and_batch(map_func,
     num_parallel_calls: (Optional.) A `tf.int32` scalar `tf.Tensor`,
         representing the number of elements to process in parallel. If not
         specified, `batch_size * num_parallel_batches` elements will be
-        processed in parallel.
+        processed in parallel. If the value `tf.contrib.data.AUTOTUNE` is
+        used, then the number of parallel calls is tuned at runtime based on
+        available CPU.
+    sloppy: (Optional.) A Python `bool`. If true, a batch is returned as soon
+        as all of its elements have been computed, even if an earlier batch is
+        still being computed, so the order of the batches is not
+        deterministic. The elements within a batch stay in order.
 
   Returns:
     A `Dataset` transformation function, which can be passed to
@@ -825,6 +885,6 @@ def map_and_batch(map_func,
 
   def _apply_fn(dataset):
     return _MapAndBatchDataset(dataset, map_func, batch_size,
-                               num_parallel_calls, drop_remainder)
+                               num_parallel_calls, drop_remainder, sloppy)
 
   return _apply_fn
@@ -0,0 +1,106 @@
+# Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Sharded cache dataset transformation."""
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+from tensorflow.python.data.ops import dataset_ops
+from tensorflow.python.data.util import convert
+from tensorflow.python.framework import dtypes
+from tensorflow.python.framework import ops
+from tensorflow.python.ops import gen_dataset_ops
+
+
+def sharded_cache(filename, num_shards=8, compression_type=None):
+  """Caches the elements of a `Dataset` in sharded, compressed files.
+
+  Like @{tf.data.Dataset.cache} with a `filename`, the first iteration over the
+  dataset passes through the elements of the input and writes them to the
+  cache, and every later iteration reads them from the cache. The elements are
+  spread over `num_shards` files, which are written in parallel in chunks that
+  are compressed independently, and each file is read ahead by its own thread,
+  so that reading the cache is not limited by a single reader thread. For
+  example:
+
+  ```python
+  dataset = tf.data.TFRecordDataset(filenames).map(decode_image)
+  dataset = dataset.apply(tf.contrib.data.sharded_cache(
+      "/tmp/images", num_shards=16, compression_type="SNAPPY"))
+  ```
+
+  The cache is complete once its first iteration has reached the end of the
+  input; the file `<filename>.sharded_index` is written at that point. Until
+  then, saving the iterator makes the elements cached so far durable, and
+  restoring it continues writing the cache. As with @{tf.data.Dataset.cache},
+  the cache cannot be read while it is still being written: another iterator
+  created in the meantime raises `tf.errors.AlreadyExistsError`.
+
+  Args:
+    filename: A `tf.string` scalar `tf.Tensor`, representing the prefix of the
+      cache files.
+    num_shards: (Optional.) A `tf.int64` scalar `tf.Tensor`, representing the
+      number of files that the elements are spread over.
+    compression_type: (Optional.) A `tf.string` scalar evaluating to one of
+      `""` (no compression), `"ZLIB"`, or `"SNAPPY"`.
+
+  Returns:
+    A `Dataset` transformation function, which can be passed to
+    @{tf.data.Dataset.apply}.
+  """
+
+  def _apply_fn(dataset):
+    return _ShardedCacheDataset(dataset, filename, num_shards,
+                                compression_type)
+
+  return _apply_fn
+
+
+class _ShardedCacheDataset(dataset_ops.Dataset):
+  """A `Dataset` that caches the elements of its input in sharded files."""
+
+  def __init__(self, input_dataset, filename, num_shards, compression_type):
+    """See `sharded_cache()` for details."""
+    super(_ShardedCacheDataset, self).__init__()
+    self._input_dataset = input_dataset
+    self._filename = ops.convert_to_tensor(
+        filename, dtype=dtypes.string, name="filename")
+    self._num_shards = ops.convert_to_tensor(
+        num_shards, dtype=dtypes.int64, name="num_shards")
+    self._compression_type = convert.optional_param_to_tensor(
+        "compression_type",
+        compression_type,
+        argument_default="",
+        argument_dtype=dtypes.string)
+
+  def _as_variant_tensor(self):
+    return gen_dataset_ops.sharded_cache_dataset(
+        self._input_dataset._as_variant_tensor(),  # pylint: disable=protected-access
+        filename=self._filename,
+        num_shards=self._num_shards,
+        compression_type=self._compression_type,
+        **dataset_ops.flat_structure(self))
+
+  @property
+  def output_classes(self):
+    return self._input_dataset.output_classes
+
+  @property
+  def output_shapes(self):
+    return self._input_dataset.output_shapes
+
+  @property
+  def output_types(self):
+    return self._input_dataset.output_types
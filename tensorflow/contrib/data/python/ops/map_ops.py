@@ -0,0 +1,64 @@
+# Copyright 2017 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Non-deterministic map transformations."""
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+from tensorflow.python.data.ops import dataset_ops
+
+
+def sloppy_map(map_func, num_parallel_calls):
+  """A non-deterministic version of the parallel `Dataset.map()` transformation.
+
+  `sloppy_map()` maps `map_func` across `dataset` like
+  `dataset.map(map_func, num_parallel_calls)`. The difference is that it returns
+  each result as soon as it has been computed, rather than in the order of the
+  input elements, so that an element that takes long to process (such as a large
+  image) does not hold back the elements after it.
+
+  If all elements take about as long to process, `sloppy_map` produces the
+  elements in about the same order as `map`. For example:
+
+  ```python
+  dataset = tf.data.TFRecordDataset(filenames)
+  dataset = dataset.apply(
+      tf.contrib.data.sloppy_map(decode_and_resize_image,
+                                 num_parallel_calls=64))
+  ```
+
+  WARNING: The order of elements in the resulting dataset is not
+  deterministic. Use `Dataset.map()` if you want the elements to have a
+  deterministic order.
+
+  Args:
+    map_func: A function mapping a nested structure of tensors (having shapes
+      and types defined by `self.output_shapes` and `self.output_types`) to
+      another nested structure of tensors.
+    num_parallel_calls: A `tf.int32` scalar `tf.Tensor`, representing the
+      number of elements to process in parallel. If the value
+      `tf.contrib.data.AUTOTUNE` is used, then the number of parallel calls is
+      tuned at runtime based on available CPU.
+
+  Returns:
+    A `Dataset` transformation function, which can be passed to
+    @{tf.data.Dataset.apply}.
+  """
+
+  def _apply_fn(dataset):
+    return dataset_ops.ParallelMapDataset(
+        dataset, map_func, num_parallel_calls, sloppy=True)
+
+  return _apply_fn
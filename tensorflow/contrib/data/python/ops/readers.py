@@ -25,19 +25,20 @@ import numpy as np
 from tensorflow.contrib.data.python.ops import batching
 from tensorflow.contrib.data.python.ops import gen_dataset_ops as contrib_gen_dataset_ops
 from tensorflow.contrib.data.python.ops import interleave_ops
+from tensorflow.contrib.data.python.ops import parsing_ops as contrib_parsing_ops
 from tensorflow.contrib.data.python.ops import shuffle_ops
 from tensorflow.contrib.data.python.ops import stats_ops
 from tensorflow.python.data.ops import dataset_ops
 from tensorflow.python.data.ops import readers as core_readers
 from tensorflow.python.data.util import convert
 from tensorflow.python.data.util import nest
+from tensorflow.python.data.util import random_seed
 from tensorflow.python.framework import constant_op
 from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import ops
 from tensorflow.python.framework import tensor_shape
 from tensorflow.python.lib.io import file_io
 from tensorflow.python.ops import gen_dataset_ops
-from tensorflow.python.ops import parsing_ops
 from tensorflow.python.platform import gfile
 from tensorflow.python.util import deprecation
 
@@ -479,17 +480,35 @@ def make_csv_dataset(
       return features, label
     return features
 
-  # Read files sequentially (if num_parallel_reads=1) or in parallel
-  dataset = dataset.apply(
-      interleave_ops.parallel_interleave(
-          filename_to_dataset, cycle_length=num_parallel_reads, sloppy=sloppy))
-
-  dataset = _maybe_shuffle_and_repeat(
-      dataset, num_epochs, shuffle, shuffle_buffer_size, shuffle_seed)
-
-  # Apply batch before map for perf, because map has high overhead relative
-  # to the size of the computation in each map
-  dataset = dataset.batch(batch_size=batch_size)
+  if (not shuffle and num_parallel_reads == 1 and num_epochs is not None and
+      num_epochs > 0):
+    # The records are read in order, so a single reader can parse them
+    # directly into batches of columns, rather than `batch` gathering them one
+    # record at a time. The reader repeats the files itself, so that batches
+    # span epochs as they would after `repeat`.
+    dataset = CsvDataset(
+        filenames,
+        record_defaults=column_defaults,
+        field_delim=field_delim,
+        use_quote_delim=use_quote_delim,
+        na_value=na_value,
+        select_cols=select_columns,
+        header=header,
+        record_batch_size=batch_size,
+        num_epochs=num_epochs)
+  else:
+    # Read files sequentially (if num_parallel_reads=1) or in parallel
+    dataset = dataset.apply(
+        interleave_ops.parallel_interleave(
+            filename_to_dataset, cycle_length=num_parallel_reads,
+            sloppy=sloppy))
+
+    dataset = _maybe_shuffle_and_repeat(
+        dataset, num_epochs, shuffle, shuffle_buffer_size, shuffle_seed)
+
+    # Apply batch before map for perf, because map has high overhead relative
+    # to the size of the computation in each map
+    dataset = dataset.batch(batch_size=batch_size)
   dataset = dataset.map(map_fn, num_parallel_calls=num_parallel_parser_calls)
   dataset = dataset.prefetch(prefetch_buffer_size)
 
@@ -510,7 +529,9 @@ class CsvDataset(dataset_ops.Dataset):
                field_delim=",",
                use_quote_delim=True,
                na_value="",
-               select_cols=None):
+               select_cols=None,
+               record_batch_size=None,
+               num_epochs=None):
     """Creates a `CsvDataset` by reading and decoding CSV files.
 
     The elements of this dataset correspond to records from the file(s).
@@ -577,6 +598,14 @@ class CsvDataset(dataset_ops.Dataset):
       select_cols: (Optional.) A sorted list of column indices to select from
         the input data. If specified, only this subset of columns will be
         parsed. Defaults to parsing all columns.
+      record_batch_size: (Optional.) A Python integer. If set, each element is
+        a batch of up to this many consecutive records, possibly from several
+        files, with one vector per column. The fields are parsed directly into
+        these vectors, which is cheaper than batching single records. An
+        invalid record fails its whole batch.
+      num_epochs: (Optional.) A positive Python integer. The number of times to
+        read the files. Unlike `repeat`, record batches span the end of an
+        epoch and the start of the next one. Defaults to 1.
     """
     super(CsvDataset, self).__init__()
     self._filenames = ops.convert_to_tensor(
@@ -603,8 +632,13 @@ class CsvDataset(dataset_ops.Dataset):
         argument_default=[],
         argument_dtype=dtypes.int64,
     )
-    self._output_shapes = tuple(
-        tensor_shape.scalar() for _ in range(len(record_defaults)))
+    self._record_batch_size = record_batch_size or 0
+    self._num_epochs = 1 if num_epochs is None else num_epochs
+    if self._record_batch_size:
+      row_shape = tensor_shape.vector(None)
+    else:
+      row_shape = tensor_shape.scalar()
+    self._output_shapes = tuple(row_shape for _ in range(len(record_defaults)))
     self._output_types = tuple(d.dtype for d in self._record_defaults)
     self._output_classes = tuple(
         ops.Tensor for _ in range(len(record_defaults)))
@@ -621,6 +655,8 @@ class CsvDataset(dataset_ops.Dataset):
         use_quote_delim=self._use_quote_delim,
         na_value=self._na_value,
         select_cols=self._select_cols,
+        record_batch_size=self._record_batch_size,
+        num_epochs=self._num_epochs,
     )
 
   @property
@@ -763,9 +799,9 @@ def make_batched_features_dataset(file_pattern,
     dataset = dataset.batch(batch_size)
 
   # Parse `Example` tensors to a dictionary of `Feature` tensors.
-  dataset = dataset.map(
-      lambda x: parsing_ops.parse_example(x, features),
-      num_parallel_calls=parser_num_threads)
+  dataset = dataset.apply(
+      contrib_parsing_ops.parse_example_dataset(
+          features, num_parallel_calls=parser_num_threads))
 
   # TODO(rachelim): Add an optional label_name argument for extracting the label
   # from the features dictionary, to comply with the type expected by the
@@ -890,6 +926,73 @@ def _get_file_names(file_pattern, shuffle):
   return file_names
 
 
+class ShuffledTFRecordDataset(dataset_ops.Dataset):
+  """A `Dataset` of the records of TFRecord files, in a random order.
+
+  Unlike `tf.data.TFRecordDataset(filenames).shuffle(buffer_size)`, which only
+  shuffles within a sliding window of `buffer_size` records, this dataset emits
+  the records of all the files in the order of a random permutation of all the
+  records. It only keeps the offsets and lengths of the records in memory. They
+  come from the `<filename>.index` record index of each file when the file has
+  one, and otherwise from reading the record headers of the file before the
+  first record is produced. For example:
+
+  ```python
+  dataset = tf.contrib.data.ShuffledTFRecordDataset(filenames,
+                                                    count=num_epochs)
+  dataset = dataset.batch(batch_size)
+  ```
+
+  Each of the `count` epochs uses a different permutation. Like
+  `tf.contrib.data.shuffle_and_repeat`, the dataset repeats the records itself,
+  so that the permutation of each epoch only depends on the seed and on the
+  epoch, and is restored with the iterator. Repeating the dataset with
+  `repeat()` instead replays the same permutations. The files must not be
+  compressed.
+  """
+
+  def __init__(self, filenames, buffer_size=1024, seed=None, count=1):
+    """Creates a `ShuffledTFRecordDataset`.
+
+    Args:
+      filenames: A `tf.string` tensor containing one or more filenames.
+      buffer_size: (Optional.) A `tf.int64` scalar representing the number of
+        records that are read together, in file order, ahead of the records
+        being consumed. Larger values let more nearby records share a read, at
+        the cost of memory for up to twice as many records.
+      seed: (Optional.) A `tf.int64` scalar `tf.Tensor`, representing the
+        random seed that will be used to create the permutations. See
+        @{tf.set_random_seed} for behavior.
+      count: (Optional.) A `tf.int64` scalar `tf.Tensor`, representing the
+        number of epochs. The default is one epoch, and -1 repeats the records
+        indefinitely.
+    """
+    super(ShuffledTFRecordDataset, self).__init__()
+    self._filenames = ops.convert_to_tensor(
+        filenames, dtype=dtypes.string, name="filenames")
+    self._buffer_size = ops.convert_to_tensor(
+        buffer_size, dtype=dtypes.int64, name="buffer_size")
+    self._seed, self._seed2 = random_seed.get_seed(seed)
+    self._count = ops.convert_to_tensor(count, dtype=dtypes.int64, name="count")
+
+  def _as_variant_tensor(self):
+    return gen_dataset_ops.shuffled_tf_record_dataset(
+        self._filenames, self._buffer_size, self._seed, self._seed2,
+        self._count)
+
+  @property
+  def output_classes(self):
+    return ops.Tensor
+
+  @property
+  def output_shapes(self):
+    return tensor_shape.TensorShape([])
+
+  @property
+  def output_types(self):
+    return dtypes.string
+
+
 class SqlDataset(dataset_ops.Dataset):
   """A `Dataset` consisting of the results from a SQL query."""
 
@@ -949,3 +1052,84 @@ class SqlDataset(dataset_ops.Dataset):
   @property
   def output_types(self):
     return self._output_types
+
+
+class SharedMemoryDataset(dataset_ops.Dataset):
+  """A `Dataset` of the elements that another process publishes locally.
+
+  The elements are read from a ring buffer in shared memory that a
+  `tf.contrib.data.SharedMemoryWriter` with the same `ring_name` writes,
+  typically in another process on the same machine, which avoids serializing
+  the elements. For example, a process can run the input pipeline with
+
+  ```python
+  writer = tf.contrib.data.SharedMemoryWriter("input", num_consumers=2)
+  sess.run(writer.write(dataset))
+  ```
+
+  while each of two training processes reads all of its elements with
+
+  ```python
+  dataset = tf.contrib.data.SharedMemoryDataset(
+      "input", dataset.output_types, dataset.output_shapes,
+      consumer_index=task_index)
+  ```
+
+  The dataset waits up to `timeout_ms` for the writer to create the ring, and
+  then raises `tf.errors.NotFoundError`. Numeric tensors refer
+  to the shared memory directly, so the writer is blocked from reusing the
+  space of an element as long as any of its tensors is alive. Elements must
+  not contain `tf.SparseTensor`s, and the dataset cannot be checkpointed.
+  """
+
+  def __init__(self, ring_name, output_types, output_shapes=None,
+               consumer_index=0, timeout_ms=60000):
+    """Creates a `SharedMemoryDataset`.
+
+    Args:
+      ring_name: A `tf.string` scalar tensor containing the name of the ring.
+      output_types: A nested structure of `tf.DType` objects corresponding to
+        each component of an element of the dataset.
+      output_shapes: (Optional.) A nested structure of `tf.TensorShape`
+        objects corresponding to each component of an element of the dataset.
+        If omitted, the shapes are unknown.
+      consumer_index: (Optional.) A `tf.int64` scalar tensor representing
+        which of the `num_consumers` consumers of the ring this dataset is.
+      timeout_ms: (Optional.) A `tf.int64` scalar tensor representing how many
+        milliseconds to wait for the writer to create the ring, or -1 to wait
+        indefinitely. Defaults to one minute.
+    """
+    super(SharedMemoryDataset, self).__init__()
+    self._ring_name = ops.convert_to_tensor(
+        ring_name, dtype=dtypes.string, name="ring_name")
+    self._consumer_index = ops.convert_to_tensor(
+        consumer_index, dtype=dtypes.int64, name="consumer_index")
+    self._timeout_ms = ops.convert_to_tensor(
+        timeout_ms, dtype=dtypes.int64, name="timeout_ms")
+    self._output_types = nest.map_structure(dtypes.as_dtype, output_types)
+    if output_shapes is None:
+      self._output_shapes = nest.map_structure(
+          lambda _: tensor_shape.TensorShape(None), self._output_types)
+    else:
+      self._output_shapes = nest.map_structure_up_to(
+          self._output_types, tensor_shape.as_shape, output_shapes)
+
+  def _as_variant_tensor(self):
+    return gen_dataset_ops.shared_memory_dataset(
+        self._ring_name,
+        self._consumer_index,
+        self._timeout_ms,
+        output_types=nest.flatten(self.output_types),
+        output_shapes=nest.flatten(self.output_shapes))
+
+  @property
+  def output_classes(self):
+    return nest.map_structure(lambda _: ops.Tensor, self._output_types)
+
+  @property
+  def output_shapes(self):
+    return self._output_shapes
+
+  @property
+  def output_types(self):
+    return self._output_types
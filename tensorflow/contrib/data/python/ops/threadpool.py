@@ -40,17 +40,39 @@ def _generate_shared_name(prefix):
 # TODO(b/73383364): Properly export in the `tf.contrib.data` API when stable
 # or make private / remove.
 class PrivateThreadPool(object):
-  """A stateful resource that represents a private thread pool."""
+  """A stateful resource that represents a private thread pool.
+
+  The threads of the pool, and the background threads of the datasets that use
+  it, can be restricted to a set of CPUs or to the CPUs of a NUMA node. When a
+  `tf.contrib.data.StatsAggregator` is attached to the dataset, the CPU time
+  used by these threads is recorded as the scalars
+  `"<display_name>::cpu_seconds"` and `"<display_name>::cpu_utilization"`, the
+  average number of CPUs used since the pool was created.
+  """
 
   def __init__(self, num_threads, display_name=None,
-               max_intra_op_parallelism=1):
-    """Creates a `PrivateThreadPool` with the given number of threads."""
+               max_intra_op_parallelism=1, cpus=None, numa_node=None):
+    """Creates a `PrivateThreadPool` with the given number of threads.
+
+    Args:
+      num_threads: The number of threads in the pool.
+      display_name: (Optional.) A name for the threads of the pool.
+      max_intra_op_parallelism: (Optional.) The maximum degree of parallelism
+        to use within operations that execute on the pool.
+      cpus: (Optional.) A list of CPU numbers that the threads may run on.
+      numa_node: (Optional.) The NUMA node whose CPUs the threads may run on.
+        At most one of `cpus` and `numa_node` may be set.
+    """
+    cpus = [] if cpus is None else list(cpus)
+    numa_node = -1 if numa_node is None else numa_node
     if context.executing_eagerly():
       shared_name = _generate_shared_name("privatethreadpool")
       self._resource = gen_dataset_ops.thread_pool_handle(
           num_threads=num_threads,
           max_intra_op_parallelism=max_intra_op_parallelism,
           display_name=display_name,
+          cpus=cpus,
+          numa_node=numa_node,
           shared_name=shared_name)
       self._resource_deleter = resource_variable_ops.EagerResourceDeleter(
           handle=self._resource, handle_device=context.context().device_name)
@@ -58,7 +80,9 @@ class PrivateThreadPool(object):
       self._resource = gen_dataset_ops.thread_pool_handle(
           num_threads=num_threads,
           max_intra_op_parallelism=max_intra_op_parallelism,
-          display_name=display_name)
+          display_name=display_name,
+          cpus=cpus,
+          numa_node=numa_node)
 
 
 class _ThreadPoolDataset(dataset_ops.Dataset):
@@ -19,6 +19,7 @@ from __future__ import print_function
 
 from tensorflow.python.data.ops import dataset_ops
 from tensorflow.python.data.util import convert
+from tensorflow.python.data.util import nest
 from tensorflow.python.framework import dtypes
 from tensorflow.python.framework import ops
 from tensorflow.python.framework import tensor_shape
@@ -56,3 +57,53 @@ class TFRecordWriter(object):
                                                     dataset.output_types))
     return gen_dataset_ops.dataset_to_tf_record(
         dataset._as_variant_tensor(), self._filename, self._compression_type)  # pylint: disable=protected-access
+
+
+class SharedMemoryWriter(object):
+  """Publishes the elements of a dataset to processes on the same machine.
+
+  The elements are written to a ring buffer in POSIX shared memory, from which
+  each of `num_consumers` `tf.contrib.data.SharedMemoryDataset`s with the same
+  `ring_name` reads all of them. See `tf.contrib.data.SharedMemoryDataset` for
+  an example.
+  """
+
+  def __init__(self, ring_name, capacity_bytes=256 << 20, num_consumers=1):
+    """Creates a `SharedMemoryWriter`.
+
+    Args:
+      ring_name: A `tf.string` scalar tensor containing the name of the ring,
+        which must not exist yet.
+      capacity_bytes: (Optional.) A `tf.int64` scalar tensor representing the
+        size of the ring in bytes, which bounds how far the writer can get
+        ahead of the slowest consumer, and must be larger than any element.
+      num_consumers: (Optional.) A `tf.int64` scalar tensor representing the
+        number of consumers, which the writer waits for before it returns.
+    """
+    self._ring_name = ops.convert_to_tensor(
+        ring_name, dtypes.string, name="ring_name")
+    self._capacity_bytes = ops.convert_to_tensor(
+        capacity_bytes, dtypes.int64, name="capacity_bytes")
+    self._num_consumers = ops.convert_to_tensor(
+        num_consumers, dtypes.int64, name="num_consumers")
+
+  def write(self, dataset):
+    """Returns a @{tf.Operation} to publish the elements of a dataset.
+
+    Args:
+      dataset: a @{tf.data.Dataset} whose elements are to be published.
+
+    Returns:
+      A @{tf.Operation} that, when run, publishes the elements of `dataset`
+      and finishes once all consumers have attached to the ring.
+    """
+    if not isinstance(dataset, dataset_ops.Dataset):
+      raise TypeError("`dataset` must be a `tf.data.Dataset` object.")
+    if any(output_class is not ops.Tensor
+           for output_class in nest.flatten(dataset.output_classes)):
+      raise TypeError(
+          "`dataset` must produce dense tensors whereas it produces classes "
+          "{0}".format(dataset.output_classes))
+    return gen_dataset_ops.dataset_to_shared_memory(
+        dataset._as_variant_tensor(), self._ring_name, self._capacity_bytes,  # pylint: disable=protected-access
+        self._num_consumers)
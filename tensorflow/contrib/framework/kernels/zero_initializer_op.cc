@@ -124,6 +124,7 @@ class ZeroVarInitializer : public OpKernel {
                 errors::InvalidArgument("input is already initialized"));
 
     variable->is_initialized = true;
+    variable->MarkAllRowsDirty();
 
     Tensor* output = nullptr;
     OP_REQUIRES_OK(ctx, ctx->allocate_output(0, TensorShape({}), &output));
@@ -310,7 +310,9 @@ class MutableHashTable(LookupInterface):
                default_value,
                shared_name=None,
                name="MutableHashTable",
-               checkpoint=True):
+               checkpoint=True,
+               use_flat_hash_map=False,
+               num_shards=1):
     """Creates an empty `MutableHashTable` object.
 
     Creates a table, the type of its keys and values are specified by key_dtype
@@ -326,6 +328,12 @@ class MutableHashTable(LookupInterface):
       checkpoint: if True, the contents of the table are saved to and restored
         from checkpoints. If `shared_name` is empty for a checkpointed table, it
         is shared using the table node name.
+      use_flat_hash_map: if True and `default_value` is a scalar, the table is
+        an open-addressing hash map, which is faster to look up in for large
+        tables.
+      num_shards: the number of independently locked shards the keys are split
+        into. Lookups never block each other, and with more than one shard an
+        insert only blocks the lookups of the shards that its keys fall into.
 
     Returns:
       A `MutableHashTable` object.
@@ -347,6 +355,8 @@ class MutableHashTable(LookupInterface):
           use_node_name_sharing=use_node_name_sharing,
           key_dtype=key_dtype,
           value_dtype=value_dtype,
+          use_flat_hash_map=use_flat_hash_map,
+          num_shards=num_shards,
           name=name)
     else:
       self._table_ref = gen_lookup_ops.mutable_hash_table_of_tensors_v2(
@@ -355,6 +365,7 @@ class MutableHashTable(LookupInterface):
           key_dtype=key_dtype,
           value_dtype=value_dtype,
           value_shape=self._default_value.get_shape(),
+          num_shards=num_shards,
           name=name)
     super(MutableHashTable, self).__init__(key_dtype, value_dtype,
                                            self._table_ref.op.name.split(
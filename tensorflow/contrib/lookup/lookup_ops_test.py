@@ -65,6 +65,28 @@ class HashTableOpTest(test.TestCase):
                             exported_keys_tensor.eval())
       self.assertItemsEqual([0, 1, 2], exported_values_tensor.eval())
 
+  def testFlatHashTable(self):
+    with self.test_session():
+      default_val = -1
+      keys = constant_op.constant(["brain", "salad", "surgery"])
+      values = constant_op.constant([0, 1, 2], dtypes.int64)
+      table = lookup.HashTable(
+          lookup.KeyValueTensorInitializer(keys, values),
+          default_val,
+          use_flat_hash_map=True)
+      table.init.run()
+
+      self.assertAllEqual(3, table.size().eval())
+
+      input_string = constant_op.constant(["brain", "salad", "tank"])
+      output = table.lookup(input_string)
+      self.assertAllEqual([0, 1, -1], output.eval())
+
+      exported_keys_tensor, exported_values_tensor = table.export()
+      self.assertItemsEqual([b"brain", b"salad", b"surgery"],
+                            exported_keys_tensor.eval())
+      self.assertItemsEqual([0, 1, 2], exported_values_tensor.eval())
+
   def testHashTableFindHighRank(self):
     with self.test_session():
       default_val = -1
@@ -716,6 +738,61 @@ class MutableHashTableOpTest(test.TestCase):
       self.assertAllEqual((b"brain", b"salad", b"n/a"), result)
 
 
+  def testFlatMutableHashTable(self):
+    with self.test_session():
+      default_val = -1.0
+      num_keys = 1000
+      keys = constant_op.constant(np.arange(num_keys), dtypes.int64)
+      values = constant_op.constant(np.arange(num_keys), dtypes.float32)
+      table = lookup.MutableHashTable(
+          dtypes.int64, dtypes.float32, default_val, use_flat_hash_map=True)
+      self.assertAllEqual(0, table.size().eval())
+
+      table.insert(keys, values).run()
+      table.insert(keys[:10], -values[:10]).run()
+      self.assertAllEqual(num_keys, table.size().eval())
+
+      input_keys = constant_op.constant([5, 500, num_keys], dtypes.int64)
+      output = table.lookup(input_keys)
+      self.assertAllClose([-5.0, 500.0, default_val], output.eval())
+
+      exported_keys, _ = table.export()
+      self.assertAllEqual(np.arange(num_keys), np.sort(exported_keys.eval()))
+
+  def testShardedMutableHashTable(self):
+    with self.test_session() as sess:
+      num_keys = 1000
+      keys = constant_op.constant(np.arange(num_keys), dtypes.int64)
+      values = constant_op.constant(np.arange(num_keys), dtypes.float32)
+      input_keys = constant_op.constant([5, 500, num_keys], dtypes.int64)
+      for use_flat_hash_map in [False, True]:
+        table = lookup.MutableHashTable(
+            dtypes.int64,
+            dtypes.float32,
+            -1.0,
+            use_flat_hash_map=use_flat_hash_map,
+            num_shards=7)
+        table.insert(keys, values).run()
+        table.insert(keys[:10], -values[:10]).run()
+        self.assertAllEqual(num_keys, table.size().eval())
+        self.assertAllClose([-5.0, 500.0, -1.0],
+                            table.lookup(input_keys).eval())
+
+        exported_keys, exported_values = sess.run(table.export())
+        order = np.argsort(exported_keys)
+        self.assertAllEqual(np.arange(num_keys), exported_keys[order])
+        self.assertAllClose(
+            np.concatenate([-np.arange(10), np.arange(10, num_keys)]),
+            exported_values[order])
+
+      table = lookup.MutableHashTable(
+          dtypes.int64, dtypes.float32, [-1.0, -1.0], num_shards=7)
+      table.insert(keys, array_ops.stack([values, -values], 1)).run()
+      self.assertAllEqual(num_keys, table.size().eval())
+      self.assertAllClose([[5.0, -5.0], [500.0, -500.0], [-1.0, -1.0]],
+                          table.lookup(input_keys).eval())
+
+
 class MutableDenseHashTableOpTest(test.TestCase):
 
   def testBasic(self):
@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 
 #include <atomic>
+#include <thread>
 
 #include "tensorflow/core/common_runtime/bfc_allocator.h"
 
@@ -23,14 +24,38 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/numbers.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/types.h"
 
 namespace tensorflow {
 
+namespace {
+
+// Returns a small integer identifying the calling thread. Threads are
+// numbered in the order in which they first call this, so that the first
+// num_cache_shards_ threads to use an allocator get a shard of their own.
+uint32 ThreadCacheIndex() {
+  static std::atomic<uint32> next_index{0};
+  thread_local uint32 index =
+      next_index.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+void UpdateMax(std::atomic<int64>* max, int64 value) {
+  int64 current = max->load(std::memory_order_relaxed);
+  while (value > current &&
+         !max->compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
 BFCAllocator::BFCAllocator(SubAllocator* sub_allocator, size_t total_memory,
-                           bool allow_growth, const string& name)
+                           bool allow_growth, const string& name,
+                           bool enable_thread_caches)
     : suballocator_(sub_allocator),
       name_(name),
       free_chunks_list_(kInvalidChunkHandle),
@@ -65,6 +90,13 @@ BFCAllocator::BFCAllocator(SubAllocator* sub_allocator, size_t total_memory,
       CHECK_NE(BinForSize(bin_size * 2), BinFromIndex(b));
     }
   }
+
+  if (enable_thread_caches) {
+    num_cache_shards_ = std::max(1, port::NumSchedulableCPUs());
+    cache_shards_.reset(new CacheShard[num_cache_shards_]);
+    VLOG(1) << "Enabled " << num_cache_shards_ << " thread caches for "
+            << name_;
+  }
 }
 
 BFCAllocator::~BFCAllocator() {
@@ -142,6 +174,9 @@ bool BFCAllocator::Extend(size_t alignment, size_t rounded_bytes) {
   VLOG(1) << "Allocated memory at " << mem_addr << " to "
           << static_cast<void*>(static_cast<char*>(mem_addr) + bytes);
   region_manager_.AddAllocationRegion(mem_addr, bytes);
+  if (thread_caches_enabled()) {
+    AddCacheRegion(mem_addr, bytes);
+  }
 
   // Create one large chunk for the whole memory space that will
   // be chunked later.
@@ -254,16 +289,37 @@ void* BFCAllocator::AllocateRawInternal(size_t unused_alignment,
   // The BFC allocator tries to find the best fit first.
   BinNum bin_num = BinNumForSize(rounded_bytes);
 
-  mutex_lock l(lock_);
-  void* ptr = FindChunkPtr(bin_num, rounded_bytes, num_bytes);
-  if (ptr != nullptr) {
-    return ptr;
+  if (thread_caches_enabled()) {
+    // Every chunk of a magazine's bin is at least as large as the bin size,
+    // so the request is served from the first bin whose size fits it.
+    BinNum cache_bin_num = bin_num;
+    if (BinNumToSize(cache_bin_num) < rounded_bytes) {
+      ++cache_bin_num;
+    }
+    if (cache_bin_num < kNumCachedBins) {
+      void* ptr = AllocateFromThreadCache(unused_alignment, cache_bin_num);
+      if (ptr != nullptr) {
+        return ptr;
+      }
+    }
   }
 
-  // Try to extend
-  if (Extend(unused_alignment, rounded_bytes)) {
-    ptr = FindChunkPtr(bin_num, rounded_bytes, num_bytes);
+  // If the first attempt fails, the chunks held by the magazines may be what
+  // keeps this request from fitting, so return them to the bins and try once
+  // more.
+  const int num_attempts = thread_caches_enabled() ? 2 : 1;
+  for (int attempt = 0; attempt < num_attempts; ++attempt) {
+    if (attempt > 0 && FlushThreadCaches() == 0) {
+      break;
+    }
+    mutex_lock l(lock_);
+    void* ptr =
+        AllocateFromBins(unused_alignment, bin_num, rounded_bytes, num_bytes);
     if (ptr != nullptr) {
+      if (thread_caches_enabled()) {
+        RecordClientAllocation(
+            ChunkFromHandle(region_manager_.get_handle(ptr))->size);
+      }
       return ptr;
     }
   }
@@ -272,6 +328,7 @@ void* BFCAllocator::AllocateRawInternal(size_t unused_alignment,
   // couldn't find one.  This means we must have run out of memory,
   // Dump the memory log for analysis.
   if (dump_log_on_failure) {
+    mutex_lock l(lock_);
     LOG(WARNING) << "Allocator (" << Name() << ") ran out of memory trying "
                  << "to allocate " << strings::HumanReadableNumBytes(num_bytes)
                  << ".  Current allocation summary follows.";
@@ -281,6 +338,20 @@ void* BFCAllocator::AllocateRawInternal(size_t unused_alignment,
   return nullptr;
 }
 
+void* BFCAllocator::AllocateFromBins(size_t alignment, BinNum bin_num,
+                                     size_t rounded_bytes, size_t num_bytes) {
+  void* ptr = FindChunkPtr(bin_num, rounded_bytes, num_bytes);
+  if (ptr != nullptr) {
+    return ptr;
+  }
+
+  // Try to extend
+  if (Extend(alignment, rounded_bytes)) {
+    ptr = FindChunkPtr(bin_num, rounded_bytes, num_bytes);
+  }
+  return ptr;
+}
+
 void* BFCAllocator::FindChunkPtr(BinNum bin_num, size_t rounded_bytes,
                                  size_t num_bytes) {
   // First identify the first bin that could satisfy rounded_bytes.
@@ -314,7 +385,8 @@ void* BFCAllocator::FindChunkPtr(BinNum bin_num, size_t rounded_bytes,
         chunk->requested_size = num_bytes;
         // Assign a unique id and increment the id counter, marking the
         // chunk as being in use.
-        chunk->allocation_id = next_allocation_id_++;
+        chunk->allocation_id =
+            next_allocation_id_.fetch_add(1, std::memory_order_relaxed);
 
         // Update stats.
         ++stats_.num_allocs;
@@ -372,6 +444,11 @@ void BFCAllocator::SplitChunk(BFCAllocator::ChunkHandle h, size_t num_bytes) {
 }
 
 void BFCAllocator::DeallocateRaw(void* ptr) {
+  // A chunk kept in a magazine does not make memory available to the bins,
+  // so there is nobody to notify.
+  if (thread_caches_enabled() && DeallocateToThreadCache(ptr)) {
+    return;
+  }
   DeallocateRawInternal(ptr);
   retry_helper_.NotifyDealloc();
 }
@@ -387,6 +464,16 @@ void BFCAllocator::DeallocateRawInternal(void* ptr) {
   BFCAllocator::ChunkHandle h = region_manager_.get_handle(ptr);
   CHECK(h != kInvalidChunkHandle);
 
+  if (thread_caches_enabled()) {
+    // The chunk may have come from a magazine if the calling thread's shard
+    // was busy.
+    std::atomic<uint8>* units = CachedChunkUnits(ptr);
+    if (units != nullptr) {
+      units->store(0, std::memory_order_relaxed);
+    }
+    RecordClientDeallocation(ChunkFromHandle(h)->size);
+  }
+
   // Consider coalescing it.
   FreeAndMaybeCoalesce(h);
 
@@ -544,10 +631,217 @@ int64 BFCAllocator::AllocationId(const void* ptr) {
   BFCAllocator::ChunkHandle h = region_manager_.get_handle(ptr);
   CHECK(h != kInvalidChunkHandle)
       << "Asked for allocation id of pointer we never allocated: " << ptr;
+  if (thread_caches_enabled()) {
+    std::atomic<uint8>* units = CachedChunkUnits(ptr);
+    if (units != nullptr && units->load(std::memory_order_relaxed) != 0) {
+      return CachedAllocationId(ptr)->load(std::memory_order_relaxed);
+    }
+  }
   BFCAllocator::Chunk* c = ChunkFromHandle(h);
   return c->allocation_id;
 }
 
+BFCAllocator::CacheShard* BFCAllocator::TryLockThreadCacheShard() {
+  CacheShard* shard = &cache_shards_[ThreadCacheIndex() % num_cache_shards_];
+  if (shard->busy.exchange(true, std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return shard;
+}
+
+void* BFCAllocator::AllocateFromThreadCache(size_t alignment, BinNum bin_num) {
+  void* ptr = nullptr;
+  CacheShard* shard = TryLockThreadCacheShard();
+  if (shard != nullptr) {
+    Magazine* m = &shard->magazines[bin_num];
+    if (m->size == 0) {
+      m->size =
+          RefillMagazine(alignment, bin_num, m->ptrs,
+                         std::max(1, MagazineCapacity(bin_num) / 2));
+    }
+    if (m->size > 0) {
+      ptr = m->ptrs[--m->size];
+    }
+    shard->busy.store(false, std::memory_order_release);
+  } else {
+    RefillMagazine(alignment, bin_num, &ptr, 1);
+  }
+  if (ptr == nullptr) {
+    return nullptr;
+  }
+  CachedAllocationId(ptr)->store(
+      next_allocation_id_.fetch_add(1, std::memory_order_relaxed),
+      std::memory_order_relaxed);
+  RecordClientAllocation(
+      CachedChunkUnits(ptr)->load(std::memory_order_relaxed) *
+      kMinAllocationSize);
+  return ptr;
+}
+
+bool BFCAllocator::DeallocateToThreadCache(void* ptr) {
+  if (ptr == nullptr) {
+    return false;
+  }
+  std::atomic<uint8>* units = CachedChunkUnits(ptr);
+  if (units == nullptr) {
+    return false;
+  }
+  const size_t chunk_bytes =
+      units->load(std::memory_order_relaxed) * kMinAllocationSize;
+  if (chunk_bytes == 0) {
+    return false;
+  }
+  CacheShard* shard = TryLockThreadCacheShard();
+  if (shard == nullptr) {
+    return false;
+  }
+  const BinNum bin_num = BinNumForSize(chunk_bytes);
+  Magazine* m = &shard->magazines[bin_num];
+  bool returned_chunks = false;
+  if (m->size == MagazineCapacity(bin_num)) {
+    // Return the older half of the magazine to the bins in one batch.
+    const int n = m->size / 2;
+    {
+      mutex_lock l(lock_);
+      ReturnCachedChunks(m->ptrs, n);
+    }
+    std::copy(m->ptrs + n, m->ptrs + m->size, m->ptrs);
+    m->size -= n;
+    returned_chunks = true;
+  }
+  m->ptrs[m->size++] = ptr;
+  shard->busy.store(false, std::memory_order_release);
+  RecordClientDeallocation(chunk_bytes);
+  if (returned_chunks) {
+    retry_helper_.NotifyDealloc();
+  }
+  return true;
+}
+
+int BFCAllocator::RefillMagazine(size_t alignment, BinNum bin_num,
+                                 void** ptrs, int n) {
+  const size_t bin_bytes = BinNumToSize(bin_num);
+  mutex_lock l(lock_);
+  int count = 0;
+  while (count < n) {
+    void* ptr = AllocateFromBins(alignment, bin_num, bin_bytes, bin_bytes);
+    if (ptr == nullptr) {
+      break;
+    }
+    ChunkHandle h = region_manager_.get_handle(ptr);
+    std::atomic<uint8>* units = CachedChunkUnits(ptr);
+    if (units == nullptr) {
+      // The chunk lies in a region added after kMaxCacheRegions were
+      // reached, so it can not be cached.
+      FreeAndMaybeCoalesce(h);
+      break;
+    }
+    // FindChunkPtr only leaves a chunk unsplit if it is less than twice the
+    // requested size, so the size of a cached chunk fits into a uint8.
+    const size_t chunk_units = ChunkFromHandle(h)->size >> kMinAllocationBits;
+    DCHECK_LT(chunk_units, 256);
+    units->store(static_cast<uint8>(chunk_units), std::memory_order_relaxed);
+    ptrs[count++] = ptr;
+  }
+  return count;
+}
+
+void BFCAllocator::ReturnCachedChunks(void* const* ptrs, int n) {
+  for (int i = 0; i < n; ++i) {
+    CachedChunkUnits(ptrs[i])->store(0, std::memory_order_relaxed);
+    ChunkHandle h = region_manager_.get_handle(ptrs[i]);
+    CHECK(h != kInvalidChunkHandle);
+    FreeAndMaybeCoalesce(h);
+  }
+}
+
+int BFCAllocator::FlushThreadCaches() {
+  int num_returned = 0;
+  for (int i = 0; i < num_cache_shards_; ++i) {
+    CacheShard* shard = &cache_shards_[i];
+    // Shards are only held for the duration of a single magazine operation,
+    // and their holders never wait for anything but lock_, which is not held
+    // here.
+    while (shard->busy.exchange(true, std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    {
+      mutex_lock l(lock_);
+      for (BinNum b = 0; b < kNumCachedBins; ++b) {
+        Magazine* m = &shard->magazines[b];
+        ReturnCachedChunks(m->ptrs, m->size);
+        num_returned += m->size;
+        m->size = 0;
+      }
+    }
+    shard->busy.store(false, std::memory_order_release);
+  }
+  if (num_returned > 0) {
+    VLOG(1) << "Returned " << num_returned << " cached chunks of " << name_
+            << " to the bins";
+    retry_helper_.NotifyDealloc();
+  }
+  return num_returned;
+}
+
+void BFCAllocator::AddCacheRegion(void* ptr, size_t memory_size) {
+  const int n = num_cache_regions_.load(std::memory_order_relaxed);
+  if (n == kMaxCacheRegions) {
+    LOG(WARNING) << "Allocator (" << Name() << ") has more than "
+                 << kMaxCacheRegions << " regions; chunks of the new region "
+                 << "will not be kept in thread caches.";
+    return;
+  }
+  CacheRegion* region = &cache_regions_[n];
+  const size_t num_units = memory_size / kMinAllocationSize;
+  region->base = static_cast<const char*>(ptr);
+  region->end = region->base + memory_size;
+  region->chunk_units.reset(new std::atomic<uint8>[num_units]);
+  region->allocation_ids.reset(new std::atomic<int64>[num_units]);
+  for (size_t i = 0; i < num_units; ++i) {
+    region->chunk_units[i].store(0, std::memory_order_relaxed);
+    region->allocation_ids[i].store(0, std::memory_order_relaxed);
+  }
+  num_cache_regions_.store(n + 1, std::memory_order_release);
+}
+
+std::atomic<uint8>* BFCAllocator::CachedChunkUnits(const void* ptr) const {
+  const char* p = static_cast<const char*>(ptr);
+  const int n = num_cache_regions_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; ++i) {
+    const CacheRegion& region = cache_regions_[i];
+    if (p >= region.base && p < region.end) {
+      return &region.chunk_units[(p - region.base) >> kMinAllocationBits];
+    }
+  }
+  return nullptr;
+}
+
+std::atomic<int64>* BFCAllocator::CachedAllocationId(const void* ptr) const {
+  const char* p = static_cast<const char*>(ptr);
+  const int n = num_cache_regions_.load(std::memory_order_acquire);
+  for (int i = 0; i < n; ++i) {
+    const CacheRegion& region = cache_regions_[i];
+    if (p >= region.base && p < region.end) {
+      return &region.allocation_ids[(p - region.base) >> kMinAllocationBits];
+    }
+  }
+  return nullptr;
+}
+
+void BFCAllocator::RecordClientAllocation(size_t bytes) {
+  client_num_allocs_.fetch_add(1, std::memory_order_relaxed);
+  const int64 bytes_in_use =
+      client_bytes_in_use_.fetch_add(bytes, std::memory_order_relaxed) +
+      bytes;
+  UpdateMax(&client_max_bytes_in_use_, bytes_in_use);
+  UpdateMax(&client_max_alloc_size_, bytes);
+}
+
+void BFCAllocator::RecordClientDeallocation(size_t bytes) {
+  client_bytes_in_use_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
 namespace {
 
 void RenderRegion(char* rendered, const size_t resolution,
@@ -683,6 +977,14 @@ void BFCAllocator::DumpMemoryLog(size_t num_bytes) {
 void BFCAllocator::GetStats(AllocatorStats* stats) {
   mutex_lock l(lock_);
   *stats = stats_;
+  if (thread_caches_enabled()) {
+    stats->num_allocs = client_num_allocs_.load(std::memory_order_relaxed);
+    stats->bytes_in_use = client_bytes_in_use_.load(std::memory_order_relaxed);
+    stats->max_bytes_in_use =
+        client_max_bytes_in_use_.load(std::memory_order_relaxed);
+    stats->max_alloc_size =
+        client_max_alloc_size_.load(std::memory_order_relaxed);
+  }
 }
 
 void BFCAllocator::ClearStats() {
@@ -690,6 +992,11 @@ void BFCAllocator::ClearStats() {
   stats_.num_allocs = 0;
   stats_.max_bytes_in_use = stats_.bytes_in_use;
   stats_.max_alloc_size = 0;
+  client_num_allocs_.store(0, std::memory_order_relaxed);
+  client_max_bytes_in_use_.store(
+      client_bytes_in_use_.load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+  client_max_alloc_size_.store(0, std::memory_order_relaxed);
 }
 
 std::array<BFCAllocator::BinDebugInfo, BFCAllocator::kNumBins>
@@ -17,6 +17,7 @@ limitations under the License.
 #define TENSORFLOW_COMMON_RUNTIME_BFC_ALLOCATOR_H_
 
 #include <array>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -42,11 +43,18 @@ namespace tensorflow {
 // coalescing.  One assumption we make is that the process using this
 // allocator owns pretty much all of the memory, and that nearly
 // all requests to allocate memory go through this interface.
+//
+// If thread caches are enabled, small allocations are served from
+// per-thread magazines of free chunks that are refilled from, and returned
+// to, the bins in batches, so that most small AllocateRaw/DeallocateRaw calls
+// do not take the allocator lock. Chunks held by a magazine stay allocated
+// from the bins' point of view, but are not counted in GetStats().
 class BFCAllocator : public VisitableAllocator {
  public:
   // Takes ownership of sub_allocator.
   BFCAllocator(SubAllocator* sub_allocator, size_t total_memory,
-               bool allow_growth, const string& name);
+               bool allow_growth, const string& name,
+               bool enable_thread_caches = false);
   ~BFCAllocator() override;
 
   string Name() override { return name_; }
@@ -62,6 +70,8 @@ class BFCAllocator : public VisitableAllocator {
 
   bool TracksAllocationSizes() override;
 
+  // For allocations served by the thread caches, returns the size class
+  // the request was rounded up to.
   size_t RequestedSize(const void* ptr) override;
 
   size_t AllocatedSize(const void* ptr) override;
@@ -340,6 +350,100 @@ class BFCAllocator : public VisitableAllocator {
   // Removes the chunk metadata represented by 'h'.
   void DeleteChunk(ChunkHandle h) EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
+  // Finds a free chunk of at least 'rounded_bytes' bytes, extending the
+  // allocated regions if needed, and returns its pointer or nullptr.
+  void* AllocateFromBins(size_t alignment, BinNum bin_num,
+                         size_t rounded_bytes, size_t num_bytes)
+      EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Thread caches.
+  //
+  // Requests of up to BinNumToSize(kNumCachedBins - 1) bytes are rounded up
+  // to the next bin size, i.e. to a power of two, so that any chunk of that
+  // bin can serve them, and are served from the bin's magazine in the calling
+  // thread's CacheShard. Threads are spread over the shards round-robin; a
+  // thread that finds its shard busy (because more threads than shards share
+  // it) falls back to the bins instead of waiting.
+  //
+  // To find the bin of a freed pointer without taking lock_, the size of
+  // every chunk handed to a magazine is recorded, in units of
+  // kMinAllocationSize, in a CacheRegion that mirrors its AllocationRegion.
+  // Requests of up to 32KiB, served in chunks of less than 64KiB.
+  static const int kNumCachedBins = 8;
+  static const int kMaxMagazineSize = 32;
+  // Upper bound on the bytes a single magazine holds.
+  static const size_t kMaxMagazineBytes = 128 << 10;
+  static const int kMaxCacheRegions = 64;
+
+  struct Magazine {
+    int size = 0;
+    void* ptrs[kMaxMagazineSize];
+  };
+
+  struct CacheShard {
+    std::atomic<bool> busy{false};
+    Magazine magazines[kNumCachedBins];
+    char padding[64];  // Keeps 'busy' off the previous shard's cache line.
+  };
+
+  struct CacheRegion {
+    const char* base = nullptr;
+    const char* end = nullptr;
+    // Size of the cached chunk starting at each kMinAllocationSize offset of
+    // the region in units of kMinAllocationSize, 0 if there is none.
+    std::unique_ptr<std::atomic<uint8>[]> chunk_units;
+    // The allocation id of the cached chunk starting at each
+    // kMinAllocationSize offset, assigned each time a magazine hands it out.
+    std::unique_ptr<std::atomic<int64>[]> allocation_ids;
+  };
+
+  bool thread_caches_enabled() const { return cache_shards_ != nullptr; }
+
+  static int MagazineCapacity(BinNum bin_num) {
+    return static_cast<int>(std::min<size_t>(
+        kMaxMagazineSize,
+        std::max<size_t>(2, kMaxMagazineBytes / (size_t{256} << bin_num))));
+  }
+
+  // Marks the calling thread's shard busy and returns it, or returns nullptr
+  // if another thread is using it.
+  CacheShard* TryLockThreadCacheShard();
+
+  // Returns a chunk for bin 'bin_num' from the calling thread's magazine,
+  // refilling the magazine from the bins if it is empty. Returns nullptr if
+  // no cacheable chunk is available.
+  void* AllocateFromThreadCache(size_t alignment, BinNum bin_num);
+
+  // Returns true if 'ptr' was put into the calling thread's magazine, and
+  // false if it must be returned to the bins.
+  bool DeallocateToThreadCache(void* ptr);
+
+  // Moves up to 'n' chunks of bin 'bin_num' from the bins into 'ptrs', and
+  // returns the number of chunks moved.
+  int RefillMagazine(size_t alignment, BinNum bin_num, void** ptrs, int n)
+      LOCKS_EXCLUDED(lock_);
+
+  // Returns the 'n' cached chunks in 'ptrs' to the bins.
+  void ReturnCachedChunks(void* const* ptrs, int n)
+      EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Returns the chunks of all magazines to the bins, and returns their
+  // number.
+  int FlushThreadCaches() LOCKS_EXCLUDED(lock_);
+
+  void AddCacheRegion(void* ptr, size_t memory_size)
+      EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  // Returns the CacheRegion::chunk_units entry for 'ptr', or nullptr if
+  // 'ptr' is not inside a CacheRegion. Does not require lock_.
+  std::atomic<uint8>* CachedChunkUnits(const void* ptr) const;
+  // Same for the CacheRegion::allocation_ids entry.
+  std::atomic<int64>* CachedAllocationId(const void* ptr) const;
+
+  // Update the stats reported by GetStats() when thread caches are enabled.
+  void RecordClientAllocation(size_t bytes);
+  void RecordClientDeallocation(size_t bytes);
+
   string RenderOccupancy() EXCLUSIVE_LOCKS_REQUIRED(lock_);
   void DumpMemoryLog(size_t num_bytes) EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
@@ -430,12 +534,28 @@ class BFCAllocator : public VisitableAllocator {
   std::vector<Visitor> region_visitors_ GUARDED_BY(lock_);
 
   // Counter containing the next unique identifier to assign to a
-  // newly-created chunk.
-  int64 next_allocation_id_ GUARDED_BY(lock_);
+  // newly-created chunk. Atomic because the thread caches assign ids to the
+  // chunks they hand out without holding lock_.
+  std::atomic<int64> next_allocation_id_;
 
   // Stats.
   AllocatorStats stats_ GUARDED_BY(lock_);
 
+  // Thread caches. cache_shards_ is null unless thread caches are enabled.
+  int num_cache_shards_ = 0;
+  std::unique_ptr<CacheShard[]> cache_shards_;
+  CacheRegion cache_regions_[kMaxCacheRegions];
+  // Number of initialized entries of cache_regions_. Entries below it are
+  // immutable, so they can be read without holding lock_.
+  std::atomic<int> num_cache_regions_{0};
+
+  // With thread caches enabled, stats_ also counts the chunks held by the
+  // magazines as in use, so GetStats() reports these instead.
+  std::atomic<int64> client_num_allocs_{0};
+  std::atomic<int64> client_bytes_in_use_{0};
+  std::atomic<int64> client_max_bytes_in_use_{0};
+  std::atomic<int64> client_max_alloc_size_{0};
+
   friend class GPUBFCAllocatorPrivateMethodsTest;
   TF_DISALLOW_COPY_AND_ASSIGN(BFCAllocator);
 };
@@ -0,0 +1,248 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/bfc_allocator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/pool_allocator.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace {
+
+static void CheckStats(Allocator* a, int64 num_allocs, int64 bytes_in_use,
+                       int64 max_bytes_in_use, int64 max_alloc_size) {
+  AllocatorStats stats;
+  a->GetStats(&stats);
+  LOG(INFO) << "Alloc stats: " << std::endl << stats.DebugString();
+  EXPECT_EQ(stats.bytes_in_use, bytes_in_use);
+  EXPECT_EQ(stats.max_bytes_in_use, max_bytes_in_use);
+  EXPECT_EQ(stats.num_allocs, num_allocs);
+  EXPECT_EQ(stats.max_alloc_size, max_alloc_size);
+}
+
+TEST(BFCAllocatorTest, NoDups) {
+  BFCAllocator a(new BasicCPUAllocator(-1), 1 << 30, true, "cpu_bfc");
+  CheckStats(&a, 0, 0, 0, 0);
+
+  std::vector<void*> ptrs;
+  for (int s = 1; s < 1024; s++) {
+    ptrs.push_back(a.AllocateRaw(1, s));
+  }
+  CheckStats(&a, 1023, 654336, 654336, 1024);
+
+  for (void* p : ptrs) {
+    a.DeallocateRaw(p);
+  }
+  CheckStats(&a, 1023, 0, 654336, 1024);
+}
+
+TEST(BFCAllocatorTest, ThreadCachesNoDups) {
+  BFCAllocator a(new BasicCPUAllocator(-1), 1 << 30, true, "cpu_bfc",
+                 true /*enable_thread_caches*/);
+  CheckStats(&a, 0, 0, 0, 0);
+
+  // Cached requests are rounded up to a power of two.
+  std::vector<void*> ptrs;
+  std::set<int64> ids;
+  int64 bytes_in_use = 0;
+  int64 max_alloc_size = 0;
+  for (int s = 1; s < 5000; s += 7) {
+    void* raw = a.AllocateRaw(1, s);
+    ASSERT_NE(raw, nullptr);
+    ASSERT_GE(a.AllocatedSize(raw), a.RequestedSize(raw));
+    ASSERT_GE(a.RequestedSize(raw), s);
+    EXPECT_NE(0, a.AllocationId(raw));
+    EXPECT_TRUE(ids.insert(a.AllocationId(raw)).second);
+    bytes_in_use += a.AllocatedSize(raw);
+    max_alloc_size = std::max<int64>(max_alloc_size, a.AllocatedSize(raw));
+    ptrs.push_back(raw);
+  }
+  CheckStats(&a, ptrs.size(), bytes_in_use, bytes_in_use, max_alloc_size);
+
+  std::sort(ptrs.begin(), ptrs.end());
+  for (size_t i = 1; i < ptrs.size(); i++) {
+    ASSERT_NE(ptrs[i], ptrs[i - 1]);  // No dups
+    ASSERT_GE(static_cast<char*>(ptrs[i]) - static_cast<char*>(ptrs[i - 1]),
+              a.AllocatedSize(ptrs[i - 1]));
+  }
+
+  for (void* p : ptrs) {
+    a.DeallocateRaw(p);
+  }
+  CheckStats(&a, ptrs.size(), 0, bytes_in_use, max_alloc_size);
+
+  // Large requests bypass the caches.
+  void* large = a.AllocateRaw(1, 1 << 20);
+  const int64 large_size = a.AllocatedSize(large);
+  EXPECT_NE(0, a.AllocationId(large));
+  EXPECT_EQ(1 << 20, a.RequestedSize(large));
+  CheckStats(&a, ptrs.size() + 1, large_size,
+             std::max(bytes_in_use, large_size), large_size);
+  a.DeallocateRaw(large);
+
+  a.ClearStats();
+  CheckStats(&a, 0, 0, 0, 0);
+}
+
+TEST(BFCAllocatorTest, ThreadCachesReuseChunks) {
+  BFCAllocator a(new BasicCPUAllocator(-1), 1 << 30, true, "cpu_bfc",
+                 true /*enable_thread_caches*/);
+  void* first = a.AllocateRaw(1, 1000);
+  const int64 first_id = a.AllocationId(first);
+  a.DeallocateRaw(first);
+  // The most recently freed chunk of the magazine is handed out first, as a
+  // new allocation.
+  void* second = a.AllocateRaw(1, 1024);
+  EXPECT_EQ(first, second);
+  EXPECT_GT(a.AllocationId(second), first_id);
+  a.DeallocateRaw(second);
+}
+
+TEST(BFCAllocatorTest, ThreadCachesReturnedWhenOutOfMemory) {
+  const size_t kLimit = 1 << 20;
+  BFCAllocator a(new BasicCPUAllocator(-1), kLimit, false, "cpu_bfc",
+                 true /*enable_thread_caches*/);
+  // Fill the whole region with small chunks and free them, so that the
+  // magazines and the bins share the memory.
+  AllocationAttributes no_retry;
+  no_retry.no_retry_on_failure = true;
+  std::vector<void*> ptrs;
+  for (void* p = a.AllocateRaw(1, 4096, no_retry); p != nullptr;
+       p = a.AllocateRaw(1, 4096, no_retry)) {
+    ptrs.push_back(p);
+  }
+  EXPECT_EQ(kLimit / 4096, ptrs.size());
+  for (void* p : ptrs) {
+    a.DeallocateRaw(p);
+  }
+  // Only possible once the cached chunks are coalesced into the bins again.
+  void* all = a.AllocateRaw(1, kLimit);
+  ASSERT_NE(all, nullptr);
+  CheckStats(&a, ptrs.size() + 1, kLimit, kLimit, kLimit);
+  a.DeallocateRaw(all);
+}
+
+TEST(BFCAllocatorTest, ThreadCachesConcurrentAllocations) {
+  BFCAllocator a(new BasicCPUAllocator(-1), 1 << 30, true, "cpu_bfc",
+                 true /*enable_thread_caches*/);
+  const int kNumThreads = 16;
+  thread::ThreadPool pool(Env::Default(), "test", kNumThreads);
+  BlockingCounter counter(kNumThreads);
+  for (int t = 0; t < kNumThreads; t++) {
+    pool.Schedule([&a, &counter, t]() {
+      random::PhiloxRandom philox(t, 17);
+      random::SimplePhilox rand(&philox);
+      std::vector<std::pair<uint8*, size_t>> live;
+      for (int i = 0; i < 1000; i++) {
+        if (!live.empty() && rand.Uniform(3) == 0) {
+          // Verify nobody else wrote into the buffer before freeing it.
+          const size_t j = rand.Uniform(live.size());
+          uint8* p = live[j].first;
+          size_t k = 0;
+          while (k < live[j].second && p[k] == static_cast<uint8>(t)) {
+            k++;
+          }
+          EXPECT_EQ(live[j].second, k);
+          a.DeallocateRaw(p);
+          live[j] = live.back();
+          live.pop_back();
+        } else {
+          const size_t bytes = 1 + rand.Uniform(40000);
+          uint8* p = static_cast<uint8*>(a.AllocateRaw(1, bytes));
+          // Not ASSERT_NE, which would return before DecrementCount().
+          EXPECT_NE(p, nullptr);
+          if (p == nullptr) break;
+          memset(p, t, bytes);
+          live.emplace_back(p, bytes);
+        }
+      }
+      for (const auto& entry : live) {
+        a.DeallocateRaw(entry.first);
+      }
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+
+  AllocatorStats stats;
+  a.GetStats(&stats);
+  EXPECT_EQ(0, stats.bytes_in_use);
+}
+
+// Each of "num_threads" threads allocates and frees small buffers of a few
+// sizes typical for intermediate CPU tensors, with up to 16 buffers live at
+// a time.
+static void RunContendedAllocations(int iters, int num_threads,
+                                    bool enable_thread_caches) {
+  testing::StopTiming();
+  BFCAllocator a(new BasicCPUAllocator(-1), 1uLL << 32, true, "cpu_bfc",
+                 enable_thread_caches);
+  thread::ThreadPool pool(Env::Default(), "test", num_threads);
+  const int iters_per_thread = std::max(1, iters / num_threads);
+  BlockingCounter counter(num_threads);
+  testing::UseRealTime();
+  testing::StartTiming();
+  for (int t = 0; t < num_threads; t++) {
+    pool.Schedule([&a, &counter, iters_per_thread]() {
+      static const size_t kSizes[] = {64, 256, 1024, 4000, 512, 16384, 128};
+      static const int kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+      void* live[16] = {};
+      for (int i = 0; i < iters_per_thread; i++) {
+        void*& slot = live[i % 16];
+        if (slot != nullptr) {
+          a.DeallocateRaw(slot);
+        }
+        slot = a.AllocateRaw(1, kSizes[i % kNumSizes]);
+      }
+      for (void* p : live) {
+        if (p != nullptr) {
+          a.DeallocateRaw(p);
+        }
+      }
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  testing::StopTiming();
+  testing::ItemsProcessed(static_cast<int64>(iters_per_thread) * num_threads);
+}
+
+static void BM_ContendedAllocation(int iters, int num_threads) {
+  RunContendedAllocations(iters, num_threads, false);
+}
+BENCHMARK(BM_ContendedAllocation)->Arg(1)->Arg(4)->Arg(16)->Arg(32);
+
+static void BM_ContendedAllocationThreadCaches(int iters, int num_threads) {
+  RunContendedAllocations(iters, num_threads, true);
+}
+BENCHMARK(BM_ContendedAllocationThreadCaches)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(32);
+
+}  // namespace
+}  // namespace tensorflow
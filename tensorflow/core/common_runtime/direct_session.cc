@@ -26,6 +26,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/device_factory.h"
 #include "tensorflow/core/common_runtime/device_resolver_local.h"
 #include "tensorflow/core/common_runtime/executor.h"
+#include "tensorflow/core/common_runtime/executor_factory.h"
 #include "tensorflow/core/common_runtime/function.h"
 #include "tensorflow/core/common_runtime/graph_optimizer.h"
 #include "tensorflow/core/common_runtime/memory_types.h"
@@ -564,10 +565,12 @@ Status DirectSession::RunInternal(int64 step_id, const RunOptions& run_options,
         item.device->tensorflow_device_thread_pool();
     if (!device_thread_pool) {
       args.runner = default_runner;
+      args.runner_parallelism = pool->NumThreads();
     } else {
       args.runner = [this, device_thread_pool](Executor::Args::Closure c) {
         SchedClosure(device_thread_pool, std::move(c));
       };
+      args.runner_parallelism = device_thread_pool->NumThreads();
     }
     item.executor->RunAsync(args, barrier->Get());
   }
@@ -798,6 +801,7 @@ Status DirectSession::PRunSetup(const std::vector<string>& input_names,
   args.runner = [this, pool](Executor::Args::Closure c) {
     SchedClosure(pool, std::move(c));
   };
+  args.runner_parallelism = pool->NumThreads();
   args.session_state = &session_state_;
   args.tensor_store = &run_state->tensor_store;
   args.step_container = &run_state->step_container;
@@ -1160,6 +1164,12 @@ Status DirectSession::CreateExecutors(
     LocalExecutorParams params;
     params.device = device;
     params.function_library = lib;
+    params.cost_model_steps =
+        options_.config.experimental().executor_cost_model_steps();
+    params.step_arena_bytes =
+        options_.config.experimental().executor_step_arena_bytes();
+    params.static_memory_planning =
+        options_.config.experimental().executor_static_memory_planning();
     auto opseg = device->op_segment();
     params.create_kernel = [this, lib, opseg](const NodeDef& ndef,
                                               OpKernel** kernel) {
@@ -1203,14 +1213,13 @@ Status DirectSession::CreateExecutors(
     TF_RETURN_IF_ERROR(EnsureMemoryTypes(DeviceType(device->device_type()),
                                          device->name(),
                                          partition_graph.get()));
-    // NewLocalExecutor takes ownership of partition_graph.
+    // NewExecutor takes ownership of partition_graph.
     item->graph = partition_graph.get();
     item->executor = nullptr;
     item->device = device;
-    Executor* executor;
     TF_RETURN_IF_ERROR(
-        NewLocalExecutor(params, std::move(partition_graph), &executor));
-    item->executor.reset(executor);
+        NewExecutor(options_.config.experimental().executor_type(), params,
+                    std::move(partition_graph), &item->executor));
   }
 
   // Cache the mapping from input/output names to graph elements to
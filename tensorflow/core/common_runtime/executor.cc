@@ -25,6 +25,8 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/costmodel_manager.h"
 #include "tensorflow/core/common_runtime/executor_factory.h"
 #include "tensorflow/core/common_runtime/pending_counts.h"
+#include "tensorflow/core/common_runtime/static_memory_plan.h"
+#include "tensorflow/core/common_runtime/step_arena_allocator.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
 #include "tensorflow/core/framework/allocation_description.pb.h"
 #include "tensorflow/core/framework/allocator.h"
@@ -42,6 +44,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_reference.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/graph/costmodel.h"
 #include "tensorflow/core/graph/edgeset.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/notification.h"
@@ -54,6 +57,7 @@ limitations under the License.
 #include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
+#include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/mutex.h"
@@ -61,6 +65,7 @@ limitations under the License.
 #include "tensorflow/core/platform/tracing.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/util/tensor_slice_reader_cache.h"
+#include "third_party/eigen3/unsupported/Eigen/CXX11/ThreadPool"
 
 namespace tensorflow {
 namespace {
@@ -68,6 +73,11 @@ namespace {
 // 1-D, 0 element tensor.
 static const Tensor* const kEmptyTensor = new Tensor;
 
+// When an executor has cost estimates (see
+// LocalExecutorParams::cost_model_steps), nodes estimated to compute in less
+// than this many microseconds are not worth a trip through the thread pool.
+const int32 kInlineCostThresholdUsecs = 10;
+
 bool IsInitializationOp(const Node* node) {
   return node->op_def().allows_uninitialized_input();
 }
@@ -224,6 +234,9 @@ struct NodeItem {
   bool is_sink : 1;              // True iff IsSink(node)
   // True iff IsEnter(node) || IsExit(node) || IsNextIteration(node)
   bool is_enter_exit_or_next_iter : 1;
+  // True iff the outputs and temporaries of the kernel are allocated from
+  // the step's StepArenaAllocator.
+  bool use_step_allocator : 1;
 
   // Cached values of node->num_inputs() and node->num_outputs(), to
   // avoid levels of indirection.
@@ -234,6 +247,16 @@ struct NodeItem {
   // for this node.
   int input_start = 0;
 
+  // If not null, indexed by output number: the allocators serving the
+  // planned outputs of the kernel from the executor's StaticMemoryArena,
+  // or null for outputs that are not planned. Owned by the executor.
+  Allocator* const* planned_output_allocators = nullptr;
+
+  // Estimated compute time of the kernel in microseconds, or -1 if unknown.
+  // Written once by ExecutorImpl::FinishProfiledStep(), and read only by
+  // steps that started after ExecutorImpl::has_cost_estimates_ was set.
+  int32 cost_estimate_usecs = -1;
+
   // Number of output edges.
   size_t num_output_edges;
 
@@ -348,8 +371,14 @@ class GraphView {
 
 class ExecutorImpl : public Executor {
  public:
-  ExecutorImpl(const LocalExecutorParams& p, std::unique_ptr<const Graph> g)
-      : params_(p), graph_(std::move(g)), gview_() {
+  ExecutorImpl(const LocalExecutorParams& p, std::unique_ptr<const Graph> g,
+               bool work_stealing = false)
+      : params_(p),
+        graph_(std::move(g)),
+        gview_(),
+        work_stealing_(work_stealing),
+        cost_model_(false /* is_global */),
+        has_cost_estimates_(false) {
     CHECK(p.create_kernel != nullptr);
     CHECK(p.delete_kernel != nullptr);
   }
@@ -364,6 +393,9 @@ class ExecutorImpl : public Executor {
     for (auto fiter : frame_info_) {
       delete fiter.second;
     }
+    if (static_memory_arena_ != nullptr) {
+      static_memory_arena_->Unref();
+    }
   }
 
   Status Initialize();
@@ -417,6 +449,18 @@ class ExecutorImpl : public Executor {
                                      ControlFlowInfo* cf_info);
   void InitializePending(const Graph* graph, const ControlFlowInfo& cf_info);
 
+  // Plans the outputs of the nodes with fully known shapes into one slab,
+  // and sets NodeItem::planned_output_allocators accordingly.
+  void InitializeStaticMemoryPlan();
+
+  // Records that the kernel of "item" computed for "compute_usecs" during a
+  // step started before cost estimates were available.
+  void RecordNodeCost(const NodeItem& item, uint64 compute_usecs) const;
+
+  // Called at the end of each step that recorded node costs. After
+  // params_.cost_model_steps such steps, publishes the cost estimates.
+  void FinishProfiledStep() const;
+
   FrameInfo* EnsureFrameInfo(const string& fname) {
     auto slot = &frame_info_[fname];
     if (*slot == nullptr) {
@@ -430,6 +474,18 @@ class ExecutorImpl : public Executor {
   std::unique_ptr<const Graph> graph_;
   GraphView gview_;
 
+  // True iff this executor was created by NewWorkStealingExecutor().
+  const bool work_stealing_;
+
+  // True iff some NodeItem::use_step_allocator is set.
+  bool use_step_allocator_ = false;
+
+  // Holds the planned outputs if params_.static_memory_planning is set and
+  // the graph could be planned. Owned.
+  StaticMemoryArena* static_memory_arena_ = nullptr;
+  // The arrays of NodeItem::planned_output_allocators.
+  std::vector<std::unique_ptr<Allocator*[]>> planned_output_allocators_;
+
   // A cached value of params_
   bool device_record_tensor_accesses_ = false;
 
@@ -441,6 +497,13 @@ class ExecutorImpl : public Executor {
   // the overhead of constructing it for each executor instance.
   gtl::FlatMap<string, FrameInfo*> frame_info_;
 
+  // Node costs measured during the first params_.cost_model_steps steps.
+  mutable mutex cost_model_mu_;
+  mutable CostModel cost_model_ GUARDED_BY(cost_model_mu_);
+  mutable int num_profiled_steps_ GUARDED_BY(cost_model_mu_) = 0;
+  // Set (with release semantics) once NodeItem::cost_estimate_usecs is final.
+  mutable std::atomic<bool> has_cost_estimates_;
+
   TF_DISALLOW_COPY_AND_ASSIGN(ExecutorImpl);
 };
 
@@ -656,9 +719,50 @@ void GetMaxPendingCounts(const Node* n, size_t* max_pending,
   *max_dead_count = num_in_edges;
 }
 
+// Returns, by node id, whether the outputs of each node are not expected to
+// outlive the step: neither the node nor any node its outputs may reach is
+// stateful, and no node on the way has a reference output. Any kernel may
+// forward an input buffer to one of its outputs, so a tensor reaches every
+// node downstream of its producer. This excludes outputs that are sent to
+// other devices, returned from functions or stored in variables, even
+// through Identity or other ops that pass their inputs through.
+static std::vector<bool> StepLocalOutputs(const Graph& graph) {
+  std::vector<bool> may_escape(graph.num_node_ids(), false);
+  std::deque<const Node*> queue;
+  for (const Node* n : graph.nodes()) {
+    bool escapes = !n->IsOp() || n->op_def().is_stateful();
+    for (const DataType dt : n->output_types()) {
+      escapes |= IsRefType(dt);
+    }
+    if (escapes) {
+      may_escape[n->id()] = true;
+      queue.push_back(n);
+    }
+  }
+  // The inputs of a node whose outputs may escape may escape with them.
+  while (!queue.empty()) {
+    const Node* n = queue.front();
+    queue.pop_front();
+    for (const Edge* e : n->in_edges()) {
+      if (e->IsControlEdge() || may_escape[e->src()->id()]) continue;
+      may_escape[e->src()->id()] = true;
+      queue.push_back(e->src());
+    }
+  }
+  may_escape.flip();
+  return may_escape;
+}
+
 Status ExecutorImpl::Initialize() {
   gview_.Initialize(graph_.get());
 
+  // Only buffers in host memory are carved out of a step arena.
+  const bool may_use_step_allocator =
+      params_.step_arena_bytes > 0 &&
+      params_.device->device_type() == DEVICE_CPU;
+  const std::vector<bool> step_local_outputs =
+      may_use_step_allocator ? StepLocalOutputs(*graph_) : std::vector<bool>();
+
   // Build the information about frames in this subgraph.
   ControlFlowInfo cf_info;
   TF_RETURN_IF_ERROR(BuildControlFlowInfo(graph_.get(), &cf_info));
@@ -707,6 +811,9 @@ Status ExecutorImpl::Initialize() {
     item->is_sink = IsSink(n);
     item->is_enter_exit_or_next_iter =
         (IsEnter(n) || IsExit(n) || IsNextIteration(n));
+    item->use_step_allocator =
+        may_use_step_allocator && step_local_outputs[id];
+    use_step_allocator_ |= item->use_step_allocator;
 
     // Compute the maximum values we'll store for this node in the
     // pending counts data structure, and allocate a handle in
@@ -730,9 +837,77 @@ Status ExecutorImpl::Initialize() {
   // all nodes.
   InitializePending(graph_.get(), cf_info);
 
+  if (params_.static_memory_planning &&
+      params_.device->device_type() == DEVICE_CPU) {
+    InitializeStaticMemoryPlan();
+  }
+
   return gview_.SetAllocAttrs(graph_.get(), params_.device);
 }
 
+void ExecutorImpl::InitializeStaticMemoryPlan() {
+  StaticMemoryPlan plan;
+  const std::vector<bool> step_local_outputs = StepLocalOutputs(*graph_);
+  // Constants do not allocate their outputs while running.
+  Status s = PlanStaticMemory(
+      *graph_,
+      [&step_local_outputs](const Node* n) {
+        return !n->IsConstant() && step_local_outputs[n->id()];
+      },
+      &plan);
+  if (!s.ok()) {
+    VLOG(1) << "Not planning memory statically: " << s;
+    return;
+  }
+  if (plan.buffers.empty()) return;
+  StaticMemoryArena* arena = new StaticMemoryArena(
+      plan, params_.device->GetAllocator(AllocatorAttributes()));
+  if (!arena->ok()) {
+    arena->Unref();
+    return;
+  }
+  VLOG(1) << "Planned " << plan.buffers.size() << " outputs in "
+          << plan.total_bytes << " bytes";
+  for (const Node* n : graph_->op_nodes()) {
+    std::unique_ptr<Allocator*[]> allocators(new Allocator*[n->num_outputs()]);
+    bool planned = false;
+    for (int i = 0; i < n->num_outputs(); ++i) {
+      allocators[i] = arena->OutputAllocator(n->id(), i);
+      planned |= allocators[i] != nullptr;
+    }
+    if (!planned) continue;
+    gview_.node(n->id())->planned_output_allocators = allocators.get();
+    planned_output_allocators_.push_back(std::move(allocators));
+  }
+  static_memory_arena_ = arena;
+}
+
+void ExecutorImpl::RecordNodeCost(const NodeItem& item,
+                                  uint64 compute_usecs) const {
+  if (!item.node->IsOp()) return;
+  mutex_lock l(cost_model_mu_);
+  cost_model_.RecordTime(item.node, Microseconds(compute_usecs));
+  cost_model_.RecordCount(item.node, 1);
+}
+
+void ExecutorImpl::FinishProfiledStep() const {
+  mutex_lock l(cost_model_mu_);
+  if (has_cost_estimates_.load(std::memory_order_relaxed) ||
+      ++num_profiled_steps_ < params_.cost_model_steps) {
+    return;
+  }
+  for (const Node* n : graph_->op_nodes()) {
+    NodeItem* item = gview_.node(n->id());
+    // Nodes that never ran (e.g. in an untaken branch) keep relying on
+    // OpKernel::IsExpensive().
+    if (cost_model_.TotalCount(n) > 0) {
+      item->cost_estimate_usecs = static_cast<int32>(std::min<int64>(
+          cost_model_.TimeEstimate(n).value(), kint32max));
+    }
+  }
+  has_cost_estimates_.store(true, std::memory_order_release);
+}
+
 // If a Node has been marked to use a ScopedAllocator x for output i, then
 // sc_attr will contain the subsequence (i, x) at an even offset.  This function
 // extracts and transfers that ScopedAllocator id to alloc_attr.  For now, we
@@ -1244,6 +1419,7 @@ class ExecutorState {
     int64 input_iter = -1;
     bool is_dead = false;
 
+    TaggedNode() {}
     TaggedNode(const Node* t_node, FrameState* in_frame, int64 in_iter,
                bool dead) {
       node = t_node;
@@ -1256,9 +1432,13 @@ class ExecutorState {
   // A drop-in replacement for std::deque<TaggedNode>.  We typically don't
   // have that many nodes in the ready queue, so we just use a vector and
   // don't free up memory from the queue as we consume nodes.
+  //
+  // "worker_id" identifies the work-stealing worker (see Worker below) whose
+  // thread drains the queue, or is kNoWorker.
   class TaggedNodeReadyQueue {
    public:
-    TaggedNodeReadyQueue() : front_index_(0) {}
+    explicit TaggedNodeReadyQueue(int worker_id = kNoWorker)
+        : front_index_(0), worker_id_(worker_id) {}
 
     void push_back(TaggedNode node) { ready_.push_back(node); }
     TaggedNode front() const {
@@ -1282,10 +1462,29 @@ class ExecutorState {
     bool empty() const { return ready_.empty(); }
     const TaggedNode* begin() const { return ready_.begin() + front_index_; }
     const TaggedNode* end() const { return ready_.end(); }
+    int worker_id() const { return worker_id_; }
 
    private:
     gtl::InlinedVector<TaggedNode, 16> ready_;
     int front_index_;
+    const int worker_id_;
+  };
+
+  // Scheduling state of a work-stealing executor, allocated once per step.
+  //
+  // A worker is a closure handed to runner_ that owns one deque of ready
+  // nodes. It pushes the ready successors of the nodes it runs at the front
+  // of its deque and pops them from the front again, so that a node tends to
+  // run on the thread (and core) that produced its inputs. A worker whose
+  // deque is empty steals from the back of the other workers' deques, and
+  // gives up ownership of its deque when there is nothing left to steal.
+  static constexpr int kNoWorker = -1;
+  static constexpr int kWorkerQueueCapacity = 128;
+  struct Worker {
+    Eigen::RunQueue<TaggedNode, kWorkerQueueCapacity> queue;
+    // True iff a closure owns "queue". Only the owner may call
+    // queue.PushFront() and queue.PopFront().
+    std::atomic<bool> active{false};
   };
 
   struct AsyncState;
@@ -1313,6 +1512,33 @@ class ExecutorState {
   Executor::Args::Runner runner_;
   bool sync_on_finish_;
 
+  // True iff the steps before this one have produced cost estimates for the
+  // nodes, which then drive ScheduleReady().
+  const bool use_cost_estimates_;
+
+  // True iff this step times its nodes for the executor's cost model. Never
+  // set with work stealing, whose dispatch does not use the estimates.
+  const bool profile_costs_;
+
+  // Serves the buffers of nodes with NodeItem::use_step_allocator set, or
+  // null if there are no such nodes. Released in Finish().
+  StepArenaAllocator* step_allocator_ = nullptr;
+
+  // True iff this step serves planned outputs from the executor's
+  // StaticMemoryArena. Only one step at a time does.
+  bool use_static_memory_ = false;
+
+  // Work-stealing state; workers_ is null unless impl_->work_stealing_.
+  int num_workers_ = 0;
+  std::unique_ptr<Worker[]> workers_;
+  // The number of workers that own their deque.
+  std::atomic<int32> num_active_workers_;
+  // Round-robin choice of deque for nodes made ready outside of a worker.
+  std::atomic<uint32> next_worker_;
+  // One reference held until the last node completes, plus one per active
+  // worker. The step is finished when the count drops to zero.
+  std::atomic<int32> finish_refs_;
+
   // Owned.
 
   // A flag that is set on error after the frame state has been
@@ -1356,8 +1582,17 @@ class ExecutorState {
   void CleanupFramesIterations(FrameState* frame, int64 iter,
                                TaggedNodeSeq* ready);
 
-  // Process a ready node in current thread.
-  void Process(TaggedNode node, int64 scheduled_usec);
+  // Process a ready node in current thread. When "worker_id" is not
+  // kNoWorker, the calling thread owns workers_[worker_id] and keeps running
+  // nodes from its deque (or stolen from other deques) after "node".
+  void Process(TaggedNode node, int64 scheduled_usec,
+               int worker_id = kNoWorker);
+
+  // Processes the "num_nodes" ready nodes at "nodes" in the current thread,
+  // in order, through one ready queue: the nodes they make ready run after
+  // them rather than before the next one.
+  void ProcessNodes(const TaggedNode* nodes, size_t num_nodes,
+                    int64 scheduled_usec, int worker_id);
 
   // Before invoking item->kernel, fills in its "inputs".
   Status PrepareInputs(const NodeItem& item, Entry* first_input,
@@ -1387,6 +1622,51 @@ class ExecutorState {
   void ScheduleReady(const TaggedNodeSeq& ready,
                      TaggedNodeReadyQueue* inline_ready);
 
+  // Returns true if "item" is worth running on a thread of its own.
+  bool IsExpensive(const NodeItem& item) const {
+    if (use_cost_estimates_ && item.cost_estimate_usecs >= 0) {
+      return item.cost_estimate_usecs >= kInlineCostThresholdUsecs;
+    }
+    return item.kernel_is_expensive;
+  }
+
+  // The counterpart of ScheduleReady() once cost estimates are available.
+  // Cheap nodes run inline or, when that is not possible, share a closure
+  // with other cheap nodes; expensive nodes are dispatched in decreasing
+  // order of estimated cost.
+  void ScheduleReadyByCost(const TaggedNodeSeq& ready,
+                           TaggedNodeReadyQueue* inline_ready,
+                           int64 scheduled_usec);
+
+  // The work-stealing counterpart of ScheduleReady(). Nodes made ready by a
+  // worker go to its deque, except the first one, which goes to
+  // 'inline_ready' if it is empty. Other nodes are spread over the deques.
+  void ScheduleReadyToWorkers(const TaggedNodeSeq& ready,
+                              TaggedNodeReadyQueue* inline_ready,
+                              int64 scheduled_usec);
+
+  // Pushes "tagged_node" to the back of some worker's deque, and makes sure
+  // that the deque has an owner, or that an idle worker can steal the node
+  // from a busy owner. Falls back to runner_ if the deque is full.
+  void PushToWorker(const TaggedNode& tagged_node, int64 scheduled_usec);
+
+  // Hands an idle deque, if any, to a new worker closure so that it can
+  // steal the surplus nodes of the calling worker.
+  void MaybeStartWorker(int64 scheduled_usec);
+
+  // Takes ownership of workers_[worker_id] if it has no owner, and if so
+  // runs a worker on it through runner_. Returns false if the deque already
+  // had an owner.
+  bool StartWorker(int worker_id, int64 scheduled_usec);
+
+  // The body of a worker closure that owns workers_[worker_id].
+  void RunWorker(int worker_id, int64 scheduled_usec);
+
+  // Pops a node from the front of the calling worker's deque, or steals one
+  // from the back of another worker's deque. Returns false if all deques
+  // are empty.
+  bool PopOrSteal(int worker_id, TaggedNode* tagged_node);
+
   // For debugging/logging only.
   inline void MaybeMarkCompleted(FrameState* frame, int64 iter, int64 id);
 
@@ -1416,6 +1696,9 @@ class ExecutorState {
   }
 };
 
+constexpr int ExecutorState::kNoWorker;
+constexpr int ExecutorState::kWorkerQueueCapacity;
+
 ExecutorState::ExecutorState(const Executor::Args& args, ExecutorImpl* impl)
     : vlog_(VLOG_IS_ON(1)),
       log_memory_(LogMemory::IsEnabled()),
@@ -1432,7 +1715,27 @@ ExecutorState::ExecutorState(const Executor::Args& args, ExecutorImpl* impl)
       cancellation_manager_(args.cancellation_manager),
       runner_(args.runner),
       sync_on_finish_(args.sync_on_finish),
+      use_cost_estimates_(
+          impl->has_cost_estimates_.load(std::memory_order_acquire)),
+      profile_costs_(!impl->work_stealing_ && !use_cost_estimates_ &&
+                     impl->params_.cost_model_steps > 0),
+      num_active_workers_(0),
+      next_worker_(0),
+      finish_refs_(1),
       num_outstanding_ops_(0) {
+  if (impl_->work_stealing_) {
+    num_workers_ = args.runner_parallelism > 0 ? args.runner_parallelism
+                                               : port::NumSchedulableCPUs();
+    workers_.reset(new Worker[num_workers_]);
+  }
+  if (impl_->use_step_allocator_) {
+    step_allocator_ = new StepArenaAllocator(
+        impl_->params_.device->GetAllocator(AllocatorAttributes()),
+        impl_->params_.step_arena_bytes);
+  }
+  if (impl_->static_memory_arena_ != nullptr) {
+    use_static_memory_ = impl_->static_memory_arena_->TryBeginStep();
+  }
   // We start the entire execution in iteration 0 of the root frame
   // so let us create the root frame and the state for iteration 0.
   // We assume root_frame_->frame_name.empty().
@@ -1456,6 +1759,10 @@ ExecutorState::~ExecutorState() {
     it->Unref();
   }
   delete slice_reader_cache_;
+  // The frames held the last planned buffers of this step.
+  if (use_static_memory_) {
+    impl_->static_memory_arena_->EndStep();
+  }
 }
 
 Status ExecutorImpl::BuildControlFlowInfo(const Graph* g,
@@ -1615,10 +1922,17 @@ struct ExecutorState::AsyncState {
   }
 };
 
-void ExecutorState::Process(TaggedNode tagged_node, int64 scheduled_usec) {
+void ExecutorState::Process(TaggedNode tagged_node, int64 scheduled_usec,
+                            int worker_id) {
+  ProcessNodes(&tagged_node, 1, scheduled_usec, worker_id);
+}
+
+void ExecutorState::ProcessNodes(const TaggedNode* nodes, size_t num_nodes,
+                                 int64 scheduled_usec, int worker_id) {
   const GraphView& gview = impl_->gview_;
+  TaggedNode tagged_node;
   TaggedNodeSeq ready;
-  TaggedNodeReadyQueue inline_ready;
+  TaggedNodeReadyQueue inline_ready(worker_id);
 
   // Parameters passed to OpKernel::Compute.
   TensorValueVec inputs;
@@ -1651,10 +1965,15 @@ void ExecutorState::Process(TaggedNode tagged_node, int64 scheduled_usec) {
   NodeExecStatsWrapper* stats = nullptr;
   EntryVector outputs;
   bool completed = false;
-  inline_ready.push_back(tagged_node);
-  while (!inline_ready.empty()) {
-    tagged_node = inline_ready.front();
-    inline_ready.pop_front();
+  for (size_t i = 0; i < num_nodes; ++i) {
+    inline_ready.push_back(nodes[i]);
+  }
+  while (!inline_ready.empty() ||
+         (worker_id != kNoWorker && PopOrSteal(worker_id, &tagged_node))) {
+    if (!inline_ready.empty()) {
+      tagged_node = inline_ready.front();
+      inline_ready.pop_front();
+    }
     const Node* node = tagged_node.node;
     FrameState* input_frame = tagged_node.input_frame;
     const int64 input_iter = tagged_node.input_iter;
@@ -1672,6 +1991,9 @@ void ExecutorState::Process(TaggedNode tagged_node, int64 scheduled_usec) {
     if (id < device_context_map_.size()) {
       params.op_device_context = device_context_map_[id];
     }
+    params.output_allocators =
+        use_static_memory_ ? item.planned_output_allocators : nullptr;
+    params.step_allocator = item.use_step_allocator ? step_allocator_ : nullptr;
 
     params.track_allocations = false;
     stats = nullptr;
@@ -1786,7 +2108,13 @@ void ExecutorState::Process(TaggedNode tagged_node, int64 scheduled_usec) {
         // Synchronous computes.
         OpKernelContext ctx(&params, item.num_outputs);
         nodestats::SetOpStart(stats);
+        const uint64 compute_start_usecs =
+            profile_costs_ ? Env::Default()->NowMicros() : 0;
         device->Compute(CHECK_NOTNULL(op_kernel), &ctx);
+        if (profile_costs_) {
+          impl_->RecordNodeCost(
+              item, Env::Default()->NowMicros() - compute_start_usecs);
+        }
         nodestats::SetOpEnd(stats);
         s = ProcessOutputs(item, &ctx, &outputs, stats);
         if (s.ok() && impl_->device_record_tensor_accesses_) {
@@ -2202,6 +2530,14 @@ void ExecutorState::ScheduleReady(const TaggedNodeSeq& ready,
   if (stats_collector_) {
     scheduled_usec = nodestats::NowInUsec();
   }
+  if (workers_ != nullptr) {
+    ScheduleReadyToWorkers(ready, inline_ready, scheduled_usec);
+    return;
+  }
+  if (use_cost_estimates_) {
+    ScheduleReadyByCost(ready, inline_ready, scheduled_usec);
+    return;
+  }
   if (inline_ready == nullptr) {
     // Schedule to run all the ready ops in thread pool.
     for (auto& tagged_node : ready) {
@@ -2221,7 +2557,7 @@ void ExecutorState::ScheduleReady(const TaggedNodeSeq& ready,
         // Dispatch to another thread since there is plenty of work to
         // do for this thread.
         runner_(std::bind(&ExecutorState::Process, this, *curr_expensive_node,
-                          scheduled_usec));
+                          scheduled_usec, kNoWorker));
       }
       curr_expensive_node = &tagged_node;
     }
@@ -2234,11 +2570,181 @@ void ExecutorState::ScheduleReady(const TaggedNodeSeq& ready,
       // There are inline nodes to run already. We dispatch this expensive
       // node to other thread.
       runner_(std::bind(&ExecutorState::Process, this, *curr_expensive_node,
-                        scheduled_usec));
+                        scheduled_usec, kNoWorker));
     }
   }
 }
 
+void ExecutorState::ScheduleReadyByCost(const TaggedNodeSeq& ready,
+                                        TaggedNodeReadyQueue* inline_ready,
+                                        int64 scheduled_usec) {
+  const GraphView& gview = impl_->gview_;
+  TaggedNodeSeq expensive;
+  TaggedNodeSeq batch;
+  int64 batch_cost_usecs = 0;
+  auto dispatch_batch = [this, &batch, &batch_cost_usecs, scheduled_usec]() {
+    // The whole batch runs before the nodes it makes ready, so that a long
+    // inline chain started by one node does not hold up the others.
+    runner_([this, batch, scheduled_usec]() {
+      ProcessNodes(batch.data(), batch.size(), scheduled_usec, kNoWorker);
+    });
+    batch.clear();
+    batch_cost_usecs = 0;
+  };
+  for (auto& tagged_node : ready) {
+    const NodeItem& item = *gview.node(tagged_node.node->id());
+    if (!tagged_node.is_dead && IsExpensive(item)) {
+      expensive.push_back(tagged_node);
+    } else if (inline_ready != nullptr) {
+      inline_ready->push_back(tagged_node);
+    } else {
+      batch.push_back(tagged_node);
+      batch_cost_usecs += std::max(item.cost_estimate_usecs, 0);
+      if (batch_cost_usecs >= kInlineCostThresholdUsecs) dispatch_batch();
+    }
+  }
+  if (!batch.empty()) dispatch_batch();
+  if (expensive.empty()) return;
+
+  // Start the longest nodes first. If there is nothing else to run inline,
+  // the cheapest of the expensive nodes runs on this thread.
+  std::sort(expensive.begin(), expensive.end(),
+            [&gview](const TaggedNode& a, const TaggedNode& b) {
+              return gview.node(a.node->id())->cost_estimate_usecs >
+                     gview.node(b.node->id())->cost_estimate_usecs;
+            });
+  size_t num_to_dispatch = expensive.size();
+  if (inline_ready != nullptr && inline_ready->empty()) {
+    inline_ready->push_back(expensive.back());
+    --num_to_dispatch;
+  }
+  for (size_t i = 0; i < num_to_dispatch; ++i) {
+    runner_(std::bind(&ExecutorState::Process, this, expensive[i],
+                      scheduled_usec, kNoWorker));
+  }
+}
+
+void ExecutorState::ScheduleReadyToWorkers(const TaggedNodeSeq& ready,
+                                           TaggedNodeReadyQueue* inline_ready,
+                                           int64 scheduled_usec) {
+  const int worker_id =
+      (inline_ready == nullptr) ? kNoWorker : inline_ready->worker_id();
+  size_t first = 0;
+  if (inline_ready != nullptr && inline_ready->empty()) {
+    // Tail recursion optimization: the first ready node runs next on this
+    // thread regardless of whether it owns a deque.
+    inline_ready->push_back(ready[0]);
+    first = 1;
+  }
+  if (first == ready.size()) return;
+  if (worker_id == kNoWorker) {
+    // Without a node left to run inline, the step could finish as soon as
+    // the last node is pushed, so a reference keeps it alive until then.
+    const bool hold_step = inline_ready == nullptr;
+    if (hold_step) finish_refs_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = first; i < ready.size(); ++i) {
+      if (inline_ready != nullptr && ready[i].is_dead) {
+        // Dead nodes only propagate deadness, which is too little work to be
+        // worth a trip through another thread.
+        inline_ready->push_back(ready[i]);
+      } else {
+        PushToWorker(ready[i], scheduled_usec);
+      }
+    }
+    if (hold_step) Finish();
+    return;
+  }
+  // Push the remaining nodes to the front of our deque in reverse order, so
+  // that we pop them in the order they became ready. Nodes that do not fit in
+  // the deque stay in 'inline_ready', which other workers cannot steal from.
+  Worker* worker = &workers_[worker_id];
+  for (size_t i = ready.size(); i > first; --i) {
+    if (worker->queue.PushFront(ready[i - 1]).node != nullptr) {
+      inline_ready->push_back(ready[i - 1]);
+    }
+  }
+  MaybeStartWorker(scheduled_usec);
+}
+
+void ExecutorState::PushToWorker(const TaggedNode& tagged_node,
+                                 int64 scheduled_usec) {
+  const int worker_id =
+      next_worker_.fetch_add(1, std::memory_order_relaxed) % num_workers_;
+  if (workers_[worker_id].queue.PushBack(tagged_node).node != nullptr) {
+    // The deque is full: all workers have plenty of work already.
+    runner_([=]() { Process(tagged_node, scheduled_usec); });
+    return;
+  }
+  // Pairs with the fence in RunWorker(): either the worker that is giving up
+  // this deque sees our node, or we see that the deque has no owner.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!StartWorker(worker_id, scheduled_usec)) {
+    // The owner may be busy with a long inline chain, so an idle worker
+    // steals the node instead of letting it wait for the owner.
+    MaybeStartWorker(scheduled_usec);
+  }
+}
+
+void ExecutorState::MaybeStartWorker(int64 scheduled_usec) {
+  if (num_active_workers_.load(std::memory_order_relaxed) >= num_workers_) {
+    return;
+  }
+  for (int i = 0; i < num_workers_; ++i) {
+    if (!workers_[i].active.load(std::memory_order_relaxed)) {
+      StartWorker(i, scheduled_usec);
+      return;
+    }
+  }
+}
+
+bool ExecutorState::StartWorker(int worker_id, int64 scheduled_usec) {
+  Worker* worker = &workers_[worker_id];
+  if (worker->active.load(std::memory_order_relaxed) ||
+      worker->active.exchange(true)) {
+    return false;
+  }
+  // The caller is running a node of this step, so the step cannot finish
+  // before the reference is taken.
+  finish_refs_.fetch_add(1, std::memory_order_relaxed);
+  num_active_workers_.fetch_add(1, std::memory_order_relaxed);
+  runner_([this, worker_id, scheduled_usec]() {
+    RunWorker(worker_id, scheduled_usec);
+  });
+  return true;
+}
+
+void ExecutorState::RunWorker(int worker_id, int64 scheduled_usec) {
+  Worker* worker = &workers_[worker_id];
+  while (true) {
+    TaggedNode tagged_node;
+    if (PopOrSteal(worker_id, &tagged_node)) {
+      // Process() keeps draining and stealing until no ready node is left.
+      Process(tagged_node, scheduled_usec, worker_id);
+    }
+    num_active_workers_.fetch_sub(1, std::memory_order_relaxed);
+    worker->active.store(false);
+    // Pairs with the fence in PushToWorker(); another thread may have pushed
+    // to our deque while we were about to give it up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (worker->queue.Empty() || worker->active.exchange(true)) break;
+    num_active_workers_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // Drops this worker's reference on the step.
+  Finish();
+}
+
+bool ExecutorState::PopOrSteal(int worker_id, TaggedNode* tagged_node) {
+  *tagged_node = workers_[worker_id].queue.PopFront();
+  if (tagged_node->node != nullptr) return true;
+  for (int i = 1; i < num_workers_; ++i) {
+    Worker* victim = &workers_[(worker_id + i) % num_workers_];
+    if (victim->queue.Empty()) continue;
+    *tagged_node = victim->queue.PopBack();
+    if (tagged_node->node != nullptr) return true;
+  }
+  return false;
+}
+
 inline void ExecutorState::MaybeMarkCompleted(FrameState* frame, int64 iter,
                                               int64 node_id) {
   // TODO(misard) Replace with a finer-grain enabling flag once we
@@ -2371,6 +2877,14 @@ void ExecutorState::DumpState() {
 }
 
 void ExecutorState::Finish() {
+  if (workers_ != nullptr && finish_refs_.fetch_sub(1) != 1) {
+    // Some worker still references this state; the last one to go away
+    // finishes the step.
+    return;
+  }
+  if (profile_costs_) {
+    impl_->FinishProfiledStep();
+  }
   mu_.lock();
   auto status = status_;
   auto done_cb = std::move(done_cb_);
@@ -2383,6 +2897,11 @@ void ExecutorState::Finish() {
     // the user until the step (and its side-effects) has actually completed.
     status = impl_->params_.device->Sync();
   }
+  if (step_allocator_ != nullptr) {
+    // Buffers that are still referenced, e.g. outputs of the step, keep the
+    // arena alive until they are deallocated.
+    step_allocator_->Release();
+  }
   delete this;
   CHECK(done_cb != nullptr);
   runner([=]() { done_cb(status); });
@@ -2733,6 +3252,20 @@ Status NewLocalExecutor(const LocalExecutorParams& params,
   return s;
 }
 
+Status NewWorkStealingExecutor(const LocalExecutorParams& params,
+                               std::unique_ptr<const Graph> graph,
+                               Executor** executor) {
+  ExecutorImpl* impl =
+      new ExecutorImpl(params, std::move(graph), true /* work_stealing */);
+  const Status s = impl->Initialize();
+  if (s.ok()) {
+    *executor = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
 Status CreateNonCachedKernel(Device* device, FunctionLibraryRuntime* flib,
                              const NodeDef& ndef, int graph_def_version,
                              OpKernel** kernel) {
@@ -2768,6 +3301,27 @@ class DefaultExecutorRegistrar {
 };
 static DefaultExecutorRegistrar registrar;
 
+class WorkStealingExecutorRegistrar {
+ public:
+  WorkStealingExecutorRegistrar() {
+    ExecutorFactory::Register("WORK_STEALING", new Factory);
+  }
+
+ private:
+  class Factory : public ExecutorFactory {
+    Status NewExecutor(const LocalExecutorParams& params,
+                       std::unique_ptr<const Graph> graph,
+                       std::unique_ptr<Executor>* out_executor) override {
+      Executor* ret = nullptr;
+      TF_RETURN_IF_ERROR(
+          NewWorkStealingExecutor(params, std::move(graph), &ret));
+      out_executor->reset(ret);
+      return Status::OK();
+    }
+  };
+};
+static WorkStealingExecutorRegistrar work_stealing_registrar;
+
 }  // namespace
 
 }  // namespace tensorflow
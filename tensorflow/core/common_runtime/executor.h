@@ -98,6 +98,11 @@ class Executor {
     typedef std::function<void(Closure)> Runner;
     Runner runner = nullptr;
 
+    // The number of closures "runner" can execute concurrently, or 0 if
+    // unknown. Executors that keep per-thread scheduling state (e.g.
+    // "WORK_STEALING") use it to size that state.
+    int32 runner_parallelism = 0;
+
     // A callback that is invoked each time a node has finished executing.
     typedef std::function<Status(const string& node_name, const int output_slot,
                                  const Tensor* tensor, const bool is_ref,
@@ -138,11 +143,43 @@ struct LocalExecutorParams {
   // when the executor is deleted.
   std::function<Status(const NodeDef&, OpKernel**)> create_kernel;
   std::function<void(OpKernel*)> delete_kernel;
+
+  // If > 0, the executor times the compute of every synchronous node during
+  // its first "cost_model_steps" steps and records it in a CostModel. Later
+  // steps use these estimates instead of OpKernel::IsExpensive() to decide
+  // which ready nodes run inline, to group cheap nodes into one closure, and
+  // to dispatch expensive nodes in decreasing order of cost. Ignored by the
+  // WORK_STEALING executor, whose workers do not use the estimates.
+  int cost_model_steps = 0;
+
+  // If > 0 and the device is a CPU, each step allocates the outputs and
+  // temporaries of nodes whose outputs only reach stateless nodes, directly
+  // or through other nodes, from a StepArenaAllocator. The arena obtains up
+  // to "step_arena_bytes" bytes of blocks from the device allocator, and
+  // returns them all at once after the step.
+  int64 step_arena_bytes = 0;
+
+  // If true and the device is a CPU, the executor plans the outputs of
+  // nodes whose outputs are only consumed by stateless nodes, and whose
+  // shapes are known before the graph runs, into one slab allocated up
+  // front (see PlanStaticMemory()). Other allocations stay dynamic, as do
+  // all allocations of a step that runs while another one uses the slab.
+  bool static_memory_planning = false;
 };
 ::tensorflow::Status NewLocalExecutor(const LocalExecutorParams& params,
                                       std::unique_ptr<const Graph> graph,
                                       Executor** executor);
 
+// Like NewLocalExecutor(), but the returned executor keeps ready nodes in
+// per-worker deques instead of handing every non-inlined node to
+// Args::runner. A worker pushes the ready successors of the nodes it runs
+// onto its own deque, so they tend to run on the core that produced their
+// inputs, and idle workers steal from the other workers' deques. This
+// executor is also registered with ExecutorFactory as "WORK_STEALING".
+::tensorflow::Status NewWorkStealingExecutor(const LocalExecutorParams& params,
+                                             std::unique_ptr<const Graph> graph,
+                                             Executor** executor);
+
 // A class to help run multiple executors in parallel and wait until
 // all of them are complete.
 //
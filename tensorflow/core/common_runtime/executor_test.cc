@@ -18,15 +18,18 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/device.h"
 #include "tensorflow/core/common_runtime/device_factory.h"
 #include "tensorflow/core/common_runtime/executor.h"
+#include "tensorflow/core/common_runtime/executor_factory.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/rendezvous.h"
 #include "tensorflow/core/framework/step_stats.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/graph/graph_constructor.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/monitoring/collection_registry.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/logging.h"
@@ -57,7 +60,8 @@ class ExecutorTest : public ::testing::Test {
   }
 
   // Resets executor_ with a new executor based on a graph 'gdef'.
-  void Create(std::unique_ptr<const Graph> graph) {
+  void Create(std::unique_ptr<const Graph> graph,
+              const string& executor_type = "") {
     const int version = graph->versions().producer();
     LocalExecutorParams params;
     params.device = device_;
@@ -68,8 +72,13 @@ class ExecutorTest : public ::testing::Test {
     params.delete_kernel = [](OpKernel* kernel) {
       DeleteNonCachedKernel(kernel);
     };
+    params.cost_model_steps = cost_model_steps_;
+    params.step_arena_bytes = step_arena_bytes_;
+    params.static_memory_planning = static_memory_planning_;
     delete exec_;
-    TF_CHECK_OK(NewLocalExecutor(params, std::move(graph), &exec_));
+    std::unique_ptr<Executor> exec;
+    TF_CHECK_OK(NewExecutor(executor_type, params, std::move(graph), &exec));
+    exec_ = exec.release();
     runner_ = [this](std::function<void()> fn) { thread_pool_->Schedule(fn); };
     rendez_ = NewLocalRendezvous();
   }
@@ -79,10 +88,14 @@ class ExecutorTest : public ::testing::Test {
     args.rendezvous = rendez;
     args.stats_collector = &step_stats_collector_;
     args.runner = runner_;
+    args.runner_parallelism = thread_pool_->NumThreads();
     return exec_->Run(args);
   }
 
   thread::ThreadPool* thread_pool_ = nullptr;
+  int cost_model_steps_ = 0;
+  int64 step_arena_bytes_ = 0;
+  bool static_memory_planning_ = false;
   Device* device_ = nullptr;
   Executor* exec_ = nullptr;
   StepStatsCollector step_stats_collector_;
@@ -243,6 +256,199 @@ TEST_F(ExecutorTest, RandomTree) {
   EXPECT_EQ(4096.0, V(out));
 }
 
+TEST_F(ExecutorTest, RandomTreeCostModel) {
+  // The first two steps measure node costs; the remaining ones schedule
+  // nodes based on them.
+  cost_model_steps_ = 2;
+  std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
+  BuildTree(4096, g.get());
+  Create(std::move(g));
+  for (int iters = 0; iters < 8; ++iters) {
+    Rendezvous::Args args;
+    TF_ASSERT_OK(rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), args,
+                               V(1.0), false));
+    TF_ASSERT_OK(Run(rendez_));
+    Tensor out = V(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out,
+                               &is_dead));
+    EXPECT_EQ(4096.0, V(out));
+  }
+}
+
+TEST_F(ExecutorTest, CostModelRunsReadyNodesBeforeTheirSuccessors) {
+  // "a" feeds a chain of cheap Identity nodes and three cheap Identity
+  // leaves. They all become ready when the asynchronous Recv completes, so
+  // they are dispatched as one batch, which must run the leaves before the
+  // rest of the chain.
+  cost_model_steps_ = 1;
+  std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
+  auto in = test::graph::Recv(g.get(), "a", "float", ALICE, 1, BOB);
+  std::vector<string> chain;
+  Node* v = in;
+  for (int i = 0; i < 20; ++i) {
+    v = test::graph::Identity(g.get(), v, 0);
+    chain.push_back(v->name());
+  }
+  test::graph::Send(g.get(), v, "b", BOB, 1, ALICE);
+  std::vector<string> leaves;
+  for (int i = 0; i < 3; ++i) {
+    leaves.push_back(test::graph::Identity(g.get(), in, 0)->name());
+  }
+  Create(std::move(g));
+  // One thread runs the closures in the order they are scheduled, so that
+  // the order in which the nodes complete is that of the executor.
+  thread::ThreadPool one_thread(Env::Default(), "one_thread", 1);
+  runner_ = [&one_thread](std::function<void()> fn) {
+    one_thread.Schedule(std::move(fn));
+  };
+
+  for (int iters = 0; iters < 3; ++iters) {
+    Rendezvous::Args args;
+    TF_ASSERT_OK(rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), args,
+                               V(1.0), false));
+    StepStats step_stats;
+    StepStatsCollector collector(&step_stats);
+    Executor::Args exec_args;
+    exec_args.rendezvous = rendez_;
+    exec_args.stats_collector = &collector;
+    exec_args.runner = runner_;
+    TF_ASSERT_OK(exec_->Run(exec_args));
+    Tensor out = V(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out,
+                               &is_dead));
+    EXPECT_EQ(1.0, V(out));
+    if (iters < cost_model_steps_) continue;
+
+    collector.Finalize();
+    ASSERT_EQ(1, step_stats.dev_stats_size());
+    std::vector<string> order;
+    for (const NodeExecStats& node_stats :
+         step_stats.dev_stats(0).node_stats()) {
+      order.push_back(node_stats.node_name());
+    }
+    auto position = [&order](const string& name) {
+      return std::find(order.begin(), order.end(), name) - order.begin();
+    };
+    for (const string& leaf : leaves) {
+      EXPECT_LT(position(leaf), position(chain[1])) << leaf;
+    }
+  }
+}
+
+TEST_F(ExecutorTest, RandomTreeStepArena) {
+  // The intermediate sums come from a per-step arena; the output escapes
+  // the step through the rendezvous.
+  step_arena_bytes_ = 1 << 20;
+  std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
+  BuildTree(4096, g.get());
+  Create(std::move(g));
+  for (int iters = 0; iters < 4; ++iters) {
+    Rendezvous::Args args;
+    TF_ASSERT_OK(rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), args,
+                               V(1.0), false));
+    TF_ASSERT_OK(Run(rendez_));
+    Tensor out = V(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out,
+                               &is_dead));
+    EXPECT_EQ(4096.0, V(out));
+  }
+}
+
+TEST_F(ExecutorTest, StepArenaForwardedOutputs) {
+  // The sum reaches the rendezvous through two Identity nodes, so it must
+  // not come from the step arena, which the next step reuses.
+  step_arena_bytes_ = 1 << 20;
+  std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
+  auto in = test::graph::Recv(g.get(), "a", "float", ALICE, 1, BOB);
+  auto sum = test::graph::Add(g.get(), in, in);
+  auto id = test::graph::Identity(g.get(), test::graph::Identity(g.get(), sum));
+  test::graph::Send(g.get(), id, "b", BOB, 1, ALICE);
+  Create(std::move(g));
+  std::vector<Tensor> outs;
+  for (int iters = 0; iters < 4; ++iters) {
+    Rendezvous::Args args;
+    TF_ASSERT_OK(rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), args,
+                               V(iters), false));
+    TF_ASSERT_OK(Run(rendez_));
+    Tensor out = V(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out,
+                               &is_dead));
+    outs.push_back(out);
+  }
+  for (int iters = 0; iters < 4; ++iters) {
+    EXPECT_EQ(2.0 * iters, V(outs[iters]));
+  }
+}
+
+// Returns how many outputs have been served from static memory slabs so far.
+int64 NumPlannedAllocations() {
+  const std::unique_ptr<monitoring::CollectedMetrics> metrics =
+      monitoring::CollectionRegistry::Default()->CollectMetrics({});
+  const auto it = metrics->point_set_map.find(
+      "/tensorflow/core/static_memory_plan_allocations");
+  if (it == metrics->point_set_map.end()) return 0;
+  for (const auto& point : it->second->points) {
+    if (point->labels[0].value == "planned") return point->int64_value;
+  }
+  return 0;
+}
+
+TEST_F(ExecutorTest, StaticMemoryPlan) {
+  // The shapes of all the sums are known. The sums sent to Bob may escape
+  // the step, so they are allocated dynamically, but the sums of the side
+  // chain, which only runs before the send, are served from the slab of the
+  // static memory plan.
+  static_memory_planning_ = true;
+  std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
+  Tensor ones(DT_FLOAT, TensorShape({16}));
+  ones.flat<float>().setConstant(1.0f);
+  auto one = test::graph::Constant(g.get(), ones);
+  auto sum = one;
+  auto side = one;
+  for (int i = 0; i < 100; ++i) {
+    sum = test::graph::Add(g.get(), sum, one);
+    side = test::graph::Add(g.get(), side, one);
+  }
+  auto send = test::graph::Send(g.get(), sum, "b", BOB, 1, ALICE);
+  g->AddControlEdge(side, send);
+  Create(std::move(g));
+  const int64 num_planned_allocations = NumPlannedAllocations();
+  for (int iters = 0; iters < 4; ++iters) {
+    TF_ASSERT_OK(Run(rendez_));
+    Rendezvous::Args args;
+    Tensor out;
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out,
+                               &is_dead));
+    test::ExpectTensorEqual<float>(
+        test::AsTensor<float>(std::vector<float>(16, 101.0f)), out);
+  }
+  // The first Add of the side chain cannot forward the constant it adds, so
+  // it takes its output from the slab in every step.
+  EXPECT_GE(NumPlannedAllocations() - num_planned_allocations, 4);
+}
+
+TEST_F(ExecutorTest, RandomTreeWorkStealing) {
+  std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
+  BuildTree(4096, g.get());
+  Create(std::move(g), "WORK_STEALING");
+  for (int iters = 0; iters < 16; ++iters) {
+    Rendezvous::Args args;
+    TF_ASSERT_OK(rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), args,
+                               V(1.0), false));
+    TF_ASSERT_OK(Run(rendez_));
+    Tensor out = V(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out,
+                               &is_dead));
+    EXPECT_EQ(4096.0, V(out));
+  }
+}
+
 void BuildConcurrentAddAssign(Graph* g) {
   auto one = test::graph::Constant(g, V(1.0));
   // A variable holds one float.
@@ -278,6 +484,23 @@ TEST_F(ExecutorTest, ConcurrentAddAssign) {
     rendez->Unref();
   }
 }
+
+TEST_F(ExecutorTest, ConcurrentAddAssignWorkStealing) {
+  std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
+  BuildConcurrentAddAssign(g.get());
+  Create(std::move(g), "WORK_STEALING");
+  for (int iters = 0; iters < 16; ++iters) {
+    Rendezvous* rendez = NewLocalRendezvous();
+    TF_ASSERT_OK(Run(rendez));
+    Rendezvous::Args args;
+    Tensor out;
+    bool is_dead;
+    TF_ASSERT_OK(rendez->Recv(Key(ALICE, kIncarnation, BOB, "out"), args, &out,
+                              &is_dead));
+    EXPECT_LE(V(out), 1025.0);
+    rendez->Unref();
+  }
+}
 #endif
 
 TEST_F(ExecutorTest, SimpleSwitchLive) {
@@ -370,6 +593,21 @@ TEST_F(ExecutorTest, Abort) {
     ;
 }
 
+TEST_F(ExecutorTest, RecvInvalidDtypeWorkStealing) {
+  std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
+  auto one = test::graph::Recv(g.get(), "one", "float", ALICE, 1, BOB);
+  auto var = test::graph::Var(g.get(), DT_FLOAT, TensorShape({1}));
+  auto init = test::graph::Assign(g.get(), var, one);
+  auto* two = test::graph::Send(g.get(), var, "two", BOB, 1, ALICE);
+  g->AddControlEdge(init, two);
+  Create(std::move(g), "WORK_STEALING");
+  Rendezvous* rendez = NewLocalRendezvous();
+  TF_ASSERT_OK(rendez->Send(Key(ALICE, 1, BOB, "one"), Rendezvous::Args(),
+                            VD(1.0), false));
+  EXPECT_TRUE(errors::IsInternal(Run(rendez)));
+  rendez->Unref();
+}
+
 TEST_F(ExecutorTest, RecvInvalidDtype) {
   std::unique_ptr<Graph> g(new Graph(OpRegistry::Global()));
   // An input vector of type float of size 1.
@@ -461,6 +699,101 @@ BENCHMARK(BM_executor)->ArgPair(8192, 32);
 // Tall fat graph
 BENCHMARK(BM_executor)->ArgPair(1024, 1024);
 
+// Builds a graph shaped like a small inference model: "width" independent
+// towers, each a chain of "depth" cheap element-wise ops on a small tensor,
+// whose results are summed into a single output.
+static Graph* BuildInferenceGraph(int width, int depth) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor x(DT_FLOAT, TensorShape({64}));
+  x.flat<float>().setRandom();
+  Node* input = test::graph::Constant(g, x);
+  Node* scale = test::graph::Constant(g, V(0.5));
+  std::vector<Node*> towers;
+  for (int i = 0; i < width; ++i) {
+    Node* n = input;
+    for (int j = 0; j < depth; ++j) {
+      switch (j % 3) {
+        case 0:
+          n = test::graph::Binary(g, "Mul", n, scale);
+          break;
+        case 1:
+          n = test::graph::Add(g, n, input);
+          break;
+        default:
+          n = test::graph::Identity(g, n);
+          break;
+      }
+    }
+    towers.push_back(n);
+  }
+  while (towers.size() > 1) {
+    std::vector<Node*> sums;
+    for (size_t i = 0; i + 1 < towers.size(); i += 2) {
+      sums.push_back(test::graph::Add(g, towers[i], towers[i + 1]));
+    }
+    if (towers.size() % 2 == 1) sums.push_back(towers.back());
+    towers.swap(sums);
+  }
+  return g;
+}
+
+// Measures the step latency of BuildInferenceGraph() on an executor of type
+// "executor_type" whose runner is a pool of "num_threads" threads.
+static void RunInferenceGraphBenchmark(int iters, const string& executor_type,
+                                       int num_threads,
+                                       int cost_model_steps = 0) {
+  testing::StopTiming();
+  std::unique_ptr<const Graph> g(BuildInferenceGraph(64, 48));
+#ifdef PLATFORM_GOOGLE
+  SetBenchmarkLabel(strings::StrCat("Nodes = ", g->num_op_nodes()));
+#endif  // PLATFORM_GOOGLE
+  std::unique_ptr<Device> device(DeviceFactory::NewDevice(
+      "CPU", {}, "/job:localhost/replica:0/task:0"));
+  thread::ThreadPool pool(Env::Default(), "inference", num_threads);
+  const int version = g->versions().producer();
+  LocalExecutorParams params;
+  params.device = device.get();
+  params.create_kernel = [&device, version](const NodeDef& ndef,
+                                            OpKernel** kernel) {
+    return CreateNonCachedKernel(device.get(), nullptr, ndef, version, kernel);
+  };
+  params.delete_kernel = [](OpKernel* kernel) {
+    DeleteNonCachedKernel(kernel);
+  };
+  params.cost_model_steps = cost_model_steps;
+  std::unique_ptr<Executor> exec;
+  TF_CHECK_OK(NewExecutor(executor_type, params, std::move(g), &exec));
+
+  Executor::Args args;
+  args.runner = [&pool](std::function<void()> fn) { pool.Schedule(fn); };
+  args.runner_parallelism = num_threads;
+  for (int i = 0; i < 3; ++i) {
+    TF_CHECK_OK(exec->Run(args));
+  }
+  testing::StartTiming();
+  for (int i = 0; i < iters; ++i) {
+    TF_CHECK_OK(exec->Run(args));
+  }
+  testing::StopTiming();
+  exec.reset();
+}
+
+static void BM_InferenceGraph(int iters, int num_threads) {
+  RunInferenceGraphBenchmark(iters, "", num_threads);
+}
+BENCHMARK(BM_InferenceGraph)->Arg(1)->Arg(8)->Arg(32);
+
+static void BM_InferenceGraphWorkStealing(int iters, int num_threads) {
+  RunInferenceGraphBenchmark(iters, "WORK_STEALING", num_threads);
+}
+BENCHMARK(BM_InferenceGraphWorkStealing)->Arg(1)->Arg(8)->Arg(32);
+
+static void BM_InferenceGraphCostModel(int iters, int num_threads) {
+  // The warmup steps of RunInferenceGraphBenchmark() build the cost model.
+  RunInferenceGraphBenchmark(iters, "", num_threads, 2 /* cost_model_steps */);
+}
+BENCHMARK(BM_InferenceGraphCostModel)->Arg(1)->Arg(8)->Arg(32);
+
 static void BM_FeedInputFetchOutput(int iters) {
   Graph* g = new Graph(OpRegistry::Global());
   // z = x + y: x and y are provided as benchmark inputs.  z is the
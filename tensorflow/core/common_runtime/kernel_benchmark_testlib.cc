@@ -93,6 +93,7 @@ Benchmark::Benchmark(const string& device, Graph* g,
     Executor::Args args;
     args.rendezvous = rendez_;
     args.runner = runner;
+    args.runner_parallelism = pool_->NumThreads();
     TF_CHECK_OK(init_exec->Run(args));
   }
 
@@ -154,6 +155,7 @@ void Benchmark::RunWithArgs(
   args.runner = [this](std::function<void()> closure) {
     pool_->Schedule(closure);
   };
+  args.runner_parallelism = pool_->NumThreads();
   static const int kWarmupRuns = 3;
   for (int i = 0; i < kWarmupRuns; ++i) {
     for (const auto& p : in) {
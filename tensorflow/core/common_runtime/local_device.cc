@@ -19,30 +19,63 @@ limitations under the License.
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/common_runtime/eigen_thread_pool.h"
 #include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/byte_order.h"
 #include "tensorflow/core/platform/cpu_feature_guard.h"
 #include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/public/session_options.h"
 
 namespace tensorflow {
 
+namespace {
+
+// Returns the NUMA node the intra-op threads of the device described by
+// "attributes" are bound to, or port::kNUMANoAffinity.
+int IntraOpNumaNode(const SessionOptions& options,
+                    const DeviceAttributes& attributes) {
+  if (!options.config.experimental().use_numa_affinity() ||
+      !port::NUMAEnabled()) {
+    return port::kNUMANoAffinity;
+  }
+  const int numa_node = attributes.locality().numa_node();
+  if (numa_node < 0 || numa_node >= port::NUMANumNodes()) {
+    return port::kNUMANoAffinity;
+  }
+  return numa_node;
+}
+
+}  // namespace
+
 /* static */
 bool LocalDevice::use_global_threadpool_ = true;
 
 struct LocalDevice::EigenThreadPoolInfo {
-  explicit EigenThreadPoolInfo(const SessionOptions& options) {
+  // If "numa_node" is not port::kNUMANoAffinity, the pool gets the share of
+  // the intra-op threads that falls to one NUMA node, bound to that node.
+  EigenThreadPoolInfo(const SessionOptions& options, int numa_node) {
     int32 intra_op_parallelism_threads =
         options.config.intra_op_parallelism_threads();
     if (intra_op_parallelism_threads == 0) {
       intra_op_parallelism_threads = port::NumSchedulableCPUs();
     }
+    ThreadOptions thread_options;
+    string name = "Eigen";
+    if (numa_node != port::kNUMANoAffinity) {
+      intra_op_parallelism_threads = std::max(
+          1, intra_op_parallelism_threads / port::NUMANumNodes());
+      thread_options.numa_node = numa_node;
+      name = strings::StrCat("numa_", numa_node, "_Eigen");
+    }
     VLOG(1) << "Local device intra op parallelism threads: "
-            << intra_op_parallelism_threads;
+            << intra_op_parallelism_threads << " numa_node: " << numa_node;
     eigen_worker_threads_.num_threads = intra_op_parallelism_threads;
-    eigen_worker_threads_.workers = new thread::ThreadPool(
-        options.env, "Eigen", intra_op_parallelism_threads);
+    eigen_worker_threads_.workers =
+        new thread::ThreadPool(options.env, thread_options, name,
+                               intra_op_parallelism_threads);
     eigen_threadpool_wrapper_.reset(
         new EigenThreadPoolWrapper(eigen_worker_threads_.workers));
     eigen_device_.reset(new Eigen::ThreadPoolDevice(
@@ -67,16 +100,33 @@ LocalDevice::LocalDevice(const SessionOptions& options,
   // could speed up performance and are available on the current CPU.
   port::InfoAboutUnusedCPUFeatures();
   LocalDevice::EigenThreadPoolInfo* tp_info;
-  if (use_global_threadpool_) {
+  const int numa_node = IntraOpNumaNode(options, attributes);
+  if (use_global_threadpool_ && numa_node != port::kNUMANoAffinity) {
+    // All ThreadPoolDevices on the same NUMA node will share one fixed
+    // sized threadpool bound to that node.
+    static mutex* numa_tp_info_mu = new mutex;
+    static std::vector<LocalDevice::EigenThreadPoolInfo*>* numa_tp_infos =
+        new std::vector<LocalDevice::EigenThreadPoolInfo*>;
+    mutex_lock l(*numa_tp_info_mu);
+    if (numa_tp_infos->size() <= static_cast<size_t>(numa_node)) {
+      numa_tp_infos->resize(numa_node + 1, nullptr);
+    }
+    if ((*numa_tp_infos)[numa_node] == nullptr) {
+      (*numa_tp_infos)[numa_node] =
+          new LocalDevice::EigenThreadPoolInfo(options, numa_node);
+    }
+    tp_info = (*numa_tp_infos)[numa_node];
+  } else if (use_global_threadpool_) {
     // All ThreadPoolDevices in the process will use this single fixed
     // sized threadpool for numerical computations.
     static LocalDevice::EigenThreadPoolInfo* global_tp_info =
-        new LocalDevice::EigenThreadPoolInfo(options);
+        new LocalDevice::EigenThreadPoolInfo(options, port::kNUMANoAffinity);
     tp_info = global_tp_info;
   } else {
     // Each LocalDevice owns a separate ThreadPoolDevice for numerical
     // computations.
-    owned_tp_info_.reset(new LocalDevice::EigenThreadPoolInfo(options));
+    owned_tp_info_.reset(
+        new LocalDevice::EigenThreadPoolInfo(options, numa_node));
     tp_info = owned_tp_info_.get();
   }
   set_tensorflow_cpu_worker_threads(&tp_info->eigen_worker_threads_);
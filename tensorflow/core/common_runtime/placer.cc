@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <memory>
 #include <set>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -33,6 +34,8 @@ limitations under the License.
 
 namespace tensorflow {
 
+const char* const kNumaNodeHintAttrName = "_numa_node";
+
 namespace {
 
 // We hoist the conversion from C-style string literal to StringPiece here,
@@ -70,6 +73,32 @@ std::vector<Device*> FilterSupportedDevices(
   return filtered_devices;
 }
 
+// Reorders the devices of the preferred type, i.e. of the same type as
+// devices[0], so that the ones attached to the NUMA node selected by
+// 'numa_node_hint' come first. The hint is taken modulo the number of
+// distinct NUMA nodes these devices are attached to, so consecutive hints
+// (e.g. tower or shard indices) are spread over all of them.
+void PreferNumaNode(int64 numa_node_hint, std::vector<Device*>* devices) {
+  if (devices->empty()) return;
+  const string& preferred_type = (*devices)[0]->device_type();
+  auto end = std::find_if(devices->begin(), devices->end(),
+                          [&preferred_type](const Device* d) {
+                            return d->device_type() != preferred_type;
+                          });
+  std::set<int32> numa_nodes;
+  for (auto it = devices->begin(); it != end; ++it) {
+    numa_nodes.insert((*it)->attributes().locality().numa_node());
+  }
+  if (numa_nodes.size() < 2) return;
+  const int64 num_numa_nodes = numa_nodes.size();
+  int64 index = numa_node_hint % num_numa_nodes;
+  if (index < 0) index += num_numa_nodes;
+  const int32 numa_node = *std::next(numa_nodes.begin(), index);
+  std::stable_partition(devices->begin(), end, [numa_node](const Device* d) {
+    return d->attributes().locality().numa_node() == numa_node;
+  });
+}
+
 // This class maintains the connected components of a colocation
 // constraint graph, and uses this information to assign a satisfying
 // device placement to the nodes of the graph.
@@ -796,7 +825,30 @@ Status Placer::Run() {
     }
   }
 
-  // 3. For each node, assign a device based on the constraints in the
+  // 3. Apply NUMA node hints. The hint of a node applies to its whole
+  // colocation group, so the first hint seen for a group wins.
+  std::unordered_set<int> hinted_groups;
+  for (Node* node : graph_->op_nodes()) {
+    const AttrValue* hint = node->attrs().Find(kNumaNodeHintAttrName);
+    if (hint == nullptr || node->has_assigned_device_name()) {
+      continue;
+    }
+    if (hint->value_case() != AttrValue::kI) {
+      return AttachDef(errors::InvalidArgument("Attr ", kNumaNodeHintAttrName,
+                                               " must be an int"),
+                       *node);
+    }
+    if (!hinted_groups.insert(colocation_graph.FindRoot(node->id())).second) {
+      continue;
+    }
+    std::vector<Device*>* devices;
+    // Errors are reported when the node is assigned below.
+    if (colocation_graph.GetDevicesForNode(node, &devices).ok()) {
+      PreferNumaNode(hint->i(), devices);
+    }
+  }
+
+  // 4. For each node, assign a device based on the constraints in the
   // disjoint node set.
   std::vector<Node*> second_pass;
   for (Node* node : graph_->op_nodes()) {
@@ -863,7 +915,7 @@ Status Placer::Run() {
     AssignAndLog(assigned_device, node);
   }
 
-  // 4. Perform a second pass assignment for those nodes explicitly
+  // 5. Perform a second pass assignment for those nodes explicitly
   // skipped during the first pass.
   for (Node* node : second_pass) {
     std::vector<Device*>* devices;
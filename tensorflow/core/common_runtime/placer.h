@@ -29,6 +29,13 @@ limitations under the License.
 
 namespace tensorflow {
 
+// Name of an optional int attr that asks the placer to prefer, for a node
+// and its colocation group, the devices attached to a particular NUMA node
+// (see DeviceLocality::numa_node). Giving independent towers or batch shards
+// consecutive hints spreads them over the NUMA nodes of the available
+// devices; the hint has no effect unless those span several NUMA nodes.
+extern const char* const kNumaNodeHintAttrName;
+
 // A placement algorithm that assigns the nodes of the given Graph to
 // devices the given DeviceSet, respecting the following constraints:
 //
@@ -40,6 +47,9 @@ namespace tensorflow {
 // 4. Given nodes "A" and "B", if node "B" has a colocation group
 //    "@loc:A", nodes "A" and "B" will be colocated on the same device.
 //
+// Among the devices that satisfy these constraints, nodes with a
+// kNumaNodeHintAttrName attr prefer the ones on the hinted NUMA node.
+//
 // The implementation builds a constraint graph with the same set of
 // nodes, and edges that represent colocation constraints between
 // nodes.  Each connected component in the resulting constraint graph
@@ -74,10 +74,12 @@ class FakeDevice : public Device {
 
   Allocator* GetAllocator(AllocatorAttributes attr) override { return nullptr; }
 
-  static std::unique_ptr<Device> MakeCPU(const string& name) {
+  static std::unique_ptr<Device> MakeCPU(const string& name,
+                                         int numa_node = 0) {
     DeviceAttributes device_attributes;
     device_attributes.set_name(name);
     device_attributes.set_device_type(DeviceType("FakeCPU").type());
+    device_attributes.mutable_locality()->set_numa_node(numa_node);
     return std::unique_ptr<Device>(new FakeDevice(device_attributes));
   }
 
@@ -1320,5 +1322,66 @@ TEST_F(PlacerTest, TestGeneratorNodeDoesntFollowNonColocatedConsumers) {
   EXPECT_DEVICE_TYPE(g, "in", "FakeGPU");
 }
 
+// Test that NUMA node hints spread otherwise unconstrained node sets over the
+// NUMA nodes of the CPU devices.
+TEST_F(PlacerTest, TestNumaNodeHint) {
+  // Four CPU devices on two NUMA nodes, interleaved.
+  std::vector<std::unique_ptr<Device>> cpus;
+  DeviceSet numa_devices;
+  for (int i = 0; i < 4; ++i) {
+    cpus.push_back(FakeDevice::MakeCPU(
+        strings::StrCat("/job:a/replica:0/task:0/device:fakecpu:", i), i % 2));
+    numa_devices.AddDevice(cpus.back().get());
+  }
+
+  Graph g(OpRegistry::Global());
+  {  // Scope for temporary variables used to construct g.
+    GraphDefBuilder b(GraphDefBuilder::kFailImmediately);
+    for (int tower = 0; tower < 3; ++tower) {
+      Node* input = ops::SourceOp(
+          "TestInput", b.opts()
+                           .WithName(strings::StrCat("in_", tower))
+                           .WithAttr(kNumaNodeHintAttrName, tower));
+      // Colocated through the reference edge, without a hint of its own.
+      Node* var = ops::SourceOp(
+          "VariableCPU", b.opts().WithName(strings::StrCat("var_", tower)));
+      ops::BinaryOp("AssignCPU", var, ops::NodeOut(input, 0),
+                    b.opts()
+                        .WithName(strings::StrCat("assign_", tower))
+                        .WithAttr(kNumaNodeHintAttrName, tower));
+    }
+    ops::SourceOp("TestInput", b.opts().WithName("no_hint"));
+    TF_EXPECT_OK(BuildGraph(b, &g));
+  }
+
+  TF_EXPECT_OK(Place(&g, &numa_devices));
+  EXPECT_DEVICE_CONTAINS(g, "in_0", "/device:fakecpu:0");
+  EXPECT_DEVICE_CONTAINS(g, "in_1", "/device:fakecpu:1");
+  // Hints wrap around the number of NUMA nodes.
+  EXPECT_DEVICE_CONTAINS(g, "in_2", "/device:fakecpu:0");
+  for (int tower = 0; tower < 3; ++tower) {
+    EXPECT_COLOCATED(g, strings::StrCat("var_", tower),
+                     strings::StrCat("assign_", tower));
+    EXPECT_COLOCATED(g, strings::StrCat("in_", tower),
+                     strings::StrCat("assign_", tower));
+  }
+  EXPECT_DEVICE_CONTAINS(g, "no_hint", "/device:fakecpu:0");
+}
+
+// Test that a NUMA node hint has no effect if all devices are on the same
+// NUMA node.
+TEST_F(PlacerTest, TestNumaNodeHintSingleNode) {
+  Graph g(OpRegistry::Global());
+  {  // Scope for temporary variables used to construct g.
+    GraphDefBuilder b(GraphDefBuilder::kFailImmediately);
+    ops::SourceOp("TestInput",
+                  b.opts().WithName("in").WithAttr(kNumaNodeHintAttrName, 1));
+    TF_EXPECT_OK(BuildGraph(b, &g));
+  }
+
+  TF_EXPECT_OK(Place(&g));
+  EXPECT_DEVICE_CONTAINS(g, "in", "/device:fakecpu:0");
+}
+
 }  // namespace
 }  // namespace tensorflow
@@ -27,6 +27,7 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/numbers.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/platform/types.h"
 
 namespace tensorflow {
@@ -285,11 +286,18 @@ void PoolAllocator::AddFreeVisitor(Visitor visitor) {
 }
 
 void* BasicCPUAllocator::Alloc(size_t alignment, size_t num_bytes) {
-  return port::AlignedMalloc(num_bytes, static_cast<int>(alignment));
+  if (numa_node_ == port::kNUMANoAffinity) {
+    return port::AlignedMalloc(num_bytes, static_cast<int>(alignment));
+  }
+  return port::NUMAMalloc(numa_node_, num_bytes, static_cast<int>(alignment));
 }
 
 void BasicCPUAllocator::Free(void* ptr, size_t num_bytes) {
-  port::AlignedFree(ptr);
+  if (numa_node_ == port::kNUMANoAffinity) {
+    port::AlignedFree(ptr);
+  } else {
+    port::NUMAFree(ptr, num_bytes);
+  }
 }
 
 }  // namespace tensorflow
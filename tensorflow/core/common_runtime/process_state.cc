@@ -27,6 +27,7 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/util/env_var.h"
 
@@ -76,6 +77,9 @@ Allocator* ProcessState::GetCPUAllocator(int numa_node) {
   if (!numa_enabled_) numa_node = 0;
   mutex_lock lock(mu_);
   while (cpu_allocators_.size() <= static_cast<size_t>(numa_node)) {
+    // The allocator for node i is at cpu_allocators_[i].
+    const int node =
+        numa_enabled_ ? static_cast<int>(cpu_allocators_.size()) : -1;
     bool use_bfc_allocator = false;
     // TODO(reedwm): Switch default to BGFAllocator if it's at least as fast and
     // efficient.
@@ -85,7 +89,10 @@ Allocator* ProcessState::GetCPUAllocator(int numa_node) {
       LOG(ERROR) << "GetCPUAllocator: " << status.error_message();
     }
     VisitableAllocator* allocator;
-    if (use_bfc_allocator) {
+    // The memory of a NUMA node is always managed by a BFCAllocator, which
+    // carves allocations out of large regions bound to the node, rather than
+    // binding the pages of each allocation with a system call.
+    if (use_bfc_allocator || node != port::kNUMANoAffinity) {
       // TODO(reedwm): evaluate whether 64GB by default is the best choice.
       int64 cpu_mem_limit_in_mb = -1;
       Status status = ReadInt64FromEnvVar("TF_CPU_BFC_MEM_LIMIT_IN_MB",
@@ -95,19 +102,27 @@ Allocator* ProcessState::GetCPUAllocator(int numa_node) {
         LOG(ERROR) << "GetCPUAllocator: " << status.error_message();
       }
       int64 cpu_mem_limit = cpu_mem_limit_in_mb * (1LL << 20);
-      allocator = new BFCAllocator(
-          new BasicCPUAllocator(numa_enabled_ ? numa_node : -1), cpu_mem_limit,
-          true /*allow_growth*/, "bfc_cpu_allocator_for_gpu" /*name*/);
+      bool use_thread_caches = false;
+      status = ReadBoolFromEnvVar("TF_CPU_BFC_THREAD_CACHES", false,
+                                  &use_thread_caches);
+      if (!status.ok()) {
+        LOG(ERROR) << "GetCPUAllocator: " << status.error_message();
+      }
+      const string name = node == port::kNUMANoAffinity
+                              ? "bfc_cpu_allocator_for_gpu"
+                              : strings::StrCat("numa_bfc_cpu_allocator_", node);
+      allocator = new BFCAllocator(new BasicCPUAllocator(node), cpu_mem_limit,
+                                   true /*allow_growth*/, name,
+                                   use_thread_caches);
       VLOG(2) << "Using BFCAllocator with memory limit of "
-              << cpu_mem_limit_in_mb << " MB for ProcessState CPU allocator";
+              << cpu_mem_limit_in_mb << " MB for ProcessState CPU allocator"
+              << (use_thread_caches ? " and thread caches" : "");
     } else {
       allocator = new PoolAllocator(
           100 /*pool_size_limit*/, true /*auto_resize*/,
-          new BasicCPUAllocator(numa_enabled_ ? numa_node : -1),
-          new NoopRounder, "cpu_pool");
+          new BasicCPUAllocator(node), new NoopRounder, "cpu_pool");
       VLOG(2) << "Using PoolAllocator for ProcessState CPU allocator "
-              << "numa_enabled_=" << numa_enabled_
-              << " numa_node=" << numa_node;
+              << "numa_enabled_=" << numa_enabled_ << " numa_node=" << node;
     }
     if (LogMemory::IsEnabled()) {
       // Wrap the allocator to track allocation ids for better logging
@@ -0,0 +1,416 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/static_memory_plan.h"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+#include "tensorflow/core/common_runtime/shape_refiner.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/shape_inference.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+namespace {
+
+auto* static_memory_plan_allocations = monitoring::Counter<1>::New(
+    "/tensorflow/core/static_memory_plan_allocations",
+    "The number of buffers requested by nodes with planned outputs, by "
+    "whether they were served from the planned slab or by the backing "
+    "allocator.",
+    "source");
+
+int64 AlignTo(int64 offset) {
+  const int64 alignment = Allocator::kAllocatorAlignment;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Returns the number of bytes of output "index" of "n", or -1 if it is not
+// known before running the graph. "c" is the shape inference context of
+// "n", if any, and "annotated" holds the shapes of its "_output_shapes" attr.
+int64 OutputBytes(const Node* n, int index,
+                  shape_inference::InferenceContext* c,
+                  const std::vector<PartialTensorShape>& annotated) {
+  const DataType dtype = n->output_type(index);
+  if (IsRefType(dtype) || !DataTypeCanUseMemcpy(dtype)) return -1;
+  int64 num_elements = -1;
+  if (c != nullptr && c->FullyDefined(c->output(index))) {
+    num_elements = c->Value(c->NumElements(c->output(index)));
+  } else if (index < annotated.size() && annotated[index].IsFullyDefined()) {
+    num_elements = annotated[index].num_elements();
+  }
+  // Empty tensors do not allocate.
+  if (num_elements <= 0) return -1;
+  return num_elements * DataTypeSize(dtype);
+}
+
+bool LifetimesOverlap(const StaticMemoryPlan::Buffer& a,
+                      const StaticMemoryPlan::Buffer& b) {
+  return a.first_use <= b.last_use && b.first_use <= a.last_use;
+}
+
+// Returns, by node id, the nodes that may hold a reference to an output of
+// "n": "n" and every node its outputs may reach, since any kernel may
+// forward an input buffer to one of its outputs.
+std::vector<bool> MayHoldOutputs(const Graph& graph, const Node* n) {
+  std::vector<bool> holds(graph.num_node_ids(), false);
+  std::deque<const Node*> queue = {n};
+  holds[n->id()] = true;
+  while (!queue.empty()) {
+    const Node* m = queue.front();
+    queue.pop_front();
+    for (const Edge* e : m->out_edges()) {
+      if (e->IsControlEdge() || holds[e->dst()->id()]) continue;
+      holds[e->dst()->id()] = true;
+      queue.push_back(e->dst());
+    }
+  }
+  return holds;
+}
+
+// Returns, by node id, the nodes that must finish before "n" starts.
+std::vector<bool> Ancestors(const Graph& graph, const Node* n) {
+  std::vector<bool> ancestors(graph.num_node_ids(), false);
+  std::deque<const Node*> queue = {n};
+  while (!queue.empty()) {
+    const Node* m = queue.front();
+    queue.pop_front();
+    for (const Edge* e : m->in_edges()) {
+      if (ancestors[e->src()->id()]) continue;
+      ancestors[e->src()->id()] = true;
+      queue.push_back(e->src());
+    }
+  }
+  return ancestors;
+}
+
+// Sets StaticMemoryPlan::Buffer::freed_before of the buffers that overlap in
+// the slab. A node releases its inputs before the nodes depending on it can
+// start, so a buffer is deallocated before another one is allocated if all
+// nodes that may hold it are ancestors of the producer of the other one.
+void OrderOverlappingBuffers(const Graph& graph,
+                             std::vector<StaticMemoryPlan::Buffer>* buffers) {
+  std::vector<int> by_offset(buffers->size());
+  std::iota(by_offset.begin(), by_offset.end(), 0);
+  std::sort(by_offset.begin(), by_offset.end(), [buffers](int a, int b) {
+    return (*buffers)[a].offset < (*buffers)[b].offset;
+  });
+  std::unordered_map<int, std::vector<bool>> may_hold;
+  std::unordered_map<int, std::vector<bool>> ancestors;
+  for (int i = 0; i < by_offset.size(); ++i) {
+    const StaticMemoryPlan::Buffer& a = (*buffers)[by_offset[i]];
+    for (int j = i + 1; j < by_offset.size(); ++j) {
+      const StaticMemoryPlan::Buffer& b = (*buffers)[by_offset[j]];
+      if (b.offset >= a.offset + a.size) break;
+      // Buffers sharing memory have disjoint lifetimes in the plan.
+      int earlier = by_offset[i];
+      int later = by_offset[j];
+      if ((*buffers)[earlier].first_use > (*buffers)[later].first_use) {
+        std::swap(earlier, later);
+      }
+      const int holder_id = (*buffers)[earlier].node_id;
+      const int producer_id = (*buffers)[later].node_id;
+      if (holder_id == producer_id) continue;
+      std::vector<bool>& holds = may_hold[holder_id];
+      if (holds.empty()) {
+        holds = MayHoldOutputs(graph, graph.FindNodeId(holder_id));
+      }
+      std::vector<bool>& before = ancestors[producer_id];
+      if (before.empty()) {
+        before = Ancestors(graph, graph.FindNodeId(producer_id));
+      }
+      bool ordered = true;
+      for (int id = 0; id < holds.size() && ordered; ++id) {
+        ordered = !holds[id] || before[id];
+      }
+      if (ordered) {
+        (*buffers)[later].freed_before.push_back(earlier);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+Status PlanStaticMemory(const Graph& graph,
+                        const std::function<bool(const Node*)>& plan_outputs,
+                        StaticMemoryPlan* plan) {
+  plan->buffers.clear();
+  plan->total_bytes = 0;
+  for (const Node* n : graph.op_nodes()) {
+    if (IsEnter(n) || IsExit(n) || IsNextIteration(n)) {
+      return errors::Unimplemented(
+          "Static memory planning does not support loops, found ",
+          n->name());
+    }
+  }
+
+  std::vector<Node*> order;
+  GetReversePostOrder(graph, &order);
+  std::vector<int> position(graph.num_node_ids(), -1);
+  for (int i = 0; i < order.size(); ++i) {
+    position[order[i]->id()] = i;
+  }
+
+  ShapeRefiner refiner(graph.versions(), graph.op_registry());
+  refiner.set_require_shape_inference_fns(false);
+  std::vector<StaticMemoryPlan::Buffer> buffers;
+  for (const Node* n : order) {
+    if (!n->IsOp()) continue;
+    TF_RETURN_IF_ERROR(refiner.AddNode(n));
+    if (!plan_outputs(n)) continue;
+    std::vector<PartialTensorShape> annotated;
+    if (HasNodeAttr(n->def(), "_output_shapes")) {
+      GetNodeAttr(n->attrs(), "_output_shapes", &annotated).IgnoreError();
+    }
+    shape_inference::InferenceContext* c = refiner.GetContext(n);
+    for (int i = 0; i < n->num_outputs(); ++i) {
+      const int64 bytes = OutputBytes(n, i, c, annotated);
+      if (bytes < 0) continue;
+      StaticMemoryPlan::Buffer buffer;
+      buffer.node_id = n->id();
+      buffer.output_index = i;
+      buffer.size = bytes;
+      buffer.first_use = position[n->id()];
+      buffer.last_use = buffer.first_use;
+      for (const Edge* e : n->out_edges()) {
+        if (e->src_output() == i) {
+          buffer.last_use =
+              std::max(buffer.last_use, position[e->dst()->id()]);
+        }
+      }
+      buffers.push_back(buffer);
+    }
+  }
+
+  // Place the largest buffers first. Each buffer goes into the smallest gap
+  // that fits it between the buffers already placed whose lifetimes overlap
+  // its own, or above all of them.
+  std::vector<int> by_size(buffers.size());
+  std::iota(by_size.begin(), by_size.end(), 0);
+  std::stable_sort(by_size.begin(), by_size.end(), [&buffers](int a, int b) {
+    return buffers[a].size > buffers[b].size;
+  });
+  std::vector<int> placed;
+  std::vector<const StaticMemoryPlan::Buffer*> live;
+  int64 total_bytes = 0;
+  for (int i : by_size) {
+    StaticMemoryPlan::Buffer& buffer = buffers[i];
+    live.clear();
+    for (int j : placed) {
+      if (LifetimesOverlap(buffer, buffers[j])) live.push_back(&buffers[j]);
+    }
+    std::sort(live.begin(), live.end(),
+              [](const StaticMemoryPlan::Buffer* a,
+                 const StaticMemoryPlan::Buffer* b) {
+                return a->offset < b->offset;
+              });
+    int64 best_offset = -1;
+    int64 best_gap = std::numeric_limits<int64>::max();
+    int64 current = 0;
+    for (const StaticMemoryPlan::Buffer* other : live) {
+      const int64 gap = other->offset - current;
+      if (gap >= buffer.size && gap < best_gap) {
+        best_offset = current;
+        best_gap = gap;
+      }
+      current = std::max(current, AlignTo(other->offset + other->size));
+    }
+    buffer.offset = best_offset >= 0 ? best_offset : current;
+    total_bytes = std::max(total_bytes, AlignTo(buffer.offset + buffer.size));
+    placed.push_back(i);
+  }
+  OrderOverlappingBuffers(graph, &buffers);
+
+  plan->buffers = std::move(buffers);
+  plan->total_bytes = total_bytes;
+  return Status::OK();
+}
+
+class StaticMemoryArena::PlannedAllocator : public Allocator {
+ public:
+  // Serves buffer "index" of "size" bytes.
+  PlannedAllocator(StaticMemoryArena* arena, int index, int64 size)
+      : arena_(arena), index_(index), size_(size) {}
+
+  string Name() override { return "static_memory_plan"; }
+
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override {
+    static auto* backing = static_memory_plan_allocations->GetCell("backing");
+    arena_->Ref();
+    if (alignment <= Allocator::kAllocatorAlignment &&
+        static_cast<size_t>(size_) == num_bytes) {
+      void* ptr = arena_->TryAcquire(index_);
+      if (ptr != nullptr) return ptr;
+    }
+    void* ptr = arena_->backing_->AllocateRaw(alignment, num_bytes);
+    if (ptr == nullptr) {
+      arena_->Unref();
+      return nullptr;
+    }
+    arena_->num_backing_allocations_.fetch_add(1, std::memory_order_relaxed);
+    backing->IncrementBy(1);
+    return ptr;
+  }
+
+  void DeallocateRaw(void* ptr) override {
+    if (!arena_->Release(index_, ptr)) {
+      arena_->backing_->DeallocateRaw(ptr);
+    }
+    // May delete this.
+    arena_->Unref();
+  }
+
+ private:
+  StaticMemoryArena* const arena_;  // Not owned.
+  const int index_;
+  const int64 size_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(PlannedAllocator);
+};
+
+StaticMemoryArena::StaticMemoryArena(const StaticMemoryPlan& plan,
+                                     Allocator* backing)
+    : backing_(backing), num_backing_allocations_(0) {
+  if (plan.total_bytes <= 0) return;
+  slab_ = static_cast<char*>(backing_->AllocateRaw(
+      Allocator::kAllocatorAlignment, plan.total_bytes));
+  if (slab_ == nullptr) {
+    LOG(WARNING) << "Failed to allocate a slab of "
+                 << strings::HumanReadableNumBytes(plan.total_bytes)
+                 << " for the static memory plan; allocating dynamically";
+    return;
+  }
+  slab_bytes_ = plan.total_bytes;
+
+  num_buffers_ = plan.buffers.size();
+  buffers_.reset(new Buffer[num_buffers_]);
+  for (int i = 0; i < num_buffers_; ++i) {
+    const StaticMemoryPlan::Buffer& planned = plan.buffers[i];
+    buffers_[i].offset = planned.offset;
+    buffers_[i].size = planned.size;
+    NodeOutputs& outputs = node_outputs_[planned.node_id];
+    outputs.allocators.emplace_back(
+        new PlannedAllocator(this, i, planned.size));
+    if (outputs.by_output.size() <= static_cast<size_t>(planned.output_index)) {
+      outputs.by_output.resize(planned.output_index + 1, nullptr);
+    }
+    outputs.by_output[planned.output_index] = outputs.allocators.back().get();
+  }
+  // Find the buffers that overlap in the slab by sweeping over them in
+  // order of offset, and keep those that the plan does not order.
+  auto ordered = [&plan](int a, int b) {
+    const std::vector<int>& before = plan.buffers[b].freed_before;
+    return std::find(before.begin(), before.end(), a) != before.end();
+  };
+  std::vector<int> by_offset(num_buffers_);
+  std::iota(by_offset.begin(), by_offset.end(), 0);
+  std::sort(by_offset.begin(), by_offset.end(), [this](int a, int b) {
+    return buffers_[a].offset < buffers_[b].offset;
+  });
+  for (int i = 0; i < by_offset.size(); ++i) {
+    Buffer& a = buffers_[by_offset[i]];
+    for (int j = i + 1; j < by_offset.size(); ++j) {
+      Buffer& b = buffers_[by_offset[j]];
+      if (b.offset >= a.offset + a.size) break;
+      if (ordered(by_offset[i], by_offset[j]) ||
+          ordered(by_offset[j], by_offset[i])) {
+        continue;
+      }
+      a.conflicts.push_back(by_offset[j]);
+      b.conflicts.push_back(by_offset[i]);
+    }
+  }
+}
+
+StaticMemoryArena::~StaticMemoryArena() {
+  if (slab_ != nullptr) {
+    VLOG(1) << "Static memory plan served " << num_planned_allocations()
+            << " of "
+            << num_planned_allocations() + num_backing_allocations()
+            << " allocations from a slab of "
+            << strings::HumanReadableNumBytes(slab_bytes_);
+    static_memory_plan_allocations->GetCell("planned")->IncrementBy(
+        num_planned_allocations() - num_exported_planned_allocations_);
+    backing_->DeallocateRaw(slab_);
+  }
+}
+
+int64 StaticMemoryArena::num_planned_allocations() const {
+  int64 total = 0;
+  for (int i = 0; i < num_buffers_; ++i) {
+    total += buffers_[i].num_allocations.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void StaticMemoryArena::EndStep() {
+  // Export the count once per step rather than once per buffer.
+  const int64 total = num_planned_allocations();
+  static_memory_plan_allocations->GetCell("planned")->IncrementBy(
+      total - num_exported_planned_allocations_);
+  num_exported_planned_allocations_ = total;
+  in_step_.store(false, std::memory_order_release);
+}
+
+Allocator* StaticMemoryArena::OutputAllocator(int node_id,
+                                              int output_index) const {
+  if (slab_ == nullptr) return nullptr;
+  auto it = node_outputs_.find(node_id);
+  if (it == node_outputs_.end() ||
+      static_cast<size_t>(output_index) >= it->second.by_output.size()) {
+    return nullptr;
+  }
+  return it->second.by_output[output_index];
+}
+
+void* StaticMemoryArena::TryAcquire(int index) {
+  Buffer& buffer = buffers_[index];
+  bool in_use = false;
+  if (!buffer.in_use.compare_exchange_strong(in_use, true)) return nullptr;
+  // Every buffer is marked as used before the buffers it conflicts with are
+  // checked, so two conflicting buffers acquired at the same time may both
+  // be refused, but are never both handed out.
+  for (int other : buffer.conflicts) {
+    if (buffers_[other].in_use.load()) {
+      buffer.in_use.store(false, std::memory_order_release);
+      return nullptr;
+    }
+  }
+  buffer.num_allocations.fetch_add(1, std::memory_order_relaxed);
+  return slab_ + buffer.offset;
+}
+
+bool StaticMemoryArena::Release(int index, void* ptr) {
+  Buffer& buffer = buffers_[index];
+  if (ptr != slab_ + buffer.offset) return false;
+  const bool was_in_use =
+      buffer.in_use.exchange(false, std::memory_order_release);
+  DCHECK(was_in_use) << "Deallocating a free buffer of the static memory plan";
+  return true;
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,165 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_MEMORY_PLAN_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_MEMORY_PLAN_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// An assignment of node outputs to offsets in one preallocated slab.
+//
+// Like the ArenaPlanner of TensorFlow Lite, outputs whose lifetimes do not
+// overlap in a topological order of the graph share memory. The lifetime of
+// an output starts at the node producing it and ends at its last consumer.
+struct StaticMemoryPlan {
+  struct Buffer {
+    int node_id = -1;
+    int output_index = -1;
+    int64 offset = 0;
+    int64 size = 0;
+    // Positions of the producer and the last consumer in the topological
+    // order used for planning.
+    int first_use = 0;
+    int last_use = 0;
+    // The buffers overlapping this one in the slab, by index in "buffers",
+    // that the graph guarantees to be deallocated before this one is
+    // allocated in the same step.
+    std::vector<int> freed_before;
+  };
+  std::vector<Buffer> buffers;
+  int64 total_bytes = 0;
+};
+
+// Plans the outputs of the nodes of "graph" for which "plan_outputs"
+// returns true. Only outputs of fixed-size types whose shapes are fully
+// defined, either according to ShapeRefiner or according to the node's
+// "_output_shapes" attr, are planned.
+//
+// Returns an error, and leaves "*plan" empty, if the graph contains control
+// flow, or if shape inference fails.
+Status PlanStaticMemory(const Graph& graph,
+                        const std::function<bool(const Node*)>& plan_outputs,
+                        StaticMemoryPlan* plan);
+
+// Serves the buffers of a StaticMemoryPlan from one slab obtained from a
+// backing allocator.
+//
+// A planned buffer is handed out only if it is free, and if none of the
+// buffers overlapping it in the slab whose order the plan does not
+// guarantee (see StaticMemoryPlan::Buffer::freed_before) is in use. This
+// keeps the slab safe when nodes run in a different order than the one the
+// plan assumed, or when a consumer forwards its input, so that a buffer
+// lives longer than planned. Other requests are forwarded to the backing
+// allocator. Buffers are handed out and returned without locking.
+//
+// The order guaranteed by the plan only holds within one step, so only one
+// step at a time may use the allocators of this, see TryBeginStep().
+//
+// The slab is returned to the backing allocator once this has been Unref'd
+// by its owner and all buffers it handed out have been deallocated.
+class StaticMemoryArena : public core::RefCounted {
+ public:
+  // Does not take ownership of "backing", which must outlive this.
+  StaticMemoryArena(const StaticMemoryPlan& plan, Allocator* backing);
+
+  // Returns true iff the slab was allocated.
+  bool ok() const { return slab_ != nullptr; }
+
+  // Returns true iff no other step is using the allocators of this, in
+  // which case the caller may use them until it calls EndStep(), after all
+  // buffers of the step have been deallocated.
+  bool TryBeginStep() {
+    return !in_step_.exchange(true, std::memory_order_acquire);
+  }
+  void EndStep();
+
+  // Returns the allocator for output "output_index" of node "node_id", or
+  // nullptr if the output is not planned. It serves requests of the planned
+  // size from the output's buffer in the slab if possible, and forwards
+  // other requests to the backing allocator. The result is owned by this.
+  Allocator* OutputAllocator(int node_id, int output_index) const;
+
+  // The number of requests served from the slab, and forwarded to the
+  // backing allocator, respectively.
+  int64 num_planned_allocations() const;
+  int64 num_backing_allocations() const {
+    return num_backing_allocations_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  class PlannedAllocator;
+
+  struct Buffer {
+    int64 offset = 0;
+    int64 size = 0;
+    // The other buffers that overlap this one in the slab and that the plan
+    // does not order with respect to it.
+    std::vector<int> conflicts;
+    std::atomic<bool> in_use{false};
+    // Only incremented by the node that produces the buffer, so that the
+    // counts do not bounce between cores.
+    std::atomic<int64> num_allocations{0};
+  };
+
+  ~StaticMemoryArena() override;
+
+  // Returns the slab address of buffer "index" if it is free, and marks it
+  // as used. Otherwise returns nullptr.
+  void* TryAcquire(int index);
+
+  // Returns true, and marks buffer "index" as free, iff "ptr" is its slab
+  // address.
+  bool Release(int index, void* ptr);
+
+  Allocator* const backing_;
+  char* slab_ = nullptr;
+  int64 slab_bytes_ = 0;
+
+  int num_buffers_ = 0;
+  std::unique_ptr<Buffer[]> buffers_;
+
+  struct NodeOutputs {
+    std::vector<std::unique_ptr<PlannedAllocator>> allocators;
+    // Indexed by output number.
+    std::vector<Allocator*> by_output;
+  };
+  std::unordered_map<int, NodeOutputs> node_outputs_;
+
+  std::atomic<int64> num_backing_allocations_;
+
+  std::atomic<bool> in_step_{false};
+  // The value of num_planned_allocations() exported to the monitoring
+  // counter so far. Only accessed by the step that called TryBeginStep().
+  int64 num_exported_planned_allocations_ = 0;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StaticMemoryArena);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_MEMORY_PLAN_H_
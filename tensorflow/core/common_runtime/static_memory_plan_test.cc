@@ -0,0 +1,391 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/static_memory_plan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/bfc_allocator.h"
+#include "tensorflow/core/common_runtime/pool_allocator.h"
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/numa.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+bool IsNeg(const Node* n) { return n->type_string() == "Neg"; }
+
+// Checks that no two buffers whose lifetimes overlap share memory.
+void CheckNoOverlaps(const StaticMemoryPlan& plan) {
+  for (const auto& a : plan.buffers) {
+    EXPECT_LE(a.offset + a.size, plan.total_bytes);
+    for (const auto& b : plan.buffers) {
+      if (&a == &b) continue;
+      if (a.first_use > b.last_use || b.first_use > a.last_use) continue;
+      EXPECT_TRUE(a.offset + a.size <= b.offset ||
+                  b.offset + b.size <= a.offset)
+          << a.node_id << " and " << b.node_id << " overlap";
+    }
+  }
+}
+
+TEST(PlanStaticMemoryTest, ChainReusesMemory) {
+  Graph g(OpRegistry::Global());
+  Tensor t(DT_FLOAT, TensorShape({256}));
+  t.flat<float>().setZero();
+  Node* x = test::graph::Constant(&g, t);
+  for (int i = 0; i < 4; ++i) {
+    x = test::graph::Unary(&g, "Neg", x);
+  }
+  test::graph::Send(&g, x, "out", "/job:a/replica:0/task:0/cpu:0", 1,
+                    "/job:a/replica:0/task:0/cpu:0");
+
+  StaticMemoryPlan plan;
+  TF_ASSERT_OK(PlanStaticMemory(g, IsNeg, &plan));
+  ASSERT_EQ(4, plan.buffers.size());
+  for (const auto& buffer : plan.buffers) {
+    EXPECT_EQ(1024, buffer.size);
+    EXPECT_EQ(0, buffer.output_index);
+  }
+  // Each output only lives until the next Neg has run, so two buffers are
+  // enough.
+  EXPECT_EQ(2048, plan.total_bytes);
+  CheckNoOverlaps(plan);
+  // But any Neg may forward its input to its output, so the plan cannot
+  // guarantee that a buffer is free when the next one sharing its memory is
+  // allocated.
+  for (const auto& buffer : plan.buffers) {
+    EXPECT_TRUE(buffer.freed_before.empty());
+  }
+}
+
+TEST(PlanStaticMemoryTest, FanOutKeepsBuffersApart) {
+  Graph g(OpRegistry::Global());
+  Tensor t(DT_FLOAT, TensorShape({8, 8}));
+  t.flat<float>().setZero();
+  Node* c = test::graph::Constant(&g, t);
+  std::vector<Node*> negs;
+  for (int i = 0; i < 5; ++i) {
+    negs.push_back(test::graph::Unary(&g, "Neg", c));
+  }
+  Node* sum = test::graph::Multi(&g, "AddN", negs);
+  test::graph::Send(&g, sum, "out", "/job:a/replica:0/task:0/cpu:0", 1,
+                    "/job:a/replica:0/task:0/cpu:0");
+
+  StaticMemoryPlan plan;
+  TF_ASSERT_OK(PlanStaticMemory(g, IsNeg, &plan));
+  ASSERT_EQ(5, plan.buffers.size());
+  // All five outputs are live until AddN runs.
+  EXPECT_EQ(5 * 256, plan.total_bytes);
+  CheckNoOverlaps(plan);
+}
+
+TEST(PlanStaticMemoryTest, UnknownShapesAreNotPlanned) {
+  Graph g(OpRegistry::Global());
+  Node* in = test::graph::Recv(&g, "in", "float",
+                               "/job:a/replica:0/task:0/cpu:0", 1,
+                               "/job:a/replica:0/task:0/cpu:0");
+  Node* unknown = test::graph::Unary(&g, "Neg", in);
+  Node* annotated = test::graph::Unary(&g, "Neg", unknown);
+  annotated->AddAttr("_output_shapes",
+                     std::vector<PartialTensorShape>{PartialTensorShape({4})});
+  test::graph::Send(&g, annotated, "out", "/job:a/replica:0/task:0/cpu:0", 1,
+                    "/job:a/replica:0/task:0/cpu:0");
+
+  StaticMemoryPlan plan;
+  TF_ASSERT_OK(PlanStaticMemory(g, IsNeg, &plan));
+  ASSERT_EQ(1, plan.buffers.size());
+  EXPECT_EQ(annotated->id(), plan.buffers[0].node_id);
+  EXPECT_EQ(16, plan.buffers[0].size);
+}
+
+TEST(PlanStaticMemoryTest, ControlEdgesOrderSharedBuffers) {
+  Graph g(OpRegistry::Global());
+  Tensor t(DT_FLOAT, TensorShape({256}));
+  t.flat<float>().setZero();
+  Node* c = test::graph::Constant(&g, t);
+  Node* x = test::graph::Unary(&g, "Neg", c);
+  Node* y = test::graph::Unary(&g, "Neg", x);
+  Node* z = test::graph::Unary(&g, "Neg", c);
+  // "z" only runs after "y" has released the output of "x".
+  g.AddControlEdge(y, z);
+
+  StaticMemoryPlan plan;
+  TF_ASSERT_OK(PlanStaticMemory(g, IsNeg, &plan));
+  ASSERT_EQ(3, plan.buffers.size());
+  EXPECT_EQ(2048, plan.total_bytes);
+  CheckNoOverlaps(plan);
+  int x_index = -1;
+  int z_index = -1;
+  for (int i = 0; i < plan.buffers.size(); ++i) {
+    if (plan.buffers[i].node_id == x->id()) x_index = i;
+    if (plan.buffers[i].node_id == z->id()) z_index = i;
+  }
+  EXPECT_EQ(plan.buffers[x_index].offset, plan.buffers[z_index].offset);
+  EXPECT_EQ(std::vector<int>({x_index}), plan.buffers[z_index].freed_before);
+  EXPECT_TRUE(plan.buffers[x_index].freed_before.empty());
+}
+
+TEST(PlanStaticMemoryTest, LoopsAreNotSupported) {
+  Graph g(OpRegistry::Global());
+  Node* c = test::graph::Constant(&g, test::AsScalar<float>(1.0f));
+  test::graph::Enter(&g, c, "frame");
+  StaticMemoryPlan plan;
+  EXPECT_TRUE(errors::IsUnimplemented(PlanStaticMemory(g, IsNeg, &plan)));
+  EXPECT_TRUE(plan.buffers.empty());
+}
+
+// Forwards to cpu_allocator() and counts the live buffers.
+class CountingAllocator : public Allocator {
+ public:
+  string Name() override { return "counting"; }
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override {
+    ++num_live_;
+    return cpu_allocator()->AllocateRaw(alignment, num_bytes);
+  }
+  void DeallocateRaw(void* ptr) override {
+    --num_live_;
+    cpu_allocator()->DeallocateRaw(ptr);
+  }
+  int num_live() const { return num_live_; }
+
+ private:
+  std::atomic<int> num_live_{0};
+};
+
+StaticMemoryPlan::Buffer MakeBuffer(int node_id, int64 offset, int64 size,
+                                    int output_index = 0) {
+  StaticMemoryPlan::Buffer buffer;
+  buffer.node_id = node_id;
+  buffer.output_index = output_index;
+  buffer.offset = offset;
+  buffer.size = size;
+  return buffer;
+}
+
+TEST(StaticMemoryArenaTest, ServesPlannedBuffersWhenFree) {
+  StaticMemoryPlan plan;
+  // Nodes 1 and 2 share the first 1KB; node 3 has its own buffer.
+  plan.buffers.push_back(MakeBuffer(1, 0, 1024));
+  plan.buffers.push_back(MakeBuffer(2, 0, 512));
+  plan.buffers.push_back(MakeBuffer(3, 1024, 1024));
+  plan.total_bytes = 2048;
+  CountingAllocator backing;
+  StaticMemoryArena* arena = new StaticMemoryArena(plan, &backing);
+  ASSERT_TRUE(arena->ok());
+  EXPECT_EQ(nullptr, arena->OutputAllocator(4, 0));
+  EXPECT_EQ(nullptr, arena->OutputAllocator(1, 1));
+  Allocator* a1 = arena->OutputAllocator(1, 0);
+  Allocator* a2 = arena->OutputAllocator(2, 0);
+  Allocator* a3 = arena->OutputAllocator(3, 0);
+
+  void* p1 = a1->AllocateRaw(Allocator::kAllocatorAlignment, 1024);
+  void* p3 = a3->AllocateRaw(Allocator::kAllocatorAlignment, 1024);
+  EXPECT_EQ(static_cast<char*>(p1) + 1024, p3);
+  // Node 2's buffer overlaps node 1's, which is still in use.
+  void* p2 = a2->AllocateRaw(Allocator::kAllocatorAlignment, 512);
+  EXPECT_EQ(2, backing.num_live());
+  a2->DeallocateRaw(p2);
+  a1->DeallocateRaw(p1);
+  p2 = a2->AllocateRaw(Allocator::kAllocatorAlignment, 512);
+  EXPECT_EQ(p1, p2);
+  // Requests of unplanned sizes are forwarded.
+  void* other = a2->AllocateRaw(Allocator::kAllocatorAlignment, 100);
+  EXPECT_EQ(2, backing.num_live());
+  a2->DeallocateRaw(other);
+  EXPECT_EQ(3, arena->num_planned_allocations());
+  EXPECT_EQ(2, arena->num_backing_allocations());
+
+  // Buffers still in use keep the slab alive.
+  arena->Unref();
+  EXPECT_EQ(1, backing.num_live());
+  a2->DeallocateRaw(p2);
+  EXPECT_EQ(1, backing.num_live());
+  a3->DeallocateRaw(p3);
+  EXPECT_EQ(0, backing.num_live());
+}
+
+TEST(StaticMemoryArenaTest, OutputsOnlyUseTheirOwnBuffers) {
+  StaticMemoryPlan plan;
+  // Outputs 0 and 2 of node 1 are planned with the same size; output 1 is
+  // not planned.
+  plan.buffers.push_back(MakeBuffer(1, 0, 256, 0));
+  plan.buffers.push_back(MakeBuffer(1, 256, 256, 2));
+  plan.total_bytes = 512;
+  CountingAllocator backing;
+  StaticMemoryArena* arena = new StaticMemoryArena(plan, &backing);
+  ASSERT_TRUE(arena->ok());
+  EXPECT_EQ(nullptr, arena->OutputAllocator(1, 1));
+  EXPECT_EQ(nullptr, arena->OutputAllocator(1, 3));
+  Allocator* out0 = arena->OutputAllocator(1, 0);
+  Allocator* out2 = arena->OutputAllocator(1, 2);
+  ASSERT_NE(out0, out2);
+
+  void* p0 = out0->AllocateRaw(Allocator::kAllocatorAlignment, 256);
+  // The buffer of output 0 is in use, but output 2 must not take it, nor
+  // may output 0 take the buffer of output 2.
+  void* again0 = out0->AllocateRaw(Allocator::kAllocatorAlignment, 256);
+  EXPECT_EQ(2, backing.num_live());
+  void* p2 = out2->AllocateRaw(Allocator::kAllocatorAlignment, 256);
+  EXPECT_EQ(static_cast<char*>(p0) + 256, p2);
+  EXPECT_EQ(2, arena->num_planned_allocations());
+  EXPECT_EQ(1, arena->num_backing_allocations());
+
+  out0->DeallocateRaw(again0);
+  out0->DeallocateRaw(p0);
+  out2->DeallocateRaw(p2);
+  arena->Unref();
+  EXPECT_EQ(0, backing.num_live());
+}
+
+TEST(StaticMemoryArenaTest, OrderedBuffersAreNotChecked) {
+  StaticMemoryPlan plan;
+  plan.buffers.push_back(MakeBuffer(1, 0, 1024));
+  plan.buffers.push_back(MakeBuffer(2, 0, 1024));
+  plan.buffers[1].freed_before.push_back(0);
+  plan.total_bytes = 1024;
+  CountingAllocator backing;
+  StaticMemoryArena* arena = new StaticMemoryArena(plan, &backing);
+  ASSERT_TRUE(arena->ok());
+  Allocator* a1 = arena->OutputAllocator(1, 0);
+  Allocator* a2 = arena->OutputAllocator(2, 0);
+
+  // The plan guarantees that the buffer of node 1 is free by the time node
+  // 2 runs, so the arena does not check it.
+  void* p1 = a1->AllocateRaw(Allocator::kAllocatorAlignment, 1024);
+  void* p2 = a2->AllocateRaw(Allocator::kAllocatorAlignment, 1024);
+  EXPECT_EQ(p1, p2);
+  EXPECT_EQ(2, arena->num_planned_allocations());
+  EXPECT_EQ(0, arena->num_backing_allocations());
+  a1->DeallocateRaw(p1);
+  a2->DeallocateRaw(p2);
+  arena->Unref();
+  EXPECT_EQ(0, backing.num_live());
+}
+
+TEST(StaticMemoryArenaTest, OneStepAtATime) {
+  StaticMemoryPlan plan;
+  plan.buffers.push_back(MakeBuffer(1, 0, 1024));
+  plan.total_bytes = 1024;
+  StaticMemoryArena* arena = new StaticMemoryArena(plan, cpu_allocator());
+  ASSERT_TRUE(arena->ok());
+  EXPECT_TRUE(arena->TryBeginStep());
+  EXPECT_FALSE(arena->TryBeginStep());
+  arena->EndStep();
+  EXPECT_TRUE(arena->TryBeginStep());
+  arena->EndStep();
+  arena->Unref();
+}
+
+TEST(StaticMemoryArenaTest, ConflictingBuffersAcrossThreads) {
+  // Node 1 and node 2 share the slab but are not ordered.
+  StaticMemoryPlan plan;
+  plan.buffers.push_back(MakeBuffer(1, 0, 1024));
+  plan.buffers.push_back(MakeBuffer(2, 512, 1024));
+  plan.total_bytes = 1536;
+  CountingAllocator backing;
+  StaticMemoryArena* arena = new StaticMemoryArena(plan, &backing);
+  ASSERT_TRUE(arena->ok());
+
+  constexpr int kNumThreads = 4;
+  constexpr int kIters = 10000;
+  std::atomic<int> num_corrupted{0};
+  {
+    thread::ThreadPool pool(Env::Default(), "test", kNumThreads);
+    for (int t = 0; t < kNumThreads; ++t) {
+      Allocator* a = arena->OutputAllocator(1 + t % 2, 0);
+      pool.Schedule([a, t, &num_corrupted]() {
+        for (int i = 0; i < kIters; ++i) {
+          char* p = static_cast<char*>(
+              a->AllocateRaw(Allocator::kAllocatorAlignment, 1024));
+          memset(p, t, 1024);
+          if (std::count(p, p + 1024, static_cast<char>(t)) != 1024) {
+            ++num_corrupted;
+          }
+          a->DeallocateRaw(p);
+        }
+      });
+    }
+  }
+  EXPECT_EQ(0, num_corrupted);
+  EXPECT_EQ(kNumThreads * kIters, arena->num_planned_allocations() +
+                                       arena->num_backing_allocations());
+  arena->Unref();
+  EXPECT_EQ(0, backing.num_live());
+}
+
+// Each thread allocates and deallocates 1KB outputs through its own
+// allocator, as the nodes of a step running in parallel do.
+void RunAllocations(int iters, const std::vector<Allocator*>& allocators) {
+  const int num_threads = allocators.size();
+  thread::ThreadPool pool(Env::Default(), "test", num_threads);
+  const int iters_per_thread = std::max(1, iters / num_threads);
+  BlockingCounter counter(num_threads);
+  testing::UseRealTime();
+  testing::StartTiming();
+  for (Allocator* a : allocators) {
+    pool.Schedule([a, &counter, iters_per_thread]() {
+      for (int i = 0; i < iters_per_thread; ++i) {
+        a->DeallocateRaw(a->AllocateRaw(Allocator::kAllocatorAlignment, 1024));
+      }
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  testing::StopTiming();
+  testing::ItemsProcessed(static_cast<int64>(iters_per_thread) * num_threads);
+}
+
+static void BM_PlannedAllocation(int iters, int num_threads) {
+  testing::StopTiming();
+  StaticMemoryPlan plan;
+  for (int t = 0; t < num_threads; ++t) {
+    plan.buffers.push_back(MakeBuffer(t, t * 1024, 1024));
+  }
+  plan.total_bytes = num_threads * 1024;
+  StaticMemoryArena* arena = new StaticMemoryArena(plan, cpu_allocator());
+  std::vector<Allocator*> allocators;
+  for (int t = 0; t < num_threads; ++t) {
+    allocators.push_back(arena->OutputAllocator(t, 0));
+  }
+  RunAllocations(iters, allocators);
+  arena->Unref();
+}
+BENCHMARK(BM_PlannedAllocation)->Arg(1)->Arg(4)->Arg(16);
+
+static void BM_BFCAllocation(int iters, int num_threads) {
+  testing::StopTiming();
+  BFCAllocator bfc(new BasicCPUAllocator(port::kNUMANoAffinity), 1 << 30,
+                   true, "cpu_bfc");
+  RunAllocations(iters, std::vector<Allocator*>(num_threads, &bfc));
+}
+BENCHMARK(BM_BFCAllocation)->Arg(1)->Arg(4)->Arg(16);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,155 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/step_arena_allocator.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+namespace {
+
+auto* step_arena_allocations = monitoring::Counter<1>::New(
+    "/tensorflow/core/step_arena_allocations",
+    "The number of buffers requested from per-step arena allocators, by "
+    "whether they were served from the arena or by the backing allocator.",
+    "source");
+
+}  // namespace
+
+constexpr size_t StepArenaAllocator::kDefaultBlockSize;
+
+StepArenaAllocator::StepArenaAllocator(Allocator* backing, int64 max_bytes,
+                                       size_t block_size)
+    : backing_(backing),
+      block_size_(block_size),
+      max_blocks_(static_cast<int>(
+          std::max<int64>(1, max_bytes / static_cast<int64>(block_size)))),
+      blocks_(new Block[max_blocks_]),
+      num_blocks_(0),
+      refs_(1),
+      num_arena_allocations_(0),
+      num_backing_allocations_(0) {
+  CHECK(backing_ != nullptr);
+  CHECK_GT(block_size_, 0);
+}
+
+StepArenaAllocator::~StepArenaAllocator() {
+  const int num_blocks = num_blocks_.load(std::memory_order_acquire);
+  for (int i = 0; i < num_blocks; ++i) {
+    backing_->DeallocateRaw(blocks_[i].base);
+  }
+}
+
+void* StepArenaAllocator::AllocateRaw(size_t alignment, size_t num_bytes) {
+  // A zero-byte buffer could start at the very end of a block, where
+  // InArena() would not recognize it.
+  if (num_bytes == 0) return nullptr;
+  refs_.fetch_add(1, std::memory_order_relaxed);
+  if (num_bytes <= block_size_ / 4 && alignment <= block_size_ / 4) {
+    void* ptr = AllocateFromArena(alignment, num_bytes);
+    if (ptr != nullptr) {
+      num_arena_allocations_.fetch_add(1, std::memory_order_relaxed);
+      return ptr;
+    }
+  }
+  void* ptr = backing_->AllocateRaw(alignment, num_bytes);
+  if (ptr == nullptr) {
+    Unref();
+    return nullptr;
+  }
+  num_backing_allocations_.fetch_add(1, std::memory_order_relaxed);
+  return ptr;
+}
+
+void StepArenaAllocator::DeallocateRaw(void* ptr) {
+  if (ptr == nullptr) return;
+  if (!InArena(ptr)) {
+    backing_->DeallocateRaw(ptr);
+  }
+  Unref();
+}
+
+void StepArenaAllocator::Release() {
+  step_arena_allocations->GetCell("arena")->IncrementBy(
+      num_arena_allocations());
+  step_arena_allocations->GetCell("backing")->IncrementBy(
+      num_backing_allocations());
+  VLOG(2) << "Step arena served " << num_arena_allocations() << " of "
+          << num_arena_allocations() + num_backing_allocations()
+          << " allocations using "
+          << num_blocks_.load(std::memory_order_relaxed) << " blocks";
+  Unref();
+}
+
+void* StepArenaAllocator::AllocateFromArena(size_t alignment,
+                                            size_t num_bytes) {
+  while (true) {
+    const int n = num_blocks_.load(std::memory_order_acquire);
+    if (n > 0) {
+      void* ptr = AllocateFromBlock(&blocks_[n - 1], alignment, num_bytes);
+      if (ptr != nullptr || n == max_blocks_) return ptr;
+    }
+    mutex_lock l(mu_);
+    if (num_blocks_.load(std::memory_order_relaxed) != n) {
+      // Another thread added a block in the meantime.
+      continue;
+    }
+    void* base =
+        backing_->AllocateRaw(Allocator::kAllocatorAlignment, block_size_);
+    if (base == nullptr) return nullptr;
+    blocks_[n].base = static_cast<char*>(base);
+    num_blocks_.store(n + 1, std::memory_order_release);
+  }
+}
+
+void* StepArenaAllocator::AllocateFromBlock(Block* block, size_t alignment,
+                                            size_t num_bytes) {
+  const uintptr_t base = reinterpret_cast<uintptr_t>(block->base);
+  // Keep every buffer on its own cache lines.
+  alignment = std::max<size_t>(alignment, Allocator::kAllocatorAlignment);
+  size_t used = block->used.load(std::memory_order_relaxed);
+  while (true) {
+    const uintptr_t start = (base + used + alignment - 1) & ~(alignment - 1);
+    const size_t end = start - base + num_bytes;
+    if (end > block_size_) return nullptr;
+    if (block->used.compare_exchange_weak(used, end,
+                                          std::memory_order_relaxed)) {
+      return reinterpret_cast<void*>(start);
+    }
+  }
+}
+
+bool StepArenaAllocator::InArena(const void* ptr) const {
+  const char* p = static_cast<const char*>(ptr);
+  const int num_blocks = num_blocks_.load(std::memory_order_acquire);
+  for (int i = 0; i < num_blocks; ++i) {
+    if (p >= blocks_[i].base && p < blocks_[i].base + block_size_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void StepArenaAllocator::Unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+
+}  // namespace tensorflow
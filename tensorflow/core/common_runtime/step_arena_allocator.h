@@ -0,0 +1,111 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_ALLOCATOR_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_ALLOCATOR_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// An Allocator for buffers that are expected to die before the step that
+// allocated them ends, such as the intermediate tensors of an inference
+// step.
+//
+// Buffers are carved out of large blocks, obtained from a backing
+// allocator, by bumping a pointer; DeallocateRaw() of such a buffer only
+// drops a reference. All blocks are handed back to the backing allocator at
+// once, when the step has ended (Release()) and the last buffer has been
+// deallocated. A buffer that unexpectedly outlives its step therefore stays
+// valid, at the cost of keeping its blocks alive.
+//
+// Requests larger than a quarter of a block, and requests that no longer
+// fit once "max_bytes" worth of blocks have been obtained, are forwarded to
+// the backing allocator. Zero-byte requests return nullptr, which
+// DeallocateRaw() ignores.
+//
+// AllocateRaw() and DeallocateRaw() are thread-safe.
+class StepArenaAllocator : public Allocator {
+ public:
+  static constexpr size_t kDefaultBlockSize = 1 << 20;
+
+  // Does not take ownership of "backing", which must outlive this.
+  StepArenaAllocator(Allocator* backing, int64 max_bytes,
+                     size_t block_size = kDefaultBlockSize);
+
+  string Name() override { return "step_arena"; }
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override;
+  void DeallocateRaw(void* ptr) override;
+
+  // Ends the step. The caller must not allocate from this afterwards. This
+  // is deleted as soon as all buffers it handed out have been deallocated,
+  // which may be before Release() returns.
+  void Release();
+
+  // The number of buffers served from the arena blocks, and forwarded to
+  // the backing allocator, respectively.
+  int64 num_arena_allocations() const {
+    return num_arena_allocations_.load(std::memory_order_relaxed);
+  }
+  int64 num_backing_allocations() const {
+    return num_backing_allocations_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Block {
+    char* base = nullptr;
+    std::atomic<size_t> used{0};
+  };
+
+  ~StepArenaAllocator() override;
+
+  // Returns nullptr if the request does not fit in the arena.
+  void* AllocateFromArena(size_t alignment, size_t num_bytes);
+  void* AllocateFromBlock(Block* block, size_t alignment, size_t num_bytes);
+
+  // Returns true iff "ptr" lies in one of the arena blocks.
+  bool InArena(const void* ptr) const;
+
+  void Unref();
+
+  Allocator* const backing_;
+  const size_t block_size_;
+  const int max_blocks_;
+
+  // blocks_[0, num_blocks_) have been obtained from backing_. New buffers
+  // are carved out of the last one.
+  std::unique_ptr<Block[]> blocks_;
+  std::atomic<int> num_blocks_;
+  mutex mu_;  // Serializes adding blocks.
+
+  // One reference per outstanding buffer, plus one until Release().
+  std::atomic<int64> refs_;
+
+  std::atomic<int64> num_arena_allocations_;
+  std::atomic<int64> num_backing_allocations_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StepArenaAllocator);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_ALLOCATOR_H_
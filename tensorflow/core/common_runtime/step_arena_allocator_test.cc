@@ -0,0 +1,209 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/step_arena_allocator.h"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+// Forwards to cpu_allocator() and counts the live buffers.
+class CountingAllocator : public Allocator {
+ public:
+  string Name() override { return "counting"; }
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override {
+    ++num_allocations_;
+    ++num_live_;
+    return cpu_allocator()->AllocateRaw(alignment, num_bytes);
+  }
+  void DeallocateRaw(void* ptr) override {
+    --num_live_;
+    cpu_allocator()->DeallocateRaw(ptr);
+  }
+
+  int num_allocations() const { return num_allocations_; }
+  int num_live() const { return num_live_; }
+
+ private:
+  std::atomic<int> num_allocations_{0};
+  std::atomic<int> num_live_{0};
+};
+
+TEST(StepArenaAllocatorTest, SmallBuffersShareBlocks) {
+  CountingAllocator backing;
+  StepArenaAllocator* arena =
+      new StepArenaAllocator(&backing, 1 << 20, 64 << 10);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 100; ++i) {
+    void* p = arena->AllocateRaw(Allocator::kAllocatorAlignment, 1000);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p) %
+                     Allocator::kAllocatorAlignment);
+    memset(p, i, 1000);
+    ptrs.push_back(p);
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(static_cast<char>(i), static_cast<char*>(ptrs[i])[999]);
+  }
+  EXPECT_EQ(100, arena->num_arena_allocations());
+  EXPECT_EQ(0, arena->num_backing_allocations());
+  // 100 buffers of 1024 bytes fit in two blocks of 64KB.
+  EXPECT_EQ(2, backing.num_allocations());
+
+  for (void* p : ptrs) {
+    arena->DeallocateRaw(p);
+  }
+  // The blocks are only returned once the step has ended.
+  EXPECT_EQ(2, backing.num_live());
+  arena->Release();
+  EXPECT_EQ(0, backing.num_live());
+}
+
+TEST(StepArenaAllocatorTest, LargeBuffersBypassArena) {
+  CountingAllocator backing;
+  StepArenaAllocator* arena =
+      new StepArenaAllocator(&backing, 1 << 20, 64 << 10);
+  void* large = arena->AllocateRaw(Allocator::kAllocatorAlignment, 32 << 10);
+  ASSERT_NE(large, nullptr);
+  EXPECT_EQ(0, arena->num_arena_allocations());
+  EXPECT_EQ(1, arena->num_backing_allocations());
+  EXPECT_EQ(1, backing.num_live());
+  arena->DeallocateRaw(large);
+  EXPECT_EQ(0, backing.num_live());
+  arena->Release();
+}
+
+TEST(StepArenaAllocatorTest, FallsBackWhenFull) {
+  CountingAllocator backing;
+  StepArenaAllocator* arena =
+      new StepArenaAllocator(&backing, 128 << 10, 64 << 10);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 200; ++i) {
+    ptrs.push_back(arena->AllocateRaw(Allocator::kAllocatorAlignment, 1024));
+    ASSERT_NE(ptrs.back(), nullptr);
+  }
+  // Two blocks hold 128 buffers; the rest come from the backing allocator.
+  EXPECT_EQ(128, arena->num_arena_allocations());
+  EXPECT_EQ(72, arena->num_backing_allocations());
+  EXPECT_EQ(2 + 72, backing.num_live());
+  for (void* p : ptrs) {
+    arena->DeallocateRaw(p);
+  }
+  EXPECT_EQ(2, backing.num_live());
+  arena->Release();
+  EXPECT_EQ(0, backing.num_live());
+}
+
+TEST(StepArenaAllocatorTest, ZeroByteRequests) {
+  CountingAllocator backing;
+  StepArenaAllocator* arena = new StepArenaAllocator(&backing, 1024, 1024);
+  // Fill the only block up to its very end.
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 4; ++i) {
+    ptrs.push_back(arena->AllocateRaw(Allocator::kAllocatorAlignment, 256));
+    ASSERT_NE(ptrs.back(), nullptr);
+  }
+  EXPECT_EQ(nullptr, arena->AllocateRaw(Allocator::kAllocatorAlignment, 0));
+  arena->DeallocateRaw(nullptr);
+  EXPECT_EQ(4, arena->num_arena_allocations());
+  EXPECT_EQ(0, arena->num_backing_allocations());
+  EXPECT_EQ(1, backing.num_live());
+  for (void* p : ptrs) {
+    arena->DeallocateRaw(p);
+  }
+  arena->Release();
+  EXPECT_EQ(0, backing.num_live());
+}
+
+TEST(StepArenaAllocatorTest, BuffersOutliveRelease) {
+  CountingAllocator backing;
+  StepArenaAllocator* arena =
+      new StepArenaAllocator(&backing, 1 << 20, 64 << 10);
+  Tensor escaped(arena, DT_FLOAT, TensorShape({16}));
+  {
+    Tensor temp(arena, DT_FLOAT, TensorShape({16}));
+  }
+  arena->Release();
+  // The step has ended, but "escaped" still holds on to the arena.
+  EXPECT_EQ(1, backing.num_live());
+  escaped.flat<float>().setConstant(1.0f);
+  escaped = Tensor();
+  EXPECT_EQ(0, backing.num_live());
+}
+
+TEST(StepArenaAllocatorTest, ConcurrentAllocations) {
+  CountingAllocator backing;
+  StepArenaAllocator* arena =
+      new StepArenaAllocator(&backing, 4 << 20, 64 << 10);
+  const int kNumThreads = 16;
+  const int kNumBuffers = 1000;
+  thread::ThreadPool pool(Env::Default(), "test", kNumThreads);
+  BlockingCounter counter(kNumThreads);
+  for (int t = 0; t < kNumThreads; ++t) {
+    pool.Schedule([arena, &counter, t]() {
+      std::vector<uint8*> ptrs;
+      for (int i = 0; i < kNumBuffers; ++i) {
+        const size_t bytes = 1 + (i * 37 + t) % 512;
+        uint8* p = static_cast<uint8*>(
+            arena->AllocateRaw(Allocator::kAllocatorAlignment, bytes));
+        ASSERT_NE(p, nullptr);
+        memset(p, t, bytes);
+        ptrs.push_back(p);
+      }
+      for (int i = 0; i < kNumBuffers; ++i) {
+        // Nobody else wrote into the buffer.
+        const size_t bytes = 1 + (i * 37 + t) % 512;
+        for (size_t k = 0; k < bytes; ++k) {
+          ASSERT_EQ(static_cast<uint8>(t), ptrs[i][k]);
+        }
+        arena->DeallocateRaw(ptrs[i]);
+      }
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  EXPECT_EQ(kNumThreads * kNumBuffers,
+            arena->num_arena_allocations() + arena->num_backing_allocations());
+  arena->Release();
+  EXPECT_EQ(0, backing.num_live());
+}
+
+static void BM_StepArenaAllocation(int iters, int num_bytes) {
+  for (int i = 0; i < iters; ++i) {
+    StepArenaAllocator* arena =
+        new StepArenaAllocator(cpu_allocator(), 16 << 20);
+    for (int j = 0; j < 100; ++j) {
+      arena->DeallocateRaw(
+          arena->AllocateRaw(Allocator::kAllocatorAlignment, num_bytes));
+    }
+    arena->Release();
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * 100);
+}
+BENCHMARK(BM_StepArenaAllocation)->Arg(64)->Arg(1024)->Arg(16384);
+
+}  // namespace
+}  // namespace tensorflow
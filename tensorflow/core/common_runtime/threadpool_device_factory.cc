@@ -18,7 +18,9 @@ limitations under the License.
 
 #include <vector>
 #include "tensorflow/core/common_runtime/device_factory.h"
+#include "tensorflow/core/common_runtime/process_state.h"
 #include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/public/session_options.h"
 
 namespace tensorflow {
@@ -31,14 +33,37 @@ class ThreadPoolDeviceFactory : public DeviceFactory {
     // TODO(zhifengc/tucker): Figure out the number of available CPUs
     // and/or NUMA configuration.
     int n = 1;
+    bool use_numa_affinity = options.config.experimental().use_numa_affinity();
+    if (use_numa_affinity && !port::NUMAEnabled()) {
+      LOG(WARNING) << "use_numa_affinity is set, but NUMA is not supported "
+                   << "on this platform";
+      use_numa_affinity = false;
+    }
+    // With NUMA affinity, there is one CPU device per NUMA node by default.
+    const int num_numa_nodes = use_numa_affinity ? port::NUMANumNodes() : 1;
     auto iter = options.config.device_count().find("CPU");
     if (iter != options.config.device_count().end()) {
       n = iter->second;
+    } else if (use_numa_affinity) {
+      n = num_numa_nodes;
+    }
+    if (use_numa_affinity) {
+      ProcessState::singleton()->EnableNUMA();
     }
     for (int i = 0; i < n; i++) {
       string name = strings::StrCat(name_prefix, "/device:CPU:", i);
-      devices->push_back(new ThreadPoolDevice(
-          options, name, Bytes(256 << 20), DeviceLocality(), cpu_allocator()));
+      DeviceLocality locality;
+      Allocator* allocator = cpu_allocator();
+      if (use_numa_affinity) {
+        // Device i is bound to NUMA node i, wrapping around if there are
+        // more devices than nodes.
+        const int numa_node = i % num_numa_nodes;
+        locality.set_numa_node(numa_node);
+        allocator = ProcessState::singleton()->GetCPUAllocator(numa_node);
+        VLOG(1) << "Binding " << name << " to NUMA node " << numa_node;
+      }
+      devices->push_back(new ThreadPoolDevice(options, name, Bytes(256 << 20),
+                                              locality, allocator));
     }
 
     return Status::OK();
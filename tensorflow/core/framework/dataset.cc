@@ -196,6 +196,20 @@ bool GraphDefBuilderWrapper::HasAttr(const string& op_type_name,
   return HasAttr(op_def, attr_name);
 }
 
+Status IteratorBase::Skip(IteratorContext* ctx, int64 num_to_skip,
+                          bool* end_of_sequence, int64* num_skipped) {
+  *num_skipped = 0;
+  *end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  while (*num_skipped < num_to_skip) {
+    out_tensors.clear();
+    TF_RETURN_IF_ERROR(GetNext(ctx, &out_tensors, end_of_sequence));
+    if (*end_of_sequence) break;
+    ++*num_skipped;
+  }
+  return Status::OK();
+}
+
 Status GraphDatasetBase::Serialize(OpKernelContext* ctx,
                                    string* serialized_graph_def,
                                    string* output_node) const {
@@ -283,6 +297,7 @@ IteratorContext MakeIteratorContext(OpKernelContext* ctx) {
   params.allocator_getter = [device](AllocatorAttributes attrs) {
     return device->GetAllocator(attrs);
   };
+  params.model = std::make_shared<model::LazyModel>();
   return IteratorContext(params);
 }
 
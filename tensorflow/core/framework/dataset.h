@@ -22,6 +22,7 @@ limitations under the License.
 #include "tensorflow/core/framework/dataset_stateful_op_whitelist.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/model.h"
 #include "tensorflow/core/framework/node_def.pb.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/register_types.h"
@@ -275,10 +276,27 @@ class IteratorContext {
 
     // The Allocator to be used to allocate the output of an iterator.
     std::function<Allocator*(AllocatorAttributes)> allocator_getter = nullptr;
+
+    // The performance model of the input pipeline, if any. Iterators created
+    // with this context add themselves to it once it is created.
+    std::shared_ptr<model::LazyModel> model = nullptr;
+
+    // If not null, the cancellation manager of the step that gets the
+    // element. Iterators that block, e.g. waiting for another process, may
+    // poll it. It is only valid until GetNext() returns, so copies of the
+    // context do not have it.
+    CancellationManager* cancellation_manager = nullptr;
   };
 
   explicit IteratorContext(Params params) : params_(std::move(params)) {}
 
+  // Copies are made to use the context after GetNext() returns, e.g. in
+  // background threads, so they drop the step's cancellation manager.
+  IteratorContext(const IteratorContext& other) : params_(other.params_) {
+    params_.cancellation_manager = nullptr;
+  }
+  IteratorContext(IteratorContext&& other) = default;
+
   Env* env() const { return params_.env; }
 
   std::function<void(std::function<void()>)>* runner() {
@@ -313,6 +331,12 @@ class IteratorContext {
     return params_.stats_aggregator_getter;
   }
 
+  std::shared_ptr<model::LazyModel> model() { return params_.model; }
+
+  CancellationManager* cancellation_manager() {
+    return params_.cancellation_manager;
+  }
+
  private:
   Params params_;
 };
@@ -341,6 +365,20 @@ class IteratorBase {
   virtual Status GetNext(IteratorContext* ctx, std::vector<Tensor>* out_tensors,
                          bool* end_of_sequence) = 0;
 
+  // Skips at most `num_to_skip` outputs of the range that this iterator is
+  // traversing, and stores the number of outputs skipped in `*num_skipped`.
+  //
+  // If fewer than `num_to_skip` outputs remained, `true` will be stored in
+  // `*end_of_sequence`.
+  //
+  // The default implementation calls `GetNext()` and discards its outputs.
+  // Iterators that can skip outputs without producing them should override
+  // it.
+  //
+  // This method is thread-safe.
+  virtual Status Skip(IteratorContext* ctx, int64 num_to_skip,
+                      bool* end_of_sequence, int64* num_skipped);
+
   // Returns a vector of DataType values, representing the respective
   // element types of each tuple component in the outputs of this
   // iterator.
@@ -392,6 +430,13 @@ class IteratorBase {
                                  IteratorStateReader* reader) {
     return errors::Unimplemented("RestoreInternal");
   }
+
+ private:
+  friend class DatasetBase;
+
+  // Makes this iterator part of `model`. Called before Initialize() when the
+  // iterator context has a model.
+  virtual void SetModel(const std::shared_ptr<model::LazyModel>& model) {}
 };
 
 // Represents a (potentially infinite) range of outputs, where each
@@ -411,6 +456,9 @@ class DatasetBase : public core::RefCounted {
   Status MakeIterator(IteratorContext* ctx, const string& prefix,
                       std::unique_ptr<IteratorBase>* iterator) const {
     *iterator = MakeIteratorInternal(prefix);
+    if (ctx->model()) {
+      (*iterator)->SetModel(ctx->model());
+    }
     return (*iterator)->Initialize(ctx);
   }
 
@@ -513,7 +561,12 @@ class DatasetIterator : public IteratorBase {
     params_.dataset->Ref();
   }
 
-  ~DatasetIterator() override { params_.dataset->Unref(); }
+  ~DatasetIterator() override {
+    if (node_) {
+      model_->RemoveNode(node_.get());
+    }
+    params_.dataset->Unref();
+  }
 
   // The dataset from which this iterator was created.
   const DatasetType* dataset() const { return params_.dataset; }
@@ -532,7 +585,9 @@ class DatasetIterator : public IteratorBase {
   Status GetNext(IteratorContext* ctx, std::vector<Tensor>* out_tensors,
                  bool* end_of_sequence) final {
     tracing::ScopedActivity activity(params_.prefix);
+    model::GetNextRecorder recorder(recording_node());
     Status s = GetNextInternal(ctx, out_tensors, end_of_sequence);
+    recorder.Stop(s.ok() && !*end_of_sequence ? out_tensors : nullptr);
     if (TF_PREDICT_FALSE(errors::IsOutOfRange(s) && !*end_of_sequence)) {
       s = errors::Internal(
           "Iterator \"", params_.prefix,
@@ -544,6 +599,15 @@ class DatasetIterator : public IteratorBase {
     return s;
   }
 
+  Status Skip(IteratorContext* ctx, int64 num_to_skip, bool* end_of_sequence,
+              int64* num_skipped) final {
+    tracing::ScopedActivity activity(params_.prefix);
+    model::GetNextRecorder recorder(recording_node());
+    Status s = SkipInternal(ctx, num_to_skip, end_of_sequence, num_skipped);
+    recorder.StopSkip(s.ok() ? *num_skipped : 0);
+    return s;
+  }
+
   Status Save(OpKernelContext* ctx, IteratorStateWriter* writer) final {
     TF_RETURN_IF_ERROR(dataset()->Save(ctx, writer));
     return IteratorBase::Save(ctx, writer);
@@ -555,12 +619,116 @@ class DatasetIterator : public IteratorBase {
                                  std::vector<Tensor>* out_tensors,
                                  bool* end_of_sequence) = 0;
 
+  // Internal implementation of Skip that is wrapped in tracing logic.
+  virtual Status SkipInternal(IteratorContext* ctx, int64 num_to_skip,
+                              bool* end_of_sequence, int64* num_skipped) {
+    return IteratorBase::Skip(ctx, num_to_skip, end_of_sequence, num_skipped);
+  }
+
   string full_name(const string& name) const {
     return strings::StrCat(prefix(), ":", name);
   }
 
+  // Returns a parameter for the parallelism or buffer size of this iterator.
+  // If `value` is model::kAutoTune, the parameter is tuned in [min, max] by
+  // the model of the input pipeline, which this creates if needed, or fixed
+  // to `max` if the pipeline cannot have a model. Otherwise it is fixed to
+  // `value`. When the model changes the parameter, it notifies `cond_var`
+  // under `mu`.
+  std::shared_ptr<model::Parameter> MakeParameter(
+      int64 value, int64 min, int64 max, std::shared_ptr<mutex> mu,
+      std::shared_ptr<condition_variable> cond_var) {
+    if (value == model::kAutoTune) {
+      if (lazy_model_) {
+        return lazy_model_->GetOrCreate()->AddTunableParameter(
+            min, max, std::move(mu), std::move(cond_var));
+      }
+      value = max;
+    }
+    return std::make_shared<model::Parameter>(value, value);
+  }
+
+  // Returns true iff this iterator is part of a pipeline that can have a
+  // model.
+  bool has_model() const { return lazy_model_ != nullptr; }
+
+  // Marks this iterator as asynchronous in the model, if any. See
+  // `model::Node::SetAsync()`.
+  void SetAsync(std::shared_ptr<model::Parameter> parallelism,
+                std::shared_ptr<model::Parameter> buffer_size) {
+    mutex_lock l(model_mu_);
+    async_ = true;
+    parallelism_ = std::move(parallelism);
+    buffer_size_ = std::move(buffer_size);
+    if (node_) {
+      node_->SetAsync(parallelism_, buffer_size_);
+    }
+  }
+
+  // Records processing time of an asynchronous iterator in the model, if
+  // any.
+  void AddProcessingTime(int64 time_ns) {
+    model::Node* node = recording_node();
+    if (node) {
+      node->AddProcessingTime(time_ns);
+    }
+  }
+
+  // Records the number of elements buffered by an asynchronous iterator in
+  // the model, if any.
+  void RecordBufferSize(int64 size) {
+    model::Node* node = recording_node();
+    if (node) {
+      node->RecordBufferSize(size);
+    }
+  }
+
  private:
+  void SetModel(const std::shared_ptr<model::LazyModel>& model) final {
+    lazy_model_ = model;
+  }
+
+  // Returns the node of this iterator in the model of the input pipeline if
+  // the model collects statistics, adding it if the model was created since
+  // the last call, or null.
+  model::Node* recording_node() {
+    model::Node* node = node_ptr_.load(std::memory_order_acquire);
+    if (TF_PREDICT_FALSE(node == nullptr)) {
+      if (!lazy_model_ || !lazy_model_->created()) {
+        return nullptr;
+      }
+      node = AddModelNode();
+    }
+    return model_ptr_.load(std::memory_order_relaxed)->collecting() ? node
+                                                                     : nullptr;
+  }
+
+  model::Node* AddModelNode() LOCKS_EXCLUDED(model_mu_) {
+    mutex_lock l(model_mu_);
+    if (!node_) {
+      model_ = lazy_model_->Get();
+      node_ = model_->AddNode(params_.prefix);
+      if (async_) {
+        node_->SetAsync(parallelism_, buffer_size_);
+      }
+      model_ptr_.store(model_.get(), std::memory_order_relaxed);
+      node_ptr_.store(node_.get(), std::memory_order_release);
+    }
+    return node_.get();
+  }
+
   Params params_;
+  std::shared_ptr<model::LazyModel> lazy_model_;
+  // `model_` and `node_`, readable without `model_mu_` once set.
+  std::atomic<model::Model*> model_ptr_{nullptr};
+  std::atomic<model::Node*> node_ptr_{nullptr};
+  mutex model_mu_;
+  std::shared_ptr<model::Model> model_ GUARDED_BY(model_mu_);
+  std::shared_ptr<model::Node> node_ GUARDED_BY(model_mu_);
+  // The arguments of SetAsync(), applied to `node_` once it is added.
+  bool async_ GUARDED_BY(model_mu_) = false;
+  std::shared_ptr<model::Parameter> parallelism_ GUARDED_BY(model_mu_);
+  std::shared_ptr<model::Parameter> buffer_size_ GUARDED_BY(model_mu_);
 };
 
 // Encapsulates the work required to plug a DatasetBase into the core TensorFlow
@@ -648,6 +816,9 @@ Status StoreDatasetInVariantTensor(DatasetBase* dataset, Tensor* tensor);
 
 namespace dataset {
 
+// Returns a context for creating the root iterator of an input pipeline from
+// `ctx`, whose performance model is created when the pipeline first needs
+// it.
 IteratorContext MakeIteratorContext(OpKernelContext* ctx);
 
 }  // namespace dataset
@@ -0,0 +1,630 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/framework/model.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cmath>
+
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/mem.h"
+
+namespace tensorflow {
+namespace model {
+
+namespace {
+
+// The optimization period starts short, so that pipelines are tuned soon
+// after they start, and backs off as their parameters settle.
+constexpr int64 kMinOptimizationPeriodMs = 10;
+constexpr int64 kMaxOptimizationPeriodMs = 1000;
+
+// The optimization stops increasing parameters when the best increment
+// improves the output time by less than this fraction of the output time, or
+// of the time the consumer spends between calls if that is larger: waiting
+// much less than that for an element is not worth any more resources.
+constexpr double kMinImprovement = 1e-3;
+
+// Bounds the number of increments of one optimization.
+constexpr int kMaxOptimizationSteps = 10000;
+
+constexpr int64 kNanosPerMicro = 1000;
+
+// The time spent in the GetNext() calls of modeled iterators by the current
+// thread, since the innermost enclosing GetNextRecorder started.
+thread_local int64 input_time_ns = 0;
+
+// Returns the probability that the buffer of an asynchronous iterator is
+// empty when its consumer asks for an element, modeling the buffer as an
+// M/M/1/K queue whose producer is `rho` times faster than its consumer.
+double EmptyProbability(double rho, double buffer_size) {
+  if (buffer_size <= 0 || rho <= 0) return 1.0;
+  if (std::fabs(rho - 1.0) < 1e-6) return 1.0 / (buffer_size + 1.0);
+  const double power = std::pow(rho, buffer_size + 1.0);
+  if (std::isinf(power)) return 0.0;
+  return (1.0 - rho) / (1.0 - power);
+}
+
+}  // namespace
+
+int64 NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Parameter::set_value(int64 value) {
+  if (value == value_.load(std::memory_order_relaxed)) return;
+  if (cond_var_ == nullptr) {
+    value_.store(value, std::memory_order_relaxed);
+    return;
+  }
+  // Changing the value under the lock of the iterator ensures that a thread
+  // that checked the old value under that lock is already waiting.
+  mutex_lock l(*mu_);
+  value_.store(value, std::memory_order_relaxed);
+  cond_var_->notify_all();
+}
+
+void Node::SetAsync(std::shared_ptr<Parameter> parallelism,
+                    std::shared_ptr<Parameter> buffer_size) {
+  mutex_lock l(mu_);
+  async_ = true;
+  parallelism_ = std::move(parallelism);
+  buffer_size_ = std::move(buffer_size);
+}
+
+void Node::RecordGetNext(int64 start_ns, int64 time_ns, int64 self_time_ns,
+                         const std::vector<Tensor>* outputs) {
+  if (outputs != nullptr) {
+    int64 bytes = 0;
+    for (const Tensor& t : *outputs) {
+      bytes += t.TotalBytes();
+    }
+    num_elements_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  RecordCall(start_ns, time_ns, self_time_ns);
+}
+
+void Node::RecordSkip(int64 start_ns, int64 time_ns, int64 self_time_ns,
+                      int64 num_skipped) {
+  num_elements_.fetch_add(num_skipped, std::memory_order_relaxed);
+  num_skipped_.fetch_add(num_skipped, std::memory_order_relaxed);
+  RecordCall(start_ns, time_ns, self_time_ns);
+}
+
+void Node::RecordCall(int64 start_ns, int64 time_ns, int64 self_time_ns) {
+  wall_time_ns_.fetch_add(time_ns, std::memory_order_relaxed);
+  if (async_.load(std::memory_order_relaxed)) {
+    input_time_ns_.fetch_add(time_ns, std::memory_order_relaxed);
+  } else {
+    processing_time_ns_.fetch_add(self_time_ns, std::memory_order_relaxed);
+    input_time_ns_.fetch_add(time_ns - self_time_ns,
+                             std::memory_order_relaxed);
+  }
+  int64 first_start_ns = 0;
+  first_start_ns_.compare_exchange_strong(first_start_ns, start_ns,
+                                          std::memory_order_relaxed);
+  const int64 last_return_ns = last_return_ns_.exchange(
+      start_ns + time_ns, std::memory_order_relaxed);
+  if (last_return_ns > 0 && start_ns > last_return_ns) {
+    gap_time_ns_.fetch_add(start_ns - last_return_ns,
+                           std::memory_order_relaxed);
+    num_gaps_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+GetNextRecorder::GetNextRecorder(Node* node) : node_(node) {
+  if (node_ != nullptr) {
+    start_ns_ = NowNanos();
+    saved_input_time_ns_ = input_time_ns;
+    input_time_ns = 0;
+  }
+}
+
+void GetNextRecorder::Stop(const std::vector<Tensor>* outputs) {
+  if (node_ == nullptr) return;
+  const int64 time_ns = NowNanos() - start_ns_;
+  const int64 self_time_ns = std::max<int64>(0, time_ns - input_time_ns);
+  input_time_ns = saved_input_time_ns_ + time_ns;
+  node_->RecordGetNext(start_ns_, time_ns, self_time_ns, outputs);
+}
+
+void GetNextRecorder::StopSkip(int64 num_skipped) {
+  if (node_ == nullptr) return;
+  const int64 time_ns = NowNanos() - start_ns_;
+  const int64 self_time_ns = std::max<int64>(0, time_ns - input_time_ns);
+  input_time_ns = saved_input_time_ns_ + time_ns;
+  node_->RecordSkip(start_ns_, time_ns, self_time_ns, num_skipped);
+}
+
+// A snapshot of the nodes reachable from the root, in which the optimization
+// tries parameter values.
+struct Model::State {
+  struct NodeState {
+    const Node* node = nullptr;
+    string name;
+    bool async = false;
+    // The counters of the node.
+    int64 num_elements = 0;
+    int64 num_skipped = 0;
+    int64 processing_time_ns = 0;
+    int64 total_bytes = 0;
+    int64 first_start_ns = 0;
+    int64 last_return_ns = 0;
+    int64 wall_time_ns = 0;
+    int64 input_time_ns = 0;
+    int64 buffered_elements = 0;
+    int64 num_buffer_samples = 0;
+    // Per element produced, derived from the counters.
+    double self_time_ns = 0;
+    double bytes = 0;
+    double average_buffer_size = 0;
+    // Tried values of the parameters of asynchronous nodes. A buffer size of
+    // zero means that the buffer holds the outputs of the calls in flight.
+    std::shared_ptr<Parameter> parallelism;
+    std::shared_ptr<Parameter> buffer_size;
+    int64 parallelism_value = 1;
+    int64 buffer_size_value = 0;
+    // The inputs, and the number of their elements consumed per element
+    // produced.
+    std::vector<std::pair<int, double>> inputs;
+
+    // Computes the per element statistics from the counters.
+    void ComputeAverages() {
+      const double elements = std::max<int64>(1, num_elements);
+      self_time_ns = processing_time_ns / elements;
+      bytes = static_cast<double>(total_bytes) /
+              std::max<int64>(1, num_elements - num_skipped);
+      average_buffer_size =
+          num_buffer_samples > 0
+              ? static_cast<double>(buffered_elements) / num_buffer_samples
+              : 0;
+    }
+
+    // Leaves the counters accumulated since `start`, the state of the same
+    // node at an earlier time.
+    void Subtract(const NodeState& start) {
+      num_elements -= start.num_elements;
+      num_skipped -= start.num_skipped;
+      processing_time_ns -= start.processing_time_ns;
+      total_bytes -= start.total_bytes;
+      wall_time_ns -= start.wall_time_ns;
+      input_time_ns -= start.input_time_ns;
+      buffered_elements -= start.buffered_elements;
+      num_buffer_samples -= start.num_buffer_samples;
+      ComputeAverages();
+    }
+  };
+
+  // Returns the number of elements buffered by node `i`.
+  double BufferSize(int i) const {
+    const NodeState& node = nodes[i];
+    if (node.buffer_size_value > 0) return node.buffer_size_value;
+    double ratio = 0;
+    for (const auto& input : node.inputs) ratio += input.second;
+    return std::ceil(node.parallelism_value / std::max(1.0, ratio));
+  }
+
+  // Returns the time the consumer of node `i` waits for each element if it
+  // asks for one every `gap_ns` nanoseconds.
+  double OutputTime(int i, double gap_ns) const {
+    const NodeState& node = nodes[i];
+    if (!node.async) {
+      double time = node.self_time_ns;
+      for (const auto& input : node.inputs) {
+        if (input.second <= 0) continue;
+        time += input.second *
+                OutputTime(input.first,
+                           (gap_ns + node.self_time_ns) / input.second);
+      }
+      return time;
+    }
+    // The calls in flight share the processing, but the inputs are read
+    // sequentially.
+    const double work =
+        node.self_time_ns / std::max<int64>(1, node.parallelism_value);
+    double input_time = 0;
+    for (const auto& input : node.inputs) {
+      if (input.second <= 0) continue;
+      input_time +=
+          input.second * OutputTime(input.first, work / input.second);
+    }
+    const double production_time = std::max(work, input_time);
+    if (production_time <= 0) return 0;
+    return production_time *
+           EmptyProbability(gap_ns / production_time, BufferSize(i));
+  }
+
+  // Returns the memory used by the buffers with tunable sizes.
+  double TunableBufferBytes() const {
+    double bytes = 0;
+    for (int i = 0; i < nodes.size(); ++i) {
+      const NodeState& node = nodes[i];
+      const bool tunable =
+          (node.buffer_size && node.buffer_size->tunable()) ||
+          (!node.buffer_size && node.parallelism &&
+           node.parallelism->tunable());
+      if (node.async && tunable) bytes += BufferSize(i) * node.bytes;
+    }
+    return bytes;
+  }
+
+  // `nodes[0]` is the root.
+  std::vector<NodeState> nodes;
+  // The time between calls to GetNext() of the root.
+  double gap_ns = 0;
+};
+
+Model::Model() {}
+
+Model::~Model() {
+  std::unique_ptr<Thread> optimization_thread;
+  {
+    mutex_lock l(mu_);
+    cancelled_ = true;
+    cond_var_.notify_all();
+    optimization_thread = std::move(optimization_thread_);
+  }
+}
+
+std::shared_ptr<Node> Model::AddNode(const string& name) {
+  std::shared_ptr<Node> node(new Node(name));
+  mutex_lock l(mu_);
+  for (size_t i = name.empty() ? 0 : name.size() - 1; i > 0; --i) {
+    if (name[i] != ':' && name[i] != '[') continue;
+    auto it = nodes_.find(name.substr(0, i));
+    if (it != nodes_.end()) {
+      node->output_ = it->second.get();
+      node->output_->inputs_.push_back(node.get());
+      break;
+    }
+  }
+  // Adopt the nodes of iterators below `name` that were added first, and
+  // whose output is not closer to them.
+  for (auto it = nodes_.upper_bound(name);
+       it != nodes_.end() && str_util::StartsWith(it->first, name); ++it) {
+    Node* input = it->second.get();
+    const char next = input->name()[name.size()];
+    if (next != ':' && next != '[') continue;
+    if (input->output_ != nullptr) {
+      if (input->output_->name().size() > name.size()) continue;
+      std::vector<Node*>* inputs = &input->output_->inputs_;
+      inputs->erase(std::remove(inputs->begin(), inputs->end(), input),
+                    inputs->end());
+    }
+    input->output_ = node.get();
+    node->inputs_.push_back(input);
+  }
+  if (root_ == nullptr) {
+    root_ = node.get();
+  }
+  while (root_->output_ != nullptr) {
+    root_ = root_->output_;
+  }
+  nodes_[name] = node;
+  return node;
+}
+
+void Model::RemoveNode(Node* node) {
+  mutex_lock l(mu_);
+  auto it = nodes_.find(node->name());
+  if (it != nodes_.end() && it->second.get() == node) {
+    nodes_.erase(it);
+  }
+  if (node->output_ != nullptr) {
+    std::vector<Node*>* inputs = &node->output_->inputs_;
+    inputs->erase(std::remove(inputs->begin(), inputs->end(), node),
+                  inputs->end());
+    node->output_->processing_time_ns_.fetch_add(
+        node->processing_time_ns_.load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+    node->output_ = nullptr;
+  }
+  for (Node* input : node->inputs_) {
+    input->output_ = nullptr;
+  }
+  node->inputs_.clear();
+  if (root_ == node) {
+    root_ = nullptr;
+  }
+}
+
+std::shared_ptr<Parameter> Model::AddTunableParameter(
+    int64 min, int64 max, std::shared_ptr<mutex> mu,
+    std::shared_ptr<condition_variable> cond_var) {
+  std::shared_ptr<Parameter> parameter(
+      new Parameter(min, max, std::move(mu), std::move(cond_var)));
+  tuning_ = true;
+  mutex_lock l(mu_);
+  if (!optimization_thread_) {
+    optimization_thread_.reset(Env::Default()->StartThread(
+        {}, "tf_data_model", [this]() { OptimizationThread(); }));
+  }
+  return parameter;
+}
+
+void Model::SnapshotLocked(State* state) {
+  state->nodes.clear();
+  if (root_ == nullptr) return;
+  const int64 num_gaps = root_->num_gaps_.load(std::memory_order_relaxed);
+  state->gap_ns =
+      num_gaps > 0
+          ? static_cast<double>(
+                root_->gap_time_ns_.load(std::memory_order_relaxed)) /
+                num_gaps
+          : 0;
+  std::vector<Node*> nodes = {root_};
+  for (int i = 0; i < nodes.size(); ++i) {
+    Node* node = nodes[i];
+    state->nodes.emplace_back();
+    State::NodeState* node_state = &state->nodes.back();
+    node_state->node = node;
+    node_state->name = node->name();
+    node_state->num_elements = node->num_elements();
+    const double num_elements = std::max<int64>(1, node_state->num_elements);
+    node_state->num_skipped =
+        node->num_skipped_.load(std::memory_order_relaxed);
+    node_state->processing_time_ns =
+        node->processing_time_ns_.load(std::memory_order_relaxed);
+    node_state->total_bytes = node->bytes_.load(std::memory_order_relaxed);
+    node_state->first_start_ns =
+        node->first_start_ns_.load(std::memory_order_relaxed);
+    node_state->last_return_ns =
+        node->last_return_ns_.load(std::memory_order_relaxed);
+    node_state->wall_time_ns =
+        node->wall_time_ns_.load(std::memory_order_relaxed);
+    node_state->input_time_ns =
+        node->input_time_ns_.load(std::memory_order_relaxed);
+    node_state->buffered_elements =
+        node->buffered_elements_.load(std::memory_order_relaxed);
+    node_state->num_buffer_samples =
+        node->num_buffer_samples_.load(std::memory_order_relaxed);
+    node_state->ComputeAverages();
+    {
+      mutex_lock node_l(node->mu_);
+      node_state->async = node->async_;
+      node_state->parallelism = node->parallelism_;
+      node_state->buffer_size = node->buffer_size_;
+    }
+    if (node_state->parallelism) {
+      node_state->parallelism_value = node_state->parallelism->value();
+    }
+    if (node_state->buffer_size) {
+      node_state->buffer_size_value = node_state->buffer_size->value();
+    }
+    for (Node* input : node->inputs_) {
+      const double ratio =
+          node_state->num_elements > 0
+              ? static_cast<double>(input->num_elements()) / num_elements
+              : 1.0;
+      node_state->inputs.emplace_back(nodes.size(), ratio);
+      nodes.push_back(input);
+    }
+  }
+}
+
+void Model::Optimize(int64 cpu_budget, int64 ram_budget) {
+  State state;
+  {
+    mutex_lock l(mu_);
+    SnapshotLocked(&state);
+  }
+  if (state.nodes.empty() || state.nodes[0].num_elements == 0) return;
+
+  // The values of the tunable parameters, and whether they are parallelism.
+  std::vector<std::pair<int64*, bool>> values;
+  std::vector<Parameter*> parameters;
+  for (State::NodeState& node : state.nodes) {
+    if (node.parallelism && node.parallelism->tunable()) {
+      node.parallelism_value = node.parallelism->min();
+      values.emplace_back(&node.parallelism_value, true);
+      parameters.push_back(node.parallelism.get());
+    }
+    if (node.buffer_size && node.buffer_size->tunable()) {
+      node.buffer_size_value = node.buffer_size->min();
+      values.emplace_back(&node.buffer_size_value, false);
+      parameters.push_back(node.buffer_size.get());
+    }
+  }
+  if (values.empty()) return;
+
+  // Greedily increment the parameter that reduces the output time the most.
+  int64 parallelism = 0;
+  for (const auto& value : values) {
+    if (value.second) parallelism += *value.first;
+  }
+  double output_time = state.OutputTime(0, state.gap_ns);
+  for (int step = 0; step < kMaxOptimizationSteps && output_time > 0; ++step) {
+    int best = -1;
+    double best_output_time = output_time;
+    for (int i = 0; i < values.size(); ++i) {
+      int64* value = values[i].first;
+      if (*value >= parameters[i]->max()) continue;
+      if (values[i].second && parallelism >= cpu_budget) continue;
+      ++*value;
+      if (state.TunableBufferBytes() <= ram_budget) {
+        const double time = state.OutputTime(0, state.gap_ns);
+        if (time < best_output_time) {
+          best = i;
+          best_output_time = time;
+        }
+      }
+      --*value;
+    }
+    if (best < 0 ||
+        output_time - best_output_time <
+            kMinImprovement * std::max(output_time, state.gap_ns)) {
+      break;
+    }
+    ++*values[best].first;
+    if (values[best].second) ++parallelism;
+    output_time = best_output_time;
+  }
+
+  for (int i = 0; i < values.size(); ++i) {
+    parameters[i]->set_value(*values[i].first);
+  }
+  VLOG(2) << "Optimized the input pipeline: " << DebugString();
+}
+
+double Model::OutputTime() {
+  State state;
+  {
+    mutex_lock l(mu_);
+    SnapshotLocked(&state);
+  }
+  if (state.nodes.empty()) return 0;
+  return state.OutputTime(0, state.gap_ns);
+}
+
+string Model::DebugString() {
+  State state;
+  {
+    mutex_lock l(mu_);
+    SnapshotLocked(&state);
+  }
+  string result;
+  for (const State::NodeState& node : state.nodes) {
+    const double num_elements = std::max<int64>(1, node.num_elements);
+    strings::StrAppend(&result, node.name, ": ", node.num_elements,
+                       " elements, ", node.self_time_ns, " ns and ",
+                       node.bytes, " bytes per element, ",
+                       node.wall_time_ns / num_elements, " ns per GetNext(), ",
+                       node.input_time_ns / num_elements, " ns on inputs");
+    if (node.async) {
+      strings::StrAppend(&result, ", parallelism ", node.parallelism_value);
+      if (node.buffer_size) {
+        strings::StrAppend(&result, ", buffer size ", node.buffer_size_value);
+      }
+      strings::StrAppend(&result, ", ", node.average_buffer_size,
+                         " elements buffered");
+    }
+    strings::StrAppend(&result, "\n");
+  }
+  return result;
+}
+
+class Model::StepStart {
+ public:
+  State state;
+  int64 start_ns = 0;
+};
+
+std::shared_ptr<Model::StepStart> Model::StartStep() {
+  std::shared_ptr<StepStart> start(new StepStart);
+  num_traced_steps_.fetch_add(1, std::memory_order_relaxed);
+  mutex_lock l(mu_);
+  SnapshotLocked(&start->state);
+  start->start_ns = NowNanos();
+  return start;
+}
+
+void Model::AddStepStats(std::shared_ptr<StepStart> start,
+                         const string& device, StepStats* step_stats) {
+  State state;
+  {
+    mutex_lock l(mu_);
+    SnapshotLocked(&state);
+  }
+  num_traced_steps_.fetch_sub(1, std::memory_order_relaxed);
+  std::map<const Node*, const State::NodeState*> start_nodes;
+  for (const State::NodeState& node : start->state.nodes) {
+    start_nodes[node.node] = &node;
+  }
+  // The nodes use a monotonic clock, and step stats the wall clock.
+  const int64 wall_offset_us =
+      Env::Default()->NowMicros() - NowNanos() / kNanosPerMicro;
+  DeviceStepStats* device_stats = step_stats->add_dev_stats();
+  device_stats->set_device(device);
+  for (int i = 0; i < state.nodes.size(); ++i) {
+    State::NodeState& node = state.nodes[i];
+    auto it = start_nodes.find(node.node);
+    if (it != start_nodes.end() && it->second->name == node.name) {
+      node.Subtract(*it->second);
+    }
+    if (node.first_start_ns == 0 || node.last_return_ns < start->start_ns ||
+        (node.num_elements == 0 && node.wall_time_ns == 0)) {
+      continue;
+    }
+    const int64 start_ns = std::max(node.first_start_ns, start->start_ns);
+    NodeExecStats* node_stats = device_stats->add_node_stats();
+    node_stats->set_node_name(node.name);
+    node_stats->set_all_start_micros(start_ns / kNanosPerMicro +
+                                     wall_offset_us);
+    const int64 duration_us =
+        std::max<int64>(0, (node.last_return_ns - start_ns) / kNanosPerMicro);
+    node_stats->set_op_start_rel_micros(0);
+    node_stats->set_op_end_rel_micros(duration_us);
+    node_stats->set_all_end_rel_micros(duration_us);
+
+    // The type of the iterator is the last component of its prefix, without
+    // the index of flat map inputs.
+    size_t type_begin = node.name.rfind("::");
+    type_begin = type_begin == string::npos ? 0 : type_begin + 2;
+    const string type =
+        node.name.substr(type_begin, node.name.find('[', type_begin) -
+                                         type_begin);
+    const double num_elements = std::max<int64>(1, node.num_elements);
+    string label = strings::StrCat(
+        node.name, " = ", type, "(elements=", node.num_elements,
+        ", bytes_per_element=", node.bytes,
+        ", wall_ns_per_element=", node.wall_time_ns / num_elements,
+        ", self_ns_per_element=", node.self_time_ns,
+        ", input_ns_per_element=", node.input_time_ns / num_elements);
+    if (node.async) {
+      strings::StrAppend(&label, ", parallelism=", node.parallelism_value,
+                         ", buffer_size=", state.BufferSize(i),
+                         ", average_buffered=", node.average_buffer_size);
+    }
+    strings::StrAppend(&label, ")");
+    node_stats->set_timeline_label(label);
+  }
+}
+
+void Model::OptimizationThread() {
+  int64 period_ms = kMinOptimizationPeriodMs;
+  while (true) {
+    {
+      mutex_lock l(mu_);
+      if (!cancelled_) {
+        WaitForMilliseconds(&l, &cond_var_, period_ms);
+      }
+      if (cancelled_) return;
+    }
+    Optimize(port::NumSchedulableCPUs(), port::AvailableRam() / 2);
+    period_ms = std::min(period_ms * 2, kMaxOptimizationPeriodMs);
+  }
+}
+
+std::shared_ptr<Model> LazyModel::GetOrCreate() {
+  mutex_lock l(mu_);
+  if (!model_) {
+    model_ = std::make_shared<Model>();
+    created_.store(true, std::memory_order_release);
+  }
+  return model_;
+}
+
+std::shared_ptr<Model> LazyModel::Get() {
+  mutex_lock l(mu_);
+  return model_;
+}
+
+}  // namespace model
+}  // namespace tensorflow
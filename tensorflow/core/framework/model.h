@@ -0,0 +1,311 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_FRAMEWORK_MODEL_H_
+#define TENSORFLOW_CORE_FRAMEWORK_MODEL_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/step_stats.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace model {
+
+// A model of the performance of the iterators of an input pipeline, used to
+// tune their parallelism and buffer sizes at runtime.
+//
+// Each iterator has a node in the model, which collects how many elements
+// it produced, how much time it spent producing them, how long it was
+// blocked on its input, how large the elements were and how full its buffer
+// was. The nodes form a tree following the iterator prefixes. From these
+// statistics, the model estimates how long the consumer of the root
+// iterator waits for each element, and chooses the tunable parameters that
+// minimize that time within a budget of CPU threads and buffer memory. The
+// statistics can also be exported, to find the bottleneck of a pipeline.
+
+// The value of a parallelism or buffer size argument that asks for it to be
+// tuned by the model.
+constexpr int64 kAutoTune = -1;
+
+// Returns a monotonic time in nanoseconds.
+int64 NowNanos();
+
+// A parameter of an iterator, such as its parallelism. The iterator reads
+// the value whenever it needs it; the model may change tunable parameters
+// at any time.
+class Parameter {
+ public:
+  // A parameter tunable in [min, max], initially `min`. If `min` == `max`
+  // the parameter is fixed. If `cond_var` is not null, set_value() changes
+  // the value under `mu` and notifies `cond_var`, so that threads of the
+  // iterator that wait on `cond_var` for the value to change wake up.
+  Parameter(int64 min, int64 max, std::shared_ptr<mutex> mu = nullptr,
+            std::shared_ptr<condition_variable> cond_var = nullptr)
+      : value_(min),
+        min_(min),
+        max_(max),
+        mu_(std::move(mu)),
+        cond_var_(std::move(cond_var)) {}
+
+  int64 value() const { return value_.load(std::memory_order_relaxed); }
+  void set_value(int64 value);
+  int64 min() const { return min_; }
+  int64 max() const { return max_; }
+  bool tunable() const { return min_ < max_; }
+
+ private:
+  std::atomic<int64> value_;
+  const int64 min_;
+  const int64 max_;
+  // Shared with the iterator, which may be destroyed before the parameter.
+  const std::shared_ptr<mutex> mu_;
+  const std::shared_ptr<condition_variable> cond_var_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(Parameter);
+};
+
+// The statistics of one iterator.
+//
+// Iterators are either synchronous, producing elements in the thread that
+// calls GetNext(), or asynchronous, producing elements ahead of time in
+// background threads and buffering them. The processing time of a
+// synchronous iterator is the time spent in its GetNext() calls, minus the
+// time spent in those of the modeled iterators it calls. Asynchronous
+// iterators record their processing time with AddProcessingTime().
+class Node {
+ public:
+  explicit Node(const string& name) : name_(name) {}
+
+  const string& name() const { return name_; }
+
+  // Marks the iterator as asynchronous, with up to `parallelism` calls in
+  // flight and a buffer of up to `buffer_size` elements. A null
+  // `parallelism` means 1, and a null `buffer_size` means that the buffer
+  // holds the outputs of the calls in flight.
+  void SetAsync(std::shared_ptr<Parameter> parallelism,
+                std::shared_ptr<Parameter> buffer_size) LOCKS_EXCLUDED(mu_);
+
+  // Records processing time of an asynchronous iterator.
+  void AddProcessingTime(int64 time_ns) {
+    processing_time_ns_.fetch_add(time_ns, std::memory_order_relaxed);
+  }
+
+  // Records a call to GetNext() that started at `start_ns` and took
+  // `time_ns`, `self_time_ns` of which were spent outside of modeled
+  // inputs. `outputs` is null if the call produced no element.
+  void RecordGetNext(int64 start_ns, int64 time_ns, int64 self_time_ns,
+                     const std::vector<Tensor>* outputs);
+
+  // Records a call to Skip() like RecordGetNext(), which skipped
+  // `num_skipped` elements. The elements count as produced, but since they
+  // were never materialized, their bytes are not known.
+  void RecordSkip(int64 start_ns, int64 time_ns, int64 self_time_ns,
+                  int64 num_skipped);
+
+  // Records the number of elements in the buffer of an asynchronous
+  // iterator, sampled when its consumer asks for an element.
+  void RecordBufferSize(int64 size) {
+    buffered_elements_.fetch_add(size, std::memory_order_relaxed);
+    num_buffer_samples_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  int64 num_elements() const {
+    return num_elements_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  friend class Model;
+
+  // Records the timing of a call to GetNext() or Skip().
+  void RecordCall(int64 start_ns, int64 time_ns, int64 self_time_ns);
+
+  const string name_;
+
+  std::atomic<int64> num_elements_{0};
+  // The part of `num_elements_` that was skipped, and so is not in `bytes_`.
+  std::atomic<int64> num_skipped_{0};
+  std::atomic<int64> processing_time_ns_{0};
+  std::atomic<int64> bytes_{0};
+  // The time the consumer spent between the end of a call to GetNext() and
+  // the start of the next one, over `num_gaps_` such intervals.
+  std::atomic<int64> gap_time_ns_{0};
+  std::atomic<int64> num_gaps_{0};
+  std::atomic<int64> last_return_ns_{0};
+  std::atomic<int64> first_start_ns_{0};
+  // The time spent in GetNext(), and the part of it spent waiting for
+  // inputs: in the GetNext() calls of the inputs of a synchronous iterator,
+  // or for the buffer of an asynchronous one.
+  std::atomic<int64> wall_time_ns_{0};
+  std::atomic<int64> input_time_ns_{0};
+  // The sum of `num_buffer_samples_` samples of the buffer size.
+  std::atomic<int64> buffered_elements_{0};
+  std::atomic<int64> num_buffer_samples_{0};
+
+  std::atomic<bool> async_{false};
+  mutex mu_;
+  std::shared_ptr<Parameter> parallelism_ GUARDED_BY(mu_);
+  std::shared_ptr<Parameter> buffer_size_ GUARDED_BY(mu_);
+
+  // Maintained by the model, under its lock.
+  Node* output_ = nullptr;
+  std::vector<Node*> inputs_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(Node);
+};
+
+// Measures a call to GetNext() or Skip() of the iterator of `node`, which
+// may be null.
+class GetNextRecorder {
+ public:
+  explicit GetNextRecorder(Node* node);
+
+  // Records the call. `outputs` is null if it produced no element.
+  void Stop(const std::vector<Tensor>* outputs);
+
+  // Records the call as a Skip() that skipped `num_skipped` elements.
+  void StopSkip(int64 num_skipped);
+
+ private:
+  Node* const node_;
+  int64 start_ns_ = 0;
+  int64 saved_input_time_ns_ = 0;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(GetNextRecorder);
+};
+
+// The model of one input pipeline. Thread-safe.
+class Model {
+ public:
+  Model();
+
+  // Stops the background optimization.
+  ~Model();
+
+  // Adds the node of the iterator with prefix `name`. Its output is the node
+  // whose name is the longest prefix of `name`. The nodes may be added in
+  // any order: the nodes already in the model that are closer to `name`
+  // than to their output become inputs of the new node.
+  std::shared_ptr<Node> AddNode(const string& name) LOCKS_EXCLUDED(mu_);
+
+  // Removes `node` from the model. Its processing time is added to that of
+  // its output, so that the work of short-lived iterators, such as those
+  // created for each input element of a flat map, is still accounted for.
+  void RemoveNode(Node* node) LOCKS_EXCLUDED(mu_);
+
+  // Returns a new parameter tunable in [min, max], which notifies
+  // `cond_var` under `mu` when the model changes it (see `Parameter`).
+  // Adding the first tunable parameter starts collecting statistics, and
+  // optimizing the parameters periodically in the background.
+  std::shared_ptr<Parameter> AddTunableParameter(
+      int64 min, int64 max, std::shared_ptr<mutex> mu = nullptr,
+      std::shared_ptr<condition_variable> cond_var = nullptr)
+      LOCKS_EXCLUDED(mu_);
+
+  // Returns true iff iterators should record their statistics: once the
+  // model tunes parameters, or while a traced step collects them.
+  bool collecting() const {
+    return tuning_.load(std::memory_order_relaxed) ||
+           num_traced_steps_.load(std::memory_order_relaxed) > 0;
+  }
+
+  // Sets the tunable parameters to values that minimize the modeled time the
+  // consumer of the root iterator waits for each element, using at most
+  // `cpu_budget` threads for the tunable parallelism, and `ram_budget` bytes
+  // for the elements in tunable buffers. The search starts from the minimum
+  // values, so parameters can shrink as well as grow.
+  void Optimize(int64 cpu_budget, int64 ram_budget) LOCKS_EXCLUDED(mu_);
+
+  // Returns the modeled time in nanoseconds the consumer of the root iterator
+  // waits for each element, with the current parameter values.
+  double OutputTime() LOCKS_EXCLUDED(mu_);
+
+  // Returns a description of the nodes, their statistics and parameters.
+  string DebugString() LOCKS_EXCLUDED(mu_);
+
+  // The statistics of the nodes at the start of a traced step.
+  class StepStart;
+
+  // Starts collecting statistics for a traced step, until the matching call
+  // to AddStepStats(). Returns the statistics at the start of the step.
+  std::shared_ptr<StepStart> StartStep() LOCKS_EXCLUDED(mu_);
+
+  // Adds the statistics of the nodes since `start` was returned by
+  // StartStep() to `step_stats`, as the nodes of device `device`, and stops
+  // collecting them for that step. Each node that was used in the step
+  // spans the time from the start of the step, or of the first call to
+  // GetNext() of its iterator if later, to the end of the last call. Its
+  // timeline label has the form "prefix = Type(statistic=value, ...)", so
+  // that tensorflow/python/client/timeline.py shows the statistics as
+  // arguments of the node in a Chrome trace.
+  void AddStepStats(std::shared_ptr<StepStart> start, const string& device,
+                    StepStats* step_stats) LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct State;
+
+  // Snapshots the statistics of the tree rooted at `root_`.
+  void SnapshotLocked(State* state) EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  void OptimizationThread() LOCKS_EXCLUDED(mu_);
+
+  mutex mu_;
+  condition_variable cond_var_;
+  std::map<string, std::shared_ptr<Node>> nodes_ GUARDED_BY(mu_);
+  Node* root_ GUARDED_BY(mu_) = nullptr;
+  std::unique_ptr<Thread> optimization_thread_ GUARDED_BY(mu_);
+  bool cancelled_ GUARDED_BY(mu_) = false;
+  std::atomic<bool> tuning_{false};
+  std::atomic<int64> num_traced_steps_{0};
+
+  TF_DISALLOW_COPY_AND_ASSIGN(Model);
+};
+
+// The model of an input pipeline, created when the pipeline first needs it,
+// so that pipelines that are not tuned do not pay for one. The iterators of
+// the pipeline add their nodes in their first call to GetNext() or Skip()
+// after the model is created. Thread-safe.
+class LazyModel {
+ public:
+  LazyModel() {}
+
+  // Returns the model, creating it if necessary.
+  std::shared_ptr<Model> GetOrCreate() LOCKS_EXCLUDED(mu_);
+
+  // Returns the model, or null if it has not been created yet.
+  std::shared_ptr<Model> Get() LOCKS_EXCLUDED(mu_);
+
+  // Returns true iff the model has been created. Cheaper than Get().
+  bool created() const { return created_.load(std::memory_order_acquire); }
+
+ private:
+  mutex mu_;
+  std::shared_ptr<Model> model_ GUARDED_BY(mu_);
+  std::atomic<bool> created_{false};
+
+  TF_DISALLOW_COPY_AND_ASSIGN(LazyModel);
+};
+
+}  // namespace model
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_FRAMEWORK_MODEL_H_
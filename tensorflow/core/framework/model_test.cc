@@ -0,0 +1,263 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/framework/model.h"
+
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace model {
+namespace {
+
+constexpr int64 kNumElements = 100;
+constexpr int64 kUnlimitedRam = 1LL << 40;
+
+// Records `kNumElements` calls to GetNext() of `node`, starting now, each
+// taking `time_ns` of its own, `gap_ns` apart, and producing `bytes` bytes.
+void RecordElements(Node* node, int64 time_ns, int64 gap_ns, int64 bytes) {
+  std::vector<Tensor> outputs = {Tensor(DT_UINT8, TensorShape({bytes}))};
+  int64 start_ns = NowNanos();
+  for (int64 i = 0; i < kNumElements; ++i) {
+    node->RecordGetNext(start_ns, time_ns, time_ns, &outputs);
+    start_ns += time_ns + gap_ns;
+  }
+}
+
+// Builds the model of `range.map(f, num_parallel_calls)`, where each call to
+// `f` takes `map_time_ns`.
+std::shared_ptr<Parameter> AddParallelMap(Model* model, int64 map_time_ns) {
+  std::shared_ptr<Node> root = model->AddNode("Iterator::ParallelMap");
+  std::shared_ptr<Node> range = model->AddNode("Iterator::ParallelMap::Range");
+  std::shared_ptr<Parameter> parallelism(new Parameter(1, 16));
+  root->SetAsync(parallelism, nullptr);
+  RecordElements(root.get(), 0, 1000, 8);
+  root->AddProcessingTime(kNumElements * map_time_ns);
+  RecordElements(range.get(), 10, 0, 8);
+  return parallelism;
+}
+
+TEST(ModelTest, ParallelismGrowsToCpuBudget) {
+  Model model;
+  std::shared_ptr<Parameter> parallelism =
+      AddParallelMap(&model, /*map_time_ns=*/1000000);
+  const double sequential_time = model.OutputTime();
+  model.Optimize(/*cpu_budget=*/4, kUnlimitedRam);
+  EXPECT_EQ(4, parallelism->value());
+  EXPECT_LT(model.OutputTime(), sequential_time / 3);
+
+  model.Optimize(/*cpu_budget=*/64, kUnlimitedRam);
+  EXPECT_EQ(parallelism->max(), parallelism->value());
+}
+
+TEST(ModelTest, ParametersShrink) {
+  Model model;
+  std::shared_ptr<Parameter> parallelism =
+      AddParallelMap(&model, /*map_time_ns=*/1000000);
+  model.Optimize(/*cpu_budget=*/8, kUnlimitedRam);
+  EXPECT_EQ(8, parallelism->value());
+  model.Optimize(/*cpu_budget=*/2, kUnlimitedRam);
+  EXPECT_EQ(2, parallelism->value());
+}
+
+TEST(ModelTest, NoWorkNeedsNoParallelism) {
+  Model model;
+  std::shared_ptr<Parameter> parallelism =
+      AddParallelMap(&model, /*map_time_ns=*/0);
+  model.Optimize(/*cpu_budget=*/8, kUnlimitedRam);
+  EXPECT_EQ(1, parallelism->value());
+}
+
+TEST(ModelTest, BufferGrowsWithinRamBudget) {
+  Model model;
+  std::shared_ptr<Node> root = model.AddNode("Iterator::Prefetch");
+  std::shared_ptr<Node> map = model.AddNode("Iterator::Prefetch::Map");
+  std::shared_ptr<Parameter> buffer_size(new Parameter(1, 1024));
+  root->SetAsync(nullptr, buffer_size);
+  // The producer is as fast as the consumer, so that a larger buffer hides
+  // more of the variance of the producer.
+  RecordElements(root.get(), 0, 1000, 100);
+  RecordElements(map.get(), 1000, 0, 100);
+
+  model.Optimize(/*cpu_budget=*/8, /*ram_budget=*/1000);
+  EXPECT_EQ(10, buffer_size->value());
+  model.Optimize(/*cpu_budget=*/8, kUnlimitedRam);
+  EXPECT_GT(buffer_size->value(), 10);
+}
+
+TEST(ModelTest, RemovedNodesFoldIntoTheirOutput) {
+  Model model;
+  std::shared_ptr<Node> root = model.AddNode("Iterator::FlatMap");
+  root->SetAsync(nullptr, nullptr);
+  {
+    std::shared_ptr<Node> input = model.AddNode("Iterator::FlatMap[0]");
+    input->AddProcessingTime(1000);
+    input->SetAsync(nullptr, nullptr);
+    model.RemoveNode(input.get());
+  }
+  RecordElements(root.get(), 0, 0, 8);
+  EXPECT_NE(string::npos, model.DebugString().find("10 ns"));
+  EXPECT_EQ(string::npos, model.DebugString().find("FlatMap[0]"));
+}
+
+TEST(ModelTest, TunableParametersStartAtMin) {
+  Model model;
+  std::shared_ptr<Parameter> parameter = model.AddTunableParameter(2, 8);
+  EXPECT_TRUE(parameter->tunable());
+  EXPECT_EQ(2, parameter->value());
+}
+
+TEST(ModelTest, ParameterChangesWakeUpWaiters) {
+  auto mu = std::make_shared<mutex>();
+  auto cond_var = std::make_shared<condition_variable>();
+  Parameter parameter(1, 8, mu, cond_var);
+  int64 seen = 0;
+  {
+    std::unique_ptr<Thread> waiter(
+        Env::Default()->StartThread({}, "waiter", [&]() {
+          mutex_lock l(*mu);
+          while (parameter.value() == 1) {
+            cond_var->wait(l);
+          }
+          seen = parameter.value();
+        }));
+    parameter.set_value(4);
+  }
+  EXPECT_EQ(4, seen);
+}
+
+TEST(ModelTest, NodesAddedInAnyOrder) {
+  Model model;
+  std::shared_ptr<Node> range =
+      model.AddNode("Iterator::Prefetch::Map::Range");
+  std::shared_ptr<Node> root = model.AddNode("Iterator::Prefetch");
+  std::shared_ptr<Node> map = model.AddNode("Iterator::Prefetch::Map");
+  RecordElements(root.get(), 0, 0, 8);
+  RecordElements(map.get(), 0, 0, 8);
+  RecordElements(range.get(), 0, 0, 8);
+  const string debug_string = model.DebugString();
+  const size_t root_pos = debug_string.find("Iterator::Prefetch:");
+  const size_t map_pos = debug_string.find("Iterator::Prefetch::Map:");
+  const size_t range_pos = debug_string.find("Iterator::Prefetch::Map::Range:");
+  EXPECT_EQ(0, root_pos);
+  EXPECT_LT(root_pos, map_pos);
+  EXPECT_LT(map_pos, range_pos);
+  EXPECT_NE(string::npos, range_pos);
+}
+
+TEST(ModelTest, LazyModelIsCreatedOnce) {
+  LazyModel lazy_model;
+  EXPECT_FALSE(lazy_model.created());
+  EXPECT_EQ(nullptr, lazy_model.Get());
+  std::shared_ptr<Model> model = lazy_model.GetOrCreate();
+  ASSERT_NE(nullptr, model);
+  EXPECT_TRUE(lazy_model.created());
+  EXPECT_EQ(model, lazy_model.GetOrCreate());
+  EXPECT_EQ(model, lazy_model.Get());
+}
+
+TEST(ModelTest, StepStats) {
+  Model model;
+  std::shared_ptr<Node> root = model.AddNode("Iterator::Prefetch");
+  std::shared_ptr<Node> map = model.AddNode("Iterator::Prefetch::Map");
+  std::shared_ptr<Node> unused =
+      model.AddNode("Iterator::Prefetch::Map::Range");
+  root->SetAsync(nullptr, std::make_shared<Parameter>(4, 4));
+  std::shared_ptr<Model::StepStart> start = model.StartStep();
+  RecordElements(root.get(), 500, 1000, 100);
+  RecordElements(map.get(), 1000, 0, 100);
+  for (int64 i = 0; i < kNumElements; ++i) {
+    root->RecordBufferSize(i % 2);
+  }
+
+  StepStats step_stats;
+  model.AddStepStats(start, "/device:CPU:0/tf_data", &step_stats);
+  ASSERT_EQ(1, step_stats.dev_stats_size());
+  const DeviceStepStats& device_stats = step_stats.dev_stats(0);
+  EXPECT_EQ("/device:CPU:0/tf_data", device_stats.device());
+  // Iterators that never produced an element are left out.
+  ASSERT_EQ(2, device_stats.node_stats_size());
+  const NodeExecStats& prefetch = device_stats.node_stats(0);
+  EXPECT_EQ("Iterator::Prefetch", prefetch.node_name());
+  EXPECT_EQ((kNumElements * 1500 - 1000) / 1000,
+            prefetch.all_end_rel_micros());
+  EXPECT_EQ(
+      "Iterator::Prefetch = Prefetch(elements=100, bytes_per_element=100, "
+      "wall_ns_per_element=500, self_ns_per_element=0, "
+      "input_ns_per_element=500, parallelism=1, buffer_size=4, "
+      "average_buffered=0.5)",
+      prefetch.timeline_label());
+  EXPECT_EQ(
+      "Iterator::Prefetch::Map = Map(elements=100, bytes_per_element=100, "
+      "wall_ns_per_element=1000, self_ns_per_element=1000, "
+      "input_ns_per_element=0)",
+      device_stats.node_stats(1).timeline_label());
+}
+
+TEST(ModelTest, SkippedElements) {
+  Model model;
+  std::shared_ptr<Node> root = model.AddNode("Iterator::Skip");
+  std::shared_ptr<Node> input = model.AddNode("Iterator::Skip::Range");
+  std::shared_ptr<Model::StepStart> start = model.StartStep();
+  RecordElements(root.get(), 1000, 0, 8);
+  RecordElements(input.get(), 1000, 0, 8);
+  // Skipped elements are produced, but their bytes are not known.
+  input->RecordSkip(NowNanos(), 100 * 1000, 100 * 1000, 100);
+
+  StepStats step_stats;
+  model.AddStepStats(start, "/device:CPU:0/tf_data", &step_stats);
+  ASSERT_EQ(1, step_stats.dev_stats_size());
+  ASSERT_EQ(2, step_stats.dev_stats(0).node_stats_size());
+  EXPECT_EQ(
+      "Iterator::Skip::Range = Range(elements=200, bytes_per_element=8, "
+      "wall_ns_per_element=1000, self_ns_per_element=1000, "
+      "input_ns_per_element=0)",
+      step_stats.dev_stats(0).node_stats(1).timeline_label());
+}
+
+TEST(ModelTest, StepStatsOnlyCoverTheirStep) {
+  Model model;
+  std::shared_ptr<Node> root = model.AddNode("Iterator::Map");
+  std::shared_ptr<Node> unused = model.AddNode("Iterator::Map::Range");
+  EXPECT_FALSE(model.collecting());
+  std::shared_ptr<Model::StepStart> start = model.StartStep();
+  EXPECT_TRUE(model.collecting());
+  RecordElements(root.get(), 1000, 0, 8);
+  StepStats first_step_stats;
+  model.AddStepStats(start, "/device:CPU:0/tf_data", &first_step_stats);
+  EXPECT_FALSE(model.collecting());
+
+  start = model.StartStep();
+  RecordElements(root.get(), 3000, 0, 24);
+  StepStats second_step_stats;
+  model.AddStepStats(start, "/device:CPU:0/tf_data", &second_step_stats);
+  // Neither step reports the iterator that it did not use.
+  ASSERT_EQ(1, second_step_stats.dev_stats(0).node_stats_size());
+  EXPECT_EQ(
+      "Iterator::Map = Map(elements=100, bytes_per_element=24, "
+      "wall_ns_per_element=3000, self_ns_per_element=3000, "
+      "input_ns_per_element=0)",
+      second_step_stats.dev_stats(0).node_stats(0).timeline_label());
+
+  // Tuning collects statistics all the time.
+  std::shared_ptr<Parameter> parameter = model.AddTunableParameter(1, 2);
+  EXPECT_TRUE(model.collecting());
+}
+
+}  // namespace
+}  // namespace model
+}  // namespace tensorflow
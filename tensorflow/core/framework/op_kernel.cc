@@ -76,6 +76,14 @@ Status MatchSignatureHelper(const DataTypeSlice expected_inputs,
   return Status::OK();
 }
 
+// Attributes of plain host memory, the only kind of memory served by
+// OpKernelContext::Params::step_allocator.
+AllocatorAttributes HostMemoryAttributes() {
+  AllocatorAttributes attr;
+  attr.set_on_host(true);
+  return attr;
+}
+
 }  // namespace
 
 // OpKernel ------------------------------------------------------------------
@@ -284,11 +292,20 @@ OpKernelContext::~OpKernelContext() {
   if (params_->record_tensor_accesses) referenced_tensors_.Destroy();
 }
 
-Allocator* OpKernelContext::get_allocator(AllocatorAttributes attr) {
+Allocator* OpKernelContext::get_allocator(AllocatorAttributes attr,
+                                          bool step_local, int output_index) {
   Allocator* allocator = nullptr;
   if (TF_PREDICT_FALSE(attr.scope_id > 0)) {
     allocator = params_->device->GetScopedAllocator(attr, step_id());
     CHECK(allocator);
+  } else if (step_local && output_index >= 0 &&
+             params_->output_allocators != nullptr &&
+             params_->output_allocators[output_index] != nullptr &&
+             attr.IsEqualOrLessRestrictiveThan(HostMemoryAttributes())) {
+    allocator = params_->output_allocators[output_index];
+  } else if (step_local && params_->step_allocator != nullptr &&
+             attr.IsEqualOrLessRestrictiveThan(HostMemoryAttributes())) {
+    allocator = params_->step_allocator;
   } else {
     allocator = params_->device->GetAllocator(attr);
   }
@@ -673,8 +690,9 @@ Status OpKernelContext::allocate_output(StringPiece name,
 
 Status OpKernelContext::allocate_tensor(
     DataType type, const TensorShape& shape, Tensor* out_tensor,
-    AllocatorAttributes attr, const AllocationAttributes& allocation_attr) {
-  Allocator* a = get_allocator(attr);
+    AllocatorAttributes attr, const AllocationAttributes& allocation_attr,
+    bool step_local, int output_index) {
+  Allocator* a = get_allocator(attr, step_local, output_index);
   AllocationAttributes logged_attr(allocation_attr);
   logged_attr.allocation_will_be_logged = true;
   Tensor new_tensor(a, type, shape, logged_attr);
@@ -703,7 +721,9 @@ Status OpKernelContext::allocate_output(int index, const TensorShape& shape,
   DCHECK(!IsRefType(type));
   DCHECK(mutable_output(index) == nullptr);
   Tensor* output_tensor = new Tensor();
-  Status s = allocate_tensor(type, shape, output_tensor, attr);
+  Status s = allocate_tensor(type, shape, output_tensor, attr,
+                             AllocationAttributes(), true /* step_local */,
+                             index);
   if (s.ok()) {
     outputs_[index] = TensorValue(output_tensor);
     *output = outputs_[index].tensor;
@@ -715,10 +735,10 @@ Status OpKernelContext::allocate_temp(
     DataType type, const TensorShape& shape, Tensor* out_temp,
     AllocatorAttributes allocator_attr,
     const AllocationAttributes& allocation_attr) {
-  Status s =
-      allocate_tensor(type, shape, out_temp, allocator_attr, allocation_attr);
+  Status s = allocate_tensor(type, shape, out_temp, allocator_attr,
+                             allocation_attr, true /* step_local */);
   if (track_allocations() && s.ok() && out_temp->TotalBytes() > 0) {
-    Allocator* a = get_allocator(allocator_attr);
+    Allocator* a = get_allocator(allocator_attr, true /* step_local */);
     if (a->TracksAllocationSizes()) {
       int64 alloc_size = a->AllocatedSize(out_temp->tensor_data().data());
       record_temp_memory_allocation(alloc_size, *out_temp);
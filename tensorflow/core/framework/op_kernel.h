@@ -523,6 +523,18 @@ class OpKernelContext {
     // Array indexed by output number for this node
     const AllocatorAttributes* output_attr_array = nullptr;
 
+    // If not nullptr, the outputs and temporaries of this op kernel
+    // invocation that ask for plain host memory are allocated from this
+    // allocator, which the executor provides for buffers that are not
+    // expected to outlive the step.
+    Allocator* step_allocator = nullptr;
+
+    // If not nullptr, indexed by output number: the allocator that serves
+    // the buffer planned ahead of the step for the output, or nullptr if
+    // the output is not planned. Used instead of step_allocator by
+    // allocate_output() for plain host memory, but not for temporaries.
+    Allocator* const* output_allocators = nullptr;
+
     // Shared resources accessible by this op kernel invocation.
     ResourceMgr* resource_manager = nullptr;
 
@@ -1103,7 +1115,11 @@ class OpKernelContext {
   bool input_is_ref(int index) const;
 
  private:
-  Allocator* get_allocator(AllocatorAttributes attr);
+  // If "step_local" is true, the buffer is not expected to outlive the
+  // step, and may come from params_->step_allocator, or, for output
+  // "output_index" if it is not -1, from params_->output_allocators.
+  Allocator* get_allocator(AllocatorAttributes attr, bool step_local = false,
+                           int output_index = -1);
 
   // Internal method to add a tensor's buffer to the list of buffers
   // referenced during the execution of the Op, so that GPUs may
@@ -1122,7 +1138,8 @@ class OpKernelContext {
 
   Status allocate_tensor(DataType type, const TensorShape& shape,
                          Tensor* out_tensor, AllocatorAttributes allocator_attr,
-                         const AllocationAttributes& allocation_attr);
+                         const AllocationAttributes& allocation_attr,
+                         bool step_local = false, int output_index = -1);
 
   // This is called by PersistentTensor::AccessTensor whenever the
   // wrapped tensor is retrieved, to ensure the runtime knows that the
@@ -16,7 +16,12 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_FRAMEWORK_RESOURCE_VAR_H_
 #define TENSORFLOW_CORE_FRAMEWORK_RESOURCE_VAR_H_
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/lib/gtl/array_slice.h"
 
 namespace tensorflow {
 
@@ -48,10 +53,80 @@ class Var : public ResourceBase {
   bool is_initialized = false;  // GUARDED_BY(mu_) but annotalysis doesn't like
                                 // it.
 
+  // Tracking of the rows of the tensor, i.e. its slices along the first
+  // dimension, that kernels update, so that incremental checkpoints (see
+  // SaveDeltaV2) only save those.  Tracking starts with the first call to
+  // TakeDirtyRows().  Thread-safe, without requiring mu(); updates that are
+  // not serialized with mu() may race with the checkpoint as with any read.
+
+  // Records that "rows" have been updated.  Kernels call this once the rows
+  // have been written.
+  template <typename Tindex>
+  void MarkRowsDirty(gtl::ArraySlice<Tindex> rows) {
+    if (!track_dirty_rows_.load(std::memory_order_acquire)) return;
+    // Concurrent updates only share the lock, and set the bits of their rows
+    // with atomic operations.
+    tf_shared_lock l(dirty_rows_mu_);
+    if (all_rows_dirty_.load(std::memory_order_relaxed)) return;
+    for (const Tindex row : rows) {
+      if (row < 0 || static_cast<int64>(row) >= num_tracked_rows_) continue;
+      std::atomic<uint64>* word = &dirty_words_[row / 64];
+      const uint64 bit = uint64{1} << (row % 64);
+      // Rows that are updated often are mostly dirty already, and their
+      // words are only read.
+      if ((word->load(std::memory_order_relaxed) & bit) == 0) {
+        word->fetch_or(bit, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Records that any row may have been updated, e.g. by a dense update.
+  void MarkAllRowsDirty() {
+    if (!track_dirty_rows_.load(std::memory_order_acquire)) return;
+    tf_shared_lock l(dirty_rows_mu_);
+    all_rows_dirty_.store(true, std::memory_order_relaxed);
+  }
+
+  // Returns true if any of the "num_rows" rows may have been updated since
+  // the last call, which is the case on the first call.  Otherwise sets
+  // "*rows" to the sorted rows that have been.
+  bool TakeDirtyRows(int64 num_rows, std::vector<int64>* rows) {
+    mutex_lock l(dirty_rows_mu_);
+    track_dirty_rows_.store(true, std::memory_order_release);
+    const bool all_rows_dirty =
+        all_rows_dirty_.load(std::memory_order_relaxed) ||
+        num_tracked_rows_ != num_rows;
+    const int64 num_words = (num_rows + 63) / 64;
+    if (num_tracked_rows_ != num_rows) {
+      dirty_words_.reset(new std::atomic<uint64>[num_words]());
+      num_tracked_rows_ = num_rows;
+    }
+    rows->clear();
+    for (int64 i = 0; i < num_words; ++i) {
+      uint64 word = dirty_words_[i].load(std::memory_order_relaxed);
+      dirty_words_[i].store(0, std::memory_order_relaxed);
+      if (all_rows_dirty) continue;
+      for (int64 row = i * 64; word != 0; ++row, word >>= 1) {
+        if (word & 1) rows->push_back(row);
+      }
+    }
+    all_rows_dirty_.store(false, std::memory_order_relaxed);
+    return all_rows_dirty;
+  }
+
  private:
   mutex mu_;
   Tensor tensor_;
 
+  std::atomic<bool> track_dirty_rows_{false};
+  // Held in shared mode to mark rows dirty, and exclusively to take them.
+  mutex dirty_rows_mu_;
+  std::atomic<bool> all_rows_dirty_{true};
+  int64 num_tracked_rows_ GUARDED_BY(dirty_rows_mu_) = -1;
+  // One bit per row.
+  std::unique_ptr<std::atomic<uint64>[]> dirty_words_
+      GUARDED_BY(dirty_rows_mu_);
+
   ~Var() override {}
 };
 
@@ -501,6 +501,10 @@ class Tensor {
 
   friend class NumpyTensorBuffer;  // For access to the private constructor
                                    // taking the buffer.
+  friend class SharedMemoryTensorBuffer;  // For access to the private
+                                          // constructor taking the buffer.
+  friend class MappedBundleTensorBuffer;  // For access to the private
+                                          // constructor taking the buffer.
 
   // Creates a tensor with the input datatype, shape and buf.
   //
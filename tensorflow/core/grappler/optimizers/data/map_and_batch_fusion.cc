@@ -110,6 +110,10 @@ Status MapAndBatchFusion::Optimize(Cluster* cluster, const GrapplerItem& item,
     for (auto key : {"output_shapes", "output_types"}) {
       (*new_node->mutable_attr())[key] = batch_node.attr().at(key);
     }
+    // Set the `sloppy` attribute, so that a sloppy map stays sloppy.
+    if (map_node->attr().count("sloppy")) {
+      (*new_node->mutable_attr())["sloppy"] = map_node->attr().at("sloppy");
+    }
 
     // Mark the `Map` and `Batch` nodes for removal.
     nodes_to_delete.insert(map_node->name());
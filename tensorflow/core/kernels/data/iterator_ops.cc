@@ -15,11 +15,13 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/function.h"
 #include "tensorflow/core/common_runtime/graph_runner.h"
 #include "tensorflow/core/common_runtime/renamed_device.h"
+#include "tensorflow/core/common_runtime/step_stats_collector.h"
 #include "tensorflow/core/common_runtime/threadpool_device.h"
 #include "tensorflow/core/framework/iterator.pb.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/resource_op_kernel.h"
 #include "tensorflow/core/framework/stats_aggregator.h"
+#include "tensorflow/core/framework/step_stats.pb.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/variant_op_registry.h"
 #include "tensorflow/core/graph/graph_constructor.h"
@@ -97,20 +99,40 @@ class IteratorResource : public ResourceBase {
         output_dtypes_(output_dtypes),
         output_shapes_(output_shapes) {}
 
-  Status GetNext(IteratorContext* ctx, std::vector<Tensor>* out_tensors,
+  // Gets the next element for the step of `ctx`.
+  Status GetNext(OpKernelContext* ctx, std::vector<Tensor>* out_tensors,
                  bool* end_of_sequence) {
-    std::shared_ptr<IteratorBase> captured_iterator(iterator_);
-    if (captured_iterator) {
-      if (lib_ != nullptr) {
-        ctx->set_lib(lib_);
-      }
-      return captured_iterator->GetNext(ctx, out_tensors, end_of_sequence);
-    } else {
+    std::shared_ptr<IteratorBase> captured_iterator;
+    std::shared_ptr<model::LazyModel> model;
+    {
+      tf_shared_lock l(mu_);
+      captured_iterator = iterator_;
+      model = model_;
+    }
+    if (!captured_iterator) {
       return errors::FailedPrecondition(
           "GetNext() failed because the iterator has not been initialized. "
           "Ensure that you have run the initializer operation for this "
           "iterator before getting the next element.");
     }
+
+    IteratorContext::Params params;
+    params.env = ctx->env();
+    params.runner = *(ctx->runner());
+    params.function_library = function_library();
+    DeviceBase* device = ctx->function_library()->device();
+    params.allocator_getter = [device](AllocatorAttributes attrs) {
+      return device->GetAllocator(attrs);
+    };
+    if (lib_ != nullptr) {
+      params.lib = lib_;
+    }
+    // Iterators created while getting the element, e.g. the input of a
+    // repeat, join the model of the pipeline.
+    params.model = std::move(model);
+    params.cancellation_manager = ctx->cancellation_manager();
+    IteratorContext iter_ctx(std::move(params));
+    return captured_iterator->GetNext(&iter_ctx, out_tensors, end_of_sequence);
   }
 
   Status Save(OpKernelContext* ctx, IteratorStateWriter* writer) {
@@ -161,7 +183,8 @@ class IteratorResource : public ResourceBase {
     IteratorContext iter_ctx = dataset::MakeIteratorContext(ctx);
     std::unique_ptr<IteratorBase> iterator;
     TF_RETURN_IF_ERROR(dataset->MakeIterator(&iter_ctx, "Iterator", &iterator));
-    TF_RETURN_IF_ERROR(set_iterator(std::move(iterator)));
+    std::shared_ptr<model::LazyModel> model = iter_ctx.model();
+    TF_RETURN_IF_ERROR(set_iterator(std::move(iterator), model));
     std::shared_ptr<IteratorBase> captured_iterator(iterator_);
 
     if (captured_iterator) {
@@ -169,6 +192,7 @@ class IteratorResource : public ResourceBase {
       params.env = ctx->env();
       params.runner = *(ctx->runner());
       params.lib = lib;
+      params.model = std::move(model);
       DeviceBase* device = lib->device();
       params.allocator_getter = [device](AllocatorAttributes attrs) {
         return device->GetAllocator(attrs);
@@ -195,18 +219,68 @@ class IteratorResource : public ResourceBase {
     return lib_def_;
   }
 
-  // Transfers ownership of iterator to this. This method is thread-safe.
-  Status set_iterator(std::unique_ptr<IteratorBase> iterator) {
+  // Transfers ownership of iterator to this, along with the model of its
+  // input pipeline, if any. This method is thread-safe.
+  Status set_iterator(std::unique_ptr<IteratorBase> iterator,
+                      std::shared_ptr<model::LazyModel> model) {
     if (iterator) {
       TF_RETURN_IF_ERROR(
           VerifyTypesMatch(output_dtypes_, iterator->output_dtypes()));
       TF_RETURN_IF_ERROR(
           VerifyShapesCompatible(output_shapes_, iterator->output_shapes()));
     }
+    mutex_lock l(mu_);
     iterator_.reset(iterator.release());
+    model_ = std::move(model);
     return Status::OK();
   }
 
+  // The statistics collection of the input pipeline during a traced step.
+  struct TracedStep {
+    std::shared_ptr<model::Model> model;
+    std::shared_ptr<model::Model::StepStart> start;
+  };
+
+  // If the step of `ctx` is traced, starts collecting the statistics of the
+  // iterators of the input pipeline, creating its model if needed.
+  TracedStep StartTracedStep(OpKernelContext* ctx) {
+    TracedStep traced_step;
+    if (ctx->stats_collector() == nullptr) {
+      return traced_step;
+    }
+    std::shared_ptr<model::LazyModel> lazy_model;
+    {
+      tf_shared_lock l(mu_);
+      lazy_model = model_;
+    }
+    if (lazy_model) {
+      traced_step.model = lazy_model->GetOrCreate();
+      traced_step.start = traced_step.model->StartStep();
+    }
+    return traced_step;
+  }
+
+  // Adds the statistics of the iterators of the input pipeline since
+  // StartTracedStep() returned `traced_step` to the step stats of `ctx`.
+  // They appear in the step stats as the nodes of a "/tf_data" subdevice of
+  // the device of `ctx`.
+  void AddStepStats(OpKernelContext* ctx, TracedStep traced_step) {
+    if (!traced_step.model) {
+      return;
+    }
+    const string device =
+        strings::StrCat(ctx->device()->attributes().name(), "/tf_data");
+    StepStats step_stats;
+    traced_step.model->AddStepStats(std::move(traced_step.start), device,
+                                    &step_stats);
+    for (NodeExecStats& node_stats :
+         *step_stats.mutable_dev_stats(0)->mutable_node_stats()) {
+      NodeExecStats* saved_node_stats = new NodeExecStats;
+      saved_node_stats->Swap(&node_stats);
+      ctx->stats_collector()->Save(device, saved_node_stats);
+    }
+  }
+
   string DebugString() override { return "Iterator resource"; }
 
   const DataTypeVector& output_dtypes() const { return output_dtypes_; }
@@ -223,9 +297,10 @@ class IteratorResource : public ResourceBase {
   std::unique_ptr<FunctionLibraryDefinition> flib_def_;
   std::unique_ptr<ProcessFunctionLibraryRuntime> pflr_;
   FunctionLibraryRuntime* lib_ = nullptr;  // not owned.
-  std::shared_ptr<IteratorBase> iterator_;
   mutex mu_;
+  std::shared_ptr<IteratorBase> iterator_;
   std::shared_ptr<const FunctionLibraryDefinition> lib_def_ GUARDED_BY(mu_);
+  std::shared_ptr<model::LazyModel> model_ GUARDED_BY(mu_);
   const DataTypeVector output_dtypes_;
   const std::vector<PartialTensorShape> output_shapes_;
 };
@@ -658,7 +733,8 @@ class MakeIteratorOp : public OpKernel {
     std::unique_ptr<IteratorBase> iterator;
     OP_REQUIRES_OK(ctx,
                    dataset->MakeIterator(&iter_ctx, "Iterator", &iterator));
-    OP_REQUIRES_OK(ctx, iterator_resource->set_iterator(std::move(iterator)));
+    OP_REQUIRES_OK(ctx, iterator_resource->set_iterator(std::move(iterator),
+                                                        iter_ctx.model()));
   }
 };
 
@@ -887,7 +963,8 @@ class OneShotIteratorOp : public AsyncOpKernel {
     IteratorContext iter_ctx = dataset::MakeIteratorContext(ctx);
     std::unique_ptr<IteratorBase> iter;
     TF_RETURN_IF_ERROR(dataset->MakeIterator(&iter_ctx, "Iterator", &iter));
-    TF_RETURN_IF_ERROR((*iterator)->set_iterator(std::move(iter)));
+    TF_RETURN_IF_ERROR(
+        (*iterator)->set_iterator(std::move(iter), iter_ctx.model()));
 
     (*iterator)->Ref();
     return Status::OK();
@@ -950,18 +1027,10 @@ class IteratorGetNextOp : public AsyncOpKernel {
           std::vector<Tensor> components;
           bool end_of_sequence = false;
 
-          IteratorContext::Params params;
-          params.env = ctx->env();
-          params.runner = *(ctx->runner());
-          params.function_library = iterator->function_library();
-          DeviceBase* device = ctx->function_library()->device();
-          params.allocator_getter = [device](AllocatorAttributes attrs) {
-            return device->GetAllocator(attrs);
-          };
-          IteratorContext iter_ctx(std::move(params));
-
-          Status s =
-              iterator->GetNext(&iter_ctx, &components, &end_of_sequence);
+          IteratorResource::TracedStep traced_step =
+              iterator->StartTracedStep(ctx);
+          Status s = iterator->GetNext(ctx, &components, &end_of_sequence);
+          iterator->AddStepStats(ctx, std::move(traced_step));
           // NOTE(mrry): We must unref the iterator before calling `done()`, to
           // avoid destruction races.
           iterator->Unref();
@@ -998,18 +1067,10 @@ class IteratorGetNextSyncOp : public OpKernel {
     std::vector<Tensor> components;
     bool end_of_sequence = false;
 
-    IteratorContext::Params params;
-    params.env = ctx->env();
-    params.runner = *(ctx->runner());
-    params.function_library = iterator->function_library();
-    DeviceBase* device = ctx->function_library()->device();
-    params.allocator_getter = [device](AllocatorAttributes attrs) {
-      return device->GetAllocator(attrs);
-    };
-    IteratorContext iter_ctx(std::move(params));
-
-    OP_REQUIRES_OK(ctx,
-                   iterator->GetNext(&iter_ctx, &components, &end_of_sequence));
+    IteratorResource::TracedStep traced_step = iterator->StartTracedStep(ctx);
+    Status s = iterator->GetNext(ctx, &components, &end_of_sequence);
+    iterator->AddStepStats(ctx, std::move(traced_step));
+    OP_REQUIRES_OK(ctx, s);
     OP_REQUIRES(ctx, !end_of_sequence, errors::OutOfRange("End of sequence"));
 
     for (int i = 0; i < components.size(); ++i) {
@@ -26,6 +26,7 @@ limitations under the License.
 #include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/tracing.h"
 
 namespace tensorflow {
@@ -44,6 +45,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
     OP_REQUIRES_OK(ctx, ctx->GetAttr("f", &func_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("output_types", &output_types_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("output_shapes", &output_shapes_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("sloppy", &sloppy_));
   }
 
  protected:
@@ -77,7 +79,9 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       case 2:
         OP_REQUIRES_OK(ctx, ParseScalarArgument(ctx, "num_parallel_calls",
                                                 &num_parallel_calls));
-        OP_REQUIRES(ctx, num_parallel_calls > 0,
+        OP_REQUIRES(ctx,
+                    num_parallel_calls > 0 ||
+                        num_parallel_calls == model::kAutoTune,
                     errors::InvalidArgument(
                         "num_parallel_calls must be greater than zero."));
         break;
@@ -96,15 +100,16 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
                             func_, std::move(other_arguments), &captured_func));
 
     *output = new Dataset(ctx, input, batch_size, num_parallel_calls,
-                          drop_remainder, output_types_, output_shapes_, func_,
-                          std::move(captured_func), &ctx->eigen_cpu_device());
+                          drop_remainder, sloppy_, output_types_,
+                          output_shapes_, func_, std::move(captured_func),
+                          &ctx->eigen_cpu_device());
   }
 
  private:
   class Dataset : public GraphDatasetBase {
    public:
     Dataset(OpKernelContext* ctx, const DatasetBase* input, int64 batch_size,
-            int64 num_parallel_calls, bool drop_remainder,
+            int64 num_parallel_calls, bool drop_remainder, bool sloppy,
             const DataTypeVector& output_types,
             const std::vector<PartialTensorShape>& output_shapes,
             const NameAttrList& func,
@@ -115,6 +120,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
           batch_size_(batch_size),
           num_parallel_calls_(num_parallel_calls),
           drop_remainder_(drop_remainder),
+          sloppy_(sloppy),
           output_types_(output_types),
           output_shapes_(output_shapes),
           map_fn_(func),
@@ -171,6 +177,8 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       b->BuildAttrValue(map_fn_, &f);
       AttrValue other_arguments_types_attr;
       b->BuildAttrValue(other_arguments_types, &other_arguments_types_attr);
+      AttrValue sloppy_attr;
+      b->BuildAttrValue(sloppy_, &sloppy_attr);
 
       TF_RETURN_IF_ERROR(b->AddDataset(
           this,
@@ -180,7 +188,8 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
            std::make_pair(4, drop_remainder_node)},  // Single tensor inputs.
           {std::make_pair(1, other_arguments)},      // Tensor list inputs.
           {std::make_pair("f", f),
-           std::make_pair("Targuments", other_arguments_types_attr)},  // Attrs
+           std::make_pair("Targuments", other_arguments_types_attr),
+           std::make_pair("sloppy", sloppy_attr)},  // Attrs
           output));
       return Status::OK();
     }
@@ -189,20 +198,26 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
     class Iterator : public DatasetIterator<Dataset> {
      public:
       explicit Iterator(const Params& params)
-          : DatasetIterator<Dataset>(params) {}
+          : DatasetIterator<Dataset>(params),
+            mu_(std::make_shared<mutex>()),
+            runner_cond_var_(std::make_shared<condition_variable>()) {}
 
       ~Iterator() override {
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         // Cancel the runner thread.
         cancelled_ = true;
-        cond_var_.notify_all();
+        runner_cond_var_->notify_all();
         // Wait for all in-flight calls to complete.
         while (num_calls_ > 0) {
-          cond_var_.wait(l);
+          runner_cond_var_->wait(l);
         }
       }
 
       Status Initialize(IteratorContext* ctx) override {
+        num_parallel_calls_ = MakeParameter(
+            dataset()->num_parallel_calls_, /*min=*/1,
+            /*max=*/port::NumSchedulableCPUs(), mu_, runner_cond_var_);
+        SetAsync(num_parallel_calls_, /*buffer_size=*/nullptr);
         return dataset()->input_->MakeIterator(ctx, prefix(), &input_impl_);
       }
 
@@ -211,25 +226,25 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
                              bool* end_of_sequence) override {
         std::shared_ptr<BatchResult> result;
         {
-          mutex_lock l(mu_);
+          mutex_lock l(*mu_);
           EnsureRunnerThreadStarted(ctx);
-          while (batch_results_.empty() ||
-                 batch_results_.front()->num_calls > 0) {
-            cond_var_.wait(l);
+          RecordBufferSize(batch_results_.size());
+          num_waiting_consumers_++;
+          while (!TakeResultLocked(&result)) {
+            consumer_cond_var_.wait(l);
           }
-          std::swap(result, batch_results_.front());
-          batch_results_.pop_front();
+          num_waiting_consumers_--;
         }
-        cond_var_.notify_all();
+        runner_cond_var_->notify_all();
         return ProcessResult(ctx, result, out_tensors, end_of_sequence);
       }
 
      protected:
       Status SaveInternal(IteratorStateWriter* writer) override {
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         // Wait for all in-flight calls to complete.
         while (num_calls_ > 0) {
-          cond_var_.wait(l);
+          runner_cond_var_->wait(l);
         }
         CHECK_EQ(num_calls_, 0);
         TF_RETURN_IF_ERROR(SaveParent(writer, input_impl_));
@@ -245,7 +260,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
 
       Status RestoreInternal(IteratorContext* ctx,
                              IteratorStateReader* reader) override {
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         TF_RETURN_IF_ERROR(RestoreParent(ctx, reader, input_impl_));
         TF_RETURN_IF_ERROR(
             reader->ReadScalar(full_name("call_counter"), &call_counter_));
@@ -286,7 +301,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       void Callback(const std::shared_ptr<IteratorContext>& ctx,
                     const std::shared_ptr<BatchResult>& result,
                     const std::shared_ptr<std::vector<Tensor>>& return_values,
-                    int64 offset, const Status& status) LOCKS_EXCLUDED(mu_) {
+                    int64 offset, const Status& status) LOCKS_EXCLUDED(*mu_) {
         result->UpdateStatus(status);
         if (status.ok()) {
           EnsureOutputAllocated(ctx, result, return_values);
@@ -322,18 +337,28 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       void CallCompleted(const std::shared_ptr<BatchResult>& result)
-          LOCKS_EXCLUDED(mu_) {
+          LOCKS_EXCLUDED(*mu_) {
+        bool notify_consumers;
         {
-          mutex_lock l(mu_);
+          mutex_lock l(*mu_);
           num_calls_--;
           result->num_calls--;
+          // Unless the iterator is sloppy, a consumer only waits for the batch
+          // at the front of the buffer, so completing any other batch need not
+          // wake it.
+          notify_consumers =
+              num_waiting_consumers_ > 0 && result->num_calls == 0 &&
+              (dataset()->sloppy_ || result == batch_results_.front());
+        }
+        runner_cond_var_->notify_all();
+        if (notify_consumers) {
+          consumer_cond_var_.notify_all();
         }
-        cond_var_.notify_all();
       }
 
       void CallFunction(std::shared_ptr<IteratorContext> ctx,
                         const std::shared_ptr<BatchResult>& result,
-                        int64 offset) LOCKS_EXCLUDED(mu_) {
+                        int64 offset) LOCKS_EXCLUDED(*mu_) {
         // Get the next input element.
         std::vector<Tensor> input_element;
         bool end_of_input;
@@ -358,9 +383,12 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
                                    std::vector<Tensor> input_element) {
               std::shared_ptr<std::vector<Tensor>> return_values(
                   new std::vector<Tensor>());
+              const int64 start_ns = model::NowNanos();
               dataset()->captured_func_->RunAsync(
                   ctx.get(), std::move(input_element), return_values.get(),
-                  [this, ctx, result, return_values, offset](Status status) {
+                  [this, ctx, result, return_values, offset,
+                   start_ns](Status status) {
+                    AddProcessingTime(model::NowNanos() - start_ns);
                     Callback(ctx, result, return_values, offset, status);
                   });
             },
@@ -389,7 +417,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       void EnsureRunnerThreadStarted(IteratorContext* ctx)
-          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         if (!runner_thread_) {
           std::shared_ptr<IteratorContext> ctx_copy(new IteratorContext(*ctx));
           runner_thread_.reset(ctx->env()->StartThread(
@@ -419,11 +447,48 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
         result->output_allocated = true;
       }
 
-      int MaxBatchResults() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
-        return (dataset()->num_parallel_calls_ + dataset()->batch_size_ - 1) /
+      int MaxBatchResults() EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
+        return (num_parallel_calls_->value() + dataset()->batch_size_ - 1) /
                dataset()->batch_size_;
       }
 
+      // Moves the next batch to return into `*result`, if all of its calls
+      // have completed. This is the oldest batch, unless the iterator is
+      // sloppy, in which case it is the oldest completed one. A batch that
+      // reached the end of the input is only returned once all earlier batches
+      // have been.
+      bool TakeResultLocked(std::shared_ptr<BatchResult>* result)
+          EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
+        if (batch_results_.empty()) {
+          return false;
+        }
+        if (batch_results_.front()->num_calls == 0) {
+          std::swap(*result, batch_results_.front());
+          batch_results_.pop_front();
+          return true;
+        }
+        if (!dataset()->sloppy_) {
+          return false;
+        }
+        for (auto it = batch_results_.begin() + 1; it != batch_results_.end();
+             ++it) {
+          if ((*it)->num_calls > 0) {
+            continue;
+          }
+          bool end_of_input;
+          {
+            mutex_lock l((*it)->mu);
+            end_of_input = (*it)->end_of_input;
+          }
+          if (!end_of_input) {
+            std::swap(*result, *it);
+            batch_results_.erase(it);
+            return true;
+          }
+        }
+        return false;
+      }
+
       Status ProcessResult(IteratorContext* ctx,
                            const std::shared_ptr<BatchResult>& result,
                            std::vector<Tensor>* out_tensors,
@@ -470,25 +535,24 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       void RunnerThread(const std::shared_ptr<IteratorContext>& ctx)
-          LOCKS_EXCLUDED(mu_) {
+          LOCKS_EXCLUDED(*mu_) {
         std::vector<std::pair<std::shared_ptr<BatchResult>, int64>> new_calls;
-        new_calls.reserve(dataset()->num_parallel_calls_);
         while (true) {
           {
-            mutex_lock l(mu_);
+            mutex_lock l(*mu_);
             while (!cancelled_ &&
-                   (num_calls_ >= dataset()->num_parallel_calls_ ||
+                   (num_calls_ >= num_parallel_calls_->value() ||
                     batch_results_.size() > MaxBatchResults() ||
                     (batch_results_.size() == MaxBatchResults() &&
                      call_counter_ % dataset()->batch_size_ == 0))) {
-              cond_var_.wait(l);
+              runner_cond_var_->wait(l);
             }
 
             if (cancelled_) {
               return;
             }
 
-            while (num_calls_ < dataset()->num_parallel_calls_ &&
+            while (num_calls_ < num_parallel_calls_->value() &&
                    (batch_results_.size() < MaxBatchResults() ||
                     (batch_results_.size() == MaxBatchResults() &&
                      call_counter_ % dataset()->batch_size_ != 0))) {
@@ -510,7 +574,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       Status ReadBatchResult(IteratorContext* ctx, IteratorStateReader* reader,
-                             size_t index) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+                             size_t index) EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         batch_results_.emplace_back(new BatchResult(dataset()->batch_size_));
         std::shared_ptr<BatchResult> result = batch_results_.back();
         string prefix = strings::StrCat("batch_results_", index);
@@ -555,7 +619,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       Status ReadStatus(IteratorStateReader* reader, const string& prefix,
-                        Status* status) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+                        Status* status) EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         int64 code_int;
         TF_RETURN_IF_ERROR(reader->ReadScalar(
             full_name(strings::StrCat(prefix, "_code")), &code_int));
@@ -573,7 +637,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       Status WriteBatchResult(IteratorStateWriter* writer, size_t index)
-          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         std::shared_ptr<BatchResult> result = batch_results_[index];
         string prefix = strings::StrCat("batch_results_", index);
         mutex_lock l(result->mu);
@@ -614,7 +678,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       Status WriteStatus(IteratorStateWriter* writer, const string& prefix,
-                         const Status& status) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+                         const Status& status) EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         TF_RETURN_IF_ERROR(
             writer->WriteScalar(full_name(strings::StrCat(prefix, "_code")),
                                 static_cast<int64>(status.code())));
@@ -627,23 +691,32 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       // Used for coordination between the main thread, the runner thread, and
-      // the callback threads.
-      mutex mu_;
-      // Used for coordination between the main thread, the runner thread, and
-      // the callback threads. In particular, the runner thread should only
-      // schedule new calls when the number of in-flight calls is less than the
-      // user specified level of parallelism and there are slots available in
-      // the `batch_results_` buffer.
-      condition_variable cond_var_;
+      // the callback threads. Shared with `num_parallel_calls_`.
+      const std::shared_ptr<mutex> mu_;
+      // Wakes up the runner thread, and threads waiting for the in-flight calls
+      // to complete. In particular, the runner thread should only schedule new
+      // calls when the number of in-flight calls is less than the user
+      // specified level of parallelism and there are slots available in the
+      // `batch_results_` buffer. The model of the input pipeline notifies it
+      // when it changes `num_parallel_calls_`.
+      const std::shared_ptr<condition_variable> runner_cond_var_;
+      // Wakes up the consumers waiting in GetNext() when a batch that they can
+      // return has completed.
+      condition_variable consumer_cond_var_;
+      // Counts the number of consumers waiting on `consumer_cond_var_`.
+      int64 num_waiting_consumers_ GUARDED_BY(*mu_) = 0;
+      // The maximum number of outstanding calls, which the model of the input
+      // pipeline may tune.
+      std::shared_ptr<model::Parameter> num_parallel_calls_;
       // Counts the number of outstanding calls for this batch.
-      int64 num_calls_ GUARDED_BY(mu_) = 0;
+      int64 num_calls_ GUARDED_BY(*mu_) = 0;
       // Counts the total number of calls.
-      int64 call_counter_ GUARDED_BY(mu_) = 0;
+      int64 call_counter_ GUARDED_BY(*mu_) = 0;
       std::unique_ptr<IteratorBase> input_impl_;
       // Buffer for storing the (intermediate) batch results.
-      std::deque<std::shared_ptr<BatchResult>> batch_results_ GUARDED_BY(mu_);
-      std::unique_ptr<Thread> runner_thread_ GUARDED_BY(mu_);
-      bool cancelled_ GUARDED_BY(mu_) = false;
+      std::deque<std::shared_ptr<BatchResult>> batch_results_ GUARDED_BY(*mu_);
+      std::unique_ptr<Thread> runner_thread_ GUARDED_BY(*mu_);
+      bool cancelled_ GUARDED_BY(*mu_) = false;
     };
 
     const DatasetBase* const input_;
@@ -651,6 +724,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
     const int64 batch_size_;
     const int64 num_parallel_calls_;
     const bool drop_remainder_;
+    const bool sloppy_;
     const DataTypeVector output_types_;
     const std::vector<PartialTensorShape> output_shapes_;
     const NameAttrList map_fn_;
@@ -663,6 +737,7 @@ class MapAndBatchDatasetOp : public UnaryDatasetOpKernel {
   DataTypeVector output_types_;
   std::vector<PartialTensorShape> output_shapes_;
   NameAttrList func_;
+  bool sloppy_;
 };
 
 REGISTER_KERNEL_BUILDER(Name("MapAndBatchDataset").Device(DEVICE_CPU),
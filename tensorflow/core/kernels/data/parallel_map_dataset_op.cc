@@ -21,6 +21,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/dataset.h"
 #include "tensorflow/core/lib/core/error_codes.pb.h"
 #include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/platform/cpu_info.h"
 
 namespace tensorflow {
 
@@ -37,6 +38,7 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
     OP_REQUIRES_OK(ctx, ctx->GetAttr("f", &func_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("output_types", &output_types_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("output_shapes", &output_shapes_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("sloppy", &sloppy_));
   }
 
  protected:
@@ -53,7 +55,8 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
     int32 num_parallel_calls;
     OP_REQUIRES_OK(ctx, ParseScalarArgument(ctx, "num_parallel_calls",
                                             &num_parallel_calls));
-    OP_REQUIRES(ctx, num_parallel_calls > 0,
+    OP_REQUIRES(ctx,
+                num_parallel_calls > 0 || num_parallel_calls == model::kAutoTune,
                 errors::InvalidArgument(
                     "num_parallel_calls must be greater than zero."));
 
@@ -61,15 +64,16 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
     OP_REQUIRES_OK(ctx, CapturedFunction::Create(
                             func_, std::move(other_arguments), &captured_func));
 
-    *output = new Dataset(ctx, input, func_, num_parallel_calls, output_types_,
-                          output_shapes_, std::move(captured_func));
+    *output = new Dataset(ctx, input, func_, num_parallel_calls, sloppy_,
+                          output_types_, output_shapes_,
+                          std::move(captured_func));
   }
 
  private:
   class Dataset : public GraphDatasetBase {
    public:
     Dataset(OpKernelContext* ctx, const DatasetBase* input,
-            const NameAttrList& func, int32 num_parallel_calls,
+            const NameAttrList& func, int32 num_parallel_calls, bool sloppy,
             const DataTypeVector& output_types,
             const std::vector<PartialTensorShape>& output_shapes,
             std::unique_ptr<CapturedFunction> captured_func)
@@ -77,6 +81,7 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
           input_(input),
           func_(func),
           num_parallel_calls_(num_parallel_calls),
+          sloppy_(sloppy),
           output_types_(output_types),
           output_shapes_(output_shapes),
           captured_func_(std::move(captured_func)) {
@@ -136,13 +141,18 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
       AttrValue other_arguments_types_attr;
       b->BuildAttrValue(other_arguments_types, &other_arguments_types_attr);
 
+      // Attr: sloppy
+      AttrValue sloppy_attr;
+      b->BuildAttrValue(sloppy_, &sloppy_attr);
+
       TF_RETURN_IF_ERROR(b->AddDataset(
           this,
           {std::make_pair(0, input_graph_node),
            std::make_pair(2, num_parallel_calls)},  // Single tensor inputs.
           {std::make_pair(1, other_arguments)},     // Tensor list inputs.
           {std::make_pair("f", f),
-           std::make_pair("Targuments", other_arguments_types_attr)},  // Attrs
+           std::make_pair("Targuments", other_arguments_types_attr),
+           std::make_pair("sloppy", sloppy_attr)},  // Attrs
           output));
       return Status::OK();
     }
@@ -151,7 +161,9 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
     class Iterator : public DatasetIterator<Dataset> {
      public:
       explicit Iterator(const Params& params)
-          : DatasetIterator<Dataset>(params) {}
+          : DatasetIterator<Dataset>(params),
+            mu_(std::make_shared<mutex>()),
+            runner_cond_var_(std::make_shared<condition_variable>()) {}
 
       ~Iterator() override {
         // TODO(mrry): Replace this cancellation logic with a
@@ -159,17 +171,21 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
         // but it would be possible to thread a cancellation manager
         // through the IteratorContext to upstream,
         // potentially-blocking iterators, when we add these.
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         // Cancel the runner thread.
         cancelled_ = true;
-        cond_var_.notify_all();
+        runner_cond_var_->notify_all();
         // Wait for all in-flight calls to complete.
         while (num_calls_ > 0) {
-          cond_var_.wait(l);
+          runner_cond_var_->wait(l);
         }
       }
 
       Status Initialize(IteratorContext* ctx) override {
+        num_parallel_calls_ = MakeParameter(
+            dataset()->num_parallel_calls_, /*min=*/1,
+            /*max=*/port::NumSchedulableCPUs(), mu_, runner_cond_var_);
+        SetAsync(num_parallel_calls_, /*buffer_size=*/nullptr);
         return dataset()->input_->MakeIterator(ctx, prefix(), &input_impl_);
       }
 
@@ -178,25 +194,25 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
                              bool* end_of_sequence) override {
         std::shared_ptr<InvocationResult> result;
         {
-          mutex_lock l(mu_);
+          mutex_lock l(*mu_);
           EnsureRunnerThreadStarted(ctx);
-          while (invocation_results_.empty()) {
-            cond_var_.wait(l);
+          RecordBufferSize(invocation_results_.size());
+          num_waiting_consumers_++;
+          while (!TakeResultLocked(&result)) {
+            consumer_cond_var_.wait(l);
           }
-          std::swap(result, invocation_results_.front());
-          invocation_results_.pop_front();
+          num_waiting_consumers_--;
         }
-        cond_var_.notify_all();
-        result->notification.WaitForNotification();
+        runner_cond_var_->notify_all();
         return ProcessResult(result, out_tensors, end_of_sequence);
       }
 
      protected:
       Status SaveInternal(IteratorStateWriter* writer) override {
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         // Wait for all in-flight calls to complete.
         while (num_calls_ > 0) {
-          cond_var_.wait(l);
+          runner_cond_var_->wait(l);
         }
         CHECK_EQ(num_calls_, 0);
         TF_RETURN_IF_ERROR(SaveParent(writer, input_impl_));
@@ -226,7 +242,7 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
 
       Status RestoreInternal(IteratorContext* ctx,
                              IteratorStateReader* reader) override {
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         TF_RETURN_IF_ERROR(RestoreParent(ctx, reader, input_impl_));
         int64 invocation_results_size;
         TF_RETURN_IF_ERROR(reader->ReadScalar(
@@ -259,21 +275,22 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
           }
           result->end_of_input = reader->Contains(full_name(
               strings::StrCat("invocation_results[", i, "].end_of_input")));
-          result->notification.Notify();
+          result->done = true;
         }
         return Status::OK();
       }
 
      private:
       struct InvocationResult {
-        Notification notification;
         Status status;
         std::vector<Tensor> return_values;
-        bool end_of_input;
+        bool end_of_input = false;
+        // Whether the call has completed. Access guarded by owner's mutex.
+        bool done = false;
       };
 
       void EnsureRunnerThreadStarted(IteratorContext* ctx)
-          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         if (!runner_thread_) {
           std::shared_ptr<IteratorContext> ctx_copy(new IteratorContext(*ctx));
           runner_thread_.reset(ctx->env()->StartThread(
@@ -283,18 +300,28 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
       }
 
       void CallCompleted(const std::shared_ptr<InvocationResult>& result)
-          LOCKS_EXCLUDED(mu_) {
+          LOCKS_EXCLUDED(*mu_) {
+        bool notify_consumers;
         {
-          mutex_lock l(mu_);
+          mutex_lock l(*mu_);
           num_calls_--;
+          result->done = true;
+          // Unless the iterator is sloppy, a consumer only waits for the
+          // result at the front of the buffer, so completing any other call
+          // need not wake it.
+          notify_consumers =
+              num_waiting_consumers_ > 0 &&
+              (dataset()->sloppy_ || result == invocation_results_.front());
+        }
+        runner_cond_var_->notify_all();
+        if (notify_consumers) {
+          consumer_cond_var_.notify_all();
         }
-        result->notification.Notify();
-        cond_var_.notify_all();
       }
 
       void CallFunction(const std::shared_ptr<IteratorContext>& ctx,
                         const std::shared_ptr<InvocationResult>& result)
-          LOCKS_EXCLUDED(mu_) {
+          LOCKS_EXCLUDED(*mu_) {
         // Get the next input element.
         std::vector<Tensor> input_element;
         result->status = input_impl_->GetNext(ctx.get(), &input_element,
@@ -305,9 +332,11 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
         }
 
         // Call `func_(input_element)`, store the result in
-        // `result->return_values`, and notify `result->notification` to unblock
-        // a consumer.
-        auto done = [this, result](Status status) {
+        // `result->return_values`, and mark `result` as done to unblock a
+        // consumer.
+        const int64 start_ns = model::NowNanos();
+        auto done = [this, result, start_ns](Status status) {
+          AddProcessingTime(model::NowNanos() - start_ns);
           result->status.Update(status);
           CallCompleted(result);
         };
@@ -315,7 +344,35 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
                                             &result->return_values, done);
       }
 
-      int64 MaxInvocationResults() { return dataset()->num_parallel_calls_; }
+      int64 MaxInvocationResults() { return num_parallel_calls_->value(); }
+
+      // Moves the next result to return into `*result`, if it has completed.
+      // This is the oldest result, unless the iterator is sloppy, in which
+      // case it is the oldest completed one. A result that marks the end of
+      // the input is only returned once all earlier results have been.
+      bool TakeResultLocked(std::shared_ptr<InvocationResult>* result)
+          EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
+        if (invocation_results_.empty()) {
+          return false;
+        }
+        if (invocation_results_.front()->done) {
+          std::swap(*result, invocation_results_.front());
+          invocation_results_.pop_front();
+          return true;
+        }
+        if (!dataset()->sloppy_) {
+          return false;
+        }
+        for (auto it = invocation_results_.begin() + 1;
+             it != invocation_results_.end(); ++it) {
+          if ((*it)->done && !(*it)->end_of_input) {
+            std::swap(*result, *it);
+            invocation_results_.erase(it);
+            return true;
+          }
+        }
+        return false;
+      }
 
       Status ProcessResult(const std::shared_ptr<InvocationResult>& result,
                            std::vector<Tensor>* out_tensors,
@@ -337,26 +394,24 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
 
       void RunnerThread(const std::shared_ptr<IteratorContext>& ctx) {
         std::vector<std::shared_ptr<InvocationResult>> new_calls;
-        new_calls.reserve(dataset()->num_parallel_calls_);
         while (true) {
           {
-            mutex_lock l(mu_);
+            mutex_lock l(*mu_);
             while (!cancelled_ &&
-                   (num_calls_ >= dataset()->num_parallel_calls_ ||
+                   (num_calls_ >= num_parallel_calls_->value() ||
                     invocation_results_.size() >= MaxInvocationResults())) {
-              cond_var_.wait(l);
+              runner_cond_var_->wait(l);
             }
             if (cancelled_) {
               return;
             }
-            while (num_calls_ < dataset()->num_parallel_calls_ &&
+            while (num_calls_ < num_parallel_calls_->value() &&
                    invocation_results_.size() < MaxInvocationResults()) {
               invocation_results_.emplace_back(new InvocationResult());
               new_calls.push_back(invocation_results_.back());
               num_calls_++;
             }
           }
-          cond_var_.notify_all();
           for (const auto& call : new_calls) {
             CallFunction(ctx, call);
           }
@@ -366,7 +421,7 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
 
       Status WriteStatusLocked(IteratorStateWriter* writer, size_t index,
                                const Status& status)
-          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         TF_RETURN_IF_ERROR(writer->WriteScalar(
             CodeKey(index), static_cast<int64>(status.code())));
         if (!status.ok()) {
@@ -377,7 +432,7 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
       }
 
       Status ReadStatusLocked(IteratorStateReader* reader, size_t index,
-                              Status* status) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+                              Status* status) EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         int64 code_int;
         TF_RETURN_IF_ERROR(reader->ReadScalar(CodeKey(index), &code_int));
         error::Code code = static_cast<error::Code>(code_int);
@@ -403,27 +458,38 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
             strings::StrCat("invocation_results[", index, "].error_message"));
       }
 
-      // Used for coordination between the main thread and the runner thread.
-      mutex mu_;
-      // Used for coordination between the main thread and the runner thread. In
-      // particular, the runner thread should only schedule new calls when the
-      // number of in-flight calls is less than the user specified level of
-      // parallelism and there are slots available in the `invocation_results_`
-      // buffer.
-      condition_variable cond_var_;
+      // Used for coordination between the main thread, the runner thread, and
+      // the callback threads. Shared with `num_parallel_calls_`.
+      const std::shared_ptr<mutex> mu_;
+      // Wakes up the runner thread, and threads waiting for the in-flight calls
+      // to complete. In particular, the runner thread should only schedule new
+      // calls when the number of in-flight calls is less than the user
+      // specified level of parallelism and there are slots available in the
+      // `invocation_results_` buffer. The model of the input pipeline notifies
+      // it when it changes `num_parallel_calls_`.
+      const std::shared_ptr<condition_variable> runner_cond_var_;
+      // Wakes up the consumers waiting in GetNext() when a result that they
+      // can return has completed.
+      condition_variable consumer_cond_var_;
+      // Counts the number of consumers waiting on `consumer_cond_var_`.
+      int64 num_waiting_consumers_ GUARDED_BY(*mu_) = 0;
+      // The maximum number of outstanding calls, which the model of the input
+      // pipeline may tune.
+      std::shared_ptr<model::Parameter> num_parallel_calls_;
       // Counts the number of outstanding calls.
-      int64 num_calls_ GUARDED_BY(mu_) = 0;
+      int64 num_calls_ GUARDED_BY(*mu_) = 0;
       std::unique_ptr<IteratorBase> input_impl_;
       // Buffer for storing the invocation results.
       std::deque<std::shared_ptr<InvocationResult>> invocation_results_
-          GUARDED_BY(mu_);
-      std::unique_ptr<Thread> runner_thread_ GUARDED_BY(mu_);
-      bool cancelled_ GUARDED_BY(mu_) = false;
+          GUARDED_BY(*mu_);
+      std::unique_ptr<Thread> runner_thread_ GUARDED_BY(*mu_);
+      bool cancelled_ GUARDED_BY(*mu_) = false;
     };
 
     const DatasetBase* const input_;
     const NameAttrList func_;
     const int32 num_parallel_calls_;
+    const bool sloppy_;
     const DataTypeVector output_types_;
     const std::vector<PartialTensorShape> output_shapes_;
     const std::unique_ptr<CapturedFunction> captured_func_;
@@ -433,6 +499,7 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
   DataTypeVector output_types_;
   std::vector<PartialTensorShape> output_shapes_;
   NameAttrList func_;
+  bool sloppy_;
 };
 
 REGISTER_KERNEL_BUILDER(Name("ParallelMapDataset").Device(DEVICE_CPU),
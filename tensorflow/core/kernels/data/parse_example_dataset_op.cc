@@ -0,0 +1,388 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include <map>
+
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/data/dataset.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/util/example_proto_fast_parsing.h"
+
+namespace tensorflow {
+
+namespace {
+
+// See documentation in ../ops/dataset_ops.cc for a high-level
+// description of the following op.
+
+class ParseExampleDatasetOp : public UnaryDatasetOpKernel {
+ public:
+  explicit ParseExampleDatasetOp(OpKernelConstruction* ctx)
+      : UnaryDatasetOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("sparse_keys", &sparse_keys_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("dense_keys", &dense_keys_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("sparse_types", &sparse_types_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("Tdense", &dense_types_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("dense_shapes", &dense_shapes_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("output_types", &output_types_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("output_shapes", &output_shapes_));
+    OP_REQUIRES(ctx, sparse_keys_.size() == sparse_types_.size(),
+                errors::InvalidArgument(
+                    "len(sparse_keys) != len(sparse_types): ",
+                    sparse_keys_.size(), " vs. ", sparse_types_.size()));
+    OP_REQUIRES(ctx, dense_keys_.size() == dense_types_.size(),
+                errors::InvalidArgument(
+                    "len(dense_keys) != len(Tdense): ", dense_keys_.size(),
+                    " vs. ", dense_types_.size()));
+    OP_REQUIRES(ctx, dense_keys_.size() == dense_shapes_.size(),
+                errors::InvalidArgument(
+                    "len(dense_keys) != len(dense_shapes): ",
+                    dense_keys_.size(), " vs. ", dense_shapes_.size()));
+    OP_REQUIRES(
+        ctx, output_types_.size() == dense_keys_.size() + sparse_keys_.size(),
+        errors::InvalidArgument(
+            "Expected one output per dense and sparse key, but got ",
+            output_types_.size(), " output types."));
+    for (int d = 0; d < dense_shapes_.size(); ++d) {
+      const PartialTensorShape& shape = dense_shapes_[d];
+      bool shape_ok = shape.dims() != -1;
+      for (int i = 1; shape_ok && i < shape.dims(); ++i) {
+        shape_ok = shape.dim_size(i) != -1;
+      }
+      OP_REQUIRES(ctx, shape_ok,
+                  errors::InvalidArgument(
+                      "dense_shapes[", d,
+                      "] has unknown rank or unknown inner dimensions: ",
+                      shape.DebugString()));
+      TensorShape element_shape;
+      if (shape.dims() > 0 && shape.dim_size(0) == -1) {
+        variable_length_.push_back(true);
+        for (int i = 1; i < shape.dims(); ++i) {
+          element_shape.AddDim(shape.dim_size(i));
+        }
+      } else {
+        variable_length_.push_back(false);
+        shape.AsTensorShape(&element_shape);
+      }
+      elements_per_stride_.push_back(element_shape.num_elements());
+    }
+  }
+
+ protected:
+  void MakeDataset(OpKernelContext* ctx, DatasetBase* input,
+                   DatasetBase** output) override {
+    int64 num_parallel_calls;
+    OP_REQUIRES_OK(ctx, ParseScalarArgument(ctx, "num_parallel_calls",
+                                            &num_parallel_calls));
+    OP_REQUIRES(ctx, num_parallel_calls > 0,
+                errors::InvalidArgument(
+                    "num_parallel_calls must be greater than zero."));
+
+    OpInputList dense_default_tensors;
+    OP_REQUIRES_OK(ctx,
+                   ctx->input_list("dense_defaults", &dense_default_tensors));
+    OP_REQUIRES(ctx, dense_default_tensors.size() == dense_keys_.size(),
+                errors::InvalidArgument(
+                    "Expected len(dense_defaults) == len(dense_keys) but got: ",
+                    dense_default_tensors.size(), " vs. ", dense_keys_.size()));
+
+    std::vector<Tensor> dense_defaults;
+    example::FastParseExampleConfig config;
+    for (int d = 0; d < dense_keys_.size(); ++d) {
+      const Tensor& def_value = dense_default_tensors[d];
+      if (variable_length_[d]) {
+        OP_REQUIRES(ctx, def_value.NumElements() == 1,
+                    errors::InvalidArgument(
+                        "dense_shape[", d, "] is a variable length shape: ",
+                        dense_shapes_[d].DebugString(),
+                        ", therefore def_value[", d,
+                        "] must contain a single element (the padding "
+                        "element). But its shape is: ",
+                        def_value.shape().DebugString()));
+      } else if (def_value.NumElements() > 0) {
+        OP_REQUIRES(ctx, dense_shapes_[d].IsCompatibleWith(def_value.shape()),
+                    errors::InvalidArgument(
+                        "def_value[", d,
+                        "].shape() == ", def_value.shape().DebugString(),
+                        " is not compatible with dense_shapes_[", d,
+                        "] == ", dense_shapes_[d].DebugString()));
+      }
+      OP_REQUIRES(ctx, def_value.dtype() == dense_types_[d],
+                  errors::InvalidArgument(
+                      "dense_defaults[", d, "].dtype() == ",
+                      DataTypeString(def_value.dtype()), " != dense_types_[",
+                      d, "] == ", DataTypeString(dense_types_[d])));
+      dense_defaults.push_back(def_value);
+      config.dense.push_back({dense_keys_[d], dense_types_[d],
+                              dense_shapes_[d], def_value, variable_length_[d],
+                              elements_per_stride_[d]});
+    }
+    for (int d = 0; d < sparse_keys_.size(); ++d) {
+      config.sparse.push_back({sparse_keys_[d], sparse_types_[d]});
+    }
+
+    // The outputs are sorted by key, which is how the Python code flattens
+    // the dictionary of features.
+    std::map<string, int> key_to_output_index;
+    for (const string& key : dense_keys_) {
+      key_to_output_index[key] = 0;
+    }
+    for (const string& key : sparse_keys_) {
+      key_to_output_index[key] = 0;
+    }
+    OP_REQUIRES(
+        ctx, key_to_output_index.size() == output_types_.size(),
+        errors::InvalidArgument("dense_keys and sparse_keys must be unique."));
+    int output_index = 0;
+    for (auto& key_and_index : key_to_output_index) {
+      key_and_index.second = output_index++;
+    }
+
+    *output = new Dataset(ctx, input, num_parallel_calls,
+                          std::move(dense_defaults), std::move(config),
+                          std::move(key_to_output_index), sparse_keys_,
+                          dense_keys_, sparse_types_, dense_types_,
+                          dense_shapes_, output_types_, output_shapes_);
+  }
+
+ private:
+  class Dataset : public GraphDatasetBase {
+   public:
+    Dataset(OpKernelContext* ctx, const DatasetBase* input,
+            int64 num_parallel_calls, std::vector<Tensor> dense_defaults,
+            example::FastParseExampleConfig config,
+            std::map<string, int> key_to_output_index,
+            const std::vector<string>& sparse_keys,
+            const std::vector<string>& dense_keys,
+            const DataTypeVector& sparse_types,
+            const DataTypeVector& dense_types,
+            const std::vector<PartialTensorShape>& dense_shapes,
+            const DataTypeVector& output_types,
+            const std::vector<PartialTensorShape>& output_shapes)
+        : GraphDatasetBase(ctx),
+          input_(input),
+          num_parallel_calls_(num_parallel_calls),
+          dense_defaults_(std::move(dense_defaults)),
+          config_(std::move(config)),
+          key_to_output_index_(std::move(key_to_output_index)),
+          sparse_keys_(sparse_keys),
+          dense_keys_(dense_keys),
+          sparse_types_(sparse_types),
+          dense_types_(dense_types),
+          dense_shapes_(dense_shapes),
+          output_types_(output_types),
+          output_shapes_(output_shapes) {
+      input_->Ref();
+    }
+
+    ~Dataset() override { input_->Unref(); }
+
+    std::unique_ptr<IteratorBase> MakeIteratorInternal(
+        const string& prefix) const override {
+      return std::unique_ptr<IteratorBase>(
+          new Iterator({this, strings::StrCat(prefix, "::ParseExample")}));
+    }
+
+    const DataTypeVector& output_dtypes() const override {
+      return output_types_;
+    }
+    const std::vector<PartialTensorShape>& output_shapes() const override {
+      return output_shapes_;
+    }
+
+    string DebugString() const override {
+      return "ParseExampleDatasetOp::Dataset";
+    }
+
+   protected:
+    Status AsGraphDefInternal(OpKernelContext* ctx, DatasetGraphDefBuilder* b,
+                              Node** output) const override {
+      Node* input_graph_node = nullptr;
+      TF_RETURN_IF_ERROR(b->AddParentDataset(ctx, input_, &input_graph_node));
+      Node* num_parallel_calls_node;
+      TF_RETURN_IF_ERROR(
+          b->AddScalar(num_parallel_calls_, &num_parallel_calls_node));
+      std::vector<Node*> dense_defaults_nodes;
+      dense_defaults_nodes.reserve(dense_defaults_.size());
+      for (const Tensor& dense_default : dense_defaults_) {
+        Node* node;
+        TF_RETURN_IF_ERROR(b->AddTensor(dense_default, &node));
+        dense_defaults_nodes.emplace_back(node);
+      }
+
+      AttrValue sparse_keys_attr;
+      b->BuildAttrValue(sparse_keys_, &sparse_keys_attr);
+      AttrValue dense_keys_attr;
+      b->BuildAttrValue(dense_keys_, &dense_keys_attr);
+      AttrValue sparse_types_attr;
+      b->BuildAttrValue(sparse_types_, &sparse_types_attr);
+      AttrValue dense_types_attr;
+      b->BuildAttrValue(dense_types_, &dense_types_attr);
+      AttrValue dense_shapes_attr;
+      b->BuildAttrValue(dense_shapes_, &dense_shapes_attr);
+
+      TF_RETURN_IF_ERROR(b->AddDataset(
+          this,
+          {std::make_pair(0, input_graph_node),
+           std::make_pair(1, num_parallel_calls_node)},
+          {std::make_pair(2, dense_defaults_nodes)},
+          {std::make_pair("sparse_keys", sparse_keys_attr),
+           std::make_pair("dense_keys", dense_keys_attr),
+           std::make_pair("sparse_types", sparse_types_attr),
+           std::make_pair("Tdense", dense_types_attr),
+           std::make_pair("dense_shapes", dense_shapes_attr)},
+          output));
+      return Status::OK();
+    }
+
+   private:
+    class Iterator : public DatasetIterator<Dataset> {
+     public:
+      explicit Iterator(const Params& params)
+          : DatasetIterator<Dataset>(params) {}
+
+      Status Initialize(IteratorContext* ctx) override {
+        // The minibatches of each batch of serialized examples are parsed by
+        // these threads, directly into the tensors of the batch.
+        thread_pool_.reset(new thread::ThreadPool(
+            ctx->env(), ThreadOptions(), "parse_example_dataset",
+            dataset()->num_parallel_calls_, /*low_latency_hint=*/false));
+        return dataset()->input_->MakeIterator(ctx, prefix(), &input_impl_);
+      }
+
+      Status GetNextInternal(IteratorContext* ctx,
+                             std::vector<Tensor>* out_tensors,
+                             bool* end_of_sequence) override {
+        std::vector<Tensor> input_element;
+        {
+          mutex_lock l(mu_);
+          if (!input_impl_) {
+            *end_of_sequence = true;
+            return Status::OK();
+          }
+          TF_RETURN_IF_ERROR(
+              input_impl_->GetNext(ctx, &input_element, end_of_sequence));
+          if (*end_of_sequence) {
+            input_impl_.reset();
+            return Status::OK();
+          }
+        }
+        if (input_element.size() != 1 ||
+            input_element[0].dtype() != DT_STRING ||
+            !TensorShapeUtils::IsVector(input_element[0].shape())) {
+          return errors::InvalidArgument(
+              "ParseExampleDataset expects its input elements to be vectors "
+              "of serialized Examples, but got an element with ",
+              input_element.size(), " components",
+              input_element.empty()
+                  ? string()
+                  : strings::StrCat(" of which the first has type ",
+                                    DataTypeString(input_element[0].dtype()),
+                                    " and shape ",
+                                    input_element[0].shape().DebugString()));
+        }
+
+        // NOTE: Parsing happens outside of `mu_`, so that the batches
+        // requested by concurrent callers are parsed concurrently.
+        auto serialized_t = input_element[0].vec<string>();
+        gtl::ArraySlice<string> serialized(serialized_t.data(),
+                                           serialized_t.size());
+        example::Result result;
+        TF_RETURN_IF_ERROR(FastParseExample(dataset()->config_, serialized, {},
+                                            thread_pool_.get(), &result));
+
+        out_tensors->resize(dataset()->key_to_output_index_.size());
+        for (int d = 0; d < dataset()->dense_keys_.size(); ++d) {
+          const int output_index =
+              dataset()->key_to_output_index_.at(dataset()->dense_keys_[d]);
+          (*out_tensors)[output_index] = std::move(result.dense_values[d]);
+        }
+        for (int d = 0; d < dataset()->sparse_keys_.size(); ++d) {
+          // Sparse components are represented as a vector of their indices,
+          // values and dense shape, which `tf.data` deserializes into a
+          // `tf.SparseTensor`.
+          Tensor serialized_sparse(DT_VARIANT, TensorShape({3}));
+          auto serialized_sparse_t = serialized_sparse.vec<Variant>();
+          serialized_sparse_t(0) = std::move(result.sparse_indices[d]);
+          serialized_sparse_t(1) = std::move(result.sparse_values[d]);
+          serialized_sparse_t(2) = std::move(result.sparse_shapes[d]);
+          const int output_index =
+              dataset()->key_to_output_index_.at(dataset()->sparse_keys_[d]);
+          (*out_tensors)[output_index] = std::move(serialized_sparse);
+        }
+        return Status::OK();
+      }
+
+     protected:
+      Status SaveInternal(IteratorStateWriter* writer) override {
+        mutex_lock l(mu_);
+        if (!input_impl_) {
+          TF_RETURN_IF_ERROR(
+              writer->WriteScalar(full_name("input_impl_empty"), ""));
+        } else {
+          TF_RETURN_IF_ERROR(SaveParent(writer, input_impl_));
+        }
+        return Status::OK();
+      }
+
+      Status RestoreInternal(IteratorContext* ctx,
+                             IteratorStateReader* reader) override {
+        mutex_lock l(mu_);
+        if (!reader->Contains(full_name("input_impl_empty"))) {
+          TF_RETURN_IF_ERROR(RestoreParent(ctx, reader, input_impl_));
+        } else {
+          input_impl_.reset();
+        }
+        return Status::OK();
+      }
+
+     private:
+      mutex mu_;
+      std::unique_ptr<IteratorBase> input_impl_ GUARDED_BY(mu_);
+      std::unique_ptr<thread::ThreadPool> thread_pool_;
+    };
+
+    const DatasetBase* const input_;
+    const int64 num_parallel_calls_;
+    const std::vector<Tensor> dense_defaults_;
+    const example::FastParseExampleConfig config_;
+    // Maps each dense and sparse key to the index of its output.
+    const std::map<string, int> key_to_output_index_;
+    const std::vector<string> sparse_keys_;
+    const std::vector<string> dense_keys_;
+    const DataTypeVector sparse_types_;
+    const DataTypeVector dense_types_;
+    const std::vector<PartialTensorShape> dense_shapes_;
+    const DataTypeVector output_types_;
+    const std::vector<PartialTensorShape> output_shapes_;
+  };
+
+  std::vector<string> sparse_keys_;
+  std::vector<string> dense_keys_;
+  DataTypeVector sparse_types_;
+  DataTypeVector dense_types_;
+  std::vector<PartialTensorShape> dense_shapes_;
+  std::vector<bool> variable_length_;
+  std::vector<std::size_t> elements_per_stride_;
+  DataTypeVector output_types_;
+  std::vector<PartialTensorShape> output_shapes_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("ParseExampleDataset").Device(DEVICE_CPU),
+                        ParseExampleDatasetOp);
+
+}  // namespace
+
+}  // namespace tensorflow
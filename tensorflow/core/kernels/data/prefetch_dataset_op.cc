@@ -24,6 +24,10 @@ namespace tensorflow {
 
 namespace {
 
+// The largest buffer size the model of the input pipeline may choose; its
+// memory budget usually limits the buffer size well before.
+constexpr int64 kMaxAutoTuneBufferSize = 1024;
+
 // See documentation in ../ops/dataset_ops.cc for a high-level
 // description of the following op.
 
@@ -87,6 +91,8 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
      public:
       explicit Iterator(const Params& params)
           : DatasetIterator<Dataset>(params),
+            mu_(std::make_shared<mutex>()),
+            cond_var_(std::make_shared<condition_variable>()),
             auto_tuner_(params.dataset->buffer_size_) {}
 
       ~Iterator() override {
@@ -99,13 +105,21 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
         // through the IteratorContext to upstream,
         // potentially-blocking iterators, when we add these.
         {
-          mutex_lock l(mu_);
+          mutex_lock l(*mu_);
           cancelled_ = true;
-          cond_var_.notify_all();
+          cond_var_->notify_all();
         }
       }
 
       Status Initialize(IteratorContext* ctx) override {
+        if (dataset()->buffer_size_ == model::kAutoTune && has_model()) {
+          // The model of the input pipeline tunes the buffer size instead of
+          // `auto_tuner_`.
+          buffer_size_ =
+              MakeParameter(model::kAutoTune, /*min=*/1,
+                            /*max=*/kMaxAutoTuneBufferSize, mu_, cond_var_);
+        }
+        SetAsync(/*parallelism=*/nullptr, buffer_size_);
         return dataset()->input_->MakeIterator(ctx, prefix(), &input_impl_);
       }
 
@@ -113,14 +127,15 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
                              std::vector<Tensor>* out_tensors,
                              bool* end_of_sequence) override {
         {
-          mutex_lock l(mu_);
+          mutex_lock l(*mu_);
           TF_RETURN_IF_ERROR(EnsurePrefetchThreadStarted(ctx));
+          RecordBufferSize(buffer_.size());
           // Wait until the next element in the buffer has been
           // produced, or we are shutting down.
           while (!cancelled_ && buffer_.empty() && !prefetch_thread_finished_ &&
-                 auto_tuner_.buffer_limit() != 0) {
+                 BufferLimit() != 0) {
             auto_tuner_.RecordEmpty();
-            cond_var_.wait(l);
+            cond_var_->wait(l);
           }
 
           if (cancelled_) {
@@ -137,11 +152,11 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
             return Status::OK();
           }
 
-          DCHECK_EQ(auto_tuner_.buffer_limit(), 0);
+          DCHECK_EQ(BufferLimit(), 0);
         }
 
         mutex_lock parent_l(parent_mu_);
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         return input_impl_->GetNext(ctx, out_tensors, end_of_sequence);
       }
 
@@ -150,7 +165,7 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
         // Acquire both locks to ensure that the prefetch thread and
         // all GetNext threads are blocked.
         mutex_lock parent_l(parent_mu_);
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         TF_RETURN_IF_ERROR(SaveParent(writer, input_impl_));
         TF_RETURN_IF_ERROR(
             writer->WriteScalar(full_name("buffer_size"), buffer_.size()));
@@ -174,7 +189,7 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
       Status RestoreInternal(IteratorContext* ctx,
                              IteratorStateReader* reader) override {
         mutex_lock parent_l(parent_mu_);
-        mutex_lock l(mu_);
+        mutex_lock l(*mu_);
         buffer_.clear();
         TF_RETURN_IF_ERROR(RestoreParent(ctx, reader, input_impl_));
         size_t buffer_size;
@@ -219,7 +234,7 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
       };
 
       Status Consume(std::vector<Tensor>* out_tensors, bool* end_of_sequence)
-          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         // A new element is available. Forward the status from computing it, and
         // (if we successfully got an element) the output values.
         Status s = buffer_.front().status;
@@ -234,12 +249,12 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
         //
         // TODO(mrry): Consider using different condition variables for
         // GetNext and Prefetch.
-        cond_var_.notify_all();
+        cond_var_->notify_all();
         return s;
       }
 
       Status EnsurePrefetchThreadStarted(IteratorContext* ctx)
-          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         if (!prefetch_thread_) {
           prefetch_thread_.reset(
               ctx->env()->StartThread({}, "prefetch_thread",
@@ -260,10 +275,10 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
 
           // 1. Wait for a slot in the buffer.
           {
-            mutex_lock l(mu_);
+            mutex_lock l(*mu_);
             while (!cancelled_ &&
-                   buffer_.size() >= auto_tuner_.buffer_limit()) {
-              cond_var_.wait(l);
+                   buffer_.size() >= BufferLimit()) {
+              cond_var_->wait(l);
             }
 
             if (cancelled_) {
@@ -283,23 +298,23 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
           buffer_element.status = input_impl_->GetNext(
               ctx, &buffer_element.value, &end_of_sequence);
           if (buffer_element.status.ok() && end_of_sequence) {
-            mutex_lock l(mu_);
+            mutex_lock l(*mu_);
             prefetch_thread_finished_ = true;
-            cond_var_.notify_all();
+            cond_var_->notify_all();
             return;
           }
 
           // 3. Signal that the element has been produced.
           {
-            mutex_lock l(mu_);
+            mutex_lock l(*mu_);
             buffer_.push_back(std::move(buffer_element));
-            cond_var_.notify_all();
+            cond_var_->notify_all();
           }
         }
       }
 
       Status WriteStatus(IteratorStateWriter* writer, size_t index,
-                         const Status& status) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+                         const Status& status) EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         TF_RETURN_IF_ERROR(writer->WriteScalar(
             CodeKey(index), static_cast<int64>(status.code())));
         if (!status.ok()) {
@@ -310,7 +325,7 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
       }
 
       Status ReadStatus(IteratorStateReader* reader, size_t index,
-                        Status* status) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+                        Status* status) EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
         int64 code_int;
         TF_RETURN_IF_ERROR(reader->ReadScalar(CodeKey(index), &code_int));
         error::Code code = static_cast<error::Code>(code_int);
@@ -330,24 +345,35 @@ class PrefetchDatasetOp : public UnaryDatasetOpKernel {
         return full_name(strings::StrCat("status[", index, "].code"));
       }
 
+      int64 BufferLimit() EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
+        return buffer_size_ ? buffer_size_->value()
+                            : auto_tuner_.buffer_limit();
+      }
+
       string ErrorMessageKey(size_t index) {
         return full_name(strings::StrCat("status[", index, "].error_message"));
       }
 
       // This mutex is used to ensure exclusivity between multiple threads
-      // reading/writing this iterator's local state.
-      mutex mu_;
+      // reading/writing this iterator's local state. Shared with
+      // `buffer_size_`.
+      const std::shared_ptr<mutex> mu_;
       // This mutex is used to ensure exclusivity between multiple threads
       // accessing the parent iterator. We keep this separate from `mu_` to
       // allow prefetching to run in parallel with GetNext calls.
-      mutex parent_mu_ ACQUIRED_BEFORE(mu_);
+      mutex parent_mu_ ACQUIRED_BEFORE(*mu_);
       std::unique_ptr<IteratorBase> input_impl_ GUARDED_BY(parent_mu_);
-      condition_variable cond_var_;
-      PrefetchAutotuner auto_tuner_ GUARDED_BY(mu_);
-      std::deque<BufferElement> buffer_ GUARDED_BY(mu_);
-      std::unique_ptr<Thread> prefetch_thread_ GUARDED_BY(mu_);
-      bool cancelled_ GUARDED_BY(mu_) = false;
-      bool prefetch_thread_finished_ GUARDED_BY(mu_) = false;
+      // The model of the input pipeline notifies it when it changes
+      // `buffer_size_`.
+      const std::shared_ptr<condition_variable> cond_var_;
+      PrefetchAutotuner auto_tuner_ GUARDED_BY(*mu_);
+      // The buffer size when it is tuned by the model of the input pipeline,
+      // or null.
+      std::shared_ptr<model::Parameter> buffer_size_;
+      std::deque<BufferElement> buffer_ GUARDED_BY(*mu_);
+      std::unique_ptr<Thread> prefetch_thread_ GUARDED_BY(*mu_);
+      bool cancelled_ GUARDED_BY(*mu_) = false;
+      bool prefetch_thread_finished_ GUARDED_BY(*mu_) = false;
     };
 
     const DatasetBase* const input_;
@@ -12,15 +12,27 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/kernels/data/dataset.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/lib/io/buffered_inputstream.h"
 #include "tensorflow/core/lib/io/inputbuffer.h"
+#include "tensorflow/core/lib/io/mapped_record_reader.h"
 #include "tensorflow/core/lib/io/random_inputstream.h"
+#include "tensorflow/core/lib/io/record_index.h"
 #include "tensorflow/core/lib/io/record_reader.h"
 #include "tensorflow/core/lib/io/zlib_compression_options.h"
 #include "tensorflow/core/lib/io/zlib_inputstream.h"
+#include "tensorflow/core/lib/random/philox_random.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
@@ -524,23 +536,41 @@ class TFRecordDatasetOp : public DatasetOpKernel {
                 errors::InvalidArgument(
                     "`buffer_size` must be >= 0 (0 == no buffering)"));
 
-    *output =
-        new Dataset(ctx, std::move(filenames), compression_type, buffer_size);
+    // Uncompressed files are read with this many large reads in flight,
+    // which lets input-bound pipelines keep fast local disks busy.
+    int64 async_reads = 0;
+    OP_REQUIRES_OK(ctx, ReadInt64FromEnvVar("TF_RECORD_DATASET_ASYNC_READS",
+                                            0, &async_reads));
+
+    // Uncompressed files on file systems that support it are read in place
+    // through a memory mapping.
+    bool use_mmap = false;
+    OP_REQUIRES_OK(
+        ctx, ReadBoolFromEnvVar("TF_RECORD_DATASET_MMAP", false, &use_mmap));
+
+    *output = new Dataset(ctx, std::move(filenames), compression_type,
+                          buffer_size, async_reads, use_mmap);
   }
 
  private:
   class Dataset : public GraphDatasetBase {
    public:
     explicit Dataset(OpKernelContext* ctx, std::vector<string> filenames,
-                     const string& compression_type, int64 buffer_size)
+                     const string& compression_type, int64 buffer_size,
+                     int64 async_reads, bool use_mmap)
         : GraphDatasetBase(ctx),
           filenames_(std::move(filenames)),
           compression_type_(compression_type),
           options_(io::RecordReaderOptions::CreateRecordReaderOptions(
-              compression_type)) {
+              compression_type)),
+          use_mmap_(use_mmap && options_.compression_type ==
+                                    io::RecordReaderOptions::NONE) {
       if (buffer_size > 0) {
         options_.buffer_size = buffer_size;
       }
+      if (async_reads > 0) {
+        options_.async_reads = static_cast<int>(async_reads);
+      }
     }
 
     std::unique_ptr<IteratorBase> MakeIteratorInternal(
@@ -586,36 +616,51 @@ class TFRecordDatasetOp : public DatasetOpKernel {
                              std::vector<Tensor>* out_tensors,
                              bool* end_of_sequence) override {
         mutex_lock l(mu_);
-        do {
-          // We are currently processing a file, so try to read the next record.
-          if (reader_) {
-            Tensor result_tensor(ctx->allocator({}), DT_STRING, {});
-            Status s = reader_->ReadRecord(&result_tensor.scalar<string>()());
-            if (s.ok()) {
-              out_tensors->emplace_back(std::move(result_tensor));
-              *end_of_sequence = false;
-              return Status::OK();
-            } else if (!errors::IsOutOfRange(s)) {
-              return s;
-            }
-
-            // We have reached the end of the current file, so maybe
-            // move on to next file.
-            ResetStreamsLocked();
-            ++current_file_index_;
+        Tensor result_tensor(ctx->allocator({}), DT_STRING, {});
+        string* value = &result_tensor.scalar<string>()();
+        StringPiece record;
+        TF_RETURN_IF_ERROR(
+            ReadRecordLocked(ctx->env(), &record, value, end_of_sequence));
+        if (!*end_of_sequence) {
+          // DT_STRING tensors own their bytes, so records the reader keeps
+          // in memory are copied once here.
+          if (record.data() != value->data()) {
+            value->assign(record.data(), record.size());
           }
+          out_tensors->emplace_back(std::move(result_tensor));
+        }
+        return Status::OK();
+      }
 
-          // Iteration ends when there are no more files to process.
+     protected:
+      Status SkipInternal(IteratorContext* ctx, int64 num_to_skip,
+                          bool* end_of_sequence, int64* num_skipped) override {
+        mutex_lock l(mu_);
+        *num_skipped = 0;
+        *end_of_sequence = false;
+        StringPiece record;
+        string storage;
+        while (*num_skipped < num_to_skip) {
           if (current_file_index_ == dataset()->filenames_.size()) {
             *end_of_sequence = true;
             return Status::OK();
           }
-
-          TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
-        } while (true);
+          int64 skipped = 0;
+          bool indexed = false;
+          TF_RETURN_IF_ERROR(SkipWithIndexLocked(
+              ctx->env(), num_to_skip - *num_skipped, &skipped, &indexed));
+          *num_skipped += skipped;
+          if (indexed) continue;
+
+          // Without an index, records can only be found by reading them.
+          TF_RETURN_IF_ERROR(ReadRecordLocked(ctx->env(), &record, &storage,
+                                              end_of_sequence));
+          if (*end_of_sequence) return Status::OK();
+          ++*num_skipped;
+        }
+        return Status::OK();
       }
 
-     protected:
       Status SaveInternal(IteratorStateWriter* writer) override {
         mutex_lock l(mu_);
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("current_file_index"),
@@ -624,6 +669,9 @@ class TFRecordDatasetOp : public DatasetOpKernel {
         if (reader_) {
           TF_RETURN_IF_ERROR(
               writer->WriteScalar(full_name("offset"), reader_->TellOffset()));
+        } else if (mapped_reader_) {
+          TF_RETURN_IF_ERROR(
+              writer->WriteScalar(full_name("offset"), mapped_offset_));
         }
         return Status::OK();
       }
@@ -640,12 +688,55 @@ class TFRecordDatasetOp : public DatasetOpKernel {
           int64 offset;
           TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("offset"), &offset));
           TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
-          TF_RETURN_IF_ERROR(reader_->SeekOffset(offset));
+          if (mapped_reader_) {
+            mapped_offset_ = offset;
+          } else {
+            TF_RETURN_IF_ERROR(reader_->SeekOffset(offset));
+          }
         }
         return Status::OK();
       }
 
      private:
+      // Reads the next record, moving on to the next file at the end of
+      // each file. `*record` points into `*storage` or into memory of the
+      // reader, and stays valid until the next read; see
+      // io::SequentialRecordReader::ReadRecord().
+      Status ReadRecordLocked(Env* env, StringPiece* record, string* storage,
+                              bool* end_of_sequence)
+          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        do {
+          // We are currently processing a file, so try to read the next record.
+          if (reader_ || mapped_reader_) {
+            Status s;
+            if (mapped_reader_) {
+              s = mapped_reader_->ReadRecord(&mapped_offset_, record);
+            } else {
+              s = reader_->ReadRecord(record, storage);
+            }
+            if (s.ok()) {
+              *end_of_sequence = false;
+              return Status::OK();
+            } else if (!errors::IsOutOfRange(s)) {
+              return s;
+            }
+
+            // We have reached the end of the current file, so maybe
+            // move on to next file.
+            ResetStreamsLocked();
+            ++current_file_index_;
+          }
+
+          // Iteration ends when there are no more files to process.
+          if (current_file_index_ == dataset()->filenames_.size()) {
+            *end_of_sequence = true;
+            return Status::OK();
+          }
+
+          TF_RETURN_IF_ERROR(SetupStreamsLocked(env));
+        } while (true);
+      }
+
       // Sets up reader streams to read from the file at `current_file_index_`.
       Status SetupStreamsLocked(Env* env) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
         if (current_file_index_ >= dataset()->filenames_.size()) {
@@ -657,16 +748,86 @@ class TFRecordDatasetOp : public DatasetOpKernel {
         // Actually move on to next file.
         const string& next_filename =
             dataset()->filenames_[current_file_index_];
+        if (dataset()->use_mmap_) {
+          Status s = io::MappedRecordReader::Open(
+              env, next_filename, /*verify_checksums=*/true, &mapped_reader_);
+          if (s.ok()) {
+            mapped_offset_ = 0;
+            return Status::OK();
+          }
+          // Fall back to reading the file if it cannot be mapped.
+          if (!errors::IsUnimplemented(s)) return s;
+        }
         TF_RETURN_IF_ERROR(env->NewRandomAccessFile(next_filename, &file_));
         reader_.reset(
             new io::SequentialRecordReader(file_.get(), dataset()->options_));
         return Status::OK();
       }
 
+      // Skips at most `num_to_skip` records of the file at
+      // `current_file_index_` using its index, moving on to the next file if
+      // the end of the file is reached. Stores false in `*indexed`, and skips
+      // nothing, if the file has no usable index.
+      Status SkipWithIndexLocked(Env* env, int64 num_to_skip,
+                                 int64* num_skipped, bool* indexed)
+          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        *num_skipped = 0;
+        *indexed = false;
+        if (dataset()->options_.compression_type !=
+            io::RecordReaderOptions::NONE) {
+          return Status::OK();
+        }
+        if (index_file_index_ != current_file_index_) {
+          const string& filename = dataset()->filenames_[current_file_index_];
+          index_file_index_ = current_file_index_;
+          Status s = io::RecordIndex::ReadForFile(env, filename, &index_);
+          if (errors::IsNotFound(s)) {
+            index_.reset();
+          } else if (!s.ok()) {
+            LOG(WARNING) << "Ignoring the index of " << filename << ": " << s;
+            index_.reset();
+          }
+        }
+        if (!index_) return Status::OK();
+        *indexed = true;
+
+        if (!reader_ && !mapped_reader_) {
+          // Skip whole files without opening them.
+          if (index_->num_records() <= num_to_skip) {
+            *num_skipped = index_->num_records();
+            ++current_file_index_;
+            return Status::OK();
+          }
+          TF_RETURN_IF_ERROR(SetupStreamsLocked(env));
+        }
+        const uint64 offset =
+            mapped_reader_ ? mapped_offset_ : reader_->TellOffset();
+        const int64 record = index_->Find(offset);
+        if (record < 0) {
+          return errors::DataLoss("No record starts at offset ", offset,
+                                  " of ",
+                                  dataset()->filenames_[current_file_index_],
+                                  " according to its index");
+        }
+        *num_skipped = std::min(num_to_skip, index_->num_records() - record);
+        if (record + *num_skipped == index_->num_records()) {
+          ResetStreamsLocked();
+          ++current_file_index_;
+        } else if (mapped_reader_) {
+          mapped_offset_ = index_->offset(record + *num_skipped);
+        } else {
+          TF_RETURN_IF_ERROR(
+              reader_->SeekOffset(index_->offset(record + *num_skipped)));
+        }
+        return Status::OK();
+      }
+
       // Resets all reader streams.
       void ResetStreamsLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
         reader_.reset();
         file_.reset();
+        mapped_reader_.reset();
+        mapped_offset_ = 0;
       }
 
       mutex mu_;
@@ -676,17 +837,498 @@ class TFRecordDatasetOp : public DatasetOpKernel {
       // we must destroy `reader_` before `file_`.
       std::unique_ptr<RandomAccessFile> file_ GUARDED_BY(mu_);
       std::unique_ptr<io::SequentialRecordReader> reader_ GUARDED_BY(mu_);
+      // Set instead of `reader_` if the file is memory mapped.
+      std::unique_ptr<io::MappedRecordReader> mapped_reader_ GUARDED_BY(mu_);
+      uint64 mapped_offset_ GUARDED_BY(mu_) = 0;
+      // The index of the file at `index_file_index_`, or null if it has none.
+      // Only loaded by SkipInternal().
+      std::unique_ptr<io::RecordIndex> index_ GUARDED_BY(mu_);
+      size_t index_file_index_ GUARDED_BY(mu_) =
+          std::numeric_limits<size_t>::max();
     };
 
     const std::vector<string> filenames_;
     const string compression_type_;
     io::RecordReaderOptions options_;
+    const bool use_mmap_;
   };
 };
 
 REGISTER_KERNEL_BUILDER(Name("TFRecordDataset").Device(DEVICE_CPU),
                         TFRecordDatasetOp);
 
+// A pseudorandom permutation of [0, n), evaluated one position at a time in
+// constant memory: a Feistel network permutes the smallest power of four that
+// is at least n, and positions that land outside [0, n) are permuted again
+// until they land inside it.
+class RandomPermutation {
+ public:
+  RandomPermutation(int64 n, int64 seed, int64 seed2, int64 epoch) : n_(n) {
+    while ((uint64{1} << (2 * half_bits_)) < static_cast<uint64>(n)) {
+      ++half_bits_;
+    }
+    half_mask_ = (uint64{1} << half_bits_) - 1;
+    random::PhiloxRandom philox(seed, seed2);
+    philox.Skip(epoch * kNumRounds / 2);
+    for (int round = 0; round < kNumRounds; round += 2) {
+      random::PhiloxRandom::ResultType sample = philox();
+      keys_[round] = (static_cast<uint64>(sample[0]) << 32) | sample[1];
+      keys_[round + 1] = (static_cast<uint64>(sample[2]) << 32) | sample[3];
+    }
+  }
+
+  int64 operator()(int64 i) const {
+    uint64 x = i;
+    do {
+      x = Encrypt(x);
+    } while (x >= static_cast<uint64>(n_));
+    return x;
+  }
+
+ private:
+  static constexpr int kNumRounds = 4;
+
+  uint64 Encrypt(uint64 x) const {
+    uint64 left = x >> half_bits_;
+    uint64 right = x & half_mask_;
+    for (uint64 key : keys_) {
+      const uint64 f =
+          Hash64(reinterpret_cast<const char*>(&right), sizeof(right), key);
+      const uint64 next_right = left ^ (f & half_mask_);
+      left = right;
+      right = next_right;
+    }
+    return (left << half_bits_) | right;
+  }
+
+  const int64 n_;
+  int half_bits_ = 1;
+  uint64 half_mask_;
+  uint64 keys_[kNumRounds];
+};
+
+class ShuffledTFRecordDatasetOp : public DatasetOpKernel {
+ public:
+  using DatasetOpKernel::DatasetOpKernel;
+
+  void MakeDataset(OpKernelContext* ctx, DatasetBase** output) override {
+    const Tensor* filenames_tensor;
+    OP_REQUIRES_OK(ctx, ctx->input("filenames", &filenames_tensor));
+    OP_REQUIRES(
+        ctx, filenames_tensor->dims() <= 1,
+        errors::InvalidArgument("`filenames` must be a scalar or a vector."));
+
+    std::vector<string> filenames;
+    filenames.reserve(filenames_tensor->NumElements());
+    for (int i = 0; i < filenames_tensor->NumElements(); ++i) {
+      filenames.push_back(filenames_tensor->flat<string>()(i));
+    }
+
+    int64 buffer_size;
+    OP_REQUIRES_OK(
+        ctx, ParseScalarArgument<int64>(ctx, "buffer_size", &buffer_size));
+    OP_REQUIRES(
+        ctx, buffer_size > 0,
+        errors::InvalidArgument("`buffer_size` must be greater than zero."));
+
+    int64 seed;
+    OP_REQUIRES_OK(ctx, ParseScalarArgument<int64>(ctx, "seed", &seed));
+    int64 seed2;
+    OP_REQUIRES_OK(ctx, ParseScalarArgument<int64>(ctx, "seed2", &seed2));
+
+    int64 count;
+    OP_REQUIRES_OK(ctx, ParseScalarArgument<int64>(ctx, "count", &count));
+    OP_REQUIRES(ctx, count >= -1,
+                errors::InvalidArgument(
+                    "`count` must be -1 or a non-negative number of epochs."));
+
+    // By TensorFlow convention, passing 0 for both seeds indicates
+    // that the shuffling should be seeded non-deterministically.
+    if (seed == 0 && seed2 == 0) {
+      seed = random::New64();
+      seed2 = random::New64();
+    }
+
+    *output = new Dataset(ctx, std::move(filenames), buffer_size, seed, seed2,
+                          count);
+  }
+
+ private:
+  class Dataset : public GraphDatasetBase {
+   public:
+    explicit Dataset(OpKernelContext* ctx, std::vector<string> filenames,
+                     int64 buffer_size, int64 seed, int64 seed2, int64 count)
+        : GraphDatasetBase(ctx),
+          filenames_(std::move(filenames)),
+          buffer_size_(buffer_size),
+          seed_(seed),
+          seed2_(seed2),
+          count_(count) {}
+
+    std::unique_ptr<IteratorBase> MakeIteratorInternal(
+        const string& prefix) const override {
+      return std::unique_ptr<IteratorBase>(
+          new Iterator({this, strings::StrCat(prefix, "::ShuffledTFRecord")}));
+    }
+
+    const DataTypeVector& output_dtypes() const override {
+      static DataTypeVector* dtypes = new DataTypeVector({DT_STRING});
+      return *dtypes;
+    }
+
+    const std::vector<PartialTensorShape>& output_shapes() const override {
+      static std::vector<PartialTensorShape>* shapes =
+          new std::vector<PartialTensorShape>({{}});
+      return *shapes;
+    }
+
+    string DebugString() const override {
+      return strings::StrCat("ShuffledTFRecordDatasetOp(", buffer_size_, ", ",
+                             seed_, ", ", seed2_, ", ", count_, ")::Dataset");
+    }
+
+   protected:
+    Status AsGraphDefInternal(DatasetGraphDefBuilder* b,
+                              Node** output) const override {
+      Node* filenames = nullptr;
+      TF_RETURN_IF_ERROR(b->AddVector(filenames_, &filenames));
+      Node* buffer_size = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(buffer_size_, &buffer_size));
+      Node* seed = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(seed_, &seed));
+      Node* seed2 = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(seed2_, &seed2));
+      Node* count = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(count_, &count));
+      TF_RETURN_IF_ERROR(b->AddDataset(
+          this, {filenames, buffer_size, seed, seed2, count}, output));
+      return Status::OK();
+    }
+
+   private:
+    // Records closer than this in a file are fetched with a single read.
+    static constexpr uint64 kMaxCoalescedGap = 64 << 10;
+    // Coalesced reads stop growing at this size.
+    static constexpr uint64 kMaxCoalescedRead = 16 << 20;
+
+    // The records of all files are numbered in order, and each epoch visits
+    // them in the order of a different random permutation of those numbers,
+    // which needs memory for the record indices of the files but not for the
+    // records. Position `p` of the iterator is position `p % num_records_` of
+    // the permutation of epoch `p / num_records_`. Windows of `buffer_size`
+    // records are fetched ahead of time by a background thread, which reads
+    // them in file order so that nearby records share a read.
+    class Iterator : public DatasetIterator<Dataset> {
+     public:
+      explicit Iterator(const Params& params)
+          : DatasetIterator<Dataset>(params) {}
+
+      ~Iterator() override {
+        // Signal the fetch thread to terminate it. We will then join that
+        // thread when we delete `this->fetch_thread_`.
+        mutex_lock l(mu_);
+        cancelled_ = true;
+        cond_var_.notify_all();
+      }
+
+      Status GetNextInternal(IteratorContext* ctx,
+                             std::vector<Tensor>* out_tensors,
+                             bool* end_of_sequence) override {
+        mutex_lock l(mu_);
+        EnsureFetchThreadStartedLocked(ctx);
+        while (buffer_.empty() && status_.ok() &&
+               (!indexed_ || next_position_ < EndPositionLocked())) {
+          cond_var_.wait(l);
+        }
+        if (!buffer_.empty()) {
+          out_tensors->push_back(std::move(buffer_.front()));
+          buffer_.pop_front();
+          ++next_position_;
+          cond_var_.notify_all();
+          *end_of_sequence = false;
+          return Status::OK();
+        }
+        TF_RETURN_IF_ERROR(status_);
+        *end_of_sequence = true;
+        return Status::OK();
+      }
+
+     protected:
+      Status SaveInternal(IteratorStateWriter* writer) override {
+        mutex_lock l(mu_);
+        TF_RETURN_IF_ERROR(
+            writer->WriteScalar(full_name("next_position"), next_position_));
+        return Status::OK();
+      }
+
+      Status RestoreInternal(IteratorContext* ctx,
+                             IteratorStateReader* reader) override {
+        mutex_lock l(mu_);
+        TF_RETURN_IF_ERROR(
+            reader->ReadScalar(full_name("next_position"), &next_position_));
+        // The buffered records are fetched again from the restored position,
+        // and the window that the fetch thread may be reading is dropped.
+        buffer_.clear();
+        fetch_position_ = next_position_;
+        ++generation_;
+        cond_var_.notify_all();
+        return Status::OK();
+      }
+
+     private:
+      // The location of a record that the fetch thread reads.
+      struct RecordLocation {
+        size_t file_index;
+        uint64 offset;
+        uint64 length;
+        // The position of the record in the window being fetched.
+        size_t position;
+      };
+
+      // Starts the fetch thread, unless that has already been done.
+      void EnsureFetchThreadStartedLocked(IteratorContext* ctx)
+          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        if (fetch_thread_) return;
+        fetch_thread_.reset(ctx->env()->StartThread(
+            {}, "shuffled_tf_record_fetch_thread",
+            std::bind(&Iterator::FetchThread, this,
+                      new IteratorContext(*ctx))));
+      }
+
+      // Returns the position after the last record of the last epoch.
+      int64 EndPositionLocked() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        if (num_records_ == 0) return 0;
+        if (dataset()->count_ == -1 ||
+            dataset()->count_ > kint64max / num_records_) {
+          return kint64max;
+        }
+        return dataset()->count_ * num_records_;
+      }
+
+      // Indexes the files, then fetches windows of records in the order of
+      // the permutations of the epochs, storing them in `buffer_`.
+      //
+      // It owns the iterator context passed to it.
+      void FetchThread(IteratorContext* ctx) {
+        std::unique_ptr<IteratorContext> cleanup(ctx);
+        {
+          // Reading the indices may take a while, so it is done without
+          // holding `mu_`.
+          std::vector<std::unique_ptr<io::RecordIndex>> file_indices;
+          std::vector<int64> record_starts;
+          int64 num_records = 0;
+          Status s = ReadIndices(ctx, &file_indices, &record_starts,
+                                 &num_records);
+          mutex_lock l(mu_);
+          if (!s.ok()) {
+            status_ = s;
+          } else {
+            file_indices_ = std::move(file_indices);
+            record_starts_ = std::move(record_starts);
+            num_records_ = num_records;
+            indexed_ = true;
+          }
+          cond_var_.notify_all();
+          if (!s.ok()) return;
+        }
+        std::unique_ptr<RandomPermutation> permutation;
+        int64 permutation_epoch = -1;
+        // Files are kept open while consecutive windows read them.
+        std::unordered_map<size_t, std::unique_ptr<RandomAccessFile>> files;
+        while (true) {
+          int64 generation;
+          std::vector<RecordLocation> locations;
+          {
+            mutex_lock l(mu_);
+            while (!cancelled_ && status_.ok() &&
+                   (buffer_.size() >= dataset()->buffer_size_ ||
+                    fetch_position_ >= EndPositionLocked())) {
+              cond_var_.wait(l);
+            }
+            if (cancelled_ || !status_.ok()) return;
+            generation = generation_;
+            // Windows do not span epochs.
+            const int64 epoch = fetch_position_ / num_records_;
+            const int64 window_start = fetch_position_ % num_records_;
+            const int64 window_end =
+                std::min(num_records_, window_start + dataset()->buffer_size_);
+            if (epoch != permutation_epoch) {
+              permutation.reset(new RandomPermutation(
+                  num_records_, dataset()->seed_, dataset()->seed2_, epoch));
+              permutation_epoch = epoch;
+            }
+            locations.reserve(window_end - window_start);
+            for (int64 i = window_start; i < window_end; ++i) {
+              const int64 record = (*permutation)(i);
+              const size_t file_index =
+                  std::upper_bound(record_starts_.begin(),
+                                   record_starts_.end(), record) -
+                  record_starts_.begin() - 1;
+              const io::RecordIndex& index = *file_indices_[file_index];
+              const int64 record_in_file = record - record_starts_[file_index];
+              locations.push_back({file_index, index.offset(record_in_file),
+                                   index.length(record_in_file),
+                                   locations.size()});
+            }
+          }
+
+          std::vector<Tensor> records(locations.size());
+          Status s = FetchRecords(ctx, &locations, &files, &records);
+
+          mutex_lock l(mu_);
+          // The iterator was restored while the window was being fetched.
+          if (generation != generation_) continue;
+          if (!s.ok()) {
+            status_ = s;
+          } else {
+            for (Tensor& record : records) {
+              buffer_.push_back(std::move(record));
+            }
+            fetch_position_ += records.size();
+          }
+          cond_var_.notify_all();
+        }
+      }
+
+      // Reads the index of each file, or builds it if the file has no valid
+      // index, and numbers the records of all files in order.
+      Status ReadIndices(
+          IteratorContext* ctx,
+          std::vector<std::unique_ptr<io::RecordIndex>>* file_indices,
+          std::vector<int64>* record_starts, int64* num_records) {
+        for (const string& filename : dataset()->filenames_) {
+          std::unique_ptr<io::RecordIndex> index;
+          Status s =
+              io::RecordIndex::ReadForFile(ctx->env(), filename, &index);
+          if (!s.ok()) {
+            if (!errors::IsNotFound(s)) {
+              LOG(WARNING) << "Ignoring the index of " << filename << ": "
+                           << s;
+            }
+            TF_RETURN_IF_ERROR(
+                io::RecordIndex::BuildForFile(ctx->env(), filename, &index));
+          }
+          record_starts->push_back(*num_records);
+          *num_records += index->num_records();
+          file_indices->push_back(std::move(index));
+        }
+        return Status::OK();
+      }
+
+      // Reads the records at `*locations` into `*records`, in file order.
+      Status FetchRecords(
+          IteratorContext* ctx, std::vector<RecordLocation>* locations,
+          std::unordered_map<size_t, std::unique_ptr<RandomAccessFile>>* files,
+          std::vector<Tensor>* records) {
+        std::sort(locations->begin(), locations->end(),
+                  [](const RecordLocation& a, const RecordLocation& b) {
+                    return a.file_index < b.file_index ||
+                           (a.file_index == b.file_index &&
+                            a.offset < b.offset);
+                  });
+        std::unordered_map<size_t, std::unique_ptr<RandomAccessFile>> used;
+        string scratch;
+        auto run_begin = locations->begin();
+        while (run_begin != locations->end()) {
+          // Extend the run while the records are close together.
+          uint64 run_end_offset = run_begin->offset + RecordSize(*run_begin);
+          auto run_end = run_begin + 1;
+          while (run_end != locations->end() &&
+                 run_end->file_index == run_begin->file_index &&
+                 run_end->offset <= run_end_offset + kMaxCoalescedGap &&
+                 run_end_offset - run_begin->offset < kMaxCoalescedRead) {
+            run_end_offset = std::max(run_end_offset,
+                                      run_end->offset + RecordSize(*run_end));
+            ++run_end;
+          }
+
+          const size_t file_index = run_begin->file_index;
+          const string& filename = dataset()->filenames_[file_index];
+          std::unique_ptr<RandomAccessFile>& file = used[file_index];
+          if (!file) {
+            auto it = files->find(file_index);
+            if (it != files->end()) {
+              file = std::move(it->second);
+            } else {
+              TF_RETURN_IF_ERROR(
+                  ctx->env()->NewRandomAccessFile(filename, &file));
+            }
+          }
+          const uint64 run_size = run_end_offset - run_begin->offset;
+          scratch.resize(run_size);
+          StringPiece data;
+          Status s =
+              file->Read(run_begin->offset, run_size, &data, &scratch[0]);
+          if (!s.ok() && !errors::IsOutOfRange(s)) return s;
+          if (data.size() != run_size) {
+            return errors::DataLoss("truncated record at ", run_begin->offset,
+                                    " of ", filename);
+          }
+
+          for (auto location = run_begin; location != run_end; ++location) {
+            const char* record =
+                data.data() + (location->offset - run_begin->offset);
+            const char* record_data = record + kRecordHeaderSize;
+            const uint32 masked_crc =
+                core::DecodeFixed32(record_data + location->length);
+            if (core::DecodeFixed64(record) != location->length ||
+                crc32c::Unmask(masked_crc) !=
+                    crc32c::Value(record_data, location->length)) {
+              return errors::DataLoss("corrupted record at ",
+                                      location->offset, " of ", filename);
+            }
+            Tensor& result = (*records)[location->position];
+            result = Tensor(ctx->allocator({}), DT_STRING, {});
+            result.scalar<string>()().assign(record_data, location->length);
+          }
+          run_begin = run_end;
+        }
+        // Close the files that this window did not read.
+        files->swap(used);
+        return Status::OK();
+      }
+
+      static uint64 RecordSize(const RecordLocation& location) {
+        return kRecordHeaderSize + location.length + kRecordFooterSize;
+      }
+
+      static constexpr uint64 kRecordHeaderSize =
+          sizeof(uint64) + sizeof(uint32);
+      static constexpr uint64 kRecordFooterSize = sizeof(uint32);
+
+      mutex mu_;
+      condition_variable cond_var_;
+      // The index of each file, and the number of the first record of each
+      // file. Set once by the fetch thread, with `indexed_`.
+      std::vector<std::unique_ptr<io::RecordIndex>> file_indices_
+          GUARDED_BY(mu_);
+      std::vector<int64> record_starts_ GUARDED_BY(mu_);
+      int64 num_records_ GUARDED_BY(mu_) = 0;
+      bool indexed_ GUARDED_BY(mu_) = false;
+      // The records at positions [next_position_, fetch_position_).
+      std::deque<Tensor> buffer_ GUARDED_BY(mu_);
+      int64 next_position_ GUARDED_BY(mu_) = 0;
+      int64 fetch_position_ GUARDED_BY(mu_) = 0;
+      // Incremented by each restore, so that the fetch thread drops the
+      // window it was reading for the old position.
+      int64 generation_ GUARDED_BY(mu_) = 0;
+      Status status_ GUARDED_BY(mu_);
+      bool cancelled_ GUARDED_BY(mu_) = false;
+      std::unique_ptr<Thread> fetch_thread_ GUARDED_BY(mu_);
+    };
+
+    const std::vector<string> filenames_;
+    const int64 buffer_size_;
+    const int64 seed_;
+    const int64 seed2_;
+    // The number of epochs, or -1 to repeat indefinitely.
+    const int64 count_;
+  };
+};
+
+REGISTER_KERNEL_BUILDER(Name("ShuffledTFRecordDataset").Device(DEVICE_CPU),
+                        ShuffledTFRecordDatasetOp);
+
 }  // namespace
 
 }  // namespace tensorflow
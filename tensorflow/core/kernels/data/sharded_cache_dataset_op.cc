@@ -0,0 +1,900 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include <zlib.h>
+#include <algorithm>
+#include <deque>
+
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/kernels/data/dataset.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/lib/strings/numbers.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/snappy.h"
+
+namespace tensorflow {
+
+namespace {
+
+// See documentation in ../ops/dataset_ops.cc for a high-level description of
+// the following op.
+//
+// The cache for `filename` consists of
+//
+// * The shard files `<filename>.<segment>.shard-<shard>-of-<num_shards>`.
+//   Element `i` of the input is stored in shard `i % num_shards`. The writing
+//   iterator starts a new segment of `num_shards` files whenever it is
+//   checkpointed, so that the files of earlier segments are never modified.
+// * The index file `<filename>.sharded_index`, written once all elements have
+//   been cached, which holds the number of shards, segments and elements.
+// * The lockfile `<filename>.<segment>.lockfile` of each segment, which is
+//   created before the files of the segment and deleted with the others once
+//   the index has been written.
+//
+// Like the file cache of CacheDataset, the cache can only be read once it has
+// been completely written: the number of elements of each segment is only
+// recorded in the index, and the chunks of the open segment are still being
+// written. An iterator created while another iterator writes the cache finds
+// the lockfile of the first segment and fails with AlreadyExists, rather than
+// writing the same files. A writer restored from a checkpoint owns the
+// segments from the restored one onwards, and deletes the files that its
+// previous incarnation left there after the checkpoint was saved.
+//
+// Each shard file is a TFRecord file whose records are chunks of consecutive
+// elements of the shard. A chunk is a byte holding its `ChunkCompression`,
+// the varint64-encoded number of elements and uncompressed size of the
+// chunk, and the (compressed) elements. Each element is stored as the
+// varint64-encoded size and the serialized `TensorProto` of each component.
+
+enum ChunkCompression : uint8 { kNone = 0, kZlib = 1, kSnappy = 2 };
+
+// The elements of a shard are buffered until they take this many bytes, and
+// are then compressed and written as one chunk. The readers keep between one
+// and two chunks of each shard decoded ahead of the consumer.
+constexpr size_t kChunkBytes = 4 << 20;  // 4 MB
+constexpr int64 kReadBufferBytes = 1 << 20;  // 1 MB
+
+string ShardFilename(const string& filename, int64 segment, int64 shard,
+                     int64 num_shards) {
+  return strings::StrCat(filename, ".", segment, ".shard-", shard, "-of-",
+                         num_shards);
+}
+
+string IndexFilename(const string& filename) {
+  return strings::StrCat(filename, ".sharded_index");
+}
+
+string LockFilename(const string& filename, int64 segment) {
+  return strings::StrCat(filename, ".", segment, ".lockfile");
+}
+
+Status ParseCompression(const string& compression_type,
+                        ChunkCompression* compression) {
+  if (compression_type.empty()) {
+    *compression = kNone;
+  } else if (compression_type == "ZLIB") {
+    *compression = kZlib;
+  } else if (compression_type == "SNAPPY") {
+    // Fail early rather than after caching the first chunk of elements.
+    string compressed;
+    if (!port::Snappy_Compress("", 0, &compressed)) {
+      return errors::Unimplemented(
+          "Snappy compression is not supported on this platform");
+    }
+    *compression = kSnappy;
+  } else {
+    return errors::InvalidArgument("Unsupported compression_type: ",
+                                   compression_type,
+                                   ". Expected \"\", \"ZLIB\" or \"SNAPPY\".");
+  }
+  return Status::OK();
+}
+
+size_t ElementBytes(const std::vector<Tensor>& element) {
+  size_t bytes = 0;
+  for (const Tensor& t : element) {
+    bytes += t.TotalBytes();
+  }
+  return bytes;
+}
+
+void AppendElement(const std::vector<Tensor>& element, string* data) {
+  TensorProto proto;
+  string serialized;
+  for (const Tensor& t : element) {
+    proto.Clear();
+    t.AsProtoTensorContent(&proto);
+    proto.SerializeToString(&serialized);
+    core::PutVarint64(data, serialized.size());
+    data->append(serialized);
+  }
+}
+
+Status ParseElements(StringPiece data, uint64 num_elements,
+                     size_t num_components,
+                     std::vector<std::vector<Tensor>>* elements) {
+  elements->clear();
+  elements->reserve(num_elements);
+  TensorProto proto;
+  for (uint64 i = 0; i < num_elements; ++i) {
+    std::vector<Tensor> element(num_components);
+    for (Tensor& t : element) {
+      uint64 size;
+      if (!core::GetVarint64(&data, &size) || size > data.size() ||
+          !proto.ParseFromArray(data.data(), size) || !t.FromProto(proto)) {
+        return errors::DataLoss("Corrupted element in cache chunk");
+      }
+      data.remove_prefix(size);
+    }
+    elements->push_back(std::move(element));
+  }
+  if (!data.empty()) {
+    return errors::DataLoss("Unexpected data at the end of cache chunk");
+  }
+  return Status::OK();
+}
+
+// Stores `num_elements` elements, serialized to `data`, as a chunk in
+// `*chunk`.
+Status EncodeChunk(ChunkCompression compression, uint64 num_elements,
+                   const string& data, string* chunk) {
+  chunk->clear();
+  chunk->push_back(static_cast<char>(compression));
+  core::PutVarint64(chunk, num_elements);
+  core::PutVarint64(chunk, data.size());
+  switch (compression) {
+    case kNone:
+      chunk->append(data);
+      return Status::OK();
+    case kZlib: {
+      const size_t header_size = chunk->size();
+      uLongf compressed_size = compressBound(data.size());
+      chunk->resize(header_size + compressed_size);
+      if (compress2(reinterpret_cast<Bytef*>(&(*chunk)[header_size]),
+                    &compressed_size,
+                    reinterpret_cast<const Bytef*>(data.data()), data.size(),
+                    Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return errors::Internal("Failed to compress cache chunk with zlib");
+      }
+      chunk->resize(header_size + compressed_size);
+      return Status::OK();
+    }
+    case kSnappy: {
+      string compressed;
+      if (!port::Snappy_Compress(data.data(), data.size(), &compressed)) {
+        return errors::Unimplemented(
+            "Snappy compression is not supported on this platform");
+      }
+      chunk->append(compressed);
+      return Status::OK();
+    }
+  }
+  return errors::InvalidArgument("Unknown cache chunk compression ",
+                                 static_cast<int>(compression));
+}
+
+struct ChunkHeader {
+  uint8 compression;
+  uint64 num_elements;
+  uint64 size;
+};
+
+// Parses the header of `*chunk`, leaving the (compressed) elements in
+// `*chunk`.
+Status ParseChunkHeader(StringPiece* chunk, ChunkHeader* header) {
+  if (chunk->empty()) {
+    return errors::DataLoss("Empty cache chunk");
+  }
+  header->compression = static_cast<uint8>((*chunk)[0]);
+  chunk->remove_prefix(1);
+  if (!core::GetVarint64(chunk, &header->num_elements) ||
+      !core::GetVarint64(chunk, &header->size)) {
+    return errors::DataLoss("Corrupted cache chunk header");
+  }
+  return Status::OK();
+}
+
+Status DecodeChunk(const ChunkHeader& header, StringPiece chunk,
+                   string* data) {
+  data->resize(header.size);
+  switch (header.compression) {
+    case kNone:
+      if (chunk.size() != header.size) break;
+      memcpy(&(*data)[0], chunk.data(), chunk.size());
+      return Status::OK();
+    case kZlib: {
+      uLongf size = header.size;
+      if (uncompress(reinterpret_cast<Bytef*>(&(*data)[0]), &size,
+                     reinterpret_cast<const Bytef*>(chunk.data()),
+                     chunk.size()) != Z_OK ||
+          size != header.size) {
+        break;
+      }
+      return Status::OK();
+    }
+    case kSnappy: {
+      size_t size;
+      if (!port::Snappy_GetUncompressedLength(chunk.data(), chunk.size(),
+                                              &size) ||
+          size != header.size ||
+          !port::Snappy_Uncompress(chunk.data(), chunk.size(), &(*data)[0])) {
+        break;
+      }
+      return Status::OK();
+    }
+    default:
+      return errors::DataLoss("Unknown cache chunk compression ",
+                              static_cast<int>(header.compression));
+  }
+  return errors::DataLoss("Failed to decompress cache chunk");
+}
+
+class ShardedCacheDatasetOp : public UnaryDatasetOpKernel {
+ public:
+  explicit ShardedCacheDatasetOp(OpKernelConstruction* ctx)
+      : UnaryDatasetOpKernel(ctx) {}
+
+  void MakeDataset(OpKernelContext* ctx, DatasetBase* input,
+                   DatasetBase** output) override {
+    string filename;
+    OP_REQUIRES_OK(ctx,
+                   ParseScalarArgument<string>(ctx, "filename", &filename));
+    OP_REQUIRES(ctx, !filename.empty(),
+                errors::InvalidArgument("`filename` must not be empty."));
+
+    int64 num_shards;
+    OP_REQUIRES_OK(ctx,
+                   ParseScalarArgument<int64>(ctx, "num_shards", &num_shards));
+    OP_REQUIRES(
+        ctx, num_shards > 0,
+        errors::InvalidArgument("`num_shards` must be greater than zero."));
+
+    string compression_type;
+    OP_REQUIRES_OK(ctx, ParseScalarArgument<string>(ctx, "compression_type",
+                                                    &compression_type));
+    ChunkCompression compression;
+    OP_REQUIRES_OK(ctx, ParseCompression(compression_type, &compression));
+
+    *output = new Dataset(ctx, input, std::move(filename), num_shards,
+                          std::move(compression_type), compression);
+  }
+
+ private:
+  class Dataset : public GraphDatasetBase {
+   public:
+    Dataset(OpKernelContext* ctx, const DatasetBase* input, string filename,
+            int64 num_shards, string compression_type,
+            ChunkCompression compression)
+        : GraphDatasetBase(ctx),
+          input_(input),
+          filename_(std::move(filename)),
+          num_shards_(num_shards),
+          compression_type_(std::move(compression_type)),
+          compression_(compression),
+          env_(ctx->env()),
+          num_tensors_(input->output_dtypes().size()) {
+      input_->Ref();
+    }
+
+    ~Dataset() override { input_->Unref(); }
+
+    std::unique_ptr<IteratorBase> MakeIteratorInternal(
+        const string& prefix) const override {
+      return std::unique_ptr<IteratorBase>(
+          new Iterator({this, strings::StrCat(prefix, "::ShardedCache")}));
+    }
+
+    const DataTypeVector& output_dtypes() const override {
+      return input_->output_dtypes();
+    }
+
+    const std::vector<PartialTensorShape>& output_shapes() const override {
+      return input_->output_shapes();
+    }
+
+    string DebugString() const override {
+      return "ShardedCacheDatasetOp::Dataset";
+    }
+
+   protected:
+    Status AsGraphDefInternal(OpKernelContext* ctx, DatasetGraphDefBuilder* b,
+                              Node** output) const override {
+      Node* input_graph = nullptr;
+      TF_RETURN_IF_ERROR(b->AddParentDataset(ctx, input_, &input_graph));
+      Node* filename = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(filename_, &filename));
+      Node* num_shards = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(num_shards_, &num_shards));
+      Node* compression_type = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(compression_type_, &compression_type));
+      TF_RETURN_IF_ERROR(b->AddDataset(
+          this, {input_graph, filename, num_shards, compression_type},
+          output));
+      return Status::OK();
+    }
+
+   private:
+    // Reads the cache if it has been completely written, and writes it
+    // otherwise.
+    class Iterator : public DatasetIterator<Dataset> {
+     public:
+      explicit Iterator(const Params& params)
+          : DatasetIterator<Dataset>(params) {
+        if (params.dataset->env_
+                ->FileExists(IndexFilename(params.dataset->filename_))
+                .ok()) {
+          mode_ = Mode::read;
+        } else {
+          mode_ = Mode::write;
+        }
+        InitializeIterator();
+      }
+
+      Status Initialize(IteratorContext* ctx) override {
+        mutex_lock l(mu_);
+        return iterator_->Initialize(ctx);
+      }
+
+      Status GetNextInternal(IteratorContext* ctx,
+                             std::vector<Tensor>* out_tensors,
+                             bool* end_of_sequence) override {
+        mutex_lock l(mu_);
+        return iterator_->GetNext(ctx, out_tensors, end_of_sequence);
+      }
+
+     protected:
+      Status SaveInternal(IteratorStateWriter* writer) override {
+        mutex_lock l(mu_);
+        TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("mode"), mode_));
+        return SaveParent(writer, iterator_);
+      }
+
+      Status RestoreInternal(IteratorContext* ctx,
+                             IteratorStateReader* reader) override {
+        mutex_lock l(mu_);
+        {
+          int64 temp;
+          TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("mode"), &temp));
+          mode_ = static_cast<Mode>(temp);
+        }
+        if (mode_ == Mode::write &&
+            dataset()
+                ->env_->FileExists(IndexFilename(dataset()->filename_))
+                .ok()) {
+          // The cache was completely written after the checkpoint was saved,
+          // so we read it from the restored position instead.
+          LOG(WARNING) << "The cache " << IndexFilename(dataset()->filename_)
+                       << " was completely written after the last checkpoint "
+                       << "was saved. Reading the cache instead of continuing "
+                       << "to write it.";
+          mode_ = Mode::read;
+        }
+        InitializeIterator();
+        TF_RETURN_IF_ERROR(iterator_->Initialize(ctx));
+        return RestoreParent(ctx, reader, iterator_);
+      }
+
+     private:
+      // Passes through the elements of the input and writes them to the
+      // shards of the cache.
+      //
+      // The iterator appends each element to the open chunk of its shard, and
+      // hands full chunks to a thread pool, which compresses and writes the
+      // chunks of different shards in parallel. Saving the iterator waits
+      // for all chunks to be written and closes the current segment.
+      class WriterIterator : public DatasetIterator<Dataset> {
+       public:
+        explicit WriterIterator(const Params& params)
+            : DatasetIterator<Dataset>(params),
+              num_threads_(static_cast<int>(std::min<int64>(
+                  params.dataset->num_shards_, port::NumSchedulableCPUs()))) {}
+
+        Status Initialize(IteratorContext* ctx) override {
+          thread_pool_.reset(new thread::ThreadPool(
+              dataset()->env_, "sharded_cache_writer", num_threads_));
+          return dataset()->input_->MakeIterator(ctx, prefix(), &input_impl_);
+        }
+
+        Status GetNextInternal(IteratorContext* ctx,
+                               std::vector<Tensor>* out_tensors,
+                               bool* end_of_sequence) override {
+          mutex_lock l(mu_);
+          if (iteration_completed_) {
+            *end_of_sequence = true;
+            return Status::OK();
+          }
+          TF_RETURN_IF_ERROR(
+              input_impl_->GetNext(ctx, out_tensors, end_of_sequence));
+          if (*end_of_sequence) {
+            return Finish();
+          }
+          if (out_tensors->size() != dataset()->num_tensors_) {
+            return errors::Internal(
+                "Upstream iterator returned invalid number of tensors. "
+                "Expected ",
+                dataset()->num_tensors_, " got: ", out_tensors->size());
+          }
+          TF_RETURN_IF_ERROR(EnsureSegmentOpen());
+          Shard* shard = shards_[cur_index_ % dataset()->num_shards_].get();
+          AppendElement(*out_tensors, &shard->chunk);
+          ++shard->chunk_elements;
+          if (shard->chunk.size() >= kChunkBytes) {
+            TF_RETURN_IF_ERROR(ScheduleChunk(shard));
+          }
+          ++cur_index_;
+          return Status::OK();
+        }
+
+       protected:
+        Status SaveInternal(IteratorStateWriter* writer) override {
+          mutex_lock l(mu_);
+          TF_RETURN_IF_ERROR(
+              writer->WriteScalar(full_name("cur_index"), cur_index_));
+          if (iteration_completed_) {
+            TF_RETURN_IF_ERROR(
+                writer->WriteScalar(full_name("iteration_completed"), ""));
+            return Status::OK();
+          }
+          // Makes the elements produced so far durable, and starts writing
+          // the following elements to a new segment.
+          TF_RETURN_IF_ERROR(CloseSegment());
+          TF_RETURN_IF_ERROR(SaveParent(writer, input_impl_));
+          TF_RETURN_IF_ERROR(
+              writer->WriteScalar(full_name("segment"), segment_));
+          return Status::OK();
+        }
+
+        Status RestoreInternal(IteratorContext* ctx,
+                               IteratorStateReader* reader) override {
+          mutex_lock l(mu_);
+          TF_RETURN_IF_ERROR(
+              reader->ReadScalar(full_name("cur_index"), &cur_index_));
+          if (reader->Contains(full_name("iteration_completed"))) {
+            iteration_completed_ = true;
+            return Status::OK();
+          }
+          TF_RETURN_IF_ERROR(RestoreParent(ctx, reader, input_impl_));
+          TF_RETURN_IF_ERROR(
+              reader->ReadScalar(full_name("segment"), &segment_));
+          return DeleteSegmentsFrom(segment_);
+        }
+
+       private:
+        // The files of a shard in the current segment.
+        struct Shard {
+          std::unique_ptr<WritableFile> file;
+          std::unique_ptr<io::RecordWriter> writer;
+          // The elements that have not been handed to the thread pool yet.
+          string chunk;
+          uint64 chunk_elements = 0;
+          // The number of elements and data of the chunks to write, which
+          // are written in order by at most one closure at a time.
+          std::deque<std::pair<uint64, string>> pending;
+          bool writing = false;
+          Status status;
+        };
+
+        // Creates the files of the current segment, unless they are open.
+        Status EnsureSegmentOpen() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          if (segment_open_) return Status::OK();
+          Env* env = dataset()->env_;
+          const string& filename = dataset()->filename_;
+
+          // Perform rudimentary locking to help catch concurrent writes to
+          // the same cache files.
+          if (env->FileExists(IndexFilename(filename)).ok()) {
+            return errors::AlreadyExists(
+                "Existing cache files found: \n", IndexFilename(filename),
+                "\nTo continue delete the cache files.");
+          }
+          const string lockfile = LockFilename(filename, segment_);
+          if (env->FileExists(lockfile).ok()) {
+            return errors::AlreadyExists(
+                "There appears to be a concurrent caching iterator running - "
+                "cache lockfile already exists ('",
+                lockfile,
+                "'). The cache cannot be read before it has been completely "
+                "written. If you are sure no other running TF computations "
+                "are using this cache prefix, delete the lockfile and "
+                "re-initialize the iterator.");
+          }
+          {
+            std::unique_ptr<WritableFile> file;
+            TF_RETURN_IF_ERROR(env->NewWritableFile(lockfile, &file));
+            TF_RETURN_IF_ERROR(file->Append(
+                strings::StrCat("Created at: ", env->NowSeconds())));
+            TF_RETURN_IF_ERROR(file->Close());
+          }
+
+          std::vector<std::unique_ptr<Shard>> shards;
+          for (int64 i = 0; i < dataset()->num_shards_; ++i) {
+            std::unique_ptr<Shard> shard(new Shard);
+            TF_RETURN_IF_ERROR(env->NewWritableFile(
+                ShardFilename(filename, segment_, i, dataset()->num_shards_),
+                &shard->file));
+            shard->writer.reset(new io::RecordWriter(shard->file.get()));
+            shards.push_back(std::move(shard));
+          }
+          shards_ = std::move(shards);
+          segment_open_ = true;
+          return Status::OK();
+        }
+
+        // Deletes the files of `segment` and of the following segments. They
+        // were written by the iterator that saved the restored checkpoint,
+        // after it was saved, and hold elements that will be produced again.
+        Status DeleteSegmentsFrom(int64 segment) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          Env* env = dataset()->env_;
+          const string& filename = dataset()->filename_;
+          for (; env->FileExists(LockFilename(filename, segment)).ok();
+               ++segment) {
+            for (int64 i = 0; i < dataset()->num_shards_; ++i) {
+              const string shard_filename =
+                  ShardFilename(filename, segment, i, dataset()->num_shards_);
+              if (env->FileExists(shard_filename).ok()) {
+                TF_RETURN_IF_ERROR(env->DeleteFile(shard_filename));
+              }
+            }
+            TF_RETURN_IF_ERROR(
+                env->DeleteFile(LockFilename(filename, segment)));
+          }
+          return Status::OK();
+        }
+
+        // Hands the open chunk of `*shard` to the thread pool, waiting if
+        // too many chunks are already pending.
+        Status ScheduleChunk(Shard* shard) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          string chunk;
+          chunk.swap(shard->chunk);
+          const uint64 num_elements = shard->chunk_elements;
+          shard->chunk_elements = 0;
+
+          mutex_lock l(write_mu_);
+          while (num_pending_chunks_ >= 2 * num_threads_) {
+            write_cond_var_.wait(l);
+          }
+          TF_RETURN_IF_ERROR(shard->status);
+          shard->pending.emplace_back(num_elements, std::move(chunk));
+          ++num_pending_chunks_;
+          if (!shard->writing) {
+            shard->writing = true;
+            thread_pool_->Schedule([this, shard]() { WriteChunks(shard); });
+          }
+          return Status::OK();
+        }
+
+        // Compresses and writes the pending chunks of `*shard`.
+        void WriteChunks(Shard* shard) {
+          std::pair<uint64, string> pending;
+          string chunk;
+          while (true) {
+            {
+              mutex_lock l(write_mu_);
+              if (shard->pending.empty()) {
+                shard->writing = false;
+                write_cond_var_.notify_all();
+                return;
+              }
+              pending = std::move(shard->pending.front());
+              shard->pending.pop_front();
+            }
+            Status s = EncodeChunk(dataset()->compression_, pending.first,
+                                   pending.second, &chunk);
+            if (s.ok()) {
+              s = shard->writer->WriteRecord(chunk);
+            }
+            mutex_lock l(write_mu_);
+            shard->status.Update(s);
+            --num_pending_chunks_;
+            write_cond_var_.notify_all();
+          }
+        }
+
+        // Writes the open chunks and closes the files of the current
+        // segment.
+        Status CloseSegment() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          if (!segment_open_) return Status::OK();
+          for (const auto& shard : shards_) {
+            if (shard->chunk_elements > 0) {
+              TF_RETURN_IF_ERROR(ScheduleChunk(shard.get()));
+            }
+          }
+          {
+            mutex_lock l(write_mu_);
+            for (const auto& shard : shards_) {
+              while (shard->writing) {
+                write_cond_var_.wait(l);
+              }
+              TF_RETURN_IF_ERROR(shard->status);
+            }
+          }
+          for (const auto& shard : shards_) {
+            TF_RETURN_IF_ERROR(shard->writer->Close());
+            TF_RETURN_IF_ERROR(shard->file->Close());
+          }
+          shards_.clear();
+          segment_open_ = false;
+          ++segment_;
+          return Status::OK();
+        }
+
+        Status Finish() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          iteration_completed_ = true;
+          TF_RETURN_IF_ERROR(CloseSegment());
+          Env* env = dataset()->env_;
+          const string& filename = dataset()->filename_;
+          // The index is written to a temporary file first so that readers
+          // never see a partial index.
+          const string index = IndexFilename(filename);
+          const string tmp_index = strings::StrCat(index, ".tmp");
+          TF_RETURN_IF_ERROR(WriteStringToFile(
+              env, tmp_index,
+              strings::StrCat(dataset()->num_shards_, " ", segment_, " ",
+                              cur_index_)));
+          TF_RETURN_IF_ERROR(env->RenameFile(tmp_index, index));
+          for (int64 i = 0; i < segment_; ++i) {
+            TF_RETURN_IF_ERROR(env->DeleteFile(LockFilename(filename, i)));
+          }
+          input_impl_.reset();
+          return Status::OK();
+        }
+
+        const int num_threads_;
+        mutex mu_;
+        int64 cur_index_ GUARDED_BY(mu_) = 0;
+        // The index of the segment being written. It is incremented whenever
+        // the iterator is saved after producing elements.
+        int64 segment_ GUARDED_BY(mu_) = 0;
+        bool segment_open_ GUARDED_BY(mu_) = false;
+        bool iteration_completed_ GUARDED_BY(mu_) = false;
+        std::unique_ptr<IteratorBase> input_impl_ GUARDED_BY(mu_);
+        std::vector<std::unique_ptr<Shard>> shards_ GUARDED_BY(mu_);
+        mutex write_mu_;
+        condition_variable write_cond_var_;
+        int num_pending_chunks_ GUARDED_BY(write_mu_) = 0;
+        // Declared last, so that pending chunks are written before the
+        // shards are destroyed.
+        std::unique_ptr<thread::ThreadPool> thread_pool_;
+      };  // WriterIterator
+
+      // Reads the elements of the cache in order.
+      //
+      // A background thread per shard reads, decompresses and parses the
+      // chunks of the shard ahead of the consumer, so that the shards are
+      // read in parallel.
+      class ReaderIterator : public DatasetIterator<Dataset> {
+       public:
+        explicit ReaderIterator(const Params& params)
+            : DatasetIterator<Dataset>(params) {}
+
+        ~ReaderIterator() override {
+          // Signal the reader threads to terminate them. We will then join
+          // those threads when we delete `this->reader_threads_`.
+          mutex_lock l(mu_);
+          cancelled_ = true;
+          for (const auto& buffer : buffers_) {
+            buffer->cond_var.notify_all();
+          }
+        }
+
+        Status Initialize(IteratorContext* ctx) override {
+          mutex_lock l(mu_);
+          const string index = IndexFilename(dataset()->filename_);
+          string contents;
+          TF_RETURN_IF_ERROR(
+              ReadFileToString(dataset()->env_, index, &contents));
+          std::vector<string> fields = str_util::Split(contents, ' ');
+          if (fields.size() != 3 ||
+              !strings::safe_strto64(fields[0], &num_shards_) ||
+              !strings::safe_strto64(fields[1], &num_segments_) ||
+              !strings::safe_strto64(fields[2], &num_elements_) ||
+              num_shards_ <= 0) {
+            return errors::DataLoss("Corrupted cache index ", index);
+          }
+          for (int64 i = 0; i < num_shards_; ++i) {
+            buffers_.emplace_back(new ShardBuffer);
+          }
+          return Status::OK();
+        }
+
+        Status GetNextInternal(IteratorContext* ctx,
+                               std::vector<Tensor>* out_tensors,
+                               bool* end_of_sequence) override {
+          mutex_lock l(mu_);
+          if (cur_index_ >= num_elements_) {
+            *end_of_sequence = true;
+            return Status::OK();
+          }
+          EnsureReaderThreadsStarted(ctx);
+          ShardBuffer* buffer = buffers_[cur_index_ % num_shards_].get();
+          while (buffer->elements.empty() && !buffer->done && status_.ok()) {
+            buffer->cond_var.wait(l);
+          }
+          if (buffer->elements.empty()) {
+            TF_RETURN_IF_ERROR(status_);
+            return errors::DataLoss("Cache shard ", cur_index_ % num_shards_,
+                                    " of ", dataset()->filename_,
+                                    " ended before element ", cur_index_);
+          }
+          *out_tensors = std::move(buffer->elements.front());
+          buffer->elements.pop_front();
+          buffer->bytes -= ElementBytes(*out_tensors);
+          buffer->cond_var.notify_all();
+          ++cur_index_;
+          *end_of_sequence = false;
+          return Status::OK();
+        }
+
+       protected:
+        Status SaveInternal(IteratorStateWriter* writer) override {
+          mutex_lock l(mu_);
+          TF_RETURN_IF_ERROR(
+              writer->WriteScalar(full_name("cur_index"), cur_index_));
+          return Status::OK();
+        }
+
+        Status RestoreInternal(IteratorContext* ctx,
+                               IteratorStateReader* reader) override {
+          mutex_lock l(mu_);
+          if (!reader_threads_.empty()) {
+            return errors::FailedPrecondition(
+                "Cannot restore a cache reader that has started reading.");
+          }
+          TF_RETURN_IF_ERROR(
+              reader->ReadScalar(full_name("cur_index"), &cur_index_));
+          return Status::OK();
+        }
+
+       private:
+        // The elements of a shard read ahead of the consumer.
+        struct ShardBuffer {
+          std::deque<std::vector<Tensor>> elements;
+          size_t bytes = 0;
+          // Whether the reader thread of the shard has terminated.
+          bool done = false;
+          // Notified when elements are added or removed.
+          condition_variable cond_var;
+        };
+
+        void EnsureReaderThreadsStarted(IteratorContext* ctx)
+            EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          if (!reader_threads_.empty()) return;
+          for (int64 shard = 0; shard < num_shards_; ++shard) {
+            // The number of elements of the shard before `cur_index_`.
+            const uint64 skip = cur_index_ / num_shards_ +
+                                (shard < cur_index_ % num_shards_ ? 1 : 0);
+            reader_threads_.emplace_back(ctx->env()->StartThread(
+                {}, "sharded_cache_reader",
+                [this, shard, skip]() { ReaderThread(shard, skip); }));
+          }
+        }
+
+        void ReaderThread(int64 shard, uint64 skip) {
+          Status s = ReadShard(shard, skip);
+          mutex_lock l(mu_);
+          if (!cancelled_) {
+            status_.Update(s);
+          }
+          buffers_[shard]->done = true;
+          buffers_[shard]->cond_var.notify_all();
+        }
+
+        // Reads the elements of `shard` into its buffer, after skipping its
+        // first `skip` elements.
+        Status ReadShard(int64 shard, uint64 skip) {
+          ShardBuffer* buffer;
+          {
+            mutex_lock l(mu_);
+            buffer = buffers_[shard].get();
+          }
+          io::RecordReaderOptions options;
+          options.buffer_size = kReadBufferBytes;
+          string record;
+          string data;
+          std::vector<std::vector<Tensor>> elements;
+          for (int64 segment = 0; segment < num_segments_; ++segment) {
+            std::unique_ptr<RandomAccessFile> file;
+            TF_RETURN_IF_ERROR(dataset()->env_->NewRandomAccessFile(
+                ShardFilename(dataset()->filename_, segment, shard,
+                              num_shards_),
+                &file));
+            io::SequentialRecordReader reader(file.get(), options);
+            while (true) {
+              Status s = reader.ReadRecord(&record);
+              if (errors::IsOutOfRange(s)) break;
+              TF_RETURN_IF_ERROR(s);
+              StringPiece chunk(record);
+              ChunkHeader header;
+              TF_RETURN_IF_ERROR(ParseChunkHeader(&chunk, &header));
+              if (skip >= header.num_elements) {
+                skip -= header.num_elements;
+                continue;
+              }
+              TF_RETURN_IF_ERROR(DecodeChunk(header, chunk, &data));
+              TF_RETURN_IF_ERROR(ParseElements(data, header.num_elements,
+                                               dataset()->num_tensors_,
+                                               &elements));
+
+              mutex_lock l(mu_);
+              for (size_t i = skip; i < elements.size(); ++i) {
+                buffer->bytes += ElementBytes(elements[i]);
+                buffer->elements.push_back(std::move(elements[i]));
+              }
+              skip = 0;
+              buffer->cond_var.notify_all();
+              while (!cancelled_ && buffer->bytes >= kChunkBytes) {
+                buffer->cond_var.wait(l);
+              }
+              if (cancelled_) {
+                return errors::Cancelled("Cache reader cancelled");
+              }
+            }
+          }
+          return Status::OK();
+        }
+
+        mutex mu_;
+        // Set by Initialize() from the index of the cache.
+        int64 num_shards_ = 0;
+        int64 num_segments_ = 0;
+        int64 num_elements_ = 0;
+        int64 cur_index_ GUARDED_BY(mu_) = 0;
+        std::vector<std::unique_ptr<ShardBuffer>> buffers_ GUARDED_BY(mu_);
+        Status status_ GUARDED_BY(mu_);
+        bool cancelled_ GUARDED_BY(mu_) = false;
+        std::vector<std::unique_ptr<Thread>> reader_threads_ GUARDED_BY(mu_);
+      };  // ReaderIterator
+
+      void InitializeIterator() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        // Both iterators use the prefix of this iterator, so that an
+        // iterator restored in `write` mode from a checkpoint saved before
+        // the cache was completed can read the cache from `cur_index`.
+        switch (mode_) {
+          case Mode::read:
+            iterator_.reset(new ReaderIterator({dataset(), prefix()}));
+            break;
+          case Mode::write:
+            iterator_.reset(new WriterIterator({dataset(), prefix()}));
+        }
+      }
+
+      mutex mu_;
+      enum Mode { read, write };
+      Mode mode_ GUARDED_BY(mu_);
+      std::unique_ptr<IteratorBase> iterator_ GUARDED_BY(mu_);
+    };  // Iterator
+
+    const DatasetBase* const input_;
+    const string filename_;
+    const int64 num_shards_;
+    const string compression_type_;
+    const ChunkCompression compression_;
+    Env* const env_;
+    const size_t num_tensors_;
+  };
+};
+
+REGISTER_KERNEL_BUILDER(Name("ShardedCacheDataset").Device(DEVICE_CPU),
+                        ShardedCacheDatasetOp);
+
+}  // namespace
+
+}  // namespace tensorflow
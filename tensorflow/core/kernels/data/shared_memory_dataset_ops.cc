@@ -0,0 +1,558 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/framework/allocation_description.pb.h"
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/data/dataset.h"
+#include "tensorflow/core/kernels/data/dataset_utils.h"
+#include "tensorflow/core/kernels/data/shared_memory_ring.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace tensorflow {
+
+namespace {
+
+// A record of a ring that a consumer has read, which it releases once the
+// last tensor that refers to the record has been destroyed.
+class RingRecord : public core::RefCounted {
+ public:
+  RingRecord(std::shared_ptr<SharedMemoryRing> ring, uint64 id)
+      : ring_(std::move(ring)), id_(id) {}
+
+  ~RingRecord() override { ring_->Release(id_); }
+
+ private:
+  const std::shared_ptr<SharedMemoryRing> ring_;
+  const uint64 id_;
+};
+
+}  // namespace
+
+// A TensorBuffer for the data of a tensor in a record of a shared memory ring.
+class SharedMemoryTensorBuffer : public TensorBuffer {
+ public:
+  static Tensor MakeTensor(DataType dtype, const TensorShape& shape,
+                           void* data, size_t size, RingRecord* record) {
+    SharedMemoryTensorBuffer* buffer =
+        new SharedMemoryTensorBuffer(data, size, record);
+    Tensor tensor(dtype, shape, buffer);
+    buffer->Unref();
+    return tensor;
+  }
+
+  ~SharedMemoryTensorBuffer() override { record_->Unref(); }
+
+  void* data() const override { return data_; }
+  size_t size() const override { return size_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("SharedMemoryRing");
+  }
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  SharedMemoryTensorBuffer(void* data, size_t size, RingRecord* record)
+      : data_(data), size_(size), record_(record) {
+    record_->Ref();
+  }
+
+  void* const data_;
+  const size_t size_;
+  RingRecord* const record_;
+};
+
+namespace {
+
+// See documentation in ../ops/dataset_ops.cc for a high-level description of
+// the following ops.
+//
+// An element is stored in a record of the ring as
+//
+// * The int64 number of components, followed for each component by its
+//   int64 dtype, number of dimensions, dimension sizes, and offset and size
+//   of its data in the record.
+// * The data of each component, at a multiple of
+//   `SharedMemoryRing::kAlignment` bytes into the record, so that consumers
+//   can use it in place. The data of a `DT_STRING` component is the int64
+//   length of each string, followed by the strings.
+
+uint64 AlignedSize(uint64 size) {
+  const uint64 alignment = SharedMemoryRing::kAlignment;
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+struct ComponentData {
+  uint64 offset;
+  uint64 size;
+};
+
+// Computes where the data of each component of `element` is stored in a
+// record, and the size of the record.
+Status LayOutElement(const std::vector<Tensor>& element,
+                     std::vector<ComponentData>* components, uint64* size) {
+  uint64 num_metadata = 1;
+  for (const Tensor& t : element) {
+    if (t.dtype() != DT_STRING && !DataTypeCanUseMemcpy(t.dtype())) {
+      return errors::InvalidArgument(
+          "Tensors of type ", DataTypeString(t.dtype()),
+          " cannot be published to a shared memory ring");
+    }
+    num_metadata += 4 + t.dims();
+  }
+  uint64 end = AlignedSize(num_metadata * sizeof(int64));
+  components->clear();
+  for (const Tensor& t : element) {
+    uint64 data_size;
+    if (t.dtype() == DT_STRING) {
+      const auto strings = t.flat<string>();
+      data_size = strings.size() * sizeof(int64);
+      for (int64 j = 0; j < strings.size(); ++j) {
+        data_size += strings(j).size();
+      }
+    } else {
+      data_size = t.tensor_data().size();
+    }
+    components->push_back({end, data_size});
+    end = AlignedSize(end + data_size);
+  }
+  *size = end;
+  return Status::OK();
+}
+
+void EncodeElement(const std::vector<Tensor>& element,
+                   const std::vector<ComponentData>& components, char* data) {
+  int64* metadata = reinterpret_cast<int64*>(data);
+  *metadata++ = element.size();
+  for (size_t i = 0; i < element.size(); ++i) {
+    const Tensor& t = element[i];
+    *metadata++ = t.dtype();
+    *metadata++ = t.dims();
+    for (int d = 0; d < t.dims(); ++d) {
+      *metadata++ = t.dim_size(d);
+    }
+    *metadata++ = components[i].offset;
+    *metadata++ = components[i].size;
+
+    char* component_data = data + components[i].offset;
+    if (t.dtype() == DT_STRING) {
+      int64* lengths = reinterpret_cast<int64*>(component_data);
+      char* bytes = component_data + t.NumElements() * sizeof(int64);
+      const auto strings = t.flat<string>();
+      for (int64 j = 0; j < strings.size(); ++j) {
+        const string& s = strings(j);
+        *lengths++ = s.size();
+        memcpy(bytes, s.data(), s.size());
+        bytes += s.size();
+      }
+    } else {
+      const StringPiece tensor_data = t.tensor_data();
+      memcpy(component_data, tensor_data.data(), tensor_data.size());
+    }
+  }
+}
+
+Status DecodeElement(StringPiece data, RingRecord* record,
+                     const DataTypeVector& dtypes,
+                     std::vector<Tensor>* element) {
+  const int64* metadata = reinterpret_cast<const int64*>(data.data());
+  const int64* metadata_end = metadata + data.size() / sizeof(int64);
+  auto next = [&metadata, metadata_end](int64* value) {
+    if (metadata == metadata_end) {
+      return errors::DataLoss("Corrupted element in shared memory ring");
+    }
+    *value = *metadata++;
+    return Status::OK();
+  };
+
+  int64 num_components;
+  TF_RETURN_IF_ERROR(next(&num_components));
+  if (num_components != dtypes.size()) {
+    return errors::InvalidArgument("Expected elements with ", dtypes.size(),
+                                   " components, got ", num_components);
+  }
+  element->clear();
+  element->reserve(num_components);
+  for (const DataType dtype : dtypes) {
+    int64 component_dtype;
+    TF_RETURN_IF_ERROR(next(&component_dtype));
+    if (component_dtype != dtype) {
+      return errors::InvalidArgument(
+          "Expected a component of type ", DataTypeString(dtype), ", got ",
+          DataTypeString(static_cast<DataType>(component_dtype)));
+    }
+    int64 dims;
+    TF_RETURN_IF_ERROR(next(&dims));
+    if (dims < 0 || dims > TensorShape::MaxDimensions()) {
+      return errors::DataLoss("Corrupted element in shared memory ring");
+    }
+    TensorShape shape;
+    for (int64 d = 0; d < dims; ++d) {
+      int64 dim_size;
+      TF_RETURN_IF_ERROR(next(&dim_size));
+      if (dim_size < 0) {
+        return errors::DataLoss("Corrupted element in shared memory ring");
+      }
+      shape.AddDim(dim_size);
+    }
+    int64 offset;
+    int64 size;
+    TF_RETURN_IF_ERROR(next(&offset));
+    TF_RETURN_IF_ERROR(next(&size));
+    if (offset < 0 || size < 0 || offset + size > data.size()) {
+      return errors::DataLoss("Corrupted element in shared memory ring");
+    }
+    const char* component_data = data.data() + offset;
+
+    if (dtype == DT_STRING) {
+      Tensor t(dtype, shape);
+      const int64* lengths = reinterpret_cast<const int64*>(component_data);
+      const uint64 lengths_size = t.NumElements() * sizeof(int64);
+      if (lengths_size > size) {
+        return errors::DataLoss("Corrupted element in shared memory ring");
+      }
+      StringPiece bytes(component_data + lengths_size, size - lengths_size);
+      auto strings = t.flat<string>();
+      for (int64 j = 0; j < strings.size(); ++j) {
+        const int64 length = *lengths++;
+        if (length < 0 || length > bytes.size()) {
+          return errors::DataLoss("Corrupted element in shared memory ring");
+        }
+        strings(j).assign(bytes.data(), length);
+        bytes.remove_prefix(length);
+      }
+      element->push_back(std::move(t));
+    } else {
+      if (size != shape.num_elements() * DataTypeSize(dtype)) {
+        return errors::DataLoss("Corrupted element in shared memory ring");
+      }
+      // The ring only lets the producer overwrite the data once the tensor
+      // has been destroyed.
+      element->push_back(SharedMemoryTensorBuffer::MakeTensor(
+          dtype, shape, const_cast<char*>(component_data), size, record));
+    }
+  }
+  return Status::OK();
+}
+
+class ToSharedMemoryOp : public AsyncOpKernel {
+ public:
+  explicit ToSharedMemoryOp(OpKernelConstruction* ctx)
+      : AsyncOpKernel(ctx),
+        thread_pool_(new thread::ThreadPool(
+            ctx->env(), ThreadOptions(),
+            strings::StrCat("to_shared_memory_op_",
+                            SanitizeThreadSuffix(name())),
+            1 /* num_threads */, false /* low_latency_hint */)) {}
+
+  template <typename T>
+  Status ParseScalarArgument(OpKernelContext* ctx,
+                             const StringPiece& argument_name, T* output) {
+    const Tensor* argument_t;
+    TF_RETURN_IF_ERROR(ctx->input(argument_name, &argument_t));
+    if (!TensorShapeUtils::IsScalar(argument_t->shape())) {
+      return errors::InvalidArgument(argument_name, " must be a scalar");
+    }
+    *output = argument_t->scalar<T>()();
+    return Status::OK();
+  }
+
+  void ComputeAsync(OpKernelContext* ctx, DoneCallback done) override {
+    // The call to `iterator->GetNext()` may block and depend on an
+    // inter-op thread pool thread, and publishing the elements waits for the
+    // consumers, so we issue the calls from the owned thread pool.
+    thread_pool_->Schedule([this, ctx, done]() {
+      string ring_name;
+      OP_REQUIRES_OK_ASYNC(
+          ctx, ParseScalarArgument<string>(ctx, "ring_name", &ring_name),
+          done);
+      int64 capacity_bytes;
+      OP_REQUIRES_OK_ASYNC(ctx,
+                           ParseScalarArgument<int64>(ctx, "capacity_bytes",
+                                                      &capacity_bytes),
+                           done);
+      OP_REQUIRES_ASYNC(
+          ctx, capacity_bytes > 0,
+          errors::InvalidArgument("`capacity_bytes` must be positive."), done);
+      int64 num_consumers;
+      OP_REQUIRES_OK_ASYNC(
+          ctx,
+          ParseScalarArgument<int64>(ctx, "num_consumers", &num_consumers),
+          done);
+      OP_REQUIRES_ASYNC(
+          ctx,
+          num_consumers > 0 &&
+              num_consumers <= SharedMemoryRing::kMaxConsumers,
+          errors::InvalidArgument("`num_consumers` must be in [1, ",
+                                  SharedMemoryRing::kMaxConsumers, "]."),
+          done);
+
+      DatasetBase* dataset;
+      OP_REQUIRES_OK_ASYNC(
+          ctx, GetDatasetFromVariantTensor(ctx->input(0), &dataset), done);
+      IteratorContext iter_ctx = dataset::MakeIteratorContext(ctx);
+      std::unique_ptr<IteratorBase> iterator;
+      OP_REQUIRES_OK_ASYNC(
+          ctx,
+          dataset->MakeIterator(&iter_ctx, "ToSharedMemoryOpIterator",
+                                &iterator),
+          done);
+
+      std::unique_ptr<SharedMemoryRing> ring;
+      OP_REQUIRES_OK_ASYNC(ctx,
+                           SharedMemoryRing::Create(ring_name, capacity_bytes,
+                                                    num_consumers, &ring),
+                           done);
+      CancellationManager* cm = ctx->cancellation_manager();
+      CancellationToken token = CancellationManager::kInvalidToken;
+      if (cm != nullptr) {
+        SharedMemoryRing* ring_ptr = ring.get();
+        token = cm->get_cancellation_token();
+        if (!cm->RegisterCallback(token,
+                                  [ring_ptr]() { ring_ptr->Cancel(); })) {
+          ring_ptr->Cancel();
+        }
+      }
+
+      Status s = Publish(&iter_ctx, iterator.get(), ring.get());
+      s.Update(ring->Finish(s));
+      if (cm != nullptr) {
+        cm->DeregisterCallback(token);
+      }
+      ring.reset();
+      OP_REQUIRES_OK_ASYNC(ctx, s, done);
+      done();
+    });
+  }
+
+ private:
+  // Publishes all elements of `iterator` to `ring`.
+  static Status Publish(IteratorContext* ctx, IteratorBase* iterator,
+                        SharedMemoryRing* ring) {
+    std::vector<Tensor> element;
+    std::vector<ComponentData> components;
+    bool end_of_sequence;
+    while (true) {
+      element.clear();
+      TF_RETURN_IF_ERROR(iterator->GetNext(ctx, &element, &end_of_sequence));
+      if (end_of_sequence) return Status::OK();
+      uint64 size;
+      TF_RETURN_IF_ERROR(LayOutElement(element, &components, &size));
+      char* data;
+      TF_RETURN_IF_ERROR(ring->Reserve(size, &data));
+      EncodeElement(element, components, data);
+      ring->Commit();
+    }
+  }
+
+  std::unique_ptr<thread::ThreadPool> thread_pool_;
+};
+
+class SharedMemoryDatasetOp : public DatasetOpKernel {
+ public:
+  explicit SharedMemoryDatasetOp(OpKernelConstruction* ctx)
+      : DatasetOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("output_types", &output_types_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("output_shapes", &output_shapes_));
+  }
+
+  void MakeDataset(OpKernelContext* ctx, DatasetBase** output) override {
+    string ring_name;
+    OP_REQUIRES_OK(ctx,
+                   ParseScalarArgument<string>(ctx, "ring_name", &ring_name));
+    int64 consumer_index;
+    OP_REQUIRES_OK(ctx, ParseScalarArgument<int64>(ctx, "consumer_index",
+                                                   &consumer_index));
+    OP_REQUIRES(ctx,
+                consumer_index >= 0 &&
+                    consumer_index < SharedMemoryRing::kMaxConsumers,
+                errors::InvalidArgument("`consumer_index` must be in [0, ",
+                                        SharedMemoryRing::kMaxConsumers,
+                                        ")."));
+    int64 timeout_ms;
+    OP_REQUIRES_OK(ctx,
+                   ParseScalarArgument<int64>(ctx, "timeout_ms", &timeout_ms));
+    OP_REQUIRES(ctx, timeout_ms >= -1,
+                errors::InvalidArgument(
+                    "`timeout_ms` must be -1 (wait indefinitely) or at least "
+                    "zero."));
+    *output = new Dataset(ctx, ring_name, consumer_index, timeout_ms,
+                          output_types_, output_shapes_);
+  }
+
+ private:
+  class Dataset : public GraphDatasetBase {
+   public:
+    Dataset(OpKernelContext* ctx, const string& ring_name,
+            int64 consumer_index, int64 timeout_ms,
+            const DataTypeVector& output_types,
+            const std::vector<PartialTensorShape>& output_shapes)
+        : GraphDatasetBase(ctx),
+          ring_name_(ring_name),
+          consumer_index_(consumer_index),
+          timeout_ms_(timeout_ms),
+          output_types_(output_types),
+          output_shapes_(output_shapes) {}
+
+    std::unique_ptr<IteratorBase> MakeIteratorInternal(
+        const string& prefix) const override {
+      return std::unique_ptr<IteratorBase>(
+          new Iterator({this, strings::StrCat(prefix, "::SharedMemory")}));
+    }
+
+    const DataTypeVector& output_dtypes() const override {
+      return output_types_;
+    }
+
+    const std::vector<PartialTensorShape>& output_shapes() const override {
+      return output_shapes_;
+    }
+
+    string DebugString() const override {
+      return "SharedMemoryDatasetOp::Dataset";
+    }
+
+   protected:
+    Status AsGraphDefInternal(OpKernelContext* ctx, DatasetGraphDefBuilder* b,
+                              Node** output) const override {
+      Node* ring_name = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(ring_name_, &ring_name));
+      Node* consumer_index = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(consumer_index_, &consumer_index));
+      Node* timeout_ms = nullptr;
+      TF_RETURN_IF_ERROR(b->AddScalar(timeout_ms_, &timeout_ms));
+      TF_RETURN_IF_ERROR(b->AddDataset(
+          this, {ring_name, consumer_index, timeout_ms}, output));
+      return Status::OK();
+    }
+
+   private:
+    // Attaches to the ring on the first call to GetNext(), waiting up to
+    // `timeout_ms` for the producer to create it, and returns tensors that
+    // refer to the records of the ring, except for strings, which are copied.
+    class Iterator : public DatasetIterator<Dataset> {
+     public:
+      explicit Iterator(const Params& params)
+          : DatasetIterator<Dataset>(params) {}
+
+      Status GetNextInternal(IteratorContext* ctx,
+                             std::vector<Tensor>* out_tensors,
+                             bool* end_of_sequence) override {
+        mutex_lock l(mu_);
+        if (!ring_) {
+          TF_RETURN_IF_ERROR(OpenRing(ctx, &l));
+        }
+        // Polls the step's cancellation manager while waiting, so that a
+        // wait for a stalled producer returns without cancelling the ring
+        // for later calls.
+        CancellationManager* cm = ctx->cancellation_manager();
+        StringPiece data;
+        uint64 id;
+        Status s = ring_->Next(&data, &id, [cm]() {
+          return cm != nullptr && cm->IsCancelled();
+        });
+        if (errors::IsOutOfRange(s)) {
+          *end_of_sequence = true;
+          return Status::OK();
+        }
+        TF_RETURN_IF_ERROR(s);
+        RingRecord* record = new RingRecord(ring_, id);
+        core::ScopedUnref unref(record);
+        *end_of_sequence = false;
+        return DecodeElement(data, record, dataset()->output_types_,
+                             out_tensors);
+      }
+
+     private:
+      // Retries opening the ring until it succeeds, the timeout expires, or
+      // the iterator is cancelled. `mu_` is released between the attempts,
+      // so that concurrent calls do not queue up behind it.
+      Status OpenRing(IteratorContext* ctx, mutex_lock* l)
+          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        const string& ring_name = dataset()->ring_name_;
+        const int64 timeout_ms = dataset()->timeout_ms_;
+        const uint64 deadline_micros =
+            timeout_ms < 0 || timeout_ms > kint64max / 1000
+                ? kuint64max
+                : ctx->env()->NowMicros() + timeout_ms * 1000;
+        CancellationManager* cancellation_manager =
+            ctx->cancellation_manager();
+        for (int64 attempt = 0; !ring_; ++attempt) {
+          std::unique_ptr<SharedMemoryRing> ring;
+          Status s = SharedMemoryRing::Open(
+              ring_name, dataset()->consumer_index_, &ring);
+          if (s.ok()) {
+            ring_ = std::move(ring);
+            break;
+          }
+          if (!errors::IsNotFound(s) && !errors::IsUnavailable(s)) return s;
+          if (cancellation_manager != nullptr &&
+              cancellation_manager->IsCancelled()) {
+            return errors::Cancelled(
+                "Cancelled while waiting for the producer of shared memory "
+                "ring ",
+                ring_name);
+          }
+          if (ctx->env()->NowMicros() >= deadline_micros) {
+            // Keeps the code of the last attempt: NotFound if the ring does
+            // not exist, or Unavailable if it cannot be attached to.
+            return Status(
+                s.code(),
+                strings::StrCat("Timed out after ", timeout_ms,
+                                " ms waiting for the producer of shared "
+                                "memory ring ",
+                                ring_name, ": ", s.error_message()));
+          }
+          if (attempt % kLogAttempts == kLogAttempts - 1) {
+            LOG(INFO) << "Waiting for the producer of shared memory ring "
+                      << ring_name;
+          }
+          WaitForMilliseconds(l, &retry_cond_var_, kRetryMillis);
+        }
+        return Status::OK();
+      }
+
+      static constexpr int64 kRetryMillis = 10;
+      static constexpr int64 kLogAttempts = 1000;
+
+      mutex mu_;
+      // Only used to wait between attempts to open the ring without holding
+      // `mu_`.
+      condition_variable retry_cond_var_;
+      std::shared_ptr<SharedMemoryRing> ring_ GUARDED_BY(mu_);
+    };
+
+    const string ring_name_;
+    const int64 consumer_index_;
+    const int64 timeout_ms_;
+    const DataTypeVector output_types_;
+    const std::vector<PartialTensorShape> output_shapes_;
+  };
+
+  DataTypeVector output_types_;
+  std::vector<PartialTensorShape> output_shapes_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("DatasetToSharedMemory").Device(DEVICE_CPU),
+                        ToSharedMemoryOp);
+REGISTER_KERNEL_BUILDER(Name("SharedMemoryDataset").Device(DEVICE_CPU),
+                        SharedMemoryDatasetOp);
+
+}  // namespace
+
+}  // namespace tensorflow
@@ -0,0 +1,457 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/shared_memory_ring.h"
+
+#if !defined(PLATFORM_WINDOWS)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // !PLATFORM_WINDOWS
+
+#include <string.h>
+#include <algorithm>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+namespace {
+
+constexpr uint64 kMagic = 0x474e495248534454;  // "TDSHRING"
+constexpr size_t kMaxErrorMessageSize = 1024;
+// The size field of a record header that marks the end of the ring: the next
+// record starts at the beginning of the ring.
+constexpr uint64 kWrapMarker = ~0ULL;
+// Waits spin this many times before they start to sleep.
+constexpr int kSpinIterations = 64;
+constexpr int64 kMaxSleepMicros = 1000;
+// Waits check whether the processes on the other end have exited after
+// sleeping for this long.
+constexpr int64 kCheckIntervalMicros = 1000000;
+
+enum RingState : int32 { kRunning = 0, kFinished = 1, kFailed = 2 };
+enum ConsumerState : int32 { kUnattached = 0, kAttached = 1, kDetached = 2 };
+
+uint64 RoundUp(uint64 size) {
+  const uint64 alignment = SharedMemoryRing::kAlignment;
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+uint64 RecordSize(uint64 size) {
+  return SharedMemoryRing::kAlignment + RoundUp(size);
+}
+
+string ObjectName(const string& name) {
+  return !name.empty() && name[0] == '/' ? name : strings::StrCat("/", name);
+}
+
+bool ProcessExited(int32 pid) {
+#if !defined(PLATFORM_WINDOWS)
+  return pid != 0 && kill(pid, 0) != 0 && errno == ESRCH;
+#else
+  return false;
+#endif  // !PLATFORM_WINDOWS
+}
+
+}  // namespace
+
+// The start of the shared memory object, followed by the data of the ring.
+// The shared memory object is zero-filled when it is created, which is the
+// initial state of all fields.
+struct alignas(SharedMemoryRing::kAlignment) SharedMemoryRing::Header {
+  // Set last when the ring is created.
+  std::atomic<uint64> magic;
+  uint64 capacity;
+  int32 num_consumers;
+  int32 producer_pid;
+  std::atomic<int32> state;
+  // The error that the producer finished with if `state` is `kFailed`.
+  int32 error_code;
+  char error_message[kMaxErrorMessageSize];
+  // The position after the last published record. Positions increase
+  // forever; the record at position `p` is at offset `p % capacity`.
+  alignas(kAlignment) std::atomic<uint64> write_position;
+  struct alignas(kAlignment) Consumer {
+    std::atomic<int32> state;
+    std::atomic<int32> pid;
+    // The position before which the consumer has released all records.
+    std::atomic<uint64> read_position;
+  } consumers[kMaxConsumers];
+};
+
+SharedMemoryRing::SharedMemoryRing(const string& name, char* base,
+                                   size_t mapped_size, int consumer_index)
+    : name_(name),
+      base_(base),
+      mapped_size_(mapped_size),
+      header_(reinterpret_cast<Header*>(base)),
+      data_(base + sizeof(Header)),
+      capacity_(header_->capacity),
+      consumer_index_(consumer_index),
+      cancelled_(false) {}
+
+#if !defined(PLATFORM_WINDOWS)
+
+Status SharedMemoryRing::Create(const string& name, uint64 capacity,
+                                int num_consumers,
+                                std::unique_ptr<SharedMemoryRing>* ring) {
+  if (name.empty()) {
+    return errors::InvalidArgument("The name of the ring must not be empty");
+  }
+  if (num_consumers <= 0 || num_consumers > kMaxConsumers) {
+    return errors::InvalidArgument("The number of consumers must be in [1, ",
+                                   kMaxConsumers, "], got ", num_consumers);
+  }
+  capacity = RoundUp(capacity);
+  if (capacity == 0) {
+    return errors::InvalidArgument("The capacity of the ring must be positive");
+  }
+  const string object_name = ObjectName(name);
+  const int fd =
+      shm_open(object_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    if (errno == EEXIST) {
+      return errors::AlreadyExists(
+          "Shared memory object ", object_name,
+          " already exists. If no other process is using it, remove it (from "
+          "/dev/shm on Linux) and try again.");
+    }
+    return errors::Internal("Failed to create shared memory object ",
+                            object_name, ": ", strerror(errno));
+  }
+  const size_t mapped_size = sizeof(Header) + capacity;
+  void* base = MAP_FAILED;
+  if (ftruncate(fd, mapped_size) == 0) {
+    base = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                0);
+  }
+  const int error = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(object_name.c_str());
+    return errors::ResourceExhausted("Failed to map ", mapped_size,
+                                     " bytes of shared memory object ",
+                                     object_name, ": ", strerror(error));
+  }
+
+  Header* header = reinterpret_cast<Header*>(base);
+  header->capacity = capacity;
+  header->num_consumers = num_consumers;
+  header->producer_pid = getpid();
+  header->magic.store(kMagic, std::memory_order_release);
+  ring->reset(new SharedMemoryRing(object_name, static_cast<char*>(base),
+                                   mapped_size, -1));
+  return Status::OK();
+}
+
+Status SharedMemoryRing::Open(const string& name, int consumer_index,
+                              std::unique_ptr<SharedMemoryRing>* ring) {
+  const string object_name = ObjectName(name);
+  const int fd = shm_open(object_name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return errors::NotFound("Shared memory object ", object_name,
+                              " does not exist");
+    }
+    return errors::Internal("Failed to open shared memory object ",
+                            object_name, ": ", strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    return errors::Unavailable("Shared memory object ", object_name,
+                               " is being created");
+  }
+  const size_t mapped_size = st.st_size;
+  void* base =
+      mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int error = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    return errors::ResourceExhausted("Failed to map shared memory object ",
+                                     object_name, ": ", strerror(error));
+  }
+
+  Header* header = reinterpret_cast<Header*>(base);
+  Status s;
+  int32 unattached = kUnattached;
+  if (header->magic.load(std::memory_order_acquire) != kMagic ||
+      sizeof(Header) + header->capacity != mapped_size) {
+    s = errors::Unavailable("Shared memory object ", object_name,
+                            " is being created");
+  } else if (consumer_index < 0 || consumer_index >= header->num_consumers) {
+    s = errors::InvalidArgument("Consumer index ", consumer_index,
+                                " is out of range for the ",
+                                header->num_consumers, " consumers of ",
+                                object_name);
+  } else if (!header->consumers[consumer_index].state.compare_exchange_strong(
+                 unattached, kAttached)) {
+    s = errors::AlreadyExists("Consumer ", consumer_index, " of ",
+                              object_name, " has already attached");
+  }
+  if (!s.ok()) {
+    munmap(base, mapped_size);
+    return s;
+  }
+  header->consumers[consumer_index].pid.store(getpid());
+  ring->reset(new SharedMemoryRing(object_name, static_cast<char*>(base),
+                                   mapped_size, consumer_index));
+  return Status::OK();
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+  if (consumer_index_ < 0) {
+    if (!finished_) {
+      Cancel();
+      Finish(errors::Cancelled("The producer closed ", name_,
+                               " before the end of its input"))
+          .IgnoreError();
+    }
+    shm_unlink(name_.c_str());
+  } else {
+    header_->consumers[consumer_index_].state.store(kDetached);
+  }
+  munmap(base_, mapped_size_);
+}
+
+template <typename Done, typename Check>
+Status SharedMemoryRing::Wait(Done done, Check check) {
+  int64 sleep_micros = 1;
+  int64 unchecked_micros = 0;
+  for (int i = 0; !done(); ++i) {
+    if (cancelled_.load(std::memory_order_relaxed)) {
+      return errors::Cancelled("Cancelled waiting for shared memory ring ",
+                               name_);
+    }
+    if (i < kSpinIterations) {
+      std::this_thread::yield();
+      continue;
+    }
+    Env::Default()->SleepForMicroseconds(sleep_micros);
+    unchecked_micros += sleep_micros;
+    sleep_micros = std::min(2 * sleep_micros, kMaxSleepMicros);
+    if (unchecked_micros >= kCheckIntervalMicros) {
+      TF_RETURN_IF_ERROR(check());
+      unchecked_micros = 0;
+    }
+  }
+  return Status::OK();
+}
+
+Status SharedMemoryRing::WaitForSpace(uint64 end) {
+  if (end <= capacity_) return Status::OK();
+  const uint64 min_read_position = end - capacity_;
+  const int num_consumers = header_->num_consumers;
+  return Wait(
+      [this, min_read_position, num_consumers]() {
+        for (int i = 0; i < num_consumers; ++i) {
+          const Header::Consumer& consumer = header_->consumers[i];
+          if (consumer.state.load(std::memory_order_acquire) != kDetached &&
+              consumer.read_position.load(std::memory_order_acquire) <
+                  min_read_position) {
+            return false;
+          }
+        }
+        return true;
+      },
+      [this, num_consumers]() {
+        for (int i = 0; i < num_consumers; ++i) {
+          Header::Consumer& consumer = header_->consumers[i];
+          if (consumer.state.load() == kAttached &&
+              ProcessExited(consumer.pid.load())) {
+            LOG(WARNING) << "Consumer " << i << " of shared memory ring "
+                         << name_ << " exited without detaching";
+            consumer.state.store(kDetached);
+          }
+        }
+        return Status::OK();
+      });
+}
+
+#else  // PLATFORM_WINDOWS
+
+Status SharedMemoryRing::Create(const string& name, uint64 capacity,
+                                int num_consumers,
+                                std::unique_ptr<SharedMemoryRing>* ring) {
+  return errors::Unimplemented(
+      "Shared memory rings are not supported on this platform");
+}
+
+Status SharedMemoryRing::Open(const string& name, int consumer_index,
+                              std::unique_ptr<SharedMemoryRing>* ring) {
+  return errors::Unimplemented(
+      "Shared memory rings are not supported on this platform");
+}
+
+SharedMemoryRing::~SharedMemoryRing() {}
+
+template <typename Done, typename Check>
+Status SharedMemoryRing::Wait(Done done, Check check) {
+  return errors::Unimplemented(
+      "Shared memory rings are not supported on this platform");
+}
+
+Status SharedMemoryRing::WaitForSpace(uint64 end) {
+  return errors::Unimplemented(
+      "Shared memory rings are not supported on this platform");
+}
+
+#endif  // PLATFORM_WINDOWS
+
+Status SharedMemoryRing::Reserve(uint64 size, char** data) {
+  DCHECK_LT(consumer_index_, 0);
+  const uint64 record_size = RecordSize(size);
+  if (record_size > capacity_) {
+    return errors::InvalidArgument("A record of ", size,
+                                   " bytes does not fit in the ",
+                                   capacity_, " bytes of ring ", name_);
+  }
+  uint64 position = write_position_;
+  const uint64 offset = position % capacity_;
+  if (offset + record_size > capacity_) {
+    // The record does not fit before the end of the ring, so it starts at
+    // the beginning.
+    TF_RETURN_IF_ERROR(WaitForSpace(position + kAlignment));
+    memcpy(data_ + offset, &kWrapMarker, sizeof(kWrapMarker));
+    position += capacity_ - offset;
+  }
+  TF_RETURN_IF_ERROR(WaitForSpace(position + record_size));
+  reserved_position_ = position;
+  reserved_size_ = size;
+  *data = data_ + position % capacity_ + kAlignment;
+  return Status::OK();
+}
+
+void SharedMemoryRing::Commit() {
+  DCHECK_LT(consumer_index_, 0);
+  memcpy(data_ + reserved_position_ % capacity_, &reserved_size_,
+         sizeof(reserved_size_));
+  write_position_ = reserved_position_ + RecordSize(reserved_size_);
+  header_->write_position.store(write_position_, std::memory_order_release);
+}
+
+Status SharedMemoryRing::Finish(const Status& status) {
+  DCHECK_LT(consumer_index_, 0);
+  if (!finished_) {
+    finished_ = true;
+    if (!status.ok()) {
+      header_->error_code = status.code();
+      strncpy(header_->error_message, status.error_message().c_str(),
+              kMaxErrorMessageSize - 1);
+    }
+    header_->state.store(status.ok() ? kFinished : kFailed,
+                         std::memory_order_release);
+  }
+  // Consumers could no longer attach once the shared memory object has been
+  // removed.
+  const int num_consumers = header_->num_consumers;
+  return Wait(
+      [this, num_consumers]() {
+        for (int i = 0; i < num_consumers; ++i) {
+          if (header_->consumers[i].state.load() == kUnattached) return false;
+        }
+        return true;
+      },
+      []() { return Status::OK(); });
+}
+
+Status SharedMemoryRing::Next(StringPiece* record, uint64* id,
+                              const std::function<bool()>& is_cancelled) {
+  DCHECK_GE(consumer_index_, 0);
+  while (true) {
+    bool cancelled = false;
+    TF_RETURN_IF_ERROR(Wait(
+        [this, &is_cancelled, &cancelled]() {
+          if (header_->write_position.load(std::memory_order_acquire) >
+                  next_position_ ||
+              header_->state.load(std::memory_order_acquire) != kRunning) {
+            return true;
+          }
+          cancelled = is_cancelled && is_cancelled();
+          return cancelled;
+        },
+        [this]() {
+          if (header_->state.load(std::memory_order_acquire) == kRunning &&
+              ProcessExited(header_->producer_pid)) {
+            return errors::Aborted("The producer of shared memory ring ",
+                                   name_, " exited before finishing");
+          }
+          return Status::OK();
+        }));
+    if (cancelled) {
+      return errors::Cancelled("Cancelled waiting for shared memory ring ",
+                               name_);
+    }
+    // The producer publishes all records before it changes the state.
+    const int32 state = header_->state.load(std::memory_order_acquire);
+    if (header_->write_position.load(std::memory_order_acquire) ==
+        next_position_) {
+      if (state == kFailed) {
+        return Status(static_cast<error::Code>(header_->error_code),
+                      header_->error_message);
+      }
+      return errors::OutOfRange("End of shared memory ring ", name_);
+    }
+    const uint64 offset = next_position_ % capacity_;
+    uint64 size;
+    memcpy(&size, data_ + offset, sizeof(size));
+    if (size == kWrapMarker) {
+      next_position_ += capacity_ - offset;
+      continue;
+    }
+    if (size > capacity_ || offset + RecordSize(size) > capacity_) {
+      return errors::DataLoss("Corrupted record header in shared memory ring ",
+                              name_);
+    }
+    *record = StringPiece(data_ + offset + kAlignment, size);
+    next_position_ += RecordSize(size);
+    *id = next_position_;
+    mutex_lock l(mu_);
+    unreleased_.emplace_back(*id, false);
+    return Status::OK();
+  }
+}
+
+void SharedMemoryRing::Release(uint64 id) {
+  DCHECK_GE(consumer_index_, 0);
+  mutex_lock l(mu_);
+  for (auto& record : unreleased_) {
+    if (record.first == id) {
+      record.second = true;
+      break;
+    }
+  }
+  uint64 read_position = 0;
+  while (!unreleased_.empty() && unreleased_.front().second) {
+    read_position = unreleased_.front().first;
+    unreleased_.pop_front();
+  }
+  if (read_position > 0) {
+    header_->consumers[consumer_index_].read_position.store(
+        read_position, std::memory_order_release);
+  }
+}
+
+void SharedMemoryRing::Cancel() { cancelled_.store(true); }
+
+}  // namespace tensorflow
@@ -0,0 +1,132 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_KERNELS_DATA_SHARED_MEMORY_RING_H_
+#define TENSORFLOW_CORE_KERNELS_DATA_SHARED_MEMORY_RING_H_
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// A ring buffer of records in POSIX shared memory, which one producer process
+// writes and each of a fixed number of consumer processes reads in full.
+//
+// The producer creates the ring with `Create()`, and appends a record by
+// reserving space for it with `Reserve()` and publishing it with `Commit()`.
+// Each consumer attaches to the ring with `Open()` and reads the records in
+// order with `Next()`. The data of a record stays valid until the consumer
+// calls `Release()` for it, which may happen in any order, so that consumers
+// can use the records in place.
+//
+// The producer waits for space as long as some consumer has not released a
+// record that the new record would overwrite, unless that consumer has
+// detached from the ring or its process has exited. Consumers that have not
+// attached yet are waited for, so that every consumer sees every record.
+class SharedMemoryRing {
+ public:
+  // Every record starts at a multiple of `kAlignment` bytes in memory.
+  static constexpr size_t kAlignment = 64;
+  static constexpr int kMaxConsumers = 64;
+
+  // Creates the shared memory object `name` holding a ring of `capacity`
+  // bytes for `num_consumers` consumers. Fails if the object already exists.
+  static Status Create(const string& name, uint64 capacity, int num_consumers,
+                       std::unique_ptr<SharedMemoryRing>* ring);
+
+  // Attaches to the ring `name` as its consumer `consumer_index`. Returns
+  // NotFound if the ring does not exist, and Unavailable if it is still
+  // being created.
+  static Status Open(const string& name, int consumer_index,
+                     std::unique_ptr<SharedMemoryRing>* ring);
+
+  // The producer marks the ring as finished, if it has not been yet, and
+  // removes the shared memory object. A consumer detaches from the ring.
+  ~SharedMemoryRing();
+
+  // Producer: sets `*data` to `size` bytes of the ring for the next record,
+  // waiting until the consumers have released them.
+  Status Reserve(uint64 size, char** data);
+
+  // Producer: publishes the record written to the last reserved space.
+  void Commit();
+
+  // Producer: marks the end of the records, with an error if `status` is
+  // not OK, and waits for all consumers to attach.
+  Status Finish(const Status& status);
+
+  // Consumer: sets `*record` to the next record and `*id` to its identifier,
+  // waiting for the producer. Returns OutOfRange after the last record, or the
+  // error that the producer finished with, or Cancelled once `is_cancelled`,
+  // if given, returns true while waiting.
+  Status Next(StringPiece* record, uint64* id,
+              const std::function<bool()>& is_cancelled = nullptr);
+
+  // Consumer: allows the producer to reuse the space of the record `id`.
+  // Thread-safe.
+  void Release(uint64 id);
+
+  // Makes current and future calls that wait return Cancelled. Thread-safe.
+  void Cancel();
+
+ private:
+  struct Header;
+
+  SharedMemoryRing(const string& name, char* base, size_t mapped_size,
+                   int consumer_index);
+
+  template <typename Done, typename Check>
+  Status Wait(Done done, Check check);
+
+  // Waits until every consumer has released the space before `end`.
+  Status WaitForSpace(uint64 end);
+
+  const string name_;
+  char* const base_;
+  const size_t mapped_size_;
+  Header* const header_;
+  char* const data_;
+  const uint64 capacity_;
+  // The consumer index, or -1 for the producer.
+  const int consumer_index_;
+  std::atomic<bool> cancelled_;
+
+  // Producer: the position after the last committed record, and the
+  // position and size of the reserved record.
+  uint64 write_position_ = 0;
+  uint64 reserved_position_ = 0;
+  uint64 reserved_size_ = 0;
+  bool finished_ = false;
+
+  // Consumer: the position of the next record, and the identifiers of the
+  // records returned by Next() that have not all been released, with whether
+  // each one has been.
+  uint64 next_position_ = 0;
+  mutex mu_;
+  std::deque<std::pair<uint64, bool>> unreleased_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(SharedMemoryRing);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_DATA_SHARED_MEMORY_RING_H_
@@ -0,0 +1,238 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/data/shared_memory_ring.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr uint64 kCapacity = 4096;
+constexpr int kNumRecords = 1000;
+
+string RingName(const string& test_name) {
+  return strings::StrCat("tf_shared_memory_ring_test_", getpid(), "_",
+                         test_name);
+}
+
+// The contents of record `i`, of between 0 and 999 bytes.
+string Record(int i) { return string((i * 37) % 1000, 'a' + i % 26); }
+
+Status WriteRecords(SharedMemoryRing* ring, int num_records) {
+  for (int i = 0; i < num_records; ++i) {
+    const string record = Record(i);
+    char* data;
+    TF_RETURN_IF_ERROR(ring->Reserve(record.size(), &data));
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(data) %
+                     SharedMemoryRing::kAlignment);
+    memcpy(data, record.data(), record.size());
+    ring->Commit();
+  }
+  return Status::OK();
+}
+
+// Reads all records of `ring`, releasing each one before the next one.
+Status ReadRecords(SharedMemoryRing* ring, int* num_records) {
+  *num_records = 0;
+  while (true) {
+    StringPiece record;
+    uint64 id;
+    Status s = ring->Next(&record, &id);
+    if (errors::IsOutOfRange(s)) return Status::OK();
+    TF_RETURN_IF_ERROR(s);
+    if (record != Record(*num_records)) {
+      return errors::DataLoss("Unexpected contents of record ", *num_records);
+    }
+    ring->Release(id);
+    ++*num_records;
+  }
+}
+
+TEST(SharedMemoryRingTest, ConsumersReadAllRecords) {
+  const string name = RingName("ConsumersReadAllRecords");
+  std::unique_ptr<SharedMemoryRing> producer;
+  TF_ASSERT_OK(SharedMemoryRing::Create(name, kCapacity, 2, &producer));
+  std::vector<std::unique_ptr<Thread>> threads;
+  int num_records[2];
+  for (int i = 0; i < 2; ++i) {
+    threads.emplace_back(Env::Default()->StartThread(
+        {}, "consumer", [&name, &num_records, i]() {
+          std::unique_ptr<SharedMemoryRing> consumer;
+          TF_ASSERT_OK(SharedMemoryRing::Open(name, i, &consumer));
+          TF_EXPECT_OK(ReadRecords(consumer.get(), &num_records[i]));
+        }));
+  }
+  TF_ASSERT_OK(WriteRecords(producer.get(), kNumRecords));
+  TF_ASSERT_OK(producer->Finish(Status::OK()));
+  threads.clear();
+  EXPECT_EQ(kNumRecords, num_records[0]);
+  EXPECT_EQ(kNumRecords, num_records[1]);
+}
+
+TEST(SharedMemoryRingTest, RecordsStayValidUntilReleased) {
+  const string name = RingName("RecordsStayValidUntilReleased");
+  std::unique_ptr<SharedMemoryRing> producer;
+  TF_ASSERT_OK(SharedMemoryRing::Create(name, kCapacity, 1, &producer));
+  std::unique_ptr<SharedMemoryRing> consumer;
+  TF_ASSERT_OK(SharedMemoryRing::Open(name, 0, &consumer));
+  std::unique_ptr<Thread> thread(
+      Env::Default()->StartThread({}, "producer", [&producer]() {
+        TF_EXPECT_OK(WriteRecords(producer.get(), kNumRecords));
+        TF_EXPECT_OK(producer->Finish(Status::OK()));
+      }));
+
+  // Holds on to three records at a time, which are released out of order.
+  std::vector<std::pair<StringPiece, uint64>> held;
+  int num_records = 0;
+  while (true) {
+    StringPiece record;
+    uint64 id;
+    Status s = consumer->Next(&record, &id);
+    if (errors::IsOutOfRange(s)) break;
+    TF_ASSERT_OK(s);
+    held.emplace_back(record, id);
+    ++num_records;
+    if (held.size() == 3 || record.size() > 800) {
+      for (int i = held.size() - 1; i >= 0; --i) {
+        EXPECT_EQ(Record(num_records - held.size() + i), held[i].first);
+        consumer->Release(held[i].second);
+      }
+      held.clear();
+    }
+  }
+  EXPECT_EQ(kNumRecords, num_records);
+}
+
+TEST(SharedMemoryRingTest, ConsumersSeeProducerError) {
+  const string name = RingName("ConsumersSeeProducerError");
+  std::unique_ptr<SharedMemoryRing> producer;
+  TF_ASSERT_OK(SharedMemoryRing::Create(name, kCapacity, 1, &producer));
+  std::unique_ptr<SharedMemoryRing> consumer;
+  TF_ASSERT_OK(SharedMemoryRing::Open(name, 0, &consumer));
+  TF_ASSERT_OK(WriteRecords(producer.get(), 2));
+  TF_ASSERT_OK(producer->Finish(errors::InvalidArgument("bad input")));
+  int num_records;
+  Status s = ReadRecords(consumer.get(), &num_records);
+  EXPECT_EQ(2, num_records);
+  EXPECT_TRUE(errors::IsInvalidArgument(s));
+  EXPECT_EQ("bad input", s.error_message());
+}
+
+TEST(SharedMemoryRingTest, InvalidUse) {
+  const string name = RingName("InvalidUse");
+  std::unique_ptr<SharedMemoryRing> consumer;
+  EXPECT_TRUE(errors::IsNotFound(SharedMemoryRing::Open(name, 0, &consumer)));
+
+  std::unique_ptr<SharedMemoryRing> producer;
+  TF_ASSERT_OK(SharedMemoryRing::Create(name, kCapacity, 1, &producer));
+  std::unique_ptr<SharedMemoryRing> other_producer;
+  EXPECT_TRUE(errors::IsAlreadyExists(
+      SharedMemoryRing::Create(name, kCapacity, 1, &other_producer)));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      SharedMemoryRing::Open(name, 1, &consumer)));
+  TF_ASSERT_OK(SharedMemoryRing::Open(name, 0, &consumer));
+  std::unique_ptr<SharedMemoryRing> other_consumer;
+  EXPECT_TRUE(errors::IsAlreadyExists(
+      SharedMemoryRing::Open(name, 0, &other_consumer)));
+
+  char* data;
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(producer->Reserve(kCapacity, &data)));
+  producer->Cancel();
+  TF_ASSERT_OK(producer->Reserve(1, &data));
+  producer->Commit();
+  // The consumer has not released the first record.
+  EXPECT_TRUE(errors::IsCancelled(producer->Reserve(kCapacity - 64, &data)));
+}
+
+TEST(SharedMemoryRingTest, NextStopsWhenCancelled) {
+  const string name = RingName("NextStopsWhenCancelled");
+  std::unique_ptr<SharedMemoryRing> producer;
+  TF_ASSERT_OK(SharedMemoryRing::Create(name, kCapacity, 1, &producer));
+  std::unique_ptr<SharedMemoryRing> consumer;
+  TF_ASSERT_OK(SharedMemoryRing::Open(name, 0, &consumer));
+  StringPiece record;
+  uint64 id;
+  EXPECT_TRUE(errors::IsCancelled(
+      consumer->Next(&record, &id, []() { return true; })));
+
+  // Only that call is cancelled.
+  TF_ASSERT_OK(WriteRecords(producer.get(), 1));
+  TF_ASSERT_OK(producer->Finish(Status::OK()));
+  TF_ASSERT_OK(consumer->Next(&record, &id, []() { return false; }));
+  EXPECT_EQ(Record(0), record);
+  consumer->Release(id);
+  EXPECT_TRUE(errors::IsOutOfRange(consumer->Next(&record, &id)));
+}
+
+TEST(SharedMemoryRingTest, ConsumerProcess) {
+  const string name = RingName("ConsumerProcess");
+  std::unique_ptr<SharedMemoryRing> producer;
+  TF_ASSERT_OK(SharedMemoryRing::Create(name, kCapacity, 1, &producer));
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    std::unique_ptr<SharedMemoryRing> consumer;
+    int num_records = 0;
+    const bool ok = SharedMemoryRing::Open(name, 0, &consumer).ok() &&
+                    ReadRecords(consumer.get(), &num_records).ok() &&
+                    num_records == kNumRecords;
+    consumer.reset();
+    _exit(ok ? 0 : 1);
+  }
+  TF_ASSERT_OK(WriteRecords(producer.get(), kNumRecords));
+  TF_ASSERT_OK(producer->Finish(Status::OK()));
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST(SharedMemoryRingTest, ProducerSkipsExitedConsumer) {
+  const string name = RingName("ProducerSkipsExitedConsumer");
+  std::unique_ptr<SharedMemoryRing> producer;
+  TF_ASSERT_OK(SharedMemoryRing::Create(name, kCapacity, 1, &producer));
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // Attaches and exits without releasing any record or detaching.
+    std::unique_ptr<SharedMemoryRing> consumer;
+    StringPiece record;
+    uint64 id;
+    const bool ok = SharedMemoryRing::Open(name, 0, &consumer).ok() &&
+                    consumer->Next(&record, &id).ok();
+    _exit(ok ? 0 : 1);
+  }
+  std::unique_ptr<Thread> thread(
+      Env::Default()->StartThread({}, "producer", [&producer]() {
+        TF_EXPECT_OK(WriteRecords(producer.get(), kNumRecords));
+        TF_EXPECT_OK(producer->Finish(Status::OK()));
+      }));
+  // The consumer is only seen to have exited once it has been reaped.
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -121,21 +121,9 @@ class SkipDatasetOp : public UnaryDatasetOpKernel {
           return Status::OK();
         }
 
-        // Keep calling GetNext().  TODO(vrv): Figure out a way to
-        // skip records without reading, perhaps by adding an
-        // interface to iterator.
-        while (i_ < dataset()->count_) {
-          // Fetch and throw away Tensors.
-          std::vector<Tensor> dummy_out_tensors;
-          TF_RETURN_IF_ERROR(
-              input_impl_->GetNext(ctx, &dummy_out_tensors, end_of_sequence));
-          if (*end_of_sequence) {
-            // We reached the end before the count was reached.
-            input_impl_.reset();
-            return Status::OK();
-          }
-
-          ++i_;
+        TF_RETURN_IF_ERROR(SkipInputLocked(ctx, end_of_sequence));
+        if (*end_of_sequence) {
+          return Status::OK();
         }
 
         // Return GetNext() on the underlying iterator.
@@ -148,6 +136,26 @@ class SkipDatasetOp : public UnaryDatasetOpKernel {
       }
 
      protected:
+      Status SkipInternal(IteratorContext* ctx, int64 num_to_skip,
+                          bool* end_of_sequence, int64* num_skipped) override {
+        mutex_lock l(mu_);
+        *num_skipped = 0;
+        if (!input_impl_) {
+          *end_of_sequence = true;
+          return Status::OK();
+        }
+        TF_RETURN_IF_ERROR(SkipInputLocked(ctx, end_of_sequence));
+        if (*end_of_sequence) {
+          return Status::OK();
+        }
+        TF_RETURN_IF_ERROR(input_impl_->Skip(ctx, num_to_skip, end_of_sequence,
+                                             num_skipped));
+        if (*end_of_sequence) {
+          input_impl_.reset();
+        }
+        return Status::OK();
+      }
+
       Status SaveInternal(IteratorStateWriter* writer) override {
         mutex_lock l(mu_);
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("i"), i_));
@@ -173,6 +181,25 @@ class SkipDatasetOp : public UnaryDatasetOpKernel {
       }
 
      private:
+      // Skips the first `count_` elements of the input, if that has not been
+      // done yet.
+      Status SkipInputLocked(IteratorContext* ctx, bool* end_of_sequence)
+          EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        *end_of_sequence = false;
+        if (i_ < dataset()->count_) {
+          int64 num_skipped;
+          Status s = input_impl_->Skip(ctx, dataset()->count_ - i_,
+                                       end_of_sequence, &num_skipped);
+          i_ += num_skipped;
+          TF_RETURN_IF_ERROR(s);
+          if (*end_of_sequence) {
+            // We reached the end before the count was reached.
+            input_impl_.reset();
+          }
+        }
+        return Status::OK();
+      }
+
       mutex mu_;
       int64 i_ GUARDED_BY(mu_);
       std::unique_ptr<IteratorBase> input_impl_ GUARDED_BY(mu_);
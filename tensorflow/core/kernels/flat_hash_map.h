@@ -0,0 +1,329 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_FLAT_HASH_MAP_H_
+#define TENSORFLOW_CORE_KERNELS_FLAT_HASH_MAP_H_
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "tensorflow/core/lib/core/bits.h"
+#include "tensorflow/core/lib/core/raw_coding.h"
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/prefetch.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace lookup {
+
+// Hash function for the keys of a FlatHashMap, which relies on all bits of
+// the hash being well mixed.  Integers are mixed with the finalizer of
+// MurmurHash3 rather than hashed to themselves as by std::hash.
+template <typename K>
+struct FlatHashMapHash {
+  static_assert(std::is_integral<K>::value, "Keys must be integers or strings");
+  uint64 operator()(K key) const {
+    uint64 h = static_cast<uint64>(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+};
+
+template <>
+struct FlatHashMapHash<string> {
+  uint64 operator()(const string& key) const { return Hash64(key); }
+};
+
+// An open-addressing hash map for the lookup tables, laid out as in Swiss
+// tables: the slots are split into groups of kGroupWidth, and a control byte
+// per slot holds either kEmpty or the low 7 bits of the hash of its key.  A
+// lookup probes the groups in turn, comparing the control bytes of a whole
+// group to the hash bits at once (with SSE2 where available), and compares
+// keys only for the slots that match.  Keys and values are kept in separate
+// arrays, so that probing touches only control bytes and keys.
+//
+// Keys cannot be erased; the lookup tables only insert and clear.  Not
+// thread-safe, except for concurrent calls of the const methods.
+//
+// Sample use case:
+//
+// FlatHashMap<string, int64> map;
+// map.InsertOrUpdate("foo", 1);
+// const int64* value = map.Find("foo");
+template <typename K, typename V, class Hash = FlatHashMapHash<K>>
+class FlatHashMap {
+ public:
+  static constexpr int kGroupWidth = 16;
+
+  FlatHashMap() {}
+
+  size_t size() const { return size_; }
+
+  // The number of slots, at least 8/7 of size().
+  size_t capacity() const { return capacity_; }
+
+  // Removes all entries, keeping the allocated slots.
+  void clear() {
+    if (capacity_ > 0) {
+      memset(ctrl_.get(), kEmpty, capacity_);
+      for (size_t i = 0; i < capacity_; ++i) {
+        keys_[i] = K();
+        values_[i] = V();
+      }
+    }
+    size_ = 0;
+  }
+
+  // Makes room for "n" entries without further allocation.
+  void reserve(size_t n) {
+    if (n > MaxSize(capacity_)) Resize(CapacityFor(n));
+  }
+
+  // Returns the value of "key", or nullptr if it has none.
+  const V* Find(const K& key) const { return Find(key, hash_(key)); }
+  V* Find(const K& key) {
+    return const_cast<V*>(
+        static_cast<const FlatHashMap*>(this)->Find(key, hash_(key)));
+  }
+
+  // Inserts "key" with "value" unless "key" already has a value.  Returns
+  // the value of "key", and whether it has been inserted.
+  std::pair<V*, bool> Insert(const K& key, const V& value) {
+    const uint64 hash = hash_(key);
+    V* existing = const_cast<V*>(Find(key, hash));
+    if (existing != nullptr) return {existing, false};
+    if (size_ + 1 > MaxSize(capacity_)) Resize(CapacityFor(size_ + 1));
+    const size_t slot = FindEmptySlot(hash);
+    ctrl_[slot] = H2(hash);
+    keys_[slot] = key;
+    values_[slot] = value;
+    ++size_;
+    return {&values_[slot], true};
+  }
+
+  // Sets the value of "key" to "value".
+  void InsertOrUpdate(const K& key, const V& value) {
+    std::pair<V*, bool> result = Insert(key, value);
+    if (!result.second) *result.first = value;
+  }
+
+  // Looks up the "n" keys at "keys", and calls "callback(i, value)" for each
+  // of them in order, with the value of the i-th key or nullptr.  The groups
+  // of the keys are prefetched in batches, so that the cache misses of a
+  // batch overlap rather than follow each other.
+  template <typename Callback>
+  void FindBatch(const K* keys, int64 n, Callback callback) const {
+    constexpr int kBatchSize = 16;
+    uint64 hashes[kBatchSize];
+    for (int64 start = 0; start < n; start += kBatchSize) {
+      const int batch_size =
+          static_cast<int>(std::min<int64>(kBatchSize, n - start));
+      for (int i = 0; i < batch_size; ++i) {
+        hashes[i] = hash_(keys[start + i]);
+        Prefetch(hashes[i]);
+      }
+      for (int i = 0; i < batch_size; ++i) {
+        callback(start + i, Find(keys[start + i], hashes[i]));
+      }
+    }
+  }
+
+  // Calls "f(key, value)" for each entry, in no particular order.
+  template <typename F>
+  void ForEach(F f) const {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (ctrl_[i] != kEmpty) f(keys_[i], values_[i]);
+    }
+  }
+
+  // The number of bytes of the slots, not counting the heap memory owned by
+  // the keys and values themselves.
+  int64 MemoryUsed() const {
+    return sizeof(FlatHashMap) + capacity_ * (1 + sizeof(K) + sizeof(V));
+  }
+
+ private:
+  static constexpr uint8 kEmpty = 0x80;
+
+  // The matches of a group of control bytes, as a bitmask of its slots.
+  // Without SSE2, the group is matched as two 64-bit words.
+  class Group {
+   public:
+    explicit Group(const uint8* ctrl) {
+#ifdef __SSE2__
+      ctrl_ = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+      const char* bytes = reinterpret_cast<const char*>(ctrl);
+      ctrl_[0] = core::DecodeFixed64(bytes);
+      ctrl_[1] = core::DecodeFixed64(bytes + 8);
+#endif
+    }
+
+    uint32 Match(uint8 h2) const {
+#ifdef __SSE2__
+      return _mm_movemask_epi8(
+          _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(h2)), ctrl_));
+#else
+      const uint64 pattern = kLsbs * h2;
+      return ToMask(ZeroBytes(ctrl_[0] ^ pattern)) |
+             ToMask(ZeroBytes(ctrl_[1] ^ pattern)) << 8;
+#endif
+    }
+
+    // Only kEmpty has the high bit set.
+    uint32 MatchEmpty() const {
+#ifdef __SSE2__
+      return _mm_movemask_epi8(ctrl_);
+#else
+      return ToMask(ctrl_[0] & kMsbs) | ToMask(ctrl_[1] & kMsbs) << 8;
+#endif
+    }
+
+   private:
+#ifdef __SSE2__
+    __m128i ctrl_;
+#else
+    static constexpr uint64 kLsbs = 0x0101010101010101ULL;
+    static constexpr uint64 kMsbs = 0x8080808080808080ULL;
+
+    // Sets the high bit of exactly the zero bytes of "x".
+    static uint64 ZeroBytes(uint64 x) {
+      return ~(((x & ~kMsbs) + ~kMsbs) | x | ~kMsbs);
+    }
+
+    // Gathers the high bits of the bytes of "x", the only bits set, into
+    // the low 8 bits, the lowest byte first.
+    static uint32 ToMask(uint64 x) {
+      return static_cast<uint32>(((x >> 7) * 0x0102040810204080ULL) >> 56);
+    }
+
+    uint64 ctrl_[2];
+#endif
+  };
+
+  static int LowestBit(uint32 mask) { return Log2Floor(mask & (~mask + 1)); }
+
+  static uint8 H2(uint64 hash) { return hash & 0x7f; }
+
+  // The maximum size for "capacity" slots, for a load factor of 7/8.
+  static size_t MaxSize(size_t capacity) { return capacity - capacity / 8; }
+
+  // The smallest capacity, a power of two, for "n" entries.
+  static size_t CapacityFor(size_t n) {
+    size_t capacity = kGroupWidth;
+    while (MaxSize(capacity) < n) capacity *= 2;
+    return capacity;
+  }
+
+  // The groups are probed quadratically, which visits all of them since
+  // their number is a power of two.
+  size_t FirstGroup(uint64 hash) const {
+    return (hash >> 7) & (capacity_ / kGroupWidth - 1);
+  }
+  size_t NextGroup(size_t group, size_t probe) const {
+    return (group + probe) & (capacity_ / kGroupWidth - 1);
+  }
+
+  void Prefetch(uint64 hash) const {
+    if (capacity_ == 0) return;
+    const size_t offset = FirstGroup(hash) * kGroupWidth;
+    port::prefetch<port::PREFETCH_HINT_T0>(&ctrl_[offset]);
+    port::prefetch<port::PREFETCH_HINT_T0>(&keys_[offset]);
+  }
+
+  const V* Find(const K& key, uint64 hash) const {
+    if (capacity_ == 0) return nullptr;
+    const uint8 h2 = H2(hash);
+    size_t group = FirstGroup(hash);
+    for (size_t probe = 1;; ++probe) {
+      const size_t offset = group * kGroupWidth;
+      const Group g(&ctrl_[offset]);
+      for (uint32 mask = g.Match(h2); mask != 0; mask &= mask - 1) {
+        const size_t slot = offset + LowestBit(mask);
+        if (keys_[slot] == key) return &values_[slot];
+      }
+      // Keys are never erased, so a key is in the first group along its
+      // probe sequence that has an empty slot, if at all.
+      if (g.MatchEmpty() != 0) return nullptr;
+      group = NextGroup(group, probe);
+    }
+  }
+
+  // Returns the first empty slot along the probe sequence of "hash".
+  size_t FindEmptySlot(uint64 hash) const {
+    size_t group = FirstGroup(hash);
+    for (size_t probe = 1;; ++probe) {
+      const size_t offset = group * kGroupWidth;
+      const uint32 mask = Group(&ctrl_[offset]).MatchEmpty();
+      if (mask != 0) return offset + LowestBit(mask);
+      group = NextGroup(group, probe);
+    }
+  }
+
+  void Resize(size_t new_capacity) {
+    DCHECK_GE(MaxSize(new_capacity), size_);
+    std::unique_ptr<uint8[]> old_ctrl = std::move(ctrl_);
+    std::unique_ptr<K[]> old_keys = std::move(keys_);
+    std::unique_ptr<V[]> old_values = std::move(values_);
+    const size_t old_capacity = capacity_;
+
+    capacity_ = new_capacity;
+    ctrl_.reset(new uint8[capacity_]);
+    memset(ctrl_.get(), kEmpty, capacity_);
+    keys_.reset(new K[capacity_]);
+    values_.reset(new V[capacity_]);
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] == kEmpty) continue;
+      const uint64 hash = hash_(old_keys[i]);
+      const size_t slot = FindEmptySlot(hash);
+      ctrl_[slot] = H2(hash);
+      keys_[slot] = std::move(old_keys[i]);
+      values_[slot] = std::move(old_values[i]);
+    }
+  }
+
+  Hash hash_;
+  size_t size_ = 0;
+  size_t capacity_ = 0;  // Zero or a power of two, at least kGroupWidth.
+  std::unique_ptr<uint8[]> ctrl_;
+  std::unique_ptr<K[]> keys_;
+  std::unique_ptr<V[]> values_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(FlatHashMap);
+};
+
+template <typename K, typename V, class Hash>
+constexpr int FlatHashMap<K, V, Hash>::kGroupWidth;
+
+template <typename K, typename V, class Hash>
+constexpr uint8 FlatHashMap<K, V, Hash>::kEmpty;
+
+}  // namespace lookup
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_FLAT_HASH_MAP_H_
@@ -0,0 +1,183 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/kernels/flat_hash_map.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace lookup {
+namespace {
+
+TEST(FlatHashMapTest, InsertAndFind) {
+  FlatHashMap<int64, int64> map;
+  EXPECT_EQ(nullptr, map.Find(1));
+  for (int64 i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(map.Insert(i * 256, i).second);
+  }
+  EXPECT_EQ(1000, map.size());
+  EXPECT_GE(map.capacity() * 7, map.size() * 8);
+
+  std::pair<int64*, bool> result = map.Insert(256, -1);
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(1, *result.first);
+  map.InsertOrUpdate(256, -1);
+  EXPECT_EQ(-1, *map.Find(256));
+  EXPECT_EQ(1000, map.size());
+
+  for (int64 i = 2; i < 1000; ++i) {
+    ASSERT_NE(nullptr, map.Find(i * 256));
+    EXPECT_EQ(i, *map.Find(i * 256));
+  }
+  EXPECT_EQ(nullptr, map.Find(1));
+  EXPECT_EQ(nullptr, map.Find(1000 * 256));
+}
+
+TEST(FlatHashMapTest, StringKeys) {
+  FlatHashMap<string, string> map;
+  for (int i = 0; i < 100; ++i) {
+    map.InsertOrUpdate(strings::StrCat("key", i), strings::StrCat(i));
+  }
+  EXPECT_EQ(100, map.size());
+  EXPECT_EQ("42", *map.Find("key42"));
+  EXPECT_EQ(nullptr, map.Find("key100"));
+
+  std::vector<string> keys;
+  map.ForEach([&keys](const string& key, const string& value) {
+    EXPECT_EQ(strings::StrCat("key", value), key);
+    keys.push_back(key);
+  });
+  EXPECT_EQ(100, keys.size());
+
+  map.clear();
+  EXPECT_EQ(0, map.size());
+  EXPECT_EQ(nullptr, map.Find("key42"));
+  map.InsertOrUpdate("key42", "42");
+  EXPECT_EQ("42", *map.Find("key42"));
+}
+
+TEST(FlatHashMapTest, FindBatch) {
+  FlatHashMap<int32, float> map;
+  map.reserve(100);
+  const size_t capacity = map.capacity();
+  for (int32 i = 0; i < 100; i += 2) {
+    map.InsertOrUpdate(i, i * 0.5f);
+  }
+  EXPECT_EQ(capacity, map.capacity());
+
+  std::vector<int32> keys(100);
+  for (int32 i = 0; i < 100; ++i) keys[i] = 99 - i;
+  std::vector<float> values(100, 0.f);
+  map.FindBatch(keys.data(), keys.size(),
+                [&values](int64 i, const float* value) {
+                  values[i] = value != nullptr ? *value : -1.f;
+                });
+  for (int32 i = 0; i < 100; ++i) {
+    EXPECT_EQ(keys[i] % 2 == 0 ? keys[i] * 0.5f : -1.f, values[i]);
+  }
+}
+
+// Benchmarks looking up "num_keys" random int64 or string keys, half of which
+// are in a table of "num_keys" entries, in batches of 1024 keys.
+template <typename K>
+std::vector<K> RandomKeys(int num_keys);
+
+template <>
+std::vector<int64> RandomKeys(int num_keys) {
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  std::vector<int64> keys(num_keys);
+  for (int64& key : keys) key = rnd.Rand64();
+  return keys;
+}
+
+template <>
+std::vector<string> RandomKeys(int num_keys) {
+  std::vector<string> keys;
+  for (int64 key : RandomKeys<int64>(num_keys)) {
+    keys.push_back(strings::StrCat("token_", key));
+  }
+  return keys;
+}
+
+template <typename K>
+void BM_FlatHashMapFind(int iters, int num_keys) {
+  testing::StopTiming();
+  const std::vector<K> keys = RandomKeys<K>(2 * num_keys);
+  FlatHashMap<K, int64> map;
+  for (int i = 0; i < num_keys; ++i) map.InsertOrUpdate(keys[i], i);
+  std::vector<K> queries(keys);
+  std::random_shuffle(queries.begin(), queries.end());
+  std::vector<int64> values(1024);
+  testing::StartTiming();
+  int64 offset = 0;
+  for (int i = 0; i < iters; ++i) {
+    map.FindBatch(&queries[offset], values.size(),
+                  [&values](int64 j, const int64* value) {
+                    values[j] = value != nullptr ? *value : -1;
+                  });
+    offset = (offset + values.size()) % (queries.size() - values.size());
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * values.size());
+}
+
+template <typename K>
+void BM_UnorderedMapFind(int iters, int num_keys) {
+  testing::StopTiming();
+  const std::vector<K> keys = RandomKeys<K>(2 * num_keys);
+  std::unordered_map<K, int64> map;
+  for (int i = 0; i < num_keys; ++i) map[keys[i]] = i;
+  std::vector<K> queries(keys);
+  std::random_shuffle(queries.begin(), queries.end());
+  std::vector<int64> values(1024);
+  testing::StartTiming();
+  int64 offset = 0;
+  for (int i = 0; i < iters; ++i) {
+    for (size_t j = 0; j < values.size(); ++j) {
+      auto it = map.find(queries[offset + j]);
+      values[j] = it != map.end() ? it->second : -1;
+    }
+    offset = (offset + values.size()) % (queries.size() - values.size());
+  }
+  testing::ItemsProcessed(static_cast<int64>(iters) * values.size());
+}
+
+static void BM_FlatHashMapFindInt64(int iters, int num_keys) {
+  BM_FlatHashMapFind<int64>(iters, num_keys);
+}
+static void BM_UnorderedMapFindInt64(int iters, int num_keys) {
+  BM_UnorderedMapFind<int64>(iters, num_keys);
+}
+static void BM_FlatHashMapFindString(int iters, int num_keys) {
+  BM_FlatHashMapFind<string>(iters, num_keys);
+}
+static void BM_UnorderedMapFindString(int iters, int num_keys) {
+  BM_UnorderedMapFind<string>(iters, num_keys);
+}
+BENCHMARK(BM_FlatHashMapFindInt64)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 22);
+BENCHMARK(BM_UnorderedMapFindInt64)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 22);
+BENCHMARK(BM_FlatHashMapFindString)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK(BM_UnorderedMapFindString)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+}  // namespace
+}  // namespace lookup
+}  // namespace tensorflow
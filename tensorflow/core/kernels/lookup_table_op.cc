@@ -16,9 +16,11 @@ limitations under the License.
 #include "tensorflow/core/kernels/lookup_table_op.h"
 #define EIGEN_USE_THREADS
 
+#include <memory>
 #include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/types.h"
@@ -30,11 +32,71 @@ limitations under the License.
 namespace tensorflow {
 namespace lookup {
 
-// Lookup table that wraps an unordered_map, where the key and value data type
-// is specified. Each individual value must be a scalar. If vector values are
+namespace {
+
+// Returns the shard of a table with `num_shards` shards that `key` falls
+// into. Uses the high bits of the hash, which the maps of the shards do not
+// use to place their keys.
+template <typename K>
+inline int ShardOf(const K& key, int num_shards) {
+  const uint64 hash = FlatHashMapHash<K>()(key);
+  return static_cast<int>(((hash >> 32) * num_shards) >> 32);
+}
+
+// The positions of a batch of keys, grouped by the shard of a table that they
+// fall into so that each shard is locked once per batch. The keys of a shard
+// keep their order in the batch.
+template <typename K>
+class KeysByShard {
+ public:
+  KeysByShard(typename TTypes<K>::ConstFlat keys, int num_shards)
+      : num_keys_(keys.size()) {
+    if (num_shards == 1) return;
+    std::vector<int> shards(num_keys_);
+    offsets_.assign(num_shards + 1, 0);
+    for (int64 i = 0; i < num_keys_; ++i) {
+      shards[i] = ShardOf(SubtleMustCopyIfIntegral(keys(i)), num_shards);
+      ++offsets_[shards[i] + 1];
+    }
+    for (int s = 0; s < num_shards; ++s) {
+      offsets_[s + 1] += offsets_[s];
+    }
+    std::vector<int64> next(offsets_.begin(), offsets_.end() - 1);
+    positions_.resize(num_keys_);
+    for (int64 i = 0; i < num_keys_; ++i) {
+      positions_[next[shards[i]]++] = i;
+    }
+  }
+
+  // Returns the number of keys in shard s.
+  int64 size(int s) const {
+    return offsets_.empty() ? num_keys_ : offsets_[s + 1] - offsets_[s];
+  }
+
+  // Returns the position in the batch of the j-th key of shard s.
+  int64 position(int s, int64 j) const {
+    return offsets_.empty() ? j : positions_[offsets_[s] + j];
+  }
+
+ private:
+  const int64 num_keys_;
+  // Empty if the table has a single shard.
+  std::vector<int64> offsets_;
+  std::vector<int64> positions_;
+};
+
+}  // namespace
+
+// Lookup table that wraps an unordered_map, or a FlatHashMap if the attr
+// "use_flat_hash_map" is true, where the key and value data type is
+// specified. Each individual value must be a scalar. If vector values are
 // required, use MutableHashTableOfTensors.
 //
 // This table is mutable and thread safe - Insert can be called at any time.
+// The keys are split into "num_shards" shards, each with its own map and
+// reader/writer lock: lookups only take shared locks, and an Insert only
+// blocks the lookups of the shards that its keys fall into. With more than
+// one shard, a lookup may see some but not all keys of a concurrent Insert.
 //
 // Sample use case:
 //
@@ -47,11 +109,22 @@ namespace lookup {
 template <class K, class V>
 class MutableHashTableOfScalars final : public LookupInterface {
  public:
-  MutableHashTableOfScalars(OpKernelContext* ctx, OpKernel* kernel) {}
+  MutableHashTableOfScalars(OpKernelContext* ctx, OpKernel* kernel) {
+    OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "use_flat_hash_map",
+                                    &use_flat_hash_map_));
+    OP_REQUIRES_OK(ctx,
+                   GetNodeAttr(kernel->def(), "num_shards", &num_shards_));
+    shards_.reset(new Shard[num_shards_]);
+  }
 
   size_t size() const override {
-    mutex_lock l(mu_);
-    return table_.size();
+    size_t size = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      const Shard& shard = shards_[s];
+      tf_shared_lock l(shard.mu);
+      size += use_flat_hash_map_ ? shard.flat_table.size() : shard.table.size();
+    }
+    return size;
   }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
@@ -59,11 +132,41 @@ class MutableHashTableOfScalars final : public LookupInterface {
     const V default_val = default_value.flat<V>()(0);
     const auto key_values = key.flat<K>();
     auto value_values = value->flat<V>();
-
-    mutex_lock l(mu_);
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      value_values(i) = gtl::FindWithDefault(
-          table_, SubtleMustCopyIfIntegral(key_values(i)), default_val);
+    const KeysByShard<K> keys_by_shard(key_values, num_shards_);
+
+    std::vector<K> shard_keys;
+    for (int s = 0; s < num_shards_; ++s) {
+      const int64 num_keys = keys_by_shard.size(s);
+      if (num_keys == 0) continue;
+      const Shard& shard = shards_[s];
+      if (use_flat_hash_map_) {
+        // FindBatch() reads each key twice, so integral keys are copied
+        // first, as are the keys of a shard that are not contiguous.
+        const K* keys = key_values.data();
+        if (num_shards_ > 1 || std::is_integral<K>::value) {
+          shard_keys.resize(num_keys);
+          for (int64 j = 0; j < num_keys; ++j) {
+            shard_keys[j] = SubtleMustCopyIfIntegral(
+                key_values(keys_by_shard.position(s, j)));
+          }
+          keys = shard_keys.data();
+        }
+        tf_shared_lock l(shard.mu);
+        shard.flat_table.FindBatch(
+            keys, num_keys,
+            [&value_values, &default_val, &keys_by_shard, s](int64 j,
+                                                             const V* found) {
+              value_values(keys_by_shard.position(s, j)) =
+                  found != nullptr ? *found : default_val;
+            });
+        continue;
+      }
+      tf_shared_lock l(shard.mu);
+      for (int64 j = 0; j < num_keys; ++j) {
+        const int64 i = keys_by_shard.position(s, j);
+        value_values(i) = gtl::FindWithDefault(
+            shard.table, SubtleMustCopyIfIntegral(key_values(i)), default_val);
+      }
     }
 
     return Status::OK();
@@ -72,14 +175,27 @@ class MutableHashTableOfScalars final : public LookupInterface {
   Status DoInsert(bool clear, const Tensor& keys, const Tensor& values) {
     const auto key_values = keys.flat<K>();
     const auto value_values = values.flat<V>();
+    const KeysByShard<K> keys_by_shard(key_values, num_shards_);
 
-    mutex_lock l(mu_);
     if (clear) {
-      table_.clear();
+      // Holds the locks of all shards, so that lookups see either the old or
+      // the imported contents.
+      std::vector<mutex_lock> locks;
+      locks.reserve(num_shards_);
+      for (int s = 0; s < num_shards_; ++s) {
+        locks.emplace_back(shards_[s].mu);
+      }
+      for (int s = 0; s < num_shards_; ++s) {
+        shards_[s].table.clear();
+        shards_[s].flat_table.clear();
+        InsertIntoShard(s, keys_by_shard, key_values, value_values);
+      }
+      return Status::OK();
     }
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      gtl::InsertOrUpdate(&table_, SubtleMustCopyIfIntegral(key_values(i)),
-                          SubtleMustCopyIfIntegral(value_values(i)));
+    for (int s = 0; s < num_shards_; ++s) {
+      if (keys_by_shard.size(s) == 0) continue;
+      mutex_lock l(shards_[s].mu);
+      InsertIntoShard(s, keys_by_shard, key_values, value_values);
     }
     return Status::OK();
   }
@@ -95,8 +211,14 @@ class MutableHashTableOfScalars final : public LookupInterface {
   }
 
   Status ExportValues(OpKernelContext* ctx) override {
-    mutex_lock l(mu_);
-    int64 size = table_.size();
+    std::vector<tf_shared_lock> locks;
+    locks.reserve(num_shards_);
+    int64 size = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      const Shard& shard = shards_[s];
+      locks.emplace_back(shard.mu);
+      size += use_flat_hash_map_ ? shard.flat_table.size() : shard.table.size();
+    }
 
     Tensor* keys;
     Tensor* values;
@@ -108,9 +230,21 @@ class MutableHashTableOfScalars final : public LookupInterface {
     auto keys_data = keys->flat<K>();
     auto values_data = values->flat<V>();
     int64 i = 0;
-    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
-      keys_data(i) = it->first;
-      values_data(i) = it->second;
+    for (int s = 0; s < num_shards_; ++s) {
+      const Shard& shard = shards_[s];
+      if (use_flat_hash_map_) {
+        shard.flat_table.ForEach([&keys_data, &values_data, &i](
+                                     const K& key, const V& value) {
+          keys_data(i) = key;
+          values_data(i) = value;
+          ++i;
+        });
+        continue;
+      }
+      for (auto it = shard.table.begin(); it != shard.table.end(); ++it, ++i) {
+        keys_data(i) = it->first;
+        values_data(i) = it->second;
+      }
     }
     return Status::OK();
   }
@@ -125,22 +259,55 @@ class MutableHashTableOfScalars final : public LookupInterface {
 
   int64 MemoryUsed() const override {
     int64 ret = 0;
-    mutex_lock l(mu_);
-    for (unsigned i = 0; i < table_.bucket_count(); ++i) {
-      size_t bucket_size = table_.bucket_size(i);
-      if (bucket_size == 0) {
-        ret++;
-      } else {
-        ret += bucket_size;
+    for (int s = 0; s < num_shards_; ++s) {
+      const Shard& shard = shards_[s];
+      tf_shared_lock l(shard.mu);
+      if (use_flat_hash_map_) {
+        ret += sizeof(Shard) + shard.flat_table.MemoryUsed();
+        continue;
+      }
+      ret += sizeof(Shard);
+      for (unsigned i = 0; i < shard.table.bucket_count(); ++i) {
+        size_t bucket_size = shard.table.bucket_size(i);
+        if (bucket_size == 0) {
+          ret++;
+        } else {
+          ret += bucket_size;
+        }
       }
     }
     return sizeof(MutableHashTableOfScalars) + ret;
   }
 
  private:
-  // TODO(andreasst): consider using a read/write lock or a concurrent map
-  mutable mutex mu_;
-  std::unordered_map<K, V> table_ GUARDED_BY(mu_);
+  struct Shard {
+    mutable mutex mu;
+    std::unordered_map<K, V> table GUARDED_BY(mu);
+    FlatHashMap<K, V> flat_table GUARDED_BY(mu);
+  };
+
+  // Inserts the keys of shard s, whose lock must be held.
+  void InsertIntoShard(int s, const KeysByShard<K>& keys_by_shard,
+                       typename TTypes<K>::ConstFlat key_values,
+                       typename TTypes<V>::ConstFlat value_values) {
+    Shard& shard = shards_[s];
+    for (int64 j = 0; j < keys_by_shard.size(s); ++j) {
+      const int64 i = keys_by_shard.position(s, j);
+      if (use_flat_hash_map_) {
+        shard.flat_table.InsertOrUpdate(
+            SubtleMustCopyIfIntegral(key_values(i)),
+            SubtleMustCopyIfIntegral(value_values(i)));
+      } else {
+        gtl::InsertOrUpdate(&shard.table,
+                            SubtleMustCopyIfIntegral(key_values(i)),
+                            SubtleMustCopyIfIntegral(value_values(i)));
+      }
+    }
+  }
+
+  bool use_flat_hash_map_ = false;
+  int32 num_shards_ = 1;
+  std::unique_ptr<Shard[]> shards_;
 };
 
 // Lookup table that wraps an unordered_map. Behaves identical to
@@ -155,11 +322,19 @@ class MutableHashTableOfTensors final : public LookupInterface {
         ctx, TensorShapeUtils::IsVector(value_shape_),
         errors::InvalidArgument("Default value must be a vector, got shape ",
                                 value_shape_.DebugString()));
+    OP_REQUIRES_OK(ctx,
+                   GetNodeAttr(kernel->def(), "num_shards", &num_shards_));
+    shards_.reset(new Shard[num_shards_]);
   }
 
   size_t size() const override {
-    mutex_lock l(mu_);
-    return table_.size();
+    size_t size = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      const Shard& shard = shards_[s];
+      tf_shared_lock l(shard.mu);
+      size += shard.table.size();
+    }
+    return size;
   }
 
   Status Find(OpKernelContext* ctx, const Tensor& key, Tensor* value,
@@ -168,18 +343,24 @@ class MutableHashTableOfTensors final : public LookupInterface {
     const auto key_values = key.flat<K>();
     auto value_values = value->flat_inner_dims<V, 2>();
     int64 value_dim = value_shape_.dim_size(0);
-
-    mutex_lock l(mu_);
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      ValueArray* value_vec =
-          gtl::FindOrNull(table_, SubtleMustCopyIfIntegral(key_values(i)));
-      if (value_vec != nullptr) {
-        for (int64 j = 0; j < value_dim; j++) {
-          value_values(i, j) = value_vec->at(j);
-        }
-      } else {
-        for (int64 j = 0; j < value_dim; j++) {
-          value_values(i, j) = default_flat(j);
+    const KeysByShard<K> keys_by_shard(key_values, num_shards_);
+
+    for (int s = 0; s < num_shards_; ++s) {
+      if (keys_by_shard.size(s) == 0) continue;
+      const Shard& shard = shards_[s];
+      tf_shared_lock l(shard.mu);
+      for (int64 j = 0; j < keys_by_shard.size(s); ++j) {
+        const int64 i = keys_by_shard.position(s, j);
+        const ValueArray* value_vec = gtl::FindOrNull(
+            shard.table, SubtleMustCopyIfIntegral(key_values(i)));
+        if (value_vec != nullptr) {
+          for (int64 k = 0; k < value_dim; k++) {
+            value_values(i, k) = value_vec->at(k);
+          }
+        } else {
+          for (int64 k = 0; k < value_dim; k++) {
+            value_values(i, k) = default_flat(k);
+          }
         }
       }
     }
@@ -190,20 +371,26 @@ class MutableHashTableOfTensors final : public LookupInterface {
   Status DoInsert(bool clear, const Tensor& keys, const Tensor& values) {
     const auto key_values = keys.flat<K>();
     const auto value_values = values.flat_inner_dims<V, 2>();
-    int64 value_dim = value_shape_.dim_size(0);
+    const KeysByShard<K> keys_by_shard(key_values, num_shards_);
 
-    mutex_lock l(mu_);
     if (clear) {
-      table_.clear();
-    }
-    for (int64 i = 0; i < key_values.size(); ++i) {
-      ValueArray value_vec;
-      for (int64 j = 0; j < value_dim; j++) {
-        V value = value_values(i, j);
-        value_vec.push_back(value);
+      // Holds the locks of all shards, so that lookups see either the old or
+      // the imported contents.
+      std::vector<mutex_lock> locks;
+      locks.reserve(num_shards_);
+      for (int s = 0; s < num_shards_; ++s) {
+        locks.emplace_back(shards_[s].mu);
+      }
+      for (int s = 0; s < num_shards_; ++s) {
+        shards_[s].table.clear();
+        InsertIntoShard(s, keys_by_shard, key_values, value_values);
       }
-      gtl::InsertOrUpdate(&table_, SubtleMustCopyIfIntegral(key_values(i)),
-                          value_vec);
+      return Status::OK();
+    }
+    for (int s = 0; s < num_shards_; ++s) {
+      if (keys_by_shard.size(s) == 0) continue;
+      mutex_lock l(shards_[s].mu);
+      InsertIntoShard(s, keys_by_shard, key_values, value_values);
     }
     return Status::OK();
   }
@@ -219,8 +406,13 @@ class MutableHashTableOfTensors final : public LookupInterface {
   }
 
   Status ExportValues(OpKernelContext* ctx) override {
-    mutex_lock l(mu_);
-    int64 size = table_.size();
+    std::vector<tf_shared_lock> locks;
+    locks.reserve(num_shards_);
+    int64 size = 0;
+    for (int s = 0; s < num_shards_; ++s) {
+      locks.emplace_back(shards_[s].mu);
+      size += shards_[s].table.size();
+    }
     int64 value_dim = value_shape_.dim_size(0);
 
     Tensor* keys;
@@ -233,12 +425,14 @@ class MutableHashTableOfTensors final : public LookupInterface {
     auto keys_data = keys->flat<K>();
     auto values_data = values->matrix<V>();
     int64 i = 0;
-    for (auto it = table_.begin(); it != table_.end(); ++it, ++i) {
-      K key = it->first;
-      ValueArray value = it->second;
-      keys_data(i) = key;
-      for (int64 j = 0; j < value_dim; j++) {
-        values_data(i, j) = value[j];
+    for (int s = 0; s < num_shards_; ++s) {
+      const Shard& shard = shards_[s];
+      for (auto it = shard.table.begin(); it != shard.table.end(); ++it, ++i) {
+        keys_data(i) = it->first;
+        const ValueArray& value = it->second;
+        for (int64 j = 0; j < value_dim; j++) {
+          values_data(i, j) = value[j];
+        }
       }
     }
     return Status::OK();
@@ -254,24 +448,51 @@ class MutableHashTableOfTensors final : public LookupInterface {
 
   int64 MemoryUsed() const override {
     int64 ret = 0;
-    mutex_lock l(mu_);
-    for (unsigned i = 0; i < table_.bucket_count(); ++i) {
-      size_t bucket_size = table_.bucket_size(i);
-      if (bucket_size == 0) {
-        ret++;
-      } else {
-        ret += bucket_size;
+    for (int s = 0; s < num_shards_; ++s) {
+      const Shard& shard = shards_[s];
+      tf_shared_lock l(shard.mu);
+      ret += sizeof(Shard);
+      for (unsigned i = 0; i < shard.table.bucket_count(); ++i) {
+        size_t bucket_size = shard.table.bucket_size(i);
+        if (bucket_size == 0) {
+          ret++;
+        } else {
+          ret += bucket_size;
+        }
       }
     }
     return sizeof(MutableHashTableOfTensors) + ret;
   }
 
  private:
-  TensorShape value_shape_;
-  // TODO(andreasst): consider using a read/write lock or a concurrent map
-  mutable mutex mu_;
   typedef gtl::InlinedVector<V, 4> ValueArray;
-  std::unordered_map<K, ValueArray> table_ GUARDED_BY(mu_);
+
+  struct Shard {
+    mutable mutex mu;
+    std::unordered_map<K, ValueArray> table GUARDED_BY(mu);
+  };
+
+  // Inserts the keys of shard s, whose lock must be held.
+  void InsertIntoShard(int s, const KeysByShard<K>& keys_by_shard,
+                       typename TTypes<K>::ConstFlat key_values,
+                       typename TTypes<V, 2>::ConstTensor value_values) {
+    const int64 value_dim = value_shape_.dim_size(0);
+    Shard& shard = shards_[s];
+    for (int64 j = 0; j < keys_by_shard.size(s); ++j) {
+      const int64 i = keys_by_shard.position(s, j);
+      ValueArray value_vec;
+      for (int64 k = 0; k < value_dim; k++) {
+        V value = value_values(i, k);
+        value_vec.push_back(value);
+      }
+      gtl::InsertOrUpdate(&shard.table,
+                          SubtleMustCopyIfIntegral(key_values(i)), value_vec);
+    }
+  }
+
+  TensorShape value_shape_;
+  int32 num_shards_ = 1;
+  std::unique_ptr<Shard[]> shards_;
 };
 
 namespace {
@@ -294,6 +515,9 @@ TensorShape MaybeVectorizeShape(const TensorShape& shape) {
 }  // namespace
 
 // Modeled after densehashtable in https://github.com/sparsehash/sparsehash
+//
+// Lookups only take a shared lock, so they run concurrently with each other
+// but not with an Insert, which may rebucket the whole table.
 template <class K, class V>
 class MutableDenseHashTable final : public LookupInterface {
  public:
@@ -335,7 +559,7 @@ class MutableDenseHashTable final : public LookupInterface {
   }
 
   size_t size() const override LOCKS_EXCLUDED(mu_) {
-    mutex_lock l(mu_);
+    tf_shared_lock l(mu_);
     return num_entries_;
   }
 
@@ -355,7 +579,7 @@ class MutableDenseHashTable final : public LookupInterface {
     auto value_matrix = value->shaped<V, 2>({num_elements, value_size});
     const auto default_flat = default_value.flat<V>();
 
-    mutex_lock l(mu_);
+    tf_shared_lock l(mu_);
     const auto key_buckets_matrix =
         key_buckets_.AccessTensor(ctx)->template matrix<K>();
     const auto value_buckets_matrix =
@@ -450,7 +674,7 @@ class MutableDenseHashTable final : public LookupInterface {
   }
 
   Status ExportValues(OpKernelContext* ctx) override LOCKS_EXCLUDED(mu_) {
-    mutex_lock l(mu_);
+    tf_shared_lock l(mu_);
     Tensor key_buckets_tensor = *key_buckets_.AccessTensor(ctx);
     Tensor value_buckets_tensor = *value_buckets_.AccessTensor(ctx);
     TF_RETURN_IF_ERROR(ctx->set_output("keys", key_buckets_tensor));
@@ -492,7 +716,7 @@ class MutableDenseHashTable final : public LookupInterface {
   TensorShape value_shape() const override { return value_shape_; }
 
   int64 MemoryUsed() const override {
-    mutex_lock l(mu_);
+    tf_shared_lock l(mu_);
     return sizeof(MutableDenseHashTable) + key_buckets_.AllocatedBytes() +
            value_buckets_.AllocatedBytes() + empty_key_.AllocatedBytes();
   }
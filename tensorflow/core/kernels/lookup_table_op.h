@@ -17,11 +17,13 @@ limitations under the License.
 #define TENSORFLOW_KERNELS_LOOKUP_TABLE_OP_H_
 
 #include "tensorflow/core/framework/lookup_interface.h"
+#include "tensorflow/core/framework/node_def_util.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/kernels/bounds_check.h"
+#include "tensorflow/core/kernels/flat_hash_map.h"
 #include "tensorflow/core/kernels/lookup_util.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status.h"
@@ -143,7 +145,8 @@ inline const Variant& SubtleMustCopyIfIntegral(const Variant& value) {
   return value;
 }
 
-// Lookup table that wraps an unordered_map, where the key and value data type
+// Lookup table that wraps an unordered_map, or a FlatHashMap if the attr
+// "use_flat_hash_map" of the kernel is true, where the key and value data type
 // is specified.
 //
 // This table is recommended for any variations to key values.
@@ -166,7 +169,13 @@ inline const Variant& SubtleMustCopyIfIntegral(const Variant& value) {
 template <class K, class V>
 class HashTable : public InitializableLookupTable {
  public:
-  HashTable(OpKernelContext* ctx, OpKernel* kernel) {}
+  HashTable(OpKernelContext* ctx, OpKernel* kernel) {
+    // Other kernels use this table too, without the attr.
+    if (HasNodeAttr(kernel->def(), "use_flat_hash_map")) {
+      OP_REQUIRES_OK(ctx, GetNodeAttr(kernel->def(), "use_flat_hash_map",
+                                      &use_flat_hash_map_));
+    }
+  }
 
   size_t size() const override {
     // return the size of the table only if it's initialized, otherwise 0.
@@ -174,6 +183,7 @@ class HashTable : public InitializableLookupTable {
       return 0;
     }
     std::atomic_thread_fence(std::memory_order_acquire);
+    if (flat_table_) return flat_table_->size();
     return table_ ? table_->size() : 0;
   }
 
@@ -182,7 +192,7 @@ class HashTable : public InitializableLookupTable {
       return errors::Aborted("HashTable is not initialized.");
     }
 
-    const int64 size = table_->size();
+    const int64 size = flat_table_ ? flat_table_->size() : table_->size();
 
     Tensor* keys;
     Tensor* values;
@@ -194,6 +204,15 @@ class HashTable : public InitializableLookupTable {
     auto keys_data = keys->flat<K>();
     auto values_data = values->flat<V>();
     int64 i = 0;
+    if (flat_table_) {
+      flat_table_->ForEach([&keys_data, &values_data, &i](const K& key,
+                                                          const V& value) {
+        keys_data(i) = key;
+        values_data(i) = value;
+        ++i;
+      });
+      return Status::OK();
+    }
     for (auto it = table_->begin(); it != table_->end(); ++it, ++i) {
       keys_data(i) = it->first;
       values_data(i) = it->second;
@@ -206,11 +225,16 @@ class HashTable : public InitializableLookupTable {
   DataType value_dtype() const override { return DataTypeToEnum<V>::v(); }
 
  protected:
-  Status DoPrepare(size_t unused) override {
+  Status DoPrepare(size_t size) override {
     if (is_initialized_) {
       return errors::Aborted("HashTable already initialized.");
     }
-    if (!table_) {
+    if (use_flat_hash_map_) {
+      if (!flat_table_) {
+        flat_table_.reset(new FlatHashMap<K, V>());
+      }
+      flat_table_->reserve(size);
+    } else if (!table_) {
       table_ = std::unique_ptr<std::unordered_map<K, V>>(
           new std::unordered_map<K, V>());
     }
@@ -223,7 +247,7 @@ class HashTable : public InitializableLookupTable {
   }
 
   Status DoInsert(const Tensor& keys, const Tensor& values) override {
-    if (!table_) {
+    if (!table_ && !flat_table_) {
       return errors::FailedPrecondition("HashTable is not prepared.");
     }
 
@@ -232,7 +256,9 @@ class HashTable : public InitializableLookupTable {
     for (int64 i = 0; i < key_values.size(); ++i) {
       const K key = SubtleMustCopyIfIntegral(key_values(i));
       const V value = SubtleMustCopyIfIntegral(value_values(i));
-      const V& previous_value = gtl::LookupOrInsert(table_.get(), key, value);
+      const V& previous_value =
+          flat_table_ ? *flat_table_->Insert(key, value).first
+                      : gtl::LookupOrInsert(table_.get(), key, value);
       if (previous_value != value) {
         return errors::FailedPrecondition(
             "HashTable has different value for same key. Key ", key, " has ",
@@ -248,6 +274,24 @@ class HashTable : public InitializableLookupTable {
     const auto key_values = key.flat<K>();
     auto value_values = value->flat<V>();
 
+    if (flat_table_) {
+      // FindBatch() reads each key twice, so integral keys are copied first.
+      const K* keys = key_values.data();
+      std::vector<K> copied_keys;
+      if (std::is_integral<K>::value) {
+        copied_keys.resize(key_values.size());
+        for (int64 i = 0; i < key_values.size(); ++i) {
+          copied_keys[i] = SubtleMustCopyIfIntegral(key_values(i));
+        }
+        keys = copied_keys.data();
+      }
+      flat_table_->FindBatch(
+          keys, key_values.size(),
+          [&value_values, &default_val](int64 i, const V* found) {
+            value_values(i) = found != nullptr ? *found : default_val;
+          });
+      return Status::OK();
+    }
     for (int64 i = 0; i < key_values.size(); ++i) {
       value_values(i) = gtl::FindWithDefault(
           *table_, SubtleMustCopyIfIntegral(key_values(i)), default_val);
@@ -256,7 +300,9 @@ class HashTable : public InitializableLookupTable {
   }
 
   int64 MemoryUsed() const override {
-    if (table_) {
+    if (flat_table_) {
+      return flat_table_->MemoryUsed();
+    } else if (table_) {
       const int64 num_elements = table_->size();
       return num_elements * (sizeof(K) + sizeof(V));
     } else {
@@ -265,7 +311,9 @@ class HashTable : public InitializableLookupTable {
   }
 
  private:
+  bool use_flat_hash_map_ = false;
   std::unique_ptr<std::unordered_map<K, V>> table_;
+  std::unique_ptr<FlatHashMap<K, V>> flat_table_;
 };
 
 }  // namespace lookup
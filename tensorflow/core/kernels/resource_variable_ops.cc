@@ -253,6 +253,7 @@ class AssignVariableOp : public OpKernel {
         value.shape(), DEVICE_MEMORY, attr);
     mutex_lock ml(*variable->mu());
     variable->is_initialized = true;
+    variable->MarkAllRowsDirty();
     if (input_alias) {
       *variable->tensor() = *input_alias;
       return;
@@ -325,6 +326,7 @@ class AssignVariableOp<Device, Variant> : public OpKernel {
 
     mutex_lock ml(*variable->mu());
     variable->is_initialized = true;
+    variable->MarkAllRowsDirty();
     *variable->tensor() = Tensor(DT_VARIANT, value.shape());
 
     if (input_alias) {
@@ -396,6 +398,7 @@ class AssignUpdateVariableOp : public OpKernel {
     // PrepareToUpdateVariable() for commutative operations like Op ==
     // ADD if value's refcount was 1.
     mutex_lock ml(*variable->mu());
+    variable->MarkAllRowsDirty();
     Tensor* var_tensor = variable->tensor();
     OP_REQUIRES_OK(context,
                    PrepareToUpdateVariable<Device, T>(context, var_tensor));
@@ -649,6 +652,13 @@ class ResourceScatterUpdateOp : public OpKernel {
                         params->dim_size(0), ")"));
       }
     }
+    // On GPUs, the indices are in device memory.
+    if (std::is_same<Device, Eigen::ThreadPoolDevice>::value) {
+      v->MarkRowsDirty(gtl::ArraySlice<Index>(indices.flat<Index>().data(),
+                                              indices.NumElements()));
+    } else {
+      v->MarkAllRowsDirty();
+    }
   }
 };
 
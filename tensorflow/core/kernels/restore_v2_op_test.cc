@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <stdlib.h>
 #include <complex>
 #include <functional>
 #include <memory>
@@ -27,10 +28,16 @@ limitations under the License.
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/tensor_description.pb.h"
+#include "tensorflow/core/framework/tensor_slice.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
 namespace tensorflow {
 namespace {
@@ -57,6 +64,46 @@ class RestoreV2OpTest : public OpsTestBase {
     TF_ASSERT_OK(InitOp());
   }
 
+  // Makes an operation to restore tensors of the given types.
+  void MakeRestoreOp(const DataTypeVector& dts) {
+    TF_ASSERT_OK(NodeDefBuilder("myop", "RestoreV2")
+                     .Input(FakeInput())   // prefix
+                     .Input(FakeInput())   // tensor_names
+                     .Input(FakeInput())   // shape_and_slices
+                     .Attr("dtypes", dts)  // dtypes
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Adds the inputs to restore "tensor_names" from "prefix".
+  void AddRestoreInputs(const string& prefix,
+                        const std::vector<string>& tensor_names,
+                        const std::vector<string>& shape_and_slices) {
+    const int64 num_tensors = tensor_names.size();
+    AddInput<string>(TensorShape({}), [&prefix](int x) { return prefix; });
+    AddInput<string>(TensorShape({num_tensors}),
+                     [&tensor_names](int x) { return tensor_names[x]; });
+    AddInput<string>(TensorShape({num_tensors}), [&shape_and_slices](int x) {
+      return shape_and_slices[x];
+    });
+  }
+
+  // Writes the [1024, 1024] float tensor "partitioned" in two slices of 512
+  // rows, holding 0, 1, 2, ... in row-major order.
+  void AddPartitioned(BundleWriter* writer) {
+    const TensorShape full_shape({1024, 1024});
+    for (int part = 0; part < 2; ++part) {
+      const int64 offset = part * 512 * 1024;
+      Tensor slice = MakeInput<float>(
+          TensorShape({512, 1024}),
+          [offset](int x) -> float { return offset + x; });
+      TF_ASSERT_OK(writer->AddSlice(
+          "partitioned", full_shape,
+          TensorSlice::ParseOrDie(part == 0 ? "0,512:-" : "512,512:-"),
+          slice));
+    }
+  }
+
   void RunTest(StringPiece save_op_to_use) {
     const string filename =
         io::JoinPath(testing::TmpDir(), "tensor_simple-", save_op_to_use);
@@ -353,5 +400,107 @@ TEST_F(RestoreV2OpTest, RestoreAfterSaveV2) { RunTest("SaveV2"); }
 TEST_F(RestoreV2OpTest, RestoreAfterSaveSlicesV1) { RunTest("SaveSlices"); }
 TEST_F(RestoreV2OpTest, RestoreAfterSaveV1) { RunTest("Save"); }
 
+// Restores enough bytes for several ranges, each read by its own thread.
+TEST_F(RestoreV2OpTest, RestoreInSeveralRanges) {
+  const string prefix = io::JoinPath(testing::TmpDir(), "several_ranges");
+  {
+    BundleWriter writer(Env::Default(), prefix);
+    // Four tensors of 4MB each.
+    for (int k = 0; k < 4; ++k) {
+      TF_ASSERT_OK(writer.Add(
+          strings::StrCat("big_", k),
+          MakeInput<float>(TensorShape({1 << 20}),
+                           [k](int x) -> float { return x + k; })));
+    }
+    TF_ASSERT_OK(writer.Add(
+        "small_int",
+        MakeInput<int32>(TensorShape({10}), [](int x) { return x * 3; })));
+    AddPartitioned(&writer);
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  // Not in sorted order, and "partitioned" is restored twice: in full and a
+  // slice spanning both of its stored slices.
+  const std::vector<string> tensor_names = {
+      "small_int", "partitioned", "big_2", "big_0",
+      "partitioned", "big_3", "big_1"};
+  const std::vector<string> shape_and_slices = {
+      "", "", "", "", "1024 1024 256,512:-", "", ""};
+  MakeRestoreOp({DT_INT32, DT_FLOAT, DT_FLOAT, DT_FLOAT, DT_FLOAT, DT_FLOAT,
+                 DT_FLOAT});
+  AddRestoreInputs(prefix, tensor_names, shape_and_slices);
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<int32>(
+      *GetOutput(0),
+      MakeInput<int32>(TensorShape({10}), [](int x) { return x * 3; }));
+  test::ExpectTensorEqual<float>(
+      *GetOutput(1), MakeInput<float>(TensorShape({1024, 1024}),
+                                      [](int x) -> float { return x; }));
+  test::ExpectTensorEqual<float>(
+      *GetOutput(4),
+      MakeInput<float>(TensorShape({512, 1024}),
+                       [](int x) -> float { return 256 * 1024 + x; }));
+  for (int output : {2, 3, 5, 6}) {
+    const int k = tensor_names[output].back() - '0';
+    test::ExpectTensorEqual<float>(
+        *GetOutput(output),
+        MakeInput<float>(TensorShape({1 << 20}),
+                         [k](int x) -> float { return x + k; }));
+  }
+}
+
+// With TF_CHECKPOINT_RESTORE_MMAP, whole tensors aligned in the data file
+// are backed by a mapping of it, and the others are read as before.
+TEST_F(RestoreV2OpTest, RestoreMapped) {
+  const string prefix = io::JoinPath(testing::TmpDir(), "mapped");
+  {
+    BundleWriter::Options options;
+    options.data_alignment = EIGEN_MAX_ALIGN_BYTES;
+    BundleWriter writer(Env::Default(), prefix, options);
+    TF_ASSERT_OK(writer.Add("aligned", MakeInput<float>(TensorShape({1000}),
+                                                         [](int x) -> float {
+                                                           return x;
+                                                         })));
+    TF_ASSERT_OK(writer.Add(
+        "strings", MakeInput<string>(TensorShape({3}), [](int x) -> string {
+          return strings::StrCat("s", x);
+        })));
+    AddPartitioned(&writer);
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  setenv("TF_CHECKPOINT_RESTORE_MMAP", "1", 1);
+  MakeRestoreOp({DT_FLOAT, DT_FLOAT, DT_STRING, DT_FLOAT});
+  unsetenv("TF_CHECKPOINT_RESTORE_MMAP");
+  AddRestoreInputs(prefix, {"aligned", "aligned", "strings", "partitioned"},
+                   {"", "1000 10,20", "", ""});
+  TF_ASSERT_OK(RunOpKernel());
+
+  test::ExpectTensorEqual<float>(
+      *GetOutput(0),
+      MakeInput<float>(TensorShape({1000}), [](int x) -> float { return x; }));
+  test::ExpectTensorEqual<float>(
+      *GetOutput(1), MakeInput<float>(TensorShape({20}),
+                                      [](int x) -> float { return x + 10; }));
+  test::ExpectTensorEqual<string>(
+      *GetOutput(2), MakeInput<string>(TensorShape({3}), [](int x) -> string {
+        return strings::StrCat("s", x);
+      }));
+  test::ExpectTensorEqual<float>(
+      *GetOutput(3), MakeInput<float>(TensorShape({1024, 1024}),
+                                      [](int x) -> float { return x; }));
+
+  // Only the whole, memcpy-able and unsliced tensor is mapped.
+  for (int output = 0; output < 4; ++output) {
+    TensorDescription description;
+    GetOutput(output)->FillDescription(&description);
+    EXPECT_EQ(output == 0,
+              description.allocation_description().allocator_name() ==
+                  "MappedBundleFile")
+        << output;
+  }
+}
+
 }  // namespace
 }  // namespace tensorflow
@@ -14,6 +14,8 @@ limitations under the License.
 ==============================================================================*/
 
 #include "tensorflow/core/kernels/save_restore_tensor.h"
+#include <algorithm>
+#include <memory>
 #include <numeric>
 #include <unordered_map>
 #include <utility>
@@ -23,9 +25,12 @@ limitations under the License.
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/kernels/bounds_check.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/gtl/array_slice.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
@@ -226,10 +231,60 @@ void RestoreTensor(OpKernelContext* context,
 #undef READER_COPY
 }
 
+namespace {
+
+// Each thread restoring a checkpoint reads at least this many bytes.
+constexpr int64 kMinRestoreBytesPerThread = 4 << 20;
+
+// A tensor to restore by RestoreTensorsV2().
+struct TensorToRestore {
+  size_t index;  // Of the tensor in the inputs and outputs of the op.
+  bool is_slice;
+  TensorSlice slice;
+  // The allocated output to read the tensor into, or nullptr to look it up
+  // with BundleReader::LookupMapped() into "mapped".
+  Tensor* output = nullptr;
+  Tensor mapped;
+  int64 bytes;
+};
+
+// Restores "tensors" from "reader".
+Status RestoreTensorsFromReader(BundleReader* reader,
+                                const Tensor& tensor_names,
+                                gtl::ArraySlice<DataType> dtypes,
+                                TensorToRestore* tensors, size_t num_tensors) {
+  const auto& tensor_names_flat = tensor_names.flat<string>();
+  for (size_t j = 0; j < num_tensors; ++j) {
+    TensorToRestore* tensor = &tensors[j];
+    const string& tensor_name = tensor_names_flat(tensor->index);
+    Tensor* restored_tensor = tensor->output;
+    if (restored_tensor == nullptr) {
+      restored_tensor = &tensor->mapped;
+      TF_RETURN_IF_ERROR(reader->LookupMapped(tensor_name, restored_tensor));
+    } else if (tensor->is_slice) {
+      TF_RETURN_IF_ERROR(
+          reader->LookupSlice(tensor_name, tensor->slice, restored_tensor));
+    } else {
+      TF_RETURN_IF_ERROR(reader->Lookup(tensor_name, restored_tensor));
+    }
+    if (dtypes[tensor->index] != restored_tensor->dtype()) {
+      return errors::InvalidArgument(
+          "tensor_name = ", tensor_name, "; expected dtype ",
+          DataTypeString(dtypes[tensor->index]),
+          " does not equal restored dtype ",
+          DataTypeString(restored_tensor->dtype()));
+    }
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
 Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
                         const Tensor& tensor_names,
                         const Tensor& shape_and_slices,
-                        gtl::ArraySlice<DataType> dtypes) {
+                        gtl::ArraySlice<DataType> dtypes, int num_threads,
+                        bool use_mmap) {
   const string& prefix_string = prefix.scalar<string>()();
 
   const auto& tensor_names_flat = tensor_names.flat<string>();
@@ -246,32 +301,32 @@ Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
   BundleReader reader(Env::Default(), prefix_string);
   TF_RETURN_IF_ERROR(reader.status());
 
-  // TODO(zongheng): potential optimization: one Seek() in first lookup.
-  // TODO(zongheng): consider measuring speed and issuing concurrent lookups
-  // within a fixed memory budget.
+  // Looks up the shapes and allocates the outputs first, since the outputs
+  // cannot be allocated concurrently.
+  std::vector<TensorToRestore> tensors(sorted_name_idx.size());
+  int64 total_bytes = 0;
   TensorShape restored_full_shape;
-  Tensor* restored_tensor = nullptr;
-  for (auto i : sorted_name_idx) {
+  for (size_t j = 0; j < sorted_name_idx.size(); ++j) {
+    const size_t i = sorted_name_idx[j];
     const string& tensor_name = tensor_names_flat(i);
     const string& shape_and_slice = shape_and_slices_flat(i);
+    TensorToRestore* tensor = &tensors[j];
+    tensor->index = i;
 
     TF_RETURN_IF_ERROR(
         reader.LookupTensorShape(tensor_name, &restored_full_shape));
 
-    if (shape_and_slice.empty()) {
+    TensorShape restored_shape;
+    tensor->is_slice = !shape_and_slice.empty();
+    if (!tensor->is_slice) {
       // Lookup the full tensor.
-      TF_RETURN_IF_ERROR(
-          context->allocate_output(i, restored_full_shape, &restored_tensor));
-      TF_RETURN_IF_ERROR(reader.Lookup(tensor_name, restored_tensor));
+      restored_shape = restored_full_shape;
     } else {
       // Lookup the slice.
       TensorShape parsed_full_shape;
-      TensorSlice parsed_slice;
-      TensorShape parsed_slice_shape;
-
       TF_RETURN_IF_ERROR(
           checkpoint::ParseShapeAndSlice(shape_and_slice, &parsed_full_shape,
-                                         &parsed_slice, &parsed_slice_shape));
+                                         &tensor->slice, &restored_shape));
       if (!restored_full_shape.IsSameSize(parsed_full_shape)) {
         return errors::InvalidArgument(
             "tensor_name = ", tensor_name, "; shape in shape_and_slice spec ",
@@ -279,20 +334,229 @@ Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
             " does not match the shape stored in checkpoint: ",
             restored_full_shape.DebugString());
       }
-
-      TF_RETURN_IF_ERROR(
-          context->allocate_output(i, parsed_slice_shape, &restored_tensor));
+    }
+    if (!use_mmap || tensor->is_slice) {
       TF_RETURN_IF_ERROR(
-          reader.LookupSlice(tensor_name, parsed_slice, restored_tensor));
+          context->allocate_output(i, restored_shape, &tensor->output));
     }
-    if (dtypes[i] != restored_tensor->dtype()) {
-      return errors::InvalidArgument(
-          "tensor_name = ", tensor_name, "; expected dtype ",
-          DataTypeString(dtypes[i]), " does not equal restored dtype ",
-          DataTypeString(restored_tensor->dtype()));
+    tensor->bytes = restored_shape.num_elements() *
+                    std::max(DataTypeSize(dtypes[i]), 1);
+    total_bytes += tensor->bytes;
+  }
+
+  // Splits the sorted tensors into contiguous ranges of about the same size,
+  // each restored by its own thread with its own reader.
+  const int64 num_ranges = std::min<int64>(
+      {static_cast<int64>(num_threads), static_cast<int64>(tensors.size()),
+       total_bytes / kMinRestoreBytesPerThread});
+  std::vector<size_t> range_starts = {0};
+  int64 bytes = 0;
+  for (size_t j = 0; j < tensors.size(); ++j) {
+    const int64 num_started = range_starts.size();
+    if (num_started < num_ranges &&
+        bytes >= total_bytes * num_started / num_ranges) {
+      range_starts.push_back(j);
+    }
+    bytes += tensors[j].bytes;
+  }
+  range_starts.push_back(tensors.size());
+
+  const int num_workers = range_starts.size() - 2;
+  std::vector<Status> statuses(num_workers + 1);
+  {
+    std::unique_ptr<thread::ThreadPool> pool;
+    if (num_workers > 0) {
+      pool.reset(new thread::ThreadPool(Env::Default(), "restore_tensors",
+                                        num_workers));
+    }
+    for (int r = 1; r <= num_workers; ++r) {
+      pool->Schedule([&, r]() {
+        BundleReader range_reader(Env::Default(), prefix_string);
+        statuses[r] = range_reader.status();
+        if (statuses[r].ok()) {
+          statuses[r] = RestoreTensorsFromReader(
+              &range_reader, tensor_names, dtypes, &tensors[range_starts[r]],
+              range_starts[r + 1] - range_starts[r]);
+        }
+      });
+    }
+    // The first range is restored by this thread.
+    statuses[0] = RestoreTensorsFromReader(&reader, tensor_names, dtypes,
+                                           tensors.data(), range_starts[1]);
+    // Waits for the workers when the pool is destroyed.
+  }
+  for (const Status& s : statuses) {
+    TF_RETURN_IF_ERROR(s);
+  }
+
+  for (TensorToRestore& tensor : tensors) {
+    if (tensor.output == nullptr) {
+      context->set_output(tensor.index, tensor.mapped);
     }
   }
   return Status::OK();
 }
 
+struct AsyncCheckpointWrites::Write {
+  string prefix;
+  std::function<Status()> fn;
+  // The first error of the inputs, and then the status of the write.
+  Status status;
+  // The number of earlier writes that this write waits for, plus one while
+  // it is being scheduled.
+  int num_waiting = 1;
+  bool done = false;
+  // Whether the error of the write has been returned, directly or as the
+  // error of a write that depends on it.
+  bool reported = false;
+  // The writes that wait for this one, with whether they fail if it fails.
+  std::vector<std::pair<std::shared_ptr<Write>, bool>> dependents;
+};
+
+AsyncCheckpointWrites* AsyncCheckpointWrites::Global() {
+  static AsyncCheckpointWrites writes;
+  return &writes;
+}
+
+AsyncCheckpointWrites::AsyncCheckpointWrites() {}
+
+AsyncCheckpointWrites::~AsyncCheckpointWrites() {
+  WaitForAll();
+  std::unique_ptr<thread::ThreadPool> thread_pool;
+  {
+    mutex_lock l(mu_);
+    thread_pool = std::move(thread_pool_);
+  }
+  // Joins the threads, which may still be returning from Finish().
+  thread_pool.reset();
+}
+
+Status AsyncCheckpointWrites::Schedule(const string& prefix,
+                                       const std::vector<string>& inputs,
+                                       int64 step_id,
+                                       std::function<Status()> fn) {
+  std::shared_ptr<Write> write = std::make_shared<Write>();
+  write->prefix = prefix;
+  write->fn = std::move(fn);
+  {
+    mutex_lock l(mu_);
+    while (num_pending_ > 0 && pending_step_id_ != step_id) {
+      cond_var_.wait(l);
+    }
+    Status earlier_error;
+    for (const std::shared_ptr<Write>& failed : failed_) {
+      if (!failed->reported && earlier_error.ok()) {
+        earlier_error = Status(
+            failed->status.code(),
+            strings::StrCat("Failed to write checkpoint ", failed->prefix,
+                            " in the background: ",
+                            failed->status.error_message()));
+      }
+      failed->reported = true;
+    }
+    failed_.clear();
+    if (!earlier_error.ok()) return earlier_error;
+
+    pending_step_id_ = step_id;
+    for (const string& input : inputs) {
+      AddDependencyLocked(input, true /* propagate_error */, write);
+    }
+    AddDependencyLocked(prefix, false /* propagate_error */, write);
+    writes_[prefix] = write;
+    ++num_pending_;
+    if (--write->num_waiting > 0) return Status::OK();
+  }
+  Start(std::move(write));
+  return Status::OK();
+}
+
+void AsyncCheckpointWrites::AddDependencyLocked(
+    const string& prefix, bool propagate_error,
+    const std::shared_ptr<Write>& write) {
+  auto it = writes_.find(prefix);
+  if (it == writes_.end()) return;
+  Write* other = it->second.get();
+  if (!other->done) {
+    ++write->num_waiting;
+    other->dependents.emplace_back(write, propagate_error);
+  } else if (propagate_error && !other->status.ok()) {
+    // The error is returned as the error of "write".
+    write->status.Update(other->status);
+    other->reported = true;
+  }
+}
+
+void AsyncCheckpointWrites::Start(std::shared_ptr<Write> write) {
+  thread::ThreadPool* thread_pool;
+  {
+    // Processes that only restore checkpoints do not start the threads.
+    mutex_lock l(mu_);
+    if (!thread_pool_) {
+      thread_pool_.reset(new thread::ThreadPool(
+          Env::Default(), "async_checkpoint_writes",
+          std::max(1, std::min(port::NumSchedulableCPUs(), 8))));
+    }
+    thread_pool = thread_pool_.get();
+  }
+  thread_pool->Schedule([this, write]() {
+    Finish(write, write->status.ok() ? write->fn() : write->status);
+  });
+}
+
+void AsyncCheckpointWrites::Finish(const std::shared_ptr<Write>& write,
+                                   const Status& status) {
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to write checkpoint " << write->prefix << ": "
+               << status;
+  }
+  std::vector<std::shared_ptr<Write>> ready;
+  {
+    mutex_lock l(mu_);
+    write->status = status;
+    write->done = true;
+    // Releases the snapshots of the tensors.
+    write->fn = nullptr;
+    for (auto& dependent : write->dependents) {
+      if (dependent.second && !status.ok()) {
+        // The error is returned as the error of the dependent.
+        dependent.first->status.Update(status);
+        write->reported = true;
+      }
+      if (--dependent.first->num_waiting == 0) {
+        ready.push_back(std::move(dependent.first));
+      }
+    }
+    write->dependents.clear();
+    if (!status.ok() && !write->reported) failed_.push_back(write);
+    auto it = writes_.find(write->prefix);
+    if (status.ok() && it != writes_.end() && it->second == write) {
+      writes_.erase(it);
+    }
+    --num_pending_;
+  }
+  cond_var_.notify_all();
+  for (std::shared_ptr<Write>& dependent : ready) {
+    Start(std::move(dependent));
+  }
+}
+
+Status AsyncCheckpointWrites::Wait(const string& prefix) {
+  mutex_lock l(mu_);
+  auto it = writes_.find(prefix);
+  if (it == writes_.end()) return Status::OK();
+  std::shared_ptr<Write> write = it->second;
+  while (!write->done) {
+    cond_var_.wait(l);
+  }
+  write->reported = true;
+  return write->status;
+}
+
+void AsyncCheckpointWrites::WaitForAll() {
+  mutex_lock l(mu_);
+  while (num_pending_ > 0) {
+    cond_var_.wait(l);
+  }
+}
+
 }  // namespace tensorflow
@@ -16,6 +16,12 @@ limitations under the License.
 #ifndef TENSORFLOW_KERNELS_SAVE_RESTORE_TENSOR_H_
 #define TENSORFLOW_KERNELS_SAVE_RESTORE_TENSOR_H_
 
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/util/tensor_slice_reader.h"
 #include "tensorflow/core/util/tensor_slice_writer.h"
 
@@ -23,6 +29,10 @@ namespace tensorflow {
 
 class OpKernelContext;
 
+namespace thread {
+class ThreadPool;
+}  // namespace thread
+
 // Legacy / V1 checkpoint format.
 
 // Save input tensors in *context to a writer built from builder_func().
@@ -63,10 +73,80 @@ void RestoreTensor(OpKernelContext* context,
 //   * "prefix" has 1 element, DT_STRING.
 //   * "tensor_names" and "shape_and_slices" shaped {N}, both DT_STRING.
 //   * "dtypes" has N elements, the datatypes of the to-restore tensors.
+//
+// Up to "num_threads" threads, each with its own reader, restore contiguous
+// ranges of the tensors sorted by name, so that large checkpoints are read
+// concurrently from their data files.  With "use_mmap", whole tensors are
+// looked up with BundleReader::LookupMapped(), so that they may be backed
+// directly by the pages of the data files instead of copies.
 Status RestoreTensorsV2(OpKernelContext* context, const Tensor& prefix,
                         const Tensor& tensor_names,
                         const Tensor& shape_and_slices,
-                        gtl::ArraySlice<DataType> dtypes);
+                        gtl::ArraySlice<DataType> dtypes, int num_threads = 1,
+                        bool use_mmap = false);
+
+// Writes of V2 checkpoints that proceed in the background, after the ops that
+// requested them have returned.
+//
+// Each write produces the checkpoint "prefix".  It starts once the pending
+// writes of its "inputs" and any earlier write of the same prefix have
+// finished, and fails with the error of any of its inputs that failed instead
+// of running.  Since BundleWriter::Finish() renames the metadata file into
+// place last, a checkpoint only becomes visible once it has been written in
+// full.  Failed writes are logged, and remembered until the prefix is written
+// successfully.
+//
+// Each write holds a snapshot of the tensors until it finishes.  To bound
+// them, the writes of one step at a time are pending: Schedule() waits for
+// the writes of other steps first.
+class AsyncCheckpointWrites {
+ public:
+  // The writes of this process.  Its destruction at exit waits for all of
+  // them.
+  static AsyncCheckpointWrites* Global();
+
+  AsyncCheckpointWrites();
+  ~AsyncCheckpointWrites();
+
+  // Schedules "write" for step "step_id", once the writes of other steps
+  // have finished.  Returns the first error of the earlier writes that has
+  // not been returned by Schedule() or Wait() yet instead, without
+  // scheduling "write".
+  Status Schedule(const string& prefix, const std::vector<string>& inputs,
+                  int64 step_id, std::function<Status()> write);
+
+  // Waits for the pending write of "prefix", if any, and returns its status,
+  // or the status of its last write if that failed.
+  Status Wait(const string& prefix);
+
+  // Waits until no write is pending.
+  void WaitForAll();
+
+ private:
+  struct Write;
+
+  // Makes "write" wait for the pending write of "prefix", and fail with its
+  // error if "propagate_error".
+  void AddDependencyLocked(const string& prefix, bool propagate_error,
+                           const std::shared_ptr<Write>& write)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void Start(std::shared_ptr<Write> write);
+  void Finish(const std::shared_ptr<Write>& write, const Status& status);
+
+  mutex mu_;
+  std::unique_ptr<thread::ThreadPool> thread_pool_ GUARDED_BY(mu_);
+  condition_variable cond_var_;
+  // The pending and failed writes of each prefix.
+  std::unordered_map<string, std::shared_ptr<Write>> writes_ GUARDED_BY(mu_);
+  int64 num_pending_ GUARDED_BY(mu_) = 0;
+  // The step of the pending writes.
+  int64 pending_step_id_ GUARDED_BY(mu_) = 0;
+  // The failed writes, in the order they finished, whose errors may not have
+  // been returned yet.
+  std::vector<std::shared_ptr<Write>> failed_ GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(AsyncCheckpointWrites);
+};
 
 }  // namespace tensorflow
 
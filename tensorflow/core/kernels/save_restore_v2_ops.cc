@@ -15,11 +15,15 @@ limitations under the License.
 
 // See docs in ../ops/io_ops.cc.
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/framework/resource_var.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/kernels/bounds_check.h"
@@ -29,6 +33,7 @@ limitations under the License.
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tensorflow/core/util/saved_tensor_slice_util.h"
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 #include "tensorflow/core/util/tensor_slice_reader.h"
@@ -85,12 +90,35 @@ void ValidateInputs(bool is_save_op, OpKernelContext* context,
   }
 }
 
+// Reads the options of the BundleWriter of the save ops from the environment.
+Status GetWriterOptions(BundleWriter::Options* options) {
+  // Aligning the tensor data in the data files, e.g. to 64 bytes, lets
+  // RestoreV2 map it in place with TF_CHECKPOINT_RESTORE_MMAP.
+  int64 data_alignment;
+  TF_RETURN_IF_ERROR(
+      ReadInt64FromEnvVar("TF_CHECKPOINT_DATA_ALIGNMENT", 1, &data_alignment));
+  if (data_alignment < 1) {
+    return errors::InvalidArgument(
+        "TF_CHECKPOINT_DATA_ALIGNMENT must be positive, got ", data_alignment);
+  }
+  options->data_alignment = data_alignment;
+  return Status::OK();
+}
+
 }  // namespace
 
 // Saves a list of named tensors using the tensor bundle library.
 class SaveV2 : public OpKernel {
  public:
-  explicit SaveV2(OpKernelConstruction* context) : OpKernel(context) {}
+  explicit SaveV2(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, GetWriterOptions(&writer_options_));
+
+    // Returns once the tensors have been copied, and writes them in the
+    // background.  Fails instead with the error of an earlier background
+    // write that has not been returned yet.  See AsyncCheckpointWrites.
+    OP_REQUIRES_OK(context, ReadBoolFromEnvVar("TF_CHECKPOINT_ASYNC_SAVE",
+                                               false, &async_));
+  }
 
   void Compute(OpKernelContext* context) override {
     const Tensor& prefix = context->input(0);
@@ -98,6 +126,7 @@ class SaveV2 : public OpKernel {
     const Tensor& shape_and_slices = context->input(2);
     ValidateInputs(true /* is save op */, context, prefix, tensor_names,
                    shape_and_slices);
+    if (!context->status().ok()) return;
 
     const int kFixedInputs = 3;  // Prefix, tensor names, shape_and_slices.
     const int num_tensors = static_cast<int>(tensor_names.NumElements());
@@ -105,45 +134,271 @@ class SaveV2 : public OpKernel {
     const auto& tensor_names_flat = tensor_names.flat<string>();
     const auto& shape_and_slices_flat = shape_and_slices.flat<string>();
 
-    BundleWriter writer(Env::Default(), prefix_string);
-    OP_REQUIRES_OK(context, writer.status());
-    VLOG(1) << "BundleWriter, prefix_string: " << prefix_string;
-
+    std::vector<TensorToSave> tensors(num_tensors);
     for (int i = 0; i < num_tensors; ++i) {
-      const string& tensor_name = tensor_names_flat(i);
+      TensorToSave* to_save = &tensors[i];
+      to_save->name = tensor_names_flat(i);
       const Tensor& tensor = context->input(i + kFixedInputs);
 
       if (!shape_and_slices_flat(i).empty()) {
         const string& shape_spec = shape_and_slices_flat(i);
-        TensorShape shape;
-        TensorSlice slice(tensor.dims());
         TensorShape slice_shape;
+        to_save->is_slice = true;
+        to_save->slice = TensorSlice(tensor.dims());
 
         OP_REQUIRES_OK(context, checkpoint::ParseShapeAndSlice(
-                                    shape_spec, &shape, &slice, &slice_shape));
+                                    shape_spec, &to_save->shape,
+                                    &to_save->slice, &slice_shape));
         OP_REQUIRES(context, slice_shape.IsSameSize(tensor.shape()),
                     errors::InvalidArgument("Slice in shape_and_slice "
                                             "specification does not match the "
                                             "shape of the tensor to  save: ",
                                             shape_spec, ", tensor: ",
                                             tensor.shape().DebugString()));
+      }
+      // Later steps may update the inputs in place, so the background write
+      // saves copies of them.
+      to_save->tensor = async_ && CanDeepCopy(tensor.dtype())
+                            ? tensor::DeepCopy(tensor)
+                            : tensor;
+    }
+
+    if (!async_) {
+      OP_REQUIRES_OK(context,
+                     WriteTensors(prefix_string, writer_options_, tensors));
+      return;
+    }
+    std::shared_ptr<std::vector<TensorToSave>> snapshot =
+        std::make_shared<std::vector<TensorToSave>>(std::move(tensors));
+    const BundleWriter::Options options = writer_options_;
+    OP_REQUIRES_OK(context,
+                   AsyncCheckpointWrites::Global()->Schedule(
+                       prefix_string, {} /* inputs */, context->step_id(),
+                       [prefix_string, options, snapshot]() {
+                         return WriteTensors(prefix_string, options,
+                                             *snapshot);
+                       }));
+  }
+
+ private:
+  struct TensorToSave {
+    string name;
+    bool is_slice = false;
+    TensorShape shape;
+    TensorSlice slice;
+    Tensor tensor;
+  };
+
+  static bool CanDeepCopy(DataType dtype) {
+    return DataTypeCanUseMemcpy(dtype) || dtype == DT_STRING ||
+           dtype == DT_VARIANT;
+  }
 
-        OP_REQUIRES_OK(context,
-                       writer.AddSlice(tensor_name, shape, slice, tensor));
+  static Status WriteTensors(const string& prefix,
+                             const BundleWriter::Options& options,
+                             const std::vector<TensorToSave>& tensors) {
+    BundleWriter writer(Env::Default(), prefix, options);
+    TF_RETURN_IF_ERROR(writer.status());
+    VLOG(1) << "BundleWriter, prefix_string: " << prefix;
+    for (const TensorToSave& to_save : tensors) {
+      if (to_save.is_slice) {
+        TF_RETURN_IF_ERROR(writer.AddSlice(to_save.name, to_save.shape,
+                                           to_save.slice, to_save.tensor));
       } else {
-        OP_REQUIRES_OK(context, writer.Add(tensor_name, tensor));
+        TF_RETURN_IF_ERROR(writer.Add(to_save.name, to_save.tensor));
       }
     }
-    OP_REQUIRES_OK(context, writer.Finish());
+    return writer.Finish();
   }
+
+  BundleWriter::Options writer_options_;
+  bool async_;
 };
 REGISTER_KERNEL_BUILDER(Name("SaveV2").Device(DEVICE_CPU), SaveV2);
 
+// Saves a list of named tensors like SaveV2, except that for the resource
+// variables among them only the rows updated since they were last saved by
+// this op are saved, as deltas of the checkpoint "base_prefix".
+class SaveDeltaV2 : public OpKernel {
+ public:
+  explicit SaveDeltaV2(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, GetWriterOptions(&writer_options_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& prefix = context->input(0);
+    const Tensor& base_prefix = context->input(1);
+    const Tensor& tensor_names = context->input(2);
+    const Tensor& shape_and_slices = context->input(3);
+    OP_REQUIRES(context, TensorShapeUtils::IsScalar(base_prefix.shape()),
+                errors::InvalidArgument(
+                    "Input base_prefix should be a scalar tensor, got ",
+                    base_prefix.shape().DebugString(), " instead."));
+    ValidateInputs(false /* inputs checked below */, context, prefix,
+                   tensor_names, shape_and_slices);
+    if (!context->status().ok()) return;
+
+    const int kFixedInputs = 4;  // Prefix, base, names, shape_and_slices.
+    const int num_tensors = static_cast<int>(tensor_names.NumElements());
+    OP_REQUIRES(context, context->num_inputs() == num_tensors + kFixedInputs,
+                errors::InvalidArgument(
+                    "Got ", num_tensors, " tensor names but ",
+                    context->num_inputs() - kFixedInputs, " tensors."));
+    const string& prefix_string = prefix.scalar<string>()();
+    const string& base_prefix_string = base_prefix.scalar<string>()();
+    const auto& tensor_names_flat = tensor_names.flat<string>();
+    const auto& shape_and_slices_flat = shape_and_slices.flat<string>();
+
+    // The variables whose dirty rows have been taken, which are all marked
+    // dirty again unless the checkpoint is written.
+    std::vector<Var*> taken_vars;
+    Status s = Save(context, prefix_string, base_prefix_string,
+                    tensor_names_flat, shape_and_slices_flat, &taken_vars);
+    for (Var* var : taken_vars) {
+      if (!s.ok()) var->MarkAllRowsDirty();
+      var->Unref();
+    }
+    OP_REQUIRES_OK(context, s);
+  }
+
+ private:
+  Status Save(OpKernelContext* context, const string& prefix,
+              const string& base_prefix,
+              TTypes<string>::ConstFlat tensor_names,
+              TTypes<string>::ConstFlat shape_and_slices,
+              std::vector<Var*>* taken_vars) {
+    const int kFixedInputs = 4;
+    BundleWriter writer(Env::Default(), prefix, writer_options_);
+    TF_RETURN_IF_ERROR(writer.status());
+    VLOG(1) << "BundleWriter, prefix_string: " << prefix;
+
+    for (int i = 0; i < tensor_names.size(); ++i) {
+      const string& name = tensor_names(i);
+      const int input = i + kFixedInputs;
+      Tensor tensor = context->input(input);
+      Var* var = nullptr;
+      if (tensor.dtype() == DT_RESOURCE) {
+        TF_RETURN_IF_ERROR(
+            LookupResource(context, HandleFromInput(context, input), &var));
+        taken_vars->push_back(var);
+      }
+
+      bool is_slice = false;
+      TensorShape shape;
+      TensorSlice slice;
+      if (!shape_and_slices(i).empty()) {
+        TensorShape slice_shape;
+        is_slice = true;
+        TF_RETURN_IF_ERROR(checkpoint::ParseShapeAndSlice(
+            shape_and_slices(i), &shape, &slice, &slice_shape));
+        if (var != nullptr) {
+          tf_shared_lock l(*var->mu());
+          tensor = *var->tensor();
+        }
+        if (!slice_shape.IsSameSize(tensor.shape())) {
+          return errors::InvalidArgument(
+              "Slice in shape_and_slice specification does not match the "
+              "shape of the tensor to  save: ",
+              shape_and_slices(i), ", tensor: ", tensor.shape().DebugString());
+        }
+      }
+
+      if (var != nullptr) {
+        // Takes the dirty rows and copies them out under the lock of the
+        // variable, so that no update falls between the two.
+        Tensor indices;
+        Tensor rows;
+        bool save_delta = false;
+        {
+          mutex_lock l(*var->mu());
+          tensor = *var->tensor();
+          std::vector<int64> dirty_rows;
+          const bool all_rows_dirty = var->TakeDirtyRows(
+              tensor.dims() > 0 ? tensor.dim_size(0) : 0, &dirty_rows);
+          save_delta = !all_rows_dirty && !base_prefix.empty() &&
+                       tensor.dims() > 0 &&
+                       (DataTypeCanUseMemcpy(tensor.dtype()) ||
+                        tensor.dtype() == DT_STRING);
+          if (save_delta) {
+            indices = Tensor(DT_INT64, TensorShape({static_cast<int64>(
+                                           dirty_rows.size())}));
+            std::copy(dirty_rows.begin(), dirty_rows.end(),
+                      indices.flat<int64>().data());
+            GatherRows(tensor, dirty_rows, &rows);
+          } else {
+            // The variable may be updated in place once the lock is released.
+            tensor = tensor::DeepCopy(tensor);
+          }
+        }
+        if (save_delta) {
+          if (is_slice) {
+            TF_RETURN_IF_ERROR(writer.AddSliceDelta(name, shape, slice,
+                                                    base_prefix, indices,
+                                                    rows));
+          } else {
+            TF_RETURN_IF_ERROR(writer.AddDelta(name, tensor.shape(),
+                                               base_prefix, indices, rows));
+          }
+          continue;
+        }
+      }
+
+      if (is_slice) {
+        TF_RETURN_IF_ERROR(writer.AddSlice(name, shape, slice, tensor));
+      } else {
+        TF_RETURN_IF_ERROR(writer.Add(name, tensor));
+      }
+    }
+    return writer.Finish();
+  }
+
+  // Sets "*rows" to the "indices" rows of "tensor", whose dtype is either
+  // memcpy-able or string.
+  static void GatherRows(const Tensor& tensor,
+                         const std::vector<int64>& indices, Tensor* rows) {
+    TensorShape shape = tensor.shape();
+    shape.set_dim(0, indices.size());
+    *rows = Tensor(tensor.dtype(), shape);
+    const int64 row_size =
+        tensor.dim_size(0) == 0 ? 0 : tensor.NumElements() / tensor.dim_size(0);
+    if (tensor.dtype() == DT_STRING) {
+      const auto src = tensor.flat<string>();
+      auto dst = rows->flat<string>();
+      for (size_t i = 0; i < indices.size(); ++i) {
+        for (int64 j = 0; j < row_size; ++j) {
+          dst(i * row_size + j) = src(indices[i] * row_size + j);
+        }
+      }
+      return;
+    }
+    const int64 row_bytes = row_size * DataTypeSize(tensor.dtype());
+    const char* src = tensor.tensor_data().data();
+    char* dst = const_cast<char*>(rows->tensor_data().data());
+    for (size_t i = 0; i < indices.size(); ++i) {
+      memcpy(dst + i * row_bytes, src + indices[i] * row_bytes, row_bytes);
+    }
+  }
+
+  BundleWriter::Options writer_options_;
+};
+REGISTER_KERNEL_BUILDER(Name("SaveDeltaV2").Device(DEVICE_CPU), SaveDeltaV2);
+
 // Restores a list of named tensors from a tensor bundle (V2 checkpoint format).
 class RestoreV2 : public OpKernel {
  public:
   explicit RestoreV2(OpKernelConstruction* context) : OpKernel(context) {
     OP_REQUIRES_OK(context, context->GetAttr("dtypes", &dtypes_));
+
+    // Checkpoints with large tensors are read by up to this many threads.
+    int64 num_threads;
+    OP_REQUIRES_OK(context, ReadInt64FromEnvVar("TF_CHECKPOINT_RESTORE_THREADS",
+                                                8, &num_threads));
+    num_threads_ = static_cast<int>(num_threads);
+
+    // Tensors aligned in their data files are returned backed by read-only
+    // mappings of the files, where the file system supports it.
+    OP_REQUIRES_OK(context, ReadBoolFromEnvVar("TF_CHECKPOINT_RESTORE_MMAP",
+                                               false, &use_mmap_));
   }
 
   void Compute(OpKernelContext* context) override {
@@ -158,6 +413,8 @@ class RestoreV2 : public OpKernel {
                    shape_and_slices);
 
     const string& prefix_string = prefix.scalar<string>()();
+    OP_REQUIRES_OK(context,
+                   AsyncCheckpointWrites::Global()->Wait(prefix_string));
 
     // Intention: we plan to use the RestoreV2 op as a backward-compatible
     // reader as we upgrade to the V2 format.  This allows transparent upgrade.
@@ -180,13 +437,17 @@ class RestoreV2 : public OpKernel {
       return;
     }
     // If found, invokes the V2 reader.
-    OP_REQUIRES_OK(context, RestoreTensorsV2(context, prefix, tensor_names,
-                                             shape_and_slices, dtypes_));
+    OP_REQUIRES_OK(context,
+                   RestoreTensorsV2(context, prefix, tensor_names,
+                                    shape_and_slices, dtypes_, num_threads_,
+                                    use_mmap_));
   }
 
  private:
   // Expected dtypes of the to-restore tensors.
   std::vector<DataType> dtypes_;
+  int num_threads_;
+  bool use_mmap_;
 };
 REGISTER_KERNEL_BUILDER(Name("RestoreV2").Device(DEVICE_CPU), RestoreV2);
 
@@ -197,6 +458,10 @@ class MergeV2Checkpoints : public OpKernel {
       : OpKernel(context) {
     OP_REQUIRES_OK(context,
                    context->GetAttr("delete_old_dirs", &delete_old_dirs_));
+    // Merges in the background once the inputs have been written, when
+    // SaveV2 writes them in the background too.
+    OP_REQUIRES_OK(context, ReadBoolFromEnvVar("TF_CHECKPOINT_ASYNC_SAVE",
+                                               false, &async_));
   }
 
   void Compute(OpKernelContext* context) override {
@@ -212,14 +477,38 @@ class MergeV2Checkpoints : public OpKernel {
                     "Input destination_prefix should be a scalar tensor, got ",
                     destination_prefix.shape().DebugString(), " instead."));
 
-    const gtl::ArraySlice<string> input_prefixes =
-        gtl::ArraySlice<string>(checkpoint_prefixes.flat<string>());
-    Env* env = Env::Default();
+    const auto& input_prefixes_flat = checkpoint_prefixes.flat<string>();
+    std::vector<string> input_prefixes(
+        input_prefixes_flat.data(),
+        input_prefixes_flat.data() + input_prefixes_flat.size());
     const string& merged_prefix = destination_prefix.scalar<string>()();
-    OP_REQUIRES_OK(
-        context, tensorflow::MergeBundles(env, input_prefixes, merged_prefix));
+    if (async_) {
+      const bool delete_old_dirs = delete_old_dirs_;
+      OP_REQUIRES_OK(context,
+                     AsyncCheckpointWrites::Global()->Schedule(
+                         merged_prefix, input_prefixes, context->step_id(),
+                         [input_prefixes, merged_prefix, delete_old_dirs]() {
+                           return Merge(input_prefixes, merged_prefix,
+                                        delete_old_dirs);
+                         }));
+      return;
+    }
+    for (const string& input_prefix : input_prefixes) {
+      OP_REQUIRES_OK(context,
+                     AsyncCheckpointWrites::Global()->Wait(input_prefix));
+    }
+    OP_REQUIRES_OK(context,
+                   Merge(input_prefixes, merged_prefix, delete_old_dirs_));
+  }
 
-    if (delete_old_dirs_) {
+ private:
+  static Status Merge(const std::vector<string>& input_prefixes,
+                      const string& merged_prefix, bool delete_old_dirs) {
+    Env* env = Env::Default();
+    TF_RETURN_IF_ERROR(
+        tensorflow::MergeBundles(env, input_prefixes, merged_prefix));
+
+    if (delete_old_dirs) {
       const string& merged_dir = std::string(io::Dirname(merged_prefix));
       for (const string& input_prefix : input_prefixes) {
         const string& dirname = std::string(io::Dirname(input_prefix));
@@ -230,13 +519,34 @@ class MergeV2Checkpoints : public OpKernel {
         if (!status.ok()) VLOG(1) << status;
       }
     }
+    return Status::OK();
   }
 
- private:
   // On merge, whether or not to delete the input (temporary) directories.
   bool delete_old_dirs_;
+  bool async_;
 };
 REGISTER_KERNEL_BUILDER(Name("MergeV2Checkpoints").Device(DEVICE_CPU),
                         MergeV2Checkpoints);
 
+// Waits for the V2 checkpoint "prefix" to be written, if SaveV2 or
+// MergeV2Checkpoints write it in the background.
+class WaitForCheckpointV2 : public OpKernel {
+ public:
+  explicit WaitForCheckpointV2(OpKernelConstruction* context)
+      : OpKernel(context) {}
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& prefix = context->input(0);
+    OP_REQUIRES(context, TensorShapeUtils::IsScalar(prefix.shape()),
+                errors::InvalidArgument(
+                    "Input prefix should be a scalar tensor, got ",
+                    prefix.shape().DebugString(), " instead."));
+    OP_REQUIRES_OK(context, AsyncCheckpointWrites::Global()->Wait(
+                                prefix.scalar<string>()()));
+  }
+};
+REGISTER_KERNEL_BUILDER(Name("WaitForCheckpointV2").Device(DEVICE_CPU),
+                        WaitForCheckpointV2);
+
 }  // namespace tensorflow
@@ -14,17 +14,27 @@ limitations under the License.
 ==============================================================================*/
 
 #include <complex>
+#include <memory>
+#include <numeric>
 #include <string>
+#include <vector>
 
 #include "tensorflow/core/framework/fake_input.h"
 #include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/resource_var.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/save_restore_tensor.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/types.h"
@@ -339,5 +349,228 @@ TEST_F(SaveV2OpTest, Simple) {
   }
 }
 
+TEST_F(SaveV2OpTest, Async) {
+  setenv("TF_CHECKPOINT_ASYNC_SAVE", "1", 1 /* overwrite */);
+  TF_ASSERT_OK(NodeDefBuilder("myop", "SaveV2")
+                   .Input(FakeInput())            // prefix
+                   .Input(FakeInput())            // tensor_names
+                   .Input(FakeInput())            // shape_and_slices
+                   .Input(FakeInput({DT_FLOAT}))  // tensors
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  unsetenv("TF_CHECKPOINT_ASYNC_SAVE");
+
+  const string prefix = io::JoinPath(testing::TmpDir(), "tensor_async");
+  AddInput<string>(TensorShape({}),
+                   [&prefix](int x) -> string { return prefix; });
+  AddInput<string>(TensorShape({1}),
+                   [](int x) -> string { return "tensor_float"; });
+  AddInput<string>(TensorShape({1}), [](int x) -> string { return ""; });
+  AddInput<float>(TensorShape({8}),
+                  [](int x) -> float { return static_cast<float>(x); });
+  TF_ASSERT_OK(RunOpKernel());
+  // The checkpoint holds the values of the inputs when the op ran.
+  mutable_input(3).tensor->flat<float>().setZero();
+  TF_ASSERT_OK(AsyncCheckpointWrites::Global()->Wait(prefix));
+
+  BundleReader reader(Env::Default(), prefix);
+  TF_ASSERT_OK(reader.status());
+  Tensor val;
+  TF_ASSERT_OK(reader.Lookup("tensor_float", &val));
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(static_cast<float>(i), val.flat<float>()(i));
+  }
+}
+
+TEST_F(SaveV2OpTest, Deltas) {
+  const DataTypeVector dtypes = {DT_RESOURCE, DT_FLOAT};
+  TF_ASSERT_OK(NodeDefBuilder("myop", "SaveDeltaV2")
+                   .Input(FakeInput())        // prefix
+                   .Input(FakeInput())        // base_prefix
+                   .Input(FakeInput())        // tensor_names
+                   .Input(FakeInput())        // shape_and_slices
+                   .Input(FakeInput(dtypes))  // tensors
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+
+  const string base = io::JoinPath(testing::TmpDir(), "tensor_delta_base");
+  const string delta = io::JoinPath(testing::TmpDir(), "tensor_delta");
+  AddInput<string>(TensorShape({}), [&base](int x) -> string { return base; });
+  AddInput<string>(TensorShape({}), [](int x) -> string { return ""; });
+  AddInput<string>(TensorShape({2}), [](int x) -> string {
+    return x == 0 ? "var" : "tensor_float";
+  });
+  AddInput<string>(TensorShape({2}), [](int x) -> string { return ""; });
+  Var* var = new Var(DT_FLOAT);
+  *var->tensor() = Tensor(DT_FLOAT, TensorShape({4, 2}));
+  var->tensor()->flat<float>().setZero();
+  var->is_initialized = true;
+  var->Ref();
+  core::ScopedUnref unref_var(var);
+  AddResourceInput("", "var", var);
+  AddInput<float>(TensorShape({2}), [](int x) -> float { return 1.f; });
+  // Saves everything in full, and starts tracking the rows of "var".
+  TF_ASSERT_OK(RunOpKernel());
+
+  var->tensor()->matrix<float>()(2, 1) = 3.f;
+  var->MarkRowsDirty(gtl::ArraySlice<int64>({2}));
+  mutable_input(0).tensor->scalar<string>()() = delta;
+  mutable_input(1).tensor->scalar<string>()() = base;
+  TF_ASSERT_OK(RunOpKernel());
+
+  BundleReader reader(Env::Default(), delta);
+  TF_ASSERT_OK(reader.status());
+  TensorShape rows_shape;
+  TF_ASSERT_OK(reader.LookupTensorShape("var/.DELTA_ROWS", &rows_shape));
+  EXPECT_EQ(TensorShape({1, 2}), rows_shape);
+  Tensor val;
+  TF_ASSERT_OK(reader.Lookup("var", &val));
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(i == 5 ? 3.f : 0.f, val.flat<float>()(i));
+  }
+  TF_ASSERT_OK(reader.Lookup("tensor_float", &val));
+  EXPECT_EQ(1.f, val.flat<float>()(0));
+}
+
+TEST(VarTest, DirtyRowsMarkedConcurrently) {
+  Var* var = new Var(DT_FLOAT);
+  core::ScopedUnref unref_var(var);
+  std::vector<int64> rows;
+  // Nothing is tracked before the first call.
+  EXPECT_TRUE(var->TakeDirtyRows(1000, &rows));
+
+  // Each thread marks the rows that are multiples of its number.
+  const int kNumThreads = 8;
+  {
+    thread::ThreadPool pool(Env::Default(), "mark", kNumThreads);
+    for (int t = 1; t <= kNumThreads; ++t) {
+      pool.Schedule([var, t]() {
+        for (int32 row = 0; row < 1000; row += t) {
+          var->MarkRowsDirty(gtl::ArraySlice<int32>({row, 1000 + row}));
+        }
+      });
+    }
+  }
+  EXPECT_FALSE(var->TakeDirtyRows(1000, &rows));
+  std::vector<int64> expected(1000);
+  std::iota(expected.begin(), expected.end(), 0);
+  EXPECT_EQ(expected, rows);
+  EXPECT_FALSE(var->TakeDirtyRows(1000, &rows));
+  EXPECT_TRUE(rows.empty());
+
+  var->MarkRowsDirty(gtl::ArraySlice<int64>({63, 64, 999}));
+  EXPECT_FALSE(var->TakeDirtyRows(1000, &rows));
+  EXPECT_EQ(std::vector<int64>({63, 64, 999}), rows);
+  var->MarkAllRowsDirty();
+  EXPECT_TRUE(var->TakeDirtyRows(1000, &rows));
+  // A change of shape makes all rows dirty.
+  EXPECT_TRUE(var->TakeDirtyRows(10, &rows));
+}
+
+TEST(AsyncCheckpointWritesTest, Dependencies) {
+  AsyncCheckpointWrites writes;
+  mutex mu;
+  std::vector<string> order;
+  auto write = [&mu, &order](const string& prefix, Status status) {
+    return [&mu, &order, prefix, status]() {
+      Env::Default()->SleepForMicroseconds(1000);
+      mutex_lock l(mu);
+      order.push_back(prefix);
+      return status;
+    };
+  };
+  TF_EXPECT_OK(writes.Schedule("shard_0", {}, 1 /* step_id */,
+                               write("shard_0", Status::OK())));
+  TF_EXPECT_OK(writes.Schedule("shard_1", {}, 1 /* step_id */,
+                               write("shard_1", Status::OK())));
+  TF_EXPECT_OK(writes.Schedule("merged", {"shard_0", "shard_1"},
+                               1 /* step_id */, write("merged", Status::OK())));
+  TF_EXPECT_OK(writes.Wait("merged"));
+  {
+    mutex_lock l(mu);
+    ASSERT_EQ(3, order.size());
+    EXPECT_EQ("merged", order[2]);
+    order.clear();
+  }
+
+  // A write fails without running when one of its inputs has failed, and
+  // the failures are remembered until the prefix is written successfully.
+  TF_EXPECT_OK(
+      writes.Schedule("shard_0", {}, 2 /* step_id */,
+                      write("shard_0", errors::DataLoss("disk full"))));
+  TF_EXPECT_OK(writes.Schedule("merged", {"shard_0"}, 2 /* step_id */,
+                               write("merged", Status::OK())));
+  EXPECT_TRUE(errors::IsDataLoss(writes.Wait("merged")));
+  EXPECT_TRUE(errors::IsDataLoss(writes.Wait("shard_0")));
+  // The error has been returned by Wait(), and is not returned again.
+  TF_EXPECT_OK(writes.Schedule("shard_0", {}, 3 /* step_id */,
+                               write("shard_0", Status::OK())));
+  writes.WaitForAll();
+  TF_EXPECT_OK(writes.Wait("shard_0"));
+  mutex_lock l(mu);
+  EXPECT_EQ(std::vector<string>({"shard_0", "shard_0"}), order);
+}
+
+TEST(AsyncCheckpointWritesTest, ErrorsReturnedByNextSchedule) {
+  AsyncCheckpointWrites writes;
+  bool wrote_b = false;
+  TF_EXPECT_OK(writes.Schedule("a", {}, 1 /* step_id */,
+                               []() { return errors::DataLoss("disk full"); }));
+  Status s = writes.Schedule("b", {}, 2 /* step_id */, [&wrote_b]() {
+    wrote_b = true;
+    return Status::OK();
+  });
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+  EXPECT_TRUE(str_util::StrContains(s.error_message(), "checkpoint a")) << s;
+  writes.WaitForAll();
+  EXPECT_FALSE(wrote_b);
+  TF_EXPECT_OK(writes.Schedule("b", {}, 2 /* step_id */,
+                               []() { return Status::OK(); }));
+
+  // The error of a shard is returned once, as the error of the merge.
+  Notification merge_scheduled;
+  TF_EXPECT_OK(
+      writes.Schedule("shard", {}, 3 /* step_id */, [&merge_scheduled]() {
+        merge_scheduled.WaitForNotification();
+        return errors::DataLoss("disk full");
+      }));
+  TF_EXPECT_OK(writes.Schedule("merged", {"shard"}, 3 /* step_id */,
+                               []() { return Status::OK(); }));
+  merge_scheduled.Notify();
+  s = writes.Schedule("c", {}, 4 /* step_id */, []() { return Status::OK(); });
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+  EXPECT_TRUE(str_util::StrContains(s.error_message(), "checkpoint merged"))
+      << s;
+  TF_EXPECT_OK(writes.Schedule("c", {}, 4 /* step_id */,
+                               []() { return Status::OK(); }));
+  writes.WaitForAll();
+}
+
+TEST(AsyncCheckpointWritesTest, WritesOfOneStepPending) {
+  AsyncCheckpointWrites writes;
+  Notification unblock;
+  TF_EXPECT_OK(writes.Schedule("a", {}, 1 /* step_id */, [&unblock]() {
+    unblock.WaitForNotification();
+    return Status::OK();
+  }));
+  // Writes of the same step do not wait.
+  TF_EXPECT_OK(writes.Schedule("b", {}, 1 /* step_id */,
+                               []() { return Status::OK(); }));
+
+  Notification scheduled;
+  std::unique_ptr<Thread> thread(Env::Default()->StartThread(
+      ThreadOptions(), "schedule", [&writes, &scheduled]() {
+        TF_EXPECT_OK(writes.Schedule("c", {}, 2 /* step_id */,
+                                     []() { return Status::OK(); }));
+        scheduled.Notify();
+      }));
+  Env::Default()->SleepForMicroseconds(10000);
+  EXPECT_FALSE(scheduled.HasBeenNotified());
+  unblock.Notify();
+  scheduled.WaitForNotification();
+  thread.reset();
+  writes.WaitForAll();
+}
+
 }  // namespace
 }  // namespace tensorflow
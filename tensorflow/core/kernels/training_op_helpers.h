@@ -20,6 +20,7 @@ limitations under the License.
 #include "tensorflow/core/framework/variant_op_registry.h"
 #include "tensorflow/core/kernels/dense_update_functor.h"
 #include "tensorflow/core/kernels/variable_ops.h"
+#include "tensorflow/core/lib/gtl/inlined_vector.h"
 
 namespace tensorflow {
 
@@ -67,19 +68,60 @@ Status PrepareToUpdateVariable(OpKernelContext* ctx, Tensor* tensor) {
   return Status::OK();
 }
 
+// The resource variables that a kernel updates, as returned by
+// GetInputTensorFromVariable(), so that their updated rows are recorded for
+// incremental checkpoints once they have been written; see
+// Var::MarkRowsDirty().  Variables that are not updated sparsely have all
+// their rows recorded when this is destroyed, at the end of the kernel.
+class UpdatedVariables {
+ public:
+  UpdatedVariables() {}
+  ~UpdatedVariables() {
+    for (const auto& var_and_sparse : vars_) {
+      if (!var_and_sparse.second) var_and_sparse.first->MarkAllRowsDirty();
+      var_and_sparse.first->Unref();
+    }
+  }
+
+  // Adds a reference to "var".
+  void Add(Var* var, bool sparse) {
+    var->Ref();
+    vars_.emplace_back(var, sparse);
+  }
+
+  // Records that the rows "indices" of the variables updated sparsely have
+  // been updated.  Sparse kernels call this once they have written the rows.
+  template <typename Tindex>
+  void MarkRowsDirty(const Tensor& indices) {
+    const gtl::ArraySlice<Tindex> rows(indices.flat<Tindex>().data(),
+                                       indices.NumElements());
+    for (const auto& var_and_sparse : vars_) {
+      if (var_and_sparse.second) var_and_sparse.first->MarkRowsDirty(rows);
+    }
+  }
+
+ private:
+  gtl::InlinedVector<std::pair<Var*, bool>, 4> vars_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(UpdatedVariables);
+};
+
 // This gives you `*out`, a tensor you can update, corresponding to a
 // variable passed as input index `input`.  This handles the
 // differences between reference and resource variables.  For resource
 // variables, we ensure `*out` has a reference count of 1 (using
 // PrepareToUpdateVariable() to copy if necessary) unless
-// sparse && !lock_held, in which case it never copies.
+// sparse && !lock_held, in which case it never copies.  Resource variables
+// are added to "*updated", if not null.
 template <typename Device, typename T>
 Status GetInputTensorFromVariable(OpKernelContext* ctx, int input,
-                                  bool lock_held, bool sparse, Tensor* out) {
+                                  bool lock_held, bool sparse, Tensor* out,
+                                  UpdatedVariables* updated) {
   if (ctx->input_dtype(input) == DT_RESOURCE) {
     Var* var;
     TF_RETURN_IF_ERROR(LookupResource(ctx, HandleFromInput(ctx, input), &var));
     core::ScopedUnref unref_var(var);
+    if (updated != nullptr) updated->Add(var, sparse);
     if (lock_held) {
       TF_RETURN_IF_ERROR(
           PrepareToUpdateVariable<Device, T>(ctx, var->tensor()));
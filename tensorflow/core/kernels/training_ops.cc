@@ -430,9 +430,11 @@ class ApplyGradientDescentOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
 
     OP_REQUIRES(
         ctx, var.IsInitialized(),
@@ -471,9 +473,11 @@ class ApplyGradientDescentOp<SYCLDevice, T> : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<SYCLDevice, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
 
     OP_REQUIRES(
         ctx, var.IsInitialized(),
@@ -586,13 +590,15 @@ class ApplyAdadeltaOp : public OpKernel {
   void DoValidate(OpKernelContext* ctx) {
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var, nullptr));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &accum));
+                            ctx, 1, use_exclusive_lock_, false, &accum,
+                            nullptr));
     Tensor accum_update;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 2, use_exclusive_lock_, false, &accum_update));
+                            ctx, 2, use_exclusive_lock_, false, &accum_update,
+                            nullptr));
 
     OP_REQUIRES(
         ctx, var.IsInitialized(),
@@ -637,16 +643,20 @@ class ApplyAdadeltaOp : public OpKernel {
   }
 
   void DoCompute(OpKernelContext* ctx) {
+    UpdatedVariables updated;
     const Device& device = ctx->template eigen_device<Device>();
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &accum));
+                            ctx, 1, use_exclusive_lock_, false, &accum,
+                            &updated));
     Tensor accum_update;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 2, use_exclusive_lock_, false, &accum_update));
+                            ctx, 2, use_exclusive_lock_, false, &accum_update,
+                            &updated));
 
     const Tensor& lr = ctx->input(3);
     const Tensor& rho = ctx->input(4);
@@ -725,15 +735,18 @@ class SparseApplyAdadeltaOp : public OpKernel {
   }
 
   void DoCompute(OpKernelContext* ctx) {
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     Tensor accum_grad;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 1, use_exclusive_lock_, true, &accum_grad));
+                            ctx, 1, use_exclusive_lock_, true, &accum_grad,
+                            &updated));
     Tensor accum_update;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 2, use_exclusive_lock_, true, &accum_update));
+                            ctx, 2, use_exclusive_lock_, true, &accum_update,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -826,6 +839,7 @@ class SparseApplyAdadeltaOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -868,9 +882,11 @@ class ApplyProximalGradientDescentOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
 
     OP_REQUIRES(
         ctx, var.IsInitialized(),
@@ -937,9 +953,10 @@ class SparseApplyProximalGradientDescentOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override NO_THREAD_SAFETY_ANALYSIS {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     OP_REQUIRES(ctx, TensorShapeUtils::IsVectorOrHigher(var.shape()),
                 errors::InvalidArgument("var must be at least 1 dimensional"));
 
@@ -1046,6 +1063,7 @@ class SparseApplyProximalGradientDescentOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -1082,12 +1100,15 @@ class ApplyAdagradOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0, 1});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &accum));
+                            ctx, 1, use_exclusive_lock_, false, &accum,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -1175,12 +1196,15 @@ class ApplyProximalAdagradOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0, 1});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &accum));
+                            ctx, 1, use_exclusive_lock_, false, &accum,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -1277,12 +1301,14 @@ class SparseApplyAdagradOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override NO_THREAD_SAFETY_ANALYSIS {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0, 1});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 1, use_exclusive_lock_, true, &accum));
+                            ctx, 1, use_exclusive_lock_, true, &accum,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -1374,6 +1400,7 @@ class SparseApplyAdagradOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -1417,12 +1444,14 @@ class SparseApplyProximalAdagradOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override NO_THREAD_SAFETY_ANALYSIS {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0, 1});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 1, use_exclusive_lock_, true, &accum));
+                            ctx, 1, use_exclusive_lock_, true, &accum,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -1554,6 +1583,7 @@ class SparseApplyProximalAdagradOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -1589,17 +1619,19 @@ class ApplyAdagradDAOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor gradient_accum;
-    OP_REQUIRES_OK(
-        ctx, GetInputTensorFromVariable<Device, T>(ctx, 1, use_exclusive_lock_,
-                                                   false, &gradient_accum));
+    OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
+                            ctx, 1, use_exclusive_lock_, false, &gradient_accum,
+                            &updated));
     Tensor gradient_squared_accum;
-    OP_REQUIRES_OK(
-        ctx, GetInputTensorFromVariable<Device, T>(
-                 ctx, 2, use_exclusive_lock_, false, &gradient_squared_accum));
+    OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
+                            ctx, 2, use_exclusive_lock_, false,
+                            &gradient_squared_accum, &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -1690,17 +1722,18 @@ class SparseApplyAdagradDAOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override NO_THREAD_SAFETY_ANALYSIS {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     Tensor gradient_accum;
-    OP_REQUIRES_OK(ctx,
-                   GetInputTensorFromVariable<CPUDevice, T>(
-                       ctx, 1, use_exclusive_lock_, true, &gradient_accum));
+    OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
+                            ctx, 1, use_exclusive_lock_, true, &gradient_accum,
+                            &updated));
     Tensor gradient_squared_accum;
-    OP_REQUIRES_OK(
-        ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                 ctx, 2, use_exclusive_lock_, true, &gradient_squared_accum));
+    OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
+                            ctx, 2, use_exclusive_lock_, true,
+                            &gradient_squared_accum, &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -1850,6 +1883,7 @@ class SparseApplyAdagradDAOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -1888,16 +1922,20 @@ class ApplyFtrlOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &accum));
+                            ctx, 1, use_exclusive_lock_, false, &accum,
+                            &updated));
     Tensor linear;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 2, use_exclusive_lock_, false, &linear));
+                            ctx, 2, use_exclusive_lock_, false, &linear,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -2040,15 +2078,18 @@ class SparseApplyFtrlOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override NO_THREAD_SAFETY_ANALYSIS {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, true, &accum));
+                            ctx, 1, use_exclusive_lock_, true, &accum,
+                            &updated));
     Tensor linear;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 2, use_exclusive_lock_, true, &linear));
+                            ctx, 2, use_exclusive_lock_, true, &linear,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -2246,6 +2287,7 @@ class SparseApplyFtrlOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -2314,13 +2356,16 @@ class ApplyMomentumOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0, 1});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &accum));
+                            ctx, 1, use_exclusive_lock_, false, &accum,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -2415,13 +2460,15 @@ class SparseApplyMomentumOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override NO_THREAD_SAFETY_ANALYSIS {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0, 1});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     Tensor accum;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 1, use_exclusive_lock_, true, &accum));
+                            ctx, 1, use_exclusive_lock_, true, &accum,
+                            &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -2491,6 +2538,7 @@ class SparseApplyMomentumOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -2533,16 +2581,18 @@ class ApplyAdamOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor m;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &m));
+                            ctx, 1, use_exclusive_lock_, false, &m, &updated));
     Tensor v;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 2, use_exclusive_lock_, false, &v));
+                            ctx, 2, use_exclusive_lock_, false, &v, &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -2623,16 +2673,18 @@ class ApplyAdamOp<SYCLDevice, T> : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<SYCLDevice, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor m;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<SYCLDevice, T>(
-                            ctx, 1, use_exclusive_lock_, false, &m));
+                            ctx, 1, use_exclusive_lock_, false, &m, &updated));
     Tensor v;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<SYCLDevice, T>(
-                            ctx, 2, use_exclusive_lock_, false, &v));
+                            ctx, 2, use_exclusive_lock_, false, &v, &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -2793,16 +2845,18 @@ class ApplyAdaMaxOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor m;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &m));
+                            ctx, 1, use_exclusive_lock_, false, &m, &updated));
     Tensor v;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 2, use_exclusive_lock_, false, &v));
+                            ctx, 2, use_exclusive_lock_, false, &v, &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -2922,16 +2976,19 @@ class ApplyRMSPropOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor ms;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &ms));
+                            ctx, 1, use_exclusive_lock_, false, &ms, &updated));
     Tensor mom;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 2, use_exclusive_lock_, false, &mom));
+                            ctx, 2, use_exclusive_lock_, false, &mom,
+                            &updated));
 
     OP_REQUIRES(
         ctx, var.IsInitialized(),
@@ -3004,19 +3061,22 @@ class ApplyCenteredRMSPropOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2, 3});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor mg;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &mg));
+                            ctx, 1, use_exclusive_lock_, false, &mg, &updated));
     Tensor ms;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 2, use_exclusive_lock_, false, &ms));
+                            ctx, 2, use_exclusive_lock_, false, &ms, &updated));
     Tensor mom;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 3, use_exclusive_lock_, false, &mom));
+                            ctx, 3, use_exclusive_lock_, false, &mom,
+                            &updated));
 
     OP_REQUIRES(
         ctx, var.IsInitialized(),
@@ -3163,16 +3223,17 @@ class SparseApplyRMSPropOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override NO_THREAD_SAFETY_ANALYSIS {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     Tensor ms;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 1, use_exclusive_lock_, true, &ms));
+                            ctx, 1, use_exclusive_lock_, true, &ms, &updated));
     Tensor mom;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 2, use_exclusive_lock_, true, &mom));
+                            ctx, 2, use_exclusive_lock_, true, &mom, &updated));
 
     OP_REQUIRES(
         ctx, var.IsInitialized(),
@@ -3273,6 +3334,7 @@ class SparseApplyRMSPropOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -3292,19 +3354,20 @@ class SparseApplyCenteredRMSPropOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override NO_THREAD_SAFETY_ANALYSIS {
     auto locks = MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_,
                                                       {0, 1, 2, 3});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, true, &var));
+                            ctx, 0, use_exclusive_lock_, true, &var, &updated));
     Tensor mg;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 1, use_exclusive_lock_, true, &mg));
+                            ctx, 1, use_exclusive_lock_, true, &mg, &updated));
     Tensor ms;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 2, use_exclusive_lock_, true, &ms));
+                            ctx, 2, use_exclusive_lock_, true, &ms, &updated));
     Tensor mom;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 3, use_exclusive_lock_, true, &mom));
+                            ctx, 3, use_exclusive_lock_, true, &mom, &updated));
 
     OP_REQUIRES(
         ctx, var.IsInitialized(),
@@ -3414,6 +3477,7 @@ class SparseApplyCenteredRMSPropOp : public OpKernel {
       }
     }
 
+    updated.MarkRowsDirty<Tindex>(indices);
     MaybeForwardRefInputToRefOutput(ctx, 0, 0);
   }
 
@@ -3462,13 +3526,15 @@ class ApplyAddSignOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0, 1});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor m;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &m));
+                            ctx, 1, use_exclusive_lock_, false, &m, &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -3568,13 +3634,15 @@ class ApplyPowerSignOp : public OpKernel {
   void Compute(OpKernelContext* ctx) override {
     auto locks =
         MaybeLockVariableInputMutexesInOrder(ctx, use_exclusive_lock_, {0, 1});
+    UpdatedVariables updated;
 
     Tensor var;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 0, use_exclusive_lock_, false, &var));
+                            ctx, 0, use_exclusive_lock_, false, &var,
+                            &updated));
     Tensor m;
     OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<Device, T>(
-                            ctx, 1, use_exclusive_lock_, false, &m));
+                            ctx, 1, use_exclusive_lock_, false, &m, &updated));
     OP_REQUIRES(
         ctx, var.IsInitialized(),
         errors::FailedPrecondition(
@@ -0,0 +1,251 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/lib/io/async_record_reader.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mem.h"
+#include "tensorflow/core/platform/notification.h"
+
+namespace tensorflow {
+namespace io {
+
+namespace {
+
+constexpr size_t kHeaderSize = sizeof(uint64) + sizeof(uint32);
+constexpr size_t kFooterSize = sizeof(uint32);
+
+// Reads start at, and buffers are aligned to, multiples of this.
+constexpr size_t kReadAlignment = 4096;
+
+// Reads block their thread, so use more threads than there are cores.
+constexpr int kNumReadThreads = 32;
+
+thread::ThreadPool* ReadThreads() {
+  static thread::ThreadPool* threads = new thread::ThreadPool(
+      Env::Default(), "async_record_reads", kNumReadThreads);
+  return threads;
+}
+
+}  // namespace
+
+RecordBuffer::RecordBuffer(size_t capacity)
+    : data_(static_cast<char*>(port::AlignedMalloc(
+          std::max<size_t>(capacity, 1), kReadAlignment))),
+      capacity_(capacity) {
+  CHECK(data_ != nullptr) << "Failed to allocate " << capacity << " bytes";
+}
+
+RecordBuffer::~RecordBuffer() { port::AlignedFree(data_); }
+
+// A read of the file, which may still be in flight.
+struct AsyncRecordReader::Read {
+  uint64 offset = 0;
+  RecordBuffer* buffer = nullptr;
+  // Valid once "done" is notified.
+  size_t size = 0;
+  Status status;
+  Notification done;
+
+  ~Read() {
+    if (buffer != nullptr) buffer->Unref();
+  }
+};
+
+AsyncRecordReader::AsyncRecordReader(RandomAccessFile* file, uint64 offset,
+                                     int64 read_size, int num_reads)
+    : file_(file),
+      read_size_((std::max<int64>(read_size, 1) + kReadAlignment - 1) /
+                 kReadAlignment * kReadAlignment),
+      num_reads_(std::max(num_reads, 1)),
+      offset_(offset),
+      position_(offset) {
+  Restart(offset);
+}
+
+AsyncRecordReader::~AsyncRecordReader() {
+  for (const auto& read : reads_) {
+    read->done.WaitForNotification();
+  }
+  if (current_ != nullptr) current_->Unref();
+}
+
+void AsyncRecordReader::ScheduleReads() {
+  while (!reached_eof_ && reads_.size() < num_reads_) {
+    Read* read = new Read;
+    read->offset = next_read_offset_;
+    read->buffer = new RecordBuffer(read_size_);
+    next_read_offset_ += read_size_;
+    reads_.emplace_back(read);
+    RandomAccessFile* file = file_;
+    const size_t n = read_size_;
+    ReadThreads()->Schedule([file, read, n]() {
+      StringPiece result;
+      char* scratch = read->buffer->mutable_data();
+      read->status = file->Read(read->offset, n, &result, scratch);
+      if (result.data() != scratch) {
+        memmove(scratch, result.data(), result.size());
+      }
+      read->size = result.size();
+      // A short read is how the end of the file shows.
+      if (errors::IsOutOfRange(read->status)) read->status = Status::OK();
+      read->done.Notify();
+    });
+  }
+}
+
+void AsyncRecordReader::Restart(uint64 offset) {
+  for (const auto& read : reads_) {
+    read->done.WaitForNotification();
+  }
+  reads_.clear();
+  reached_eof_ = false;
+  next_read_offset_ = offset / kReadAlignment * kReadAlignment;
+  offset_ = offset;
+  position_ = offset;
+  ScheduleReads();
+}
+
+Status AsyncRecordReader::WaitForPosition() {
+  while (true) {
+    ScheduleReads();
+    if (reads_.empty()) return errors::OutOfRange("eof");
+    Read* read = reads_.front().get();
+    read->done.WaitForNotification();
+    TF_RETURN_IF_ERROR(read->status);
+    if (read->size < read_size_) reached_eof_ = true;
+    if (position_ < read->offset + read->size || read->size < read_size_) {
+      return Status::OK();
+    }
+    reads_.pop_front();
+  }
+}
+
+Status AsyncRecordReader::ReadBytes(size_t n, StringPiece* result,
+                                    RecordBuffer** buffer) {
+  if (n == 0) {
+    *result = StringPiece();
+    *buffer = new RecordBuffer(0);
+    return Status::OK();
+  }
+  RecordBuffer* copy = nullptr;
+  size_t copied = 0;
+  while (true) {
+    Status s = WaitForPosition();
+    const Read* read = s.ok() ? reads_.front().get() : nullptr;
+    const size_t start = s.ok() ? position_ - read->offset : 0;
+    const size_t available =
+        s.ok() && read->size > start ? read->size - start : 0;
+    if (available == 0) {
+      if (copy != nullptr) copy->Unref();
+      if (!s.ok() && !errors::IsOutOfRange(s)) return s;
+      if (copied == 0) return errors::OutOfRange("eof");
+      return errors::DataLoss("truncated record at ", offset_);
+    }
+    if (copied == 0 && available >= n) {
+      *result = StringPiece(read->buffer->data() + start, n);
+      *buffer = read->buffer;
+      (*buffer)->Ref();
+      position_ += n;
+      return Status::OK();
+    }
+    if (copy == nullptr) copy = new RecordBuffer(n);
+    const size_t k = std::min(available, n - copied);
+    memcpy(copy->mutable_data() + copied, read->buffer->data() + start, k);
+    copied += k;
+    position_ += k;
+    if (copied == n) {
+      *result = StringPiece(copy->data(), n);
+      *buffer = copy;
+      return Status::OK();
+    }
+  }
+}
+
+Status AsyncRecordReader::ParseRecord(StringPiece* record) {
+  StringPiece header;
+  RecordBuffer* header_buffer;
+  TF_RETURN_IF_ERROR(ReadBytes(kHeaderSize, &header, &header_buffer));
+  core::ScopedUnref unref_header(header_buffer);
+  if (crc32c::Unmask(core::DecodeFixed32(header.data() + sizeof(uint64))) !=
+      crc32c::Value(header.data(), sizeof(uint64))) {
+    return errors::DataLoss("corrupted record at ", offset_);
+  }
+  const uint64 length = core::DecodeFixed64(header.data());
+  if (length >= SIZE_MAX - kFooterSize) {
+    return errors::DataLoss("record size too large");
+  }
+
+  RecordBuffer* payload_buffer;
+  TF_RETURN_IF_ERROR(ReadBytes(length, record, &payload_buffer));
+  // Reading the footer may drop the read the payload lies in.
+  if (current_ != nullptr) current_->Unref();
+  current_ = payload_buffer;
+
+  StringPiece footer;
+  RecordBuffer* footer_buffer;
+  TF_RETURN_IF_ERROR(ReadBytes(kFooterSize, &footer, &footer_buffer));
+  core::ScopedUnref unref_footer(footer_buffer);
+  if (crc32c::Unmask(core::DecodeFixed32(footer.data())) !=
+      crc32c::Value(record->data(), length)) {
+    return errors::DataLoss("corrupted record at ", offset_);
+  }
+  return Status::OK();
+}
+
+Status AsyncRecordReader::ReadRecord(StringPiece* record,
+                                     RecordBuffer** buffer) {
+  Status s = ParseRecord(record);
+  if (!s.ok()) {
+    if (errors::IsOutOfRange(s) && position_ != offset_) {
+      s = errors::DataLoss("truncated record at ", offset_);
+    }
+    // Start over at the same record next time, in case the file grows.
+    Restart(offset_);
+    return s;
+  }
+  *buffer = current_;
+  offset_ = position_;
+  return Status::OK();
+}
+
+Status AsyncRecordReader::ReadRecord(string* record) {
+  StringPiece view;
+  RecordBuffer* buffer;
+  TF_RETURN_IF_ERROR(ReadRecord(&view, &buffer));
+  record->assign(view.data(), view.size());
+  return Status::OK();
+}
+
+void AsyncRecordReader::SeekOffset(uint64 offset) {
+  if (offset >= position_ && offset < next_read_offset_) {
+    offset_ = offset;
+    position_ = offset;
+  } else {
+    Restart(offset);
+  }
+}
+
+}  // namespace io
+}  // namespace tensorflow
@@ -0,0 +1,141 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LIB_IO_ASYNC_RECORD_READER_H_
+#define TENSORFLOW_LIB_IO_ASYNC_RECORD_READER_H_
+
+#include <deque>
+#include <memory>
+
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+class RandomAccessFile;
+
+namespace io {
+
+// A buffer of file contents. The records returned by
+// AsyncRecordReader::ReadRecord() point into one.
+class RecordBuffer : public core::RefCounted {
+ public:
+  explicit RecordBuffer(size_t capacity);
+
+  const char* data() const { return data_; }
+  char* mutable_data() { return data_; }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  ~RecordBuffer() override;
+
+  char* const data_;
+  const size_t capacity_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RecordBuffer);
+};
+
+// Reads uncompressed TFRecord files sequentially, keeping several large
+// reads in flight ahead of the record being parsed.
+//
+// The reads run on a pool of I/O threads shared by all readers, so that
+// parsing overlaps with I/O and the latency of the device is paid once per
+// read instead of once per record. Records are returned as views into the
+// buffers the file was read into; only records that straddle two reads are
+// copied.
+//
+// Note: this class is not thread safe; external synchronization required.
+class AsyncRecordReader {
+ public:
+  // Reads "*file", which must outlive this, starting at "offset". Each read
+  // is "read_size" bytes, rounded up to a multiple of the page size, and up
+  // to "num_reads" reads are in flight at a time.
+  AsyncRecordReader(RandomAccessFile* file, uint64 offset, int64 read_size,
+                    int num_reads);
+
+  // Waits for the reads in flight.
+  ~AsyncRecordReader();
+
+  // Reads the next record. On success "*record" points into "*buffer",
+  // which stays valid until the next call to ReadRecord() or SeekOffset(),
+  // or for as long as the caller holds a reference to it. Returns
+  // OUT_OF_RANGE for end of file, or something else for an error; like
+  // RecordReader, a failed read may be retried.
+  Status ReadRecord(StringPiece* record, RecordBuffer** buffer);
+
+  // Like above, but copies the record into "*record".
+  Status ReadRecord(string* record);
+
+  // Returns the offset of the next record.
+  uint64 TellOffset() const { return offset_; }
+
+  // Continues reading at "offset", which must be the offset of a record.
+  // Reads in flight are reused if "offset" lies ahead of the current
+  // offset, and close enough.
+  void SeekOffset(uint64 offset);
+
+ private:
+  struct Read;
+
+  // Schedules reads until "num_reads_" are in flight.
+  void ScheduleReads();
+
+  // Waits for the reads in flight and drops them, then restarts reading at
+  // "offset".
+  void Restart(uint64 offset);
+
+  // Makes reads_.front() the read containing "position_", or the last read
+  // of the file if "position_" is at or past its end, and waits for it.
+  Status WaitForPosition();
+
+  // Reads the next "n" bytes. "*result" points into "*buffer", which is the
+  // buffer of a read if the bytes are contiguous there, or a new buffer
+  // holding a copy otherwise. The caller owns a reference to "*buffer".
+  // Returns OUT_OF_RANGE if no byte is left, or DATA_LOSS if fewer than "n"
+  // bytes are.
+  Status ReadBytes(size_t n, StringPiece* result, RecordBuffer** buffer);
+
+  // Reads the record at "offset_" into "*record", which points into
+  // "current_", and advances "position_" past it.
+  Status ParseRecord(StringPiece* record);
+
+  RandomAccessFile* const file_;  // Not owned.
+  const size_t read_size_;
+  const int num_reads_;
+
+  // Reads in order of file offset. The front one contains "position_".
+  std::deque<std::unique_ptr<Read>> reads_;
+  // The offset of the next read to schedule.
+  uint64 next_read_offset_ = 0;
+  // True once a read has come back short, so later reads would be empty.
+  bool reached_eof_ = false;
+
+  // The offset of the next record, and of the next byte to parse.
+  uint64 offset_;
+  uint64 position_;
+
+  // The buffer the last record returned points into.
+  RecordBuffer* current_ = nullptr;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(AsyncRecordReader);
+};
+
+}  // namespace io
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_LIB_IO_ASYNC_RECORD_READER_H_
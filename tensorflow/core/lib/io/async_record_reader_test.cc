@@ -0,0 +1,227 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/lib/io/async_record_reader.h"
+
+#include <vector>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace io {
+namespace {
+
+class StringDest : public WritableFile {
+ public:
+  explicit StringDest(string* contents) : contents_(contents) {}
+
+  Status Close() override { return Status::OK(); }
+  Status Flush() override { return Status::OK(); }
+  Status Sync() override { return Status::OK(); }
+  Status Append(const StringPiece& slice) override {
+    contents_->append(slice.data(), slice.size());
+    return Status::OK();
+  }
+
+ private:
+  string* contents_;
+};
+
+// Returns views into the string instead of filling "scratch", like files
+// backed by memory do.
+class StringSource : public RandomAccessFile {
+ public:
+  explicit StringSource(const string* contents) : contents_(contents) {}
+
+  Status Read(uint64 offset, size_t n, StringPiece* result,
+              char* scratch) const override {
+    if (offset >= contents_->size()) {
+      *result = StringPiece();
+      return errors::OutOfRange("end of file");
+    }
+    n = std::min<size_t>(n, contents_->size() - offset);
+    *result = StringPiece(contents_->data() + offset, n);
+    return Status::OK();
+  }
+
+ private:
+  const string* contents_;
+};
+
+// Writes records of random sizes, some of them much larger than the reads
+// of the readers below, into "*contents".
+std::vector<string> WriteRecords(int num_records, string* contents) {
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  std::vector<string> records;
+  StringDest dest(contents);
+  RecordWriter writer(&dest);
+  for (int i = 0; i < num_records; ++i) {
+    string record(rnd.Skewed(15), 'a' + i % 26);
+    TF_CHECK_OK(writer.WriteRecord(record));
+    records.push_back(std::move(record));
+  }
+  TF_CHECK_OK(writer.Flush());
+  return records;
+}
+
+TEST(AsyncRecordReaderTest, ReadsAllRecords) {
+  string contents;
+  const std::vector<string> records = WriteRecords(500, &contents);
+  for (int num_reads : {1, 2, 8}) {
+    StringSource source(&contents);
+    AsyncRecordReader reader(&source, 0, 4096, num_reads);
+    string record;
+    for (const string& expected : records) {
+      TF_ASSERT_OK(reader.ReadRecord(&record));
+      EXPECT_EQ(expected, record);
+    }
+    EXPECT_EQ(contents.size(), reader.TellOffset());
+    EXPECT_TRUE(errors::IsOutOfRange(reader.ReadRecord(&record)));
+    // The end of the file is sticky.
+    EXPECT_TRUE(errors::IsOutOfRange(reader.ReadRecord(&record)));
+  }
+}
+
+TEST(AsyncRecordReaderTest, ViewsOutliveLaterReads) {
+  string contents;
+  const std::vector<string> records = WriteRecords(100, &contents);
+  StringSource source(&contents);
+  AsyncRecordReader reader(&source, 0, 4096, 2);
+  StringPiece first;
+  RecordBuffer* buffer;
+  TF_ASSERT_OK(reader.ReadRecord(&first, &buffer));
+  buffer->Ref();
+  string record;
+  for (int i = 1; i < records.size(); ++i) {
+    TF_ASSERT_OK(reader.ReadRecord(&record));
+  }
+  EXPECT_EQ(records[0], first);
+  buffer->Unref();
+}
+
+TEST(AsyncRecordReaderTest, SeekOffset) {
+  string contents;
+  const std::vector<string> records = WriteRecords(200, &contents);
+  std::vector<uint64> offsets;
+  {
+    StringSource source(&contents);
+    AsyncRecordReader reader(&source, 0, 4096, 4);
+    string record;
+    for (int i = 0; i < records.size(); ++i) {
+      offsets.push_back(reader.TellOffset());
+      TF_ASSERT_OK(reader.ReadRecord(&record));
+    }
+  }
+  StringSource source(&contents);
+  AsyncRecordReader reader(&source, offsets[10], 4096, 4);
+  string record;
+  TF_ASSERT_OK(reader.ReadRecord(&record));
+  EXPECT_EQ(records[10], record);
+  // Skip a few records, and then many.
+  for (int i : {12, 13, 150, 20, 199}) {
+    reader.SeekOffset(offsets[i]);
+    TF_ASSERT_OK(reader.ReadRecord(&record));
+    EXPECT_EQ(records[i], record);
+  }
+}
+
+TEST(AsyncRecordReaderTest, DetectsCorruption) {
+  string contents;
+  WriteRecords(50, &contents);
+  contents[contents.size() / 2] ^= 0x1;
+  StringSource source(&contents);
+  AsyncRecordReader reader(&source, 0, 4096, 2);
+  string record;
+  Status s = reader.ReadRecord(&record);
+  while (s.ok()) {
+    s = reader.ReadRecord(&record);
+  }
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+}
+
+TEST(AsyncRecordReaderTest, DetectsTruncation) {
+  string contents;
+  const std::vector<string> records = WriteRecords(50, &contents);
+  contents.resize(contents.size() - 1);
+  StringSource source(&contents);
+  AsyncRecordReader reader(&source, 0, 4096, 2);
+  string record;
+  for (int i = 0; i + 1 < records.size(); ++i) {
+    TF_ASSERT_OK(reader.ReadRecord(&record));
+  }
+  const uint64 last_offset = reader.TellOffset();
+  Status s = reader.ReadRecord(&record);
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+  // A failed read is retried at the same record.
+  EXPECT_EQ(last_offset, reader.TellOffset());
+}
+
+TEST(AsyncRecordReaderTest, SequentialRecordReader) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/async_record_reader_test";
+  string contents;
+  const std::vector<string> records = WriteRecords(300, &contents);
+  TF_ASSERT_OK(WriteStringToFile(env, fname, contents));
+
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+  RecordReaderOptions options;
+  options.async_reads = 4;
+  options.async_read_size = 8192;
+  SequentialRecordReader reader(file.get(), options);
+  string record;
+  for (const string& expected : records) {
+    TF_ASSERT_OK(reader.ReadRecord(&record));
+    EXPECT_EQ(expected, record);
+  }
+  EXPECT_TRUE(errors::IsOutOfRange(reader.ReadRecord(&record)));
+}
+
+TEST(AsyncRecordReaderTest, SequentialRecordReaderViews) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/async_record_reader_views_test";
+  string contents;
+  const std::vector<string> records = WriteRecords(300, &contents);
+  TF_ASSERT_OK(WriteStringToFile(env, fname, contents));
+
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+  for (int async_reads : {0, 4}) {
+    RecordReaderOptions options;
+    options.async_reads = async_reads;
+    options.async_read_size = 8192;
+    SequentialRecordReader reader(file.get(), options);
+    StringPiece record;
+    string storage;
+    for (const string& expected : records) {
+      TF_ASSERT_OK(reader.ReadRecord(&record, &storage));
+      EXPECT_EQ(expected, record);
+      // Only the synchronous reader copies records.
+      EXPECT_EQ(async_reads == 0, record.data() == storage.data());
+    }
+    EXPECT_TRUE(errors::IsOutOfRange(reader.ReadRecord(&record, &storage)));
+  }
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace tensorflow
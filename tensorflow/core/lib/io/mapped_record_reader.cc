@@ -0,0 +1,195 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/lib/io/mapped_record_reader.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+
+namespace tensorflow {
+namespace io {
+
+namespace {
+
+constexpr uint64 kHeaderSize = sizeof(uint64) + sizeof(uint32);
+constexpr uint64 kFooterSize = sizeof(uint32);
+
+// Ranges scanned in parallel by BuildIndex() are at least this large.
+constexpr uint64 kMinRangeSize = 4 << 20;
+
+}  // namespace
+
+// A range of the file scanned by one thread in BuildIndex().
+struct MappedRecordReader::Range {
+  uint64 begin = 0;
+  uint64 end = 0;
+  // The offsets of the records found starting in [begin, end).
+  std::vector<uint64> offsets;
+  // The offset where the scan stopped: the end of the last record found,
+  // or the offset of the first invalid one.
+  uint64 next = 0;
+};
+
+Status MappedRecordReader::Open(Env* env, const string& fname,
+                                bool verify_checksums,
+                                std::unique_ptr<MappedRecordReader>* result) {
+  uint64 file_size;
+  TF_RETURN_IF_ERROR(env->GetFileSize(fname, &file_size));
+  std::unique_ptr<ReadOnlyMemoryRegion> region;
+  // Empty files cannot be mapped.
+  if (file_size > 0) {
+    TF_RETURN_IF_ERROR(env->NewReadOnlyMemoryRegionFromFile(fname, &region));
+  }
+  result->reset(new MappedRecordReader(std::move(region), verify_checksums));
+  return Status::OK();
+}
+
+MappedRecordReader::MappedRecordReader(
+    std::unique_ptr<ReadOnlyMemoryRegion> region, bool verify_checksums)
+    : region_(std::move(region)), verify_checksums_(verify_checksums) {
+  if (region_ != nullptr) {
+    data_ = static_cast<const char*>(region_->data());
+    size_ = region_->length();
+  }
+}
+
+Status MappedRecordReader::ReadRecord(uint64* offset,
+                                      StringPiece* record) const {
+  if (*offset >= size_) {
+    return errors::OutOfRange("eof");
+  }
+  if (size_ - *offset < kHeaderSize) {
+    return errors::DataLoss("truncated record at ", *offset);
+  }
+  const char* header = data_ + *offset;
+  if (crc32c::Unmask(core::DecodeFixed32(header + sizeof(uint64))) !=
+      crc32c::Value(header, sizeof(uint64))) {
+    return errors::DataLoss("corrupted record at ", *offset);
+  }
+  const uint64 length = core::DecodeFixed64(header);
+  const uint64 remaining = size_ - *offset - kHeaderSize;
+  if (remaining < kFooterSize || length > remaining - kFooterSize) {
+    return errors::DataLoss("truncated record at ", *offset);
+  }
+  const char* payload = header + kHeaderSize;
+  if (verify_checksums_ &&
+      crc32c::Unmask(core::DecodeFixed32(payload + length)) !=
+          crc32c::Value(payload, length)) {
+    return errors::DataLoss("corrupted record at ", *offset);
+  }
+  *record = StringPiece(payload, length);
+  *offset += kHeaderSize + length + kFooterSize;
+  return Status::OK();
+}
+
+bool MappedRecordReader::IsRecordStart(uint64 offset) const {
+  if (size_ - offset < kHeaderSize + kFooterSize) return false;
+  const char* header = data_ + offset;
+  if (crc32c::Unmask(core::DecodeFixed32(header + sizeof(uint64))) !=
+      crc32c::Value(header, sizeof(uint64))) {
+    return false;
+  }
+  return core::DecodeFixed64(header) <=
+         size_ - offset - kHeaderSize - kFooterSize;
+}
+
+void MappedRecordReader::ScanRange(Range* range) const {
+  uint64 offset = range->begin;
+  if (range->begin > 0) {
+    while (offset < range->end && !IsRecordStart(offset)) ++offset;
+  }
+  StringPiece record;
+  while (offset < range->end) {
+    const uint64 start = offset;
+    if (!ReadRecord(&offset, &record).ok()) {
+      offset = start;
+      break;
+    }
+    range->offsets.push_back(start);
+  }
+  range->next = offset;
+}
+
+Status MappedRecordReader::BuildIndex(thread::ThreadPool* threads) {
+  record_offsets_.clear();
+  const int num_ranges =
+      threads == nullptr
+          ? 1
+          : static_cast<int>(std::max<uint64>(
+                1, std::min<uint64>(threads->NumThreads(),
+                                    size_ / kMinRangeSize)));
+  std::vector<Range> ranges(num_ranges);
+  const uint64 range_size = (size_ + num_ranges - 1) / num_ranges;
+  for (int i = 0; i < num_ranges; ++i) {
+    ranges[i].begin = std::min(size_, i * range_size);
+    ranges[i].end = std::min(size_, (i + 1) * range_size);
+  }
+  if (num_ranges == 1) {
+    ScanRange(&ranges[0]);
+  } else {
+    BlockingCounter counter(num_ranges - 1);
+    for (int i = 1; i < num_ranges; ++i) {
+      Range* range = &ranges[i];
+      threads->Schedule([this, range, &counter]() {
+        ScanRange(range);
+        counter.DecrementCount();
+      });
+    }
+    ScanRange(&ranges[0]);
+    counter.Wait();
+  }
+
+  // Stitch the ranges together. The records that a range found from the
+  // first record at or after the true end of the previous range are the
+  // same a sequential scan would find, since each record determines where
+  // the next one starts.
+  std::vector<uint64> offsets;
+  uint64 offset = 0;
+  StringPiece record;
+  for (const Range& range : ranges) {
+    if (offset >= range.end) continue;
+    auto it =
+        std::lower_bound(range.offsets.begin(), range.offsets.end(), offset);
+    if (it != range.offsets.end() && *it == offset) {
+      offsets.insert(offsets.end(), it, range.offsets.end());
+      offset = range.next;
+    }
+    // Rescan what the range's scan got wrong, or could not read.
+    while (offset < range.end) {
+      const uint64 start = offset;
+      TF_RETURN_IF_ERROR(ReadRecord(&offset, &record));
+      offsets.push_back(start);
+    }
+  }
+  record_offsets_ = std::move(offsets);
+  return Status::OK();
+}
+
+Status MappedRecordReader::ReadRecordAt(int64 index,
+                                        StringPiece* record) const {
+  if (index < 0 || index >= num_records()) {
+    return errors::OutOfRange("record index ", index, " is out of range [0, ",
+                              num_records(), ")");
+  }
+  uint64 offset = record_offsets_[index];
+  return ReadRecord(&offset, record);
+}
+
+}  // namespace io
+}  // namespace tensorflow
@@ -0,0 +1,100 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LIB_IO_MAPPED_RECORD_READER_H_
+#define TENSORFLOW_LIB_IO_MAPPED_RECORD_READER_H_
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace io {
+
+// Reads uncompressed TFRecord files in place through a memory mapping.
+//
+// Records are returned as views into the mapping, so reading them takes
+// neither read system calls nor copies. The checksum of each record header
+// is always verified; that of each record is verified only if requested.
+//
+// After BuildIndex(), records can also be read in any order by index.
+//
+// ReadRecord() and ReadRecordAt() are thread safe; BuildIndex() is not.
+class MappedRecordReader {
+ public:
+  // Maps "fname". Returns UNIMPLEMENTED if the file system of "fname" does
+  // not support memory mapping.
+  static Status Open(Env* env, const string& fname, bool verify_checksums,
+                     std::unique_ptr<MappedRecordReader>* result);
+
+  // Reads the records in "region", which may be null if the file is empty.
+  MappedRecordReader(std::unique_ptr<ReadOnlyMemoryRegion> region,
+                     bool verify_checksums);
+
+  // Reads the record at "*offset" into "*record" and updates "*offset" to
+  // point to the offset of the next record. "*record" stays valid as long as
+  // this. Returns OK on success, OUT_OF_RANGE for end of file, or something
+  // else for an error.
+  Status ReadRecord(uint64* offset, StringPiece* record) const;
+
+  // Finds the offsets of all records. If "threads" is not null, the file is
+  // split into ranges that are scanned in parallel: a scan that does not
+  // start at the beginning of the file looks for the first offset in its
+  // range that holds a valid record header, and follows the records from
+  // there. Ranges whose scan started at the wrong offset are rescanned
+  // sequentially, so the result is always the same as that of a sequential
+  // scan.
+  Status BuildIndex(thread::ThreadPool* threads);
+
+  // The number of records, and the offset of record "index". Only valid
+  // after a successful BuildIndex().
+  int64 num_records() const { return record_offsets_.size(); }
+  const std::vector<uint64>& record_offsets() const { return record_offsets_; }
+
+  // Reads record "index" into "*record". Requires BuildIndex().
+  Status ReadRecordAt(int64 index, StringPiece* record) const;
+
+  uint64 file_size() const { return size_; }
+
+ private:
+  struct Range;
+
+  // Returns true iff a record whose header passes its checksum, and which
+  // fits in the file, starts at "offset".
+  bool IsRecordStart(uint64 offset) const;
+
+  // Follows the records of "range" from its first record start.
+  void ScanRange(Range* range) const;
+
+  std::unique_ptr<ReadOnlyMemoryRegion> region_;
+  const char* data_ = nullptr;
+  uint64 size_ = 0;
+  const bool verify_checksums_;
+  std::vector<uint64> record_offsets_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(MappedRecordReader);
+};
+
+}  // namespace io
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_LIB_IO_MAPPED_RECORD_READER_H_
@@ -0,0 +1,169 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/lib/io/mapped_record_reader.h"
+
+#include <vector>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace io {
+namespace {
+
+class StringDest : public WritableFile {
+ public:
+  explicit StringDest(string* contents) : contents_(contents) {}
+
+  Status Close() override { return Status::OK(); }
+  Status Flush() override { return Status::OK(); }
+  Status Sync() override { return Status::OK(); }
+  Status Append(const StringPiece& slice) override {
+    contents_->append(slice.data(), slice.size());
+    return Status::OK();
+  }
+
+ private:
+  string* contents_;
+};
+
+class StringRegion : public ReadOnlyMemoryRegion {
+ public:
+  explicit StringRegion(const string* contents) : contents_(contents) {}
+  const void* data() override { return contents_->data(); }
+  uint64 length() override { return contents_->size(); }
+
+ private:
+  const string* contents_;
+};
+
+string WriteRecords(const std::vector<string>& records) {
+  string contents;
+  StringDest dest(&contents);
+  RecordWriter writer(&dest);
+  for (const string& record : records) {
+    TF_CHECK_OK(writer.WriteRecord(record));
+  }
+  TF_CHECK_OK(writer.Flush());
+  return contents;
+}
+
+std::unique_ptr<MappedRecordReader> NewReader(const string* contents,
+                                              bool verify_checksums) {
+  return std::unique_ptr<MappedRecordReader>(new MappedRecordReader(
+      std::unique_ptr<ReadOnlyMemoryRegion>(new StringRegion(contents)),
+      verify_checksums));
+}
+
+TEST(MappedRecordReaderTest, ReadsFile) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/mapped_record_reader_test";
+  const std::vector<string> records = {"abc", "", "defg"};
+  TF_ASSERT_OK(WriteStringToFile(env, fname, WriteRecords(records)));
+
+  std::unique_ptr<MappedRecordReader> reader;
+  TF_ASSERT_OK(MappedRecordReader::Open(env, fname, true, &reader));
+  uint64 offset = 0;
+  StringPiece record;
+  for (const string& expected : records) {
+    TF_ASSERT_OK(reader->ReadRecord(&offset, &record));
+    EXPECT_EQ(expected, record);
+  }
+  EXPECT_EQ(reader->file_size(), offset);
+  EXPECT_TRUE(errors::IsOutOfRange(reader->ReadRecord(&offset, &record)));
+}
+
+TEST(MappedRecordReaderTest, EmptyFile) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/mapped_record_reader_empty";
+  TF_ASSERT_OK(WriteStringToFile(env, fname, ""));
+  std::unique_ptr<MappedRecordReader> reader;
+  TF_ASSERT_OK(MappedRecordReader::Open(env, fname, true, &reader));
+  uint64 offset = 0;
+  StringPiece record;
+  EXPECT_TRUE(errors::IsOutOfRange(reader->ReadRecord(&offset, &record)));
+  TF_ASSERT_OK(reader->BuildIndex(nullptr));
+  EXPECT_EQ(0, reader->num_records());
+}
+
+TEST(MappedRecordReaderTest, VerifiesChecksumsIfAsked) {
+  string contents = WriteRecords({"abcdef"});
+  // Corrupt the record, but not its header.
+  contents[14] ^= 0x1;
+  StringPiece record;
+  uint64 offset = 0;
+  EXPECT_TRUE(errors::IsDataLoss(
+      NewReader(&contents, true)->ReadRecord(&offset, &record)));
+  offset = 0;
+  TF_EXPECT_OK(NewReader(&contents, false)->ReadRecord(&offset, &record));
+  // A corrupted header is always detected.
+  contents[1] ^= 0x1;
+  offset = 0;
+  EXPECT_TRUE(errors::IsDataLoss(
+      NewReader(&contents, false)->ReadRecord(&offset, &record)));
+}
+
+TEST(MappedRecordReaderTest, DetectsTruncation) {
+  string contents = WriteRecords({"abc", "defg"});
+  contents.resize(contents.size() - 1);
+  std::unique_ptr<MappedRecordReader> reader = NewReader(&contents, false);
+  uint64 offset = 0;
+  StringPiece record;
+  TF_ASSERT_OK(reader->ReadRecord(&offset, &record));
+  EXPECT_TRUE(errors::IsDataLoss(reader->ReadRecord(&offset, &record)));
+  EXPECT_TRUE(errors::IsDataLoss(reader->BuildIndex(nullptr)));
+}
+
+TEST(MappedRecordReaderTest, ParallelIndexMatchesSequentialScan) {
+  // Records that contain records themselves make scans that start in the
+  // middle of the file go astray.
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  std::vector<string> records;
+  for (int i = 0; i < 40; ++i) {
+    std::vector<string> nested;
+    for (int j = 0; j < 100; ++j) {
+      nested.push_back(string(rnd.Uniform(6000), 'a' + j % 26));
+    }
+    records.push_back(WriteRecords(nested));
+  }
+  const string contents = WriteRecords(records);
+  ASSERT_GT(contents.size(), 8 << 20);
+
+  std::unique_ptr<MappedRecordReader> sequential = NewReader(&contents, true);
+  TF_ASSERT_OK(sequential->BuildIndex(nullptr));
+  ASSERT_EQ(records.size(), sequential->num_records());
+
+  thread::ThreadPool threads(Env::Default(), "test", 8);
+  std::unique_ptr<MappedRecordReader> parallel = NewReader(&contents, true);
+  TF_ASSERT_OK(parallel->BuildIndex(&threads));
+  EXPECT_EQ(sequential->record_offsets(), parallel->record_offsets());
+
+  StringPiece record;
+  for (int i : {39, 0, 17}) {
+    TF_ASSERT_OK(parallel->ReadRecordAt(i, &record));
+    EXPECT_EQ(records[i], record);
+  }
+  EXPECT_TRUE(errors::IsOutOfRange(parallel->ReadRecordAt(40, &record)));
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace tensorflow
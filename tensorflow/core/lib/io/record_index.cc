@@ -0,0 +1,171 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/lib/io/record_index.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/lib/io/inputbuffer.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+
+namespace tensorflow {
+namespace io {
+
+namespace {
+
+constexpr uint32 kRecordIndexMagic = 0x78646972;  // "ridx"
+constexpr size_t kEntrySize = 2 * sizeof(uint64);
+constexpr size_t kFooterSize = 2 * sizeof(uint64) + 2 * sizeof(uint32);
+// The read size of BuildForFile(), which reads the headers of records smaller
+// than this with few reads.
+constexpr size_t kBuildBufferSize = 256 << 10;
+
+}  // namespace
+
+string RecordIndexFilename(const string& fname) {
+  return strings::StrCat(fname, ".index");
+}
+
+RecordIndexWriter::RecordIndexWriter(WritableFile* dest) : dest_(dest) {}
+
+Status RecordIndexWriter::AddRecord(uint64 offset, uint64 length) {
+  char entry[kEntrySize];
+  core::EncodeFixed64(entry, offset);
+  core::EncodeFixed64(entry + sizeof(uint64), length);
+  crc_ = crc32c::Extend(crc_, entry, kEntrySize);
+  ++num_records_;
+  return dest_->Append(StringPiece(entry, kEntrySize));
+}
+
+Status RecordIndexWriter::Finish(uint64 file_size) {
+  char footer[kFooterSize];
+  core::EncodeFixed64(footer, num_records_);
+  core::EncodeFixed64(footer + sizeof(uint64), file_size);
+  const uint32 crc = crc32c::Extend(crc_, footer, 2 * sizeof(uint64));
+  core::EncodeFixed32(footer + 2 * sizeof(uint64), crc32c::Mask(crc));
+  core::EncodeFixed32(footer + 2 * sizeof(uint64) + sizeof(uint32),
+                      kRecordIndexMagic);
+  return dest_->Append(StringPiece(footer, kFooterSize));
+}
+
+Status RecordIndex::Parse(StringPiece data,
+                          std::unique_ptr<RecordIndex>* index) {
+  if (data.size() < kFooterSize) {
+    return errors::DataLoss("record index too short");
+  }
+  const char* footer = data.data() + data.size() - kFooterSize;
+  if (core::DecodeFixed32(footer + 2 * sizeof(uint64) + sizeof(uint32)) !=
+      kRecordIndexMagic) {
+    return errors::DataLoss("not a record index");
+  }
+  const uint64 num_records = core::DecodeFixed64(footer);
+  if (num_records != (data.size() - kFooterSize) / kEntrySize ||
+      (data.size() - kFooterSize) % kEntrySize != 0) {
+    return errors::DataLoss("truncated record index");
+  }
+  const uint32 crc = crc32c::Value(data.data(), data.size() - 2 *
+                                                    sizeof(uint32));
+  if (crc32c::Unmask(core::DecodeFixed32(footer + 2 * sizeof(uint64))) !=
+      crc) {
+    return errors::DataLoss("corrupted record index");
+  }
+
+  index->reset(new RecordIndex);
+  RecordIndex* result = index->get();
+  result->offsets_.resize(num_records);
+  result->lengths_.resize(num_records);
+  for (uint64 i = 0; i < num_records; ++i) {
+    const char* entry = data.data() + i * kEntrySize;
+    result->offsets_[i] = core::DecodeFixed64(entry);
+    result->lengths_[i] = core::DecodeFixed64(entry + sizeof(uint64));
+  }
+  result->file_size_ = core::DecodeFixed64(footer + sizeof(uint64));
+  return Status::OK();
+}
+
+Status RecordIndex::ReadForFile(Env* env, const string& fname,
+                                std::unique_ptr<RecordIndex>* index) {
+  const string index_fname = RecordIndexFilename(fname);
+  TF_RETURN_IF_ERROR(env->FileExists(index_fname));
+  string data;
+  TF_RETURN_IF_ERROR(ReadFileToString(env, index_fname, &data));
+  TF_RETURN_IF_ERROR(Parse(data, index));
+  uint64 file_size;
+  TF_RETURN_IF_ERROR(env->GetFileSize(fname, &file_size));
+  if (file_size != (*index)->file_size()) {
+    const uint64 indexed_size = (*index)->file_size();
+    index->reset();
+    return errors::FailedPrecondition("The index ", index_fname, " is for ",
+                                      indexed_size, " bytes, but ", fname,
+                                      " has ", file_size);
+  }
+  return Status::OK();
+}
+
+Status RecordIndex::BuildForFile(Env* env, const string& fname,
+                                 std::unique_ptr<RecordIndex>* index) {
+  static const size_t kRecordHeaderSize = sizeof(uint64) + sizeof(uint32);
+  static const size_t kRecordFooterSize = sizeof(uint32);
+
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env->NewRandomAccessFile(fname, &file));
+  uint64 file_size;
+  TF_RETURN_IF_ERROR(env->GetFileSize(fname, &file_size));
+
+  std::unique_ptr<RecordIndex> result(new RecordIndex);
+  result->file_size_ = file_size;
+  // Small records are read sequentially through the buffer, and the data of
+  // large records is skipped by seeking past the buffer.
+  InputBuffer input(file.get(), kBuildBufferSize);
+  char header[kRecordHeaderSize];
+  uint64 offset = 0;
+  while (offset < file_size) {
+    TF_RETURN_IF_ERROR(input.Seek(offset));
+    size_t bytes_read;
+    Status s = input.ReadNBytes(kRecordHeaderSize, header, &bytes_read);
+    if (!s.ok() && !errors::IsOutOfRange(s)) return s;
+    if (bytes_read != kRecordHeaderSize) {
+      return errors::DataLoss("truncated record at ", offset, " of ", fname);
+    }
+    const uint32 masked_crc = core::DecodeFixed32(header + sizeof(uint64));
+    if (crc32c::Unmask(masked_crc) != crc32c::Value(header, sizeof(uint64))) {
+      return errors::DataLoss("corrupted record at ", offset, " of ", fname);
+    }
+    const uint64 length = core::DecodeFixed64(header);
+    const uint64 remaining = file_size - offset;
+    if (remaining - kRecordHeaderSize < kRecordFooterSize ||
+        remaining - kRecordHeaderSize - kRecordFooterSize < length) {
+      return errors::DataLoss("truncated record at ", offset, " of ", fname);
+    }
+    result->offsets_.push_back(offset);
+    result->lengths_.push_back(length);
+    offset += kRecordHeaderSize + length + kRecordFooterSize;
+  }
+  *index = std::move(result);
+  return Status::OK();
+}
+
+int64 RecordIndex::Find(uint64 offset) const {
+  if (offset == file_size_) return num_records();
+  auto it = std::lower_bound(offsets_.begin(), offsets_.end(), offset);
+  if (it == offsets_.end() || *it != offset) return -1;
+  return it - offsets_.begin();
+}
+
+}  // namespace io
+}  // namespace tensorflow
@@ -0,0 +1,112 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LIB_IO_RECORD_INDEX_H_
+#define TENSORFLOW_LIB_IO_RECORD_INDEX_H_
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace io {
+
+// An index of an uncompressed TFRecord file lists the offset and length of
+// every record, so that records can be found without reading the ones
+// before them. It is stored next to the file, as
+//
+//   entries: for each record
+//     uint64    offset of the record
+//     uint64    length of the record data
+//   footer:
+//     uint64    number of records
+//     uint64    size of the indexed file
+//     uint32    masked crc of the entries and the two fields above
+//     uint32    kRecordIndexMagic
+//
+// The size of the indexed file is used to detect stale indices.
+
+// Returns the name of the index of TFRecord file "fname".
+string RecordIndexFilename(const string& fname);
+
+// Writes an index. RecordWriter uses one when given an index file.
+class RecordIndexWriter {
+ public:
+  // Appends the index to "*dest", which must be initially empty and remain
+  // live while this is in use.
+  explicit RecordIndexWriter(WritableFile* dest);
+
+  // Adds the record at "offset" with "length" bytes of data.
+  Status AddRecord(uint64 offset, uint64 length);
+
+  // Writes the footer. "file_size" is the size of the indexed file. Does
+  // *not* close the WritableFile.
+  Status Finish(uint64 file_size);
+
+ private:
+  WritableFile* const dest_;
+  uint64 num_records_ = 0;
+  uint32 crc_ = 0;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RecordIndexWriter);
+};
+
+// A parsed index.
+class RecordIndex {
+ public:
+  // Parses the index in "data". Returns DATA_LOSS if it is malformed.
+  static Status Parse(StringPiece data, std::unique_ptr<RecordIndex>* index);
+
+  // Reads and parses the index of TFRecord file "fname". Returns NOT_FOUND
+  // if "fname" has no index, and FAILED_PRECONDITION if the index does not
+  // match the size of "fname".
+  static Status ReadForFile(Env* env, const string& fname,
+                            std::unique_ptr<RecordIndex>* index);
+
+  // Builds the index of uncompressed TFRecord file "fname" by reading the
+  // header of every record and skipping its data, through a read buffer so
+  // that small records do not cost a read each. Returns DATA_LOSS if a header
+  // is corrupted or the last record is truncated.
+  static Status BuildForFile(Env* env, const string& fname,
+                             std::unique_ptr<RecordIndex>* index);
+
+  int64 num_records() const { return offsets_.size(); }
+  uint64 offset(int64 i) const { return offsets_[i]; }
+  uint64 length(int64 i) const { return lengths_[i]; }
+  uint64 file_size() const { return file_size_; }
+
+  // Returns the number of the record at "offset", num_records() if "offset"
+  // is the end of the file, or -1 if no record starts at "offset".
+  int64 Find(uint64 offset) const;
+
+ private:
+  RecordIndex() {}
+
+  std::vector<uint64> offsets_;
+  std::vector<uint64> lengths_;
+  uint64 file_size_ = 0;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RecordIndex);
+};
+
+}  // namespace io
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_LIB_IO_RECORD_INDEX_H_
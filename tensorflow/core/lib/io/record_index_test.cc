@@ -0,0 +1,159 @@
+/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/lib/io/record_index.h"
+
+#include <vector>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace io {
+namespace {
+
+// Writes "records" to "fname" and its index.
+void WriteIndexedRecords(Env* env, const string& fname,
+                         const std::vector<string>& records) {
+  std::unique_ptr<RecordWriter> writer;
+  TF_CHECK_OK(
+      RecordWriter::NewIndexed(env, fname, RecordWriterOptions(), &writer));
+  for (const string& record : records) {
+    TF_CHECK_OK(writer->WriteRecord(record));
+  }
+  TF_CHECK_OK(writer->Close());
+}
+
+TEST(RecordIndexTest, FindsEveryRecord) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/record_index_test";
+  const std::vector<string> records = {"abc", "", "defghij", string(1000, 'x')};
+  WriteIndexedRecords(env, fname, records);
+
+  std::unique_ptr<RecordIndex> index;
+  TF_ASSERT_OK(RecordIndex::ReadForFile(env, fname, &index));
+  ASSERT_EQ(records.size(), index->num_records());
+  uint64 file_size;
+  TF_ASSERT_OK(env->GetFileSize(fname, &file_size));
+  EXPECT_EQ(file_size, index->file_size());
+
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+  RecordReader reader(file.get());
+  string record;
+  // Read the records backwards, which only works with the index.
+  for (int i = records.size() - 1; i >= 0; --i) {
+    EXPECT_EQ(records[i].size(), index->length(i));
+    EXPECT_EQ(i, index->Find(index->offset(i)));
+    uint64 offset = index->offset(i);
+    TF_ASSERT_OK(reader.ReadRecord(&offset, &record));
+    EXPECT_EQ(records[i], record);
+  }
+  EXPECT_EQ(records.size(), index->Find(file_size));
+  EXPECT_EQ(-1, index->Find(1));
+}
+
+TEST(RecordIndexTest, EmptyFile) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/record_index_empty";
+  WriteIndexedRecords(env, fname, {});
+  std::unique_ptr<RecordIndex> index;
+  TF_ASSERT_OK(RecordIndex::ReadForFile(env, fname, &index));
+  EXPECT_EQ(0, index->num_records());
+  EXPECT_EQ(0, index->Find(0));
+}
+
+TEST(RecordIndexTest, MissingOrStaleIndex) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/record_index_stale";
+  WriteIndexedRecords(env, fname, {"abc", "def"});
+  std::unique_ptr<RecordIndex> index;
+  TF_ASSERT_OK(RecordIndex::ReadForFile(env, fname, &index));
+
+  // The file was rewritten without updating its index.
+  {
+    std::unique_ptr<WritableFile> file;
+    TF_ASSERT_OK(env->NewWritableFile(fname, &file));
+    RecordWriter writer(file.get());
+    TF_ASSERT_OK(writer.WriteRecord("abcdef"));
+    TF_ASSERT_OK(writer.Close());
+    TF_ASSERT_OK(file->Close());
+  }
+  EXPECT_TRUE(errors::IsFailedPrecondition(
+      RecordIndex::ReadForFile(env, fname, &index)));
+  EXPECT_EQ(nullptr, index);
+
+  TF_ASSERT_OK(env->DeleteFile(RecordIndexFilename(fname)));
+  EXPECT_TRUE(errors::IsNotFound(RecordIndex::ReadForFile(env, fname, &index)));
+}
+
+TEST(RecordIndexTest, RejectsCompression) {
+  std::unique_ptr<RecordWriter> writer;
+  EXPECT_TRUE(errors::IsInvalidArgument(RecordWriter::NewIndexed(
+      Env::Default(), testing::TmpDir() + "/record_index_compressed",
+      RecordWriterOptions::CreateRecordWriterOptions("ZLIB"), &writer)));
+  EXPECT_EQ(nullptr, writer);
+}
+
+TEST(RecordIndexTest, DetectsCorruption) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/record_index_corrupt";
+  WriteIndexedRecords(env, fname, {"abc", "def"});
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(env, RecordIndexFilename(fname), &contents));
+
+  std::unique_ptr<RecordIndex> index;
+  TF_ASSERT_OK(RecordIndex::Parse(contents, &index));
+  string corrupted = contents;
+  corrupted[3] ^= 0x1;
+  EXPECT_TRUE(errors::IsDataLoss(RecordIndex::Parse(corrupted, &index)));
+  EXPECT_TRUE(errors::IsDataLoss(
+      RecordIndex::Parse(StringPiece(contents).substr(1), &index)));
+  EXPECT_TRUE(errors::IsDataLoss(RecordIndex::Parse("", &index)));
+}
+
+TEST(RecordIndexTest, BuildForFile) {
+  Env* env = Env::Default();
+  const string fname = testing::TmpDir() + "/record_index_build";
+  const std::vector<string> records = {"abc", "", string(1000, 'x')};
+  WriteIndexedRecords(env, fname, records);
+  std::unique_ptr<RecordIndex> written;
+  TF_ASSERT_OK(RecordIndex::ReadForFile(env, fname, &written));
+
+  std::unique_ptr<RecordIndex> built;
+  TF_ASSERT_OK(RecordIndex::BuildForFile(env, fname, &built));
+  ASSERT_EQ(written->num_records(), built->num_records());
+  EXPECT_EQ(written->file_size(), built->file_size());
+  for (int64 i = 0; i < written->num_records(); ++i) {
+    EXPECT_EQ(written->offset(i), built->offset(i));
+    EXPECT_EQ(written->length(i), built->length(i));
+  }
+
+  // Drop the footer of the last record.
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(env, fname, &contents));
+  TF_ASSERT_OK(WriteStringToFile(env, fname,
+                                 contents.substr(0, contents.size() - 1)));
+  EXPECT_TRUE(
+      errors::IsDataLoss(RecordIndex::BuildForFile(env, fname, &built)));
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace tensorflow
@@ -150,7 +150,16 @@ Status RecordReader::ReadRecord(uint64* offset, string* record) {
 
 SequentialRecordReader::SequentialRecordReader(
     RandomAccessFile* file, const RecordReaderOptions& options)
-    : underlying_(file, options), offset_(0) {}
+    : offset_(0) {
+  // The buffers of a RecordReader are only worth allocating if it is used.
+  if (options.async_reads > 0 &&
+      options.compression_type == RecordReaderOptions::NONE) {
+    async_reader_.reset(new AsyncRecordReader(
+        file, 0, options.async_read_size, options.async_reads));
+  } else {
+    underlying_.reset(new RecordReader(file, options));
+  }
+}
 
 }  // namespace io
 }  // namespace tensorflow
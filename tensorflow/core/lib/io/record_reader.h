@@ -18,6 +18,7 @@ limitations under the License.
 
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/lib/io/async_record_reader.h"
 #include "tensorflow/core/lib/io/inputstream_interface.h"
 #if !defined(IS_SLIM_BUILD)
 #include "tensorflow/core/lib/io/zlib_compression_options.h"
@@ -42,6 +43,13 @@ class RecordReaderOptions {
   // compressed files.) Consider using SequentialRecordReader.
   int64 buffer_size = 0;
 
+  // If async_reads is positive and there is no compression,
+  // SequentialRecordReader reads through an AsyncRecordReader that keeps
+  // up to async_reads reads of async_read_size bytes each in flight.
+  // buffer_size is then ignored. RecordReader ignores both.
+  int async_reads = 0;
+  int64 async_read_size = 4 << 20;
+
   static RecordReaderOptions CreateRecordReaderOptions(
       const string& compression_type);
 
@@ -97,26 +105,46 @@ class SequentialRecordReader {
   // Reads the next record in the file into *record. Returns OK on success,
   // OUT_OF_RANGE for end of file, or something else for an error.
   Status ReadRecord(string* record) {
-    return underlying_.ReadRecord(&offset_, record);
+    if (async_reader_) return async_reader_->ReadRecord(record);
+    return underlying_->ReadRecord(&offset_, record);
+  }
+
+  // Like above, but only copies the record if the reader does not keep it
+  // in memory anyway. On success "*record" points either into "*storage",
+  // which then holds exactly the record, or into a buffer of the reader
+  // that stays valid until the next call to ReadRecord() or SeekOffset().
+  Status ReadRecord(StringPiece* record, string* storage) {
+    if (async_reader_) {
+      RecordBuffer* buffer;
+      return async_reader_->ReadRecord(record, &buffer);
+    }
+    TF_RETURN_IF_ERROR(underlying_->ReadRecord(&offset_, storage));
+    *record = *storage;
+    return Status::OK();
   }
 
   // Returns the current offset in the file.
-  uint64 TellOffset() { return offset_; }
+  uint64 TellOffset() {
+    return async_reader_ ? async_reader_->TellOffset() : offset_;
+  }
 
   // Seek to this offset within the file and set this offset as the current
   // offset. Trying to seek backward will throw error.
   Status SeekOffset(uint64 offset) {
-    if (offset < offset_)
+    if (offset < TellOffset())
       return errors::InvalidArgument(
           "Trying to seek offset: ", offset,
-          " which is less than the current offset: ", offset_);
+          " which is less than the current offset: ", TellOffset());
+    if (async_reader_) async_reader_->SeekOffset(offset);
     offset_ = offset;
     return Status::OK();
   }
 
  private:
-  RecordReader underlying_;
+  // Exactly one of "underlying_" and "async_reader_" is set.
+  std::unique_ptr<RecordReader> underlying_;
   uint64 offset_ = 0;
+  std::unique_ptr<AsyncRecordReader> async_reader_;
 };
 
 }  // namespace io
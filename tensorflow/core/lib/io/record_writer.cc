@@ -16,8 +16,10 @@ limitations under the License.
 #include "tensorflow/core/lib/io/record_writer.h"
 
 #include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/hash/crc32c.h"
 #include "tensorflow/core/lib/io/compression.h"
+#include "tensorflow/core/lib/io/record_index.h"
 #include "tensorflow/core/platform/env.h"
 
 namespace tensorflow {
@@ -79,8 +81,28 @@ RecordWriter::RecordWriter(WritableFile* dest,
   }
 }
 
+Status RecordWriter::NewIndexed(Env* env, const string& fname,
+                                const RecordWriterOptions& options,
+                                std::unique_ptr<RecordWriter>* writer) {
+  if (options.compression_type != RecordWriterOptions::NONE) {
+    return errors::InvalidArgument(
+        "Record indices are not supported with compression, but ", fname,
+        " is compressed");
+  }
+  std::unique_ptr<WritableFile> dest;
+  TF_RETURN_IF_ERROR(env->NewWritableFile(fname, &dest));
+  std::unique_ptr<WritableFile> index_dest;
+  TF_RETURN_IF_ERROR(
+      env->NewWritableFile(RecordIndexFilename(fname), &index_dest));
+  writer->reset(new RecordWriter(dest.get(), options));
+  (*writer)->index_.reset(new RecordIndexWriter(index_dest.get()));
+  (*writer)->owned_dest_ = std::move(dest);
+  (*writer)->owned_index_dest_ = std::move(index_dest);
+  return Status::OK();
+}
+
 RecordWriter::~RecordWriter() {
-  if (dest_ != nullptr) {
+  if (dest_ != nullptr || index_ != nullptr) {
     Status s = Close();
     if (!s.ok()) {
       LOG(ERROR) << "Could not finish writing file: " << s;
@@ -105,12 +127,26 @@ Status RecordWriter::WriteRecord(StringPiece data) {
   char footer[sizeof(uint32)];
   core::EncodeFixed32(footer, MaskedCrc(data.data(), data.size()));
 
+  if (index_ != nullptr) {
+    TF_RETURN_IF_ERROR(index_->AddRecord(offset_, data.size()));
+  }
   TF_RETURN_IF_ERROR(dest_->Append(StringPiece(header, sizeof(header))));
   TF_RETURN_IF_ERROR(dest_->Append(data));
-  return dest_->Append(StringPiece(footer, sizeof(footer)));
+  TF_RETURN_IF_ERROR(dest_->Append(StringPiece(footer, sizeof(footer))));
+  offset_ += sizeof(header) + data.size() + sizeof(footer);
+  return Status::OK();
 }
 
 Status RecordWriter::Close() {
+  if (index_ != nullptr) {
+    Status s = index_->Finish(offset_);
+    index_.reset();
+    if (owned_dest_ != nullptr) s.Update(owned_dest_->Close());
+    if (owned_index_dest_ != nullptr) s.Update(owned_index_dest_->Close());
+    owned_dest_.reset();
+    owned_index_dest_.reset();
+    return s;
+  }
 #if !defined(IS_SLIM_BUILD)
   if (IsZlibCompressed(options_)) {
     Status s = dest_->Close();
@@ -16,6 +16,8 @@ limitations under the License.
 #ifndef TENSORFLOW_LIB_IO_RECORD_WRITER_H_
 #define TENSORFLOW_LIB_IO_RECORD_WRITER_H_
 
+#include <memory>
+
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/core/stringpiece.h"
 #if !defined(IS_SLIM_BUILD)
@@ -27,10 +29,13 @@ limitations under the License.
 
 namespace tensorflow {
 
+class Env;
 class WritableFile;
 
 namespace io {
 
+class RecordIndexWriter;
+
 class RecordWriterOptions {
  public:
   enum CompressionType { NONE = 0, ZLIB_COMPRESSION = 1 };
@@ -53,6 +58,18 @@ class RecordWriter {
   RecordWriter(WritableFile* dest,
                const RecordWriterOptions& options = RecordWriterOptions());
 
+  // Creates TFRecord file "fname", replacing any existing file, and a
+  // writer to it that also writes an index of the records to
+  // RecordIndexFilename(fname) (see record_index.h). The index lets readers
+  // find any record without reading the ones before it. Both files are
+  // complete after Close(), which also closes them. Since the index stores
+  // offsets from the start of the file, indexed files cannot be appended
+  // to. Returns INVALID_ARGUMENT if "options" enable compression, which
+  // indices do not support.
+  static Status NewIndexed(Env* env, const string& fname,
+                           const RecordWriterOptions& options,
+                           std::unique_ptr<RecordWriter>* writer);
+
   // Calls Close() and logs if an error occurs.
   //
   // TODO(jhseu): Require that callers explicitly call Close() and remove the
@@ -66,7 +83,8 @@ class RecordWriter {
   // WritableFile.
   Status Flush();
 
-  // Writes all output to the file. Does *not* close the WritableFile.
+  // Writes all output to the file. Does *not* close the WritableFile passed
+  // to the constructor.
   //
   // After calling Close(), any further calls to `WriteRecord()` or `Flush()`
   // are invalid.
@@ -75,6 +93,13 @@ class RecordWriter {
  private:
   WritableFile* dest_;
   RecordWriterOptions options_;
+  std::unique_ptr<RecordIndexWriter> index_;
+  // The number of bytes written to "*dest_" before compression.
+  uint64 offset_ = 0;
+  // The files written by a writer created with NewIndexed(), until they are
+  // closed.
+  std::unique_ptr<WritableFile> owned_dest_;
+  std::unique_ptr<WritableFile> owned_index_dest_;
 
   TF_DISALLOW_COPY_AND_ASSIGN(RecordWriter);
 };
@@ -141,6 +141,15 @@ REGISTER_OP("MergeV2Checkpoints")
       return Status::OK();
     });
 
+REGISTER_OP("WaitForCheckpointV2")
+    .Input("prefix: string")
+    .SetIsStateful()
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 0, &unused));
+      return Status::OK();
+    });
+
 REGISTER_OP("Save")
     .Input("filename: string")
     .Input("tensor_names: string")
@@ -163,6 +172,33 @@ REGISTER_OP("Save")
       return Status::OK();
     });
 
+REGISTER_OP("SaveDeltaV2")
+    .Input("prefix: string")
+    .Input("base_prefix: string")
+    .Input("tensor_names: string")
+    .Input("shape_and_slices: string")
+    .Input("tensors: dtypes")
+    .Attr("dtypes: list(type)")
+    .SetIsStateful()
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle unused;
+      ShapeHandle s;
+      DimensionHandle unused_dim;
+
+      // Validate prefix and base_prefix.
+      for (int i = 0; i <= 1; ++i) {
+        TF_RETURN_IF_ERROR(c->WithRank(c->input(i), 0, &unused));
+      }
+
+      // Validate tensor_names and shapes_and_slices.
+      for (int i = 2; i <= 3; ++i) {
+        TF_RETURN_IF_ERROR(c->WithRank(c->input(i), 1, &s));
+        TF_RETURN_IF_ERROR(
+            c->WithValue(c->Dim(s, 0), c->num_inputs() - 4, &unused_dim));
+      }
+      return Status::OK();
+    });
+
 REGISTER_OP("SaveSlices")
     .Input("filename: string")
     .Input("tensor_names: string")
@@ -221,6 +221,7 @@ REGISTER_OP("HashTable")
     .Attr("use_node_name_sharing: bool = false")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
+    .Attr("use_flat_hash_map: bool = false")
     .SetIsStateful()
     .SetShapeFn(TwoElementOutput);
 
@@ -231,6 +232,7 @@ REGISTER_OP("HashTableV2")
     .Attr("use_node_name_sharing: bool = false")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
+    .Attr("use_flat_hash_map: bool = false")
     .SetIsStateful()
     .SetShapeFn(ScalarOutput);
 
@@ -241,6 +243,8 @@ REGISTER_OP("MutableHashTable")
     .Attr("use_node_name_sharing: bool = false")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
+    .Attr("use_flat_hash_map: bool = false")
+    .Attr("num_shards: int >= 1 = 1")
     .SetIsStateful()
     .SetShapeFn(TwoElementOutput);
 
@@ -251,6 +255,8 @@ REGISTER_OP("MutableHashTableV2")
     .Attr("use_node_name_sharing: bool = false")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
+    .Attr("use_flat_hash_map: bool = false")
+    .Attr("num_shards: int >= 1 = 1")
     .SetIsStateful()
     .SetShapeFn(ScalarOutput);
 
@@ -262,6 +268,7 @@ REGISTER_OP("MutableHashTableOfTensors")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
     .Attr("value_shape: shape = {}")
+    .Attr("num_shards: int >= 1 = 1")
     .SetIsStateful()
     .SetShapeFn(TwoElementOutput);
 
@@ -273,6 +280,7 @@ REGISTER_OP("MutableHashTableOfTensorsV2")
     .Attr("key_dtype: type")
     .Attr("value_dtype: type")
     .Attr("value_shape: shape = {}")
+    .Attr("num_shards: int >= 1 = 1")
     .SetIsStateful()
     .SetShapeFn(ScalarOutput);
 
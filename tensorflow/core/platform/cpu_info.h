@@ -17,6 +17,7 @@ limitations under the License.
 #define TENSORFLOW_PLATFORM_CPU_INFO_H_
 
 #include <string>
+#include <vector>
 
 // TODO(ahentz): This is not strictly required here but, for historical
 // reasons, many people depend on cpu_info.h in order to use kLittleEndian.
@@ -39,6 +40,12 @@ int NumSchedulableCPUs();
 // on the CPU
 int NumHyperthreadsPerCore();
 
+// Restricts the calling thread to run only on the given CPUs, numbered as by
+// the operating system. Returns false if this is not supported on this
+// platform, or if it fails, e.g. because none of the CPUs is available to the
+// process.
+bool SetCurrentThreadCPUAffinity(const std::vector<int>& cpus);
+
 // Mostly ISA related features that we care about
 enum CPUFeature {
   // Do not change numeric assignments.
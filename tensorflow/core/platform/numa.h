@@ -16,6 +16,8 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_PLATFORM_NUMA_H_
 #define TENSORFLOW_CORE_PLATFORM_NUMA_H_
 
+#include <vector>
+
 #include "tensorflow/core/platform/platform.h"
 #include "tensorflow/core/platform/types.h"
 
@@ -36,7 +38,13 @@ static const int kNUMANoAffinity = -1;
 // If node == kNUMANoAffinity removes affinity to any particular node.
 void NUMASetThreadNodeAffinity(int node);
 
-// Returns NUMA node affinity of the current thread, kNUMANoAffinity if none.
+// Returns the CPUs of NUMA node "node" that the process may run on, which is
+// empty if they cannot be determined or there is no such node.
+std::vector<int> NUMANodeCPUs(int node);
+
+// Returns the NUMA node whose CPUs are the only ones the current thread may
+// run on, whether or not its affinity was set by NUMASetThreadNodeAffinity(),
+// kNUMANoAffinity if none.
 int NUMAGetThreadNodeAffinity();
 
 // Like AlignedMalloc, but allocates memory with affinity to the specified NUMA
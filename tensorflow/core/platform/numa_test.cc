@@ -15,6 +15,10 @@ limitations under the License.
 
 #include "tensorflow/core/platform/numa.h"
 
+#include <string.h>
+#include <vector>
+
+#include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/test.h"
 
@@ -23,7 +27,7 @@ namespace internal {
 
 TEST(Numa, NumNodes) {
   if (port::NUMAEnabled()) {
-    EXPECT_GE(port::NUMANumNodes(), 1);
+    EXPECT_GT(port::NUMANumNodes(), 1);
   }
 }
 
@@ -42,6 +46,18 @@ TEST(Numa, Malloc) {
   }
 }
 
+TEST(Numa, MallocAlignment) {
+  for (int alignment : {0, 64, 1 << 16}) {
+    void* ptr = port::NUMAMalloc(0, 100000, alignment);
+    ASSERT_NE(ptr, nullptr);
+    if (alignment > 0) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % alignment);
+    }
+    memset(ptr, 1, 100000);
+    port::NUMAFree(ptr, 100000);
+  }
+}
+
 TEST(Numa, SetNodeAffinity) {
   // NOTE(tucker): This test is not reliable when executed under tap because
   // the virtual machine may not have access to all of the availble NUMA
@@ -54,6 +70,25 @@ TEST(Numa, SetNodeAffinity) {
       int affinity_node = port::NUMAGetThreadNodeAffinity();
       EXPECT_EQ(affinity_node, request_node);
     }
+    port::NUMASetThreadNodeAffinity(port::kNUMANoAffinity);
+    EXPECT_EQ(-1, port::NUMAGetThreadNodeAffinity());
+  }
+}
+
+TEST(Numa, GetNodeAffinityOfCPUs) {
+  if (port::NUMAEnabled()) {
+    int num_nodes = port::NUMANumNodes();
+    // The affinity is read from the thread, however it was set.
+    for (int node = 0; node < num_nodes; ++node) {
+      ASSERT_TRUE(port::SetCurrentThreadCPUAffinity(port::NUMANodeCPUs(node)));
+      EXPECT_EQ(node, port::NUMAGetThreadNodeAffinity());
+    }
+    std::vector<int> cpus = port::NUMANodeCPUs(0);
+    const std::vector<int> other_cpus = port::NUMANodeCPUs(1);
+    cpus.insert(cpus.end(), other_cpus.begin(), other_cpus.end());
+    ASSERT_TRUE(port::SetCurrentThreadCPUAffinity(cpus));
+    EXPECT_EQ(-1, port::NUMAGetThreadNodeAffinity());
+    port::NUMASetThreadNodeAffinity(port::kNUMANoAffinity);
   }
 }
 
@@ -21,6 +21,9 @@ limitations under the License.
 #include "absl/base/internal/sysinfo.h"
 #endif
 
+#include <algorithm>
+#include <vector>
+
 #include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mem.h"
@@ -30,8 +33,11 @@ limitations under the License.
 
 #if defined(__linux__) && !defined(__ANDROID__)
 #include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/sysinfo.h>
 #endif
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -75,21 +81,162 @@ int NumSchedulableCPUs() {
   return kDefaultCores;
 }
 
+bool SetCurrentThreadCPUAffinity(const std::vector<int>& cpus) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  for (int cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &cpuset);
+  }
+  if (CPU_COUNT(&cpuset) == 0) return false;
+  return sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) == 0;
+#else
+  return false;
+#endif
+}
+
 int NumHyperthreadsPerCore() {
   static const int ht_per_core = tensorflow::port::CPUIDNumSMT();
   return (ht_per_core > 0) ? ht_per_core : 1;
 }
 
+#if defined(__linux__) && !defined(__ANDROID__)
+namespace {
+
+// Memory policy constants of <linux/mempolicy.h>. The policies are set with
+// raw system calls, so that NUMA support does not depend on libnuma.
+constexpr int kMpolBind = 2;
+constexpr unsigned long kMpolFNode = 1 << 0;
+constexpr unsigned long kMpolFAddr = 1 << 1;
+
+// Parses a sysfs CPU list such as "0-3,8,10-11".
+std::vector<int> ParseCPUList(const char* list) {
+  std::vector<int> cpus;
+  const char* p = list;
+  while (*p != '\0' && *p != '\n') {
+    char* end;
+    const long first = strtol(p, &end, 10);
+    if (end == p) break;
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+    if (*p == ',') ++p;
+  }
+  return cpus;
+}
+
+// The CPUs of NUMA nodes 0, 1, ..., read once from sysfs, that the process
+// may run on. Empty if memory policies are not available, e.g. because a
+// seccomp filter denies them.
+const std::vector<std::vector<int>>& AllNUMANodeCPUs() {
+  static const std::vector<std::vector<int>>* node_cpus = [] {
+    auto* result = new std::vector<std::vector<int>>;
+    int mode;
+    cpu_set_t allowed;
+    if (syscall(SYS_get_mempolicy, &mode, nullptr, 0, nullptr, 0) != 0 ||
+        sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) {
+      return result;
+    }
+    for (int node = 0;; ++node) {
+      char path[64];
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+               node);
+      FILE* file = fopen(path, "r");
+      if (file == nullptr) break;
+      char* line = nullptr;
+      size_t capacity = 0;
+      result->emplace_back();
+      if (getline(&line, &capacity, file) > 0) {
+        for (int cpu : ParseCPUList(line)) {
+          if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+            result->back().push_back(cpu);
+          }
+        }
+      }
+      free(line);
+      fclose(file);
+    }
+    return result;
+  }();
+  return *node_cpus;
+}
+
+size_t RoundUpToPageSize(size_t size) {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+}  // namespace
+#endif
+
 bool NUMAEnabled() {
-  // Not yet implemented: coming soon.
+#if defined(__linux__) && !defined(__ANDROID__)
+  // Binding memory and threads to the only node would only add overhead.
+  return AllNUMANodeCPUs().size() > 1;
+#else
   return false;
+#endif
+}
+
+int NUMANumNodes() {
+#if defined(__linux__) && !defined(__ANDROID__)
+  return std::max<int>(1, AllNUMANodeCPUs().size());
+#else
+  return 1;
+#endif
 }
 
-int NUMANumNodes() { return 1; }
+void NUMASetThreadNodeAffinity(int node) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  if (!NUMAEnabled() || node >= NUMANumNodes()) return;
+  std::vector<int> cpus;
+  if (node == kNUMANoAffinity) {
+    for (const std::vector<int>& node_cpus : AllNUMANodeCPUs()) {
+      cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+    }
+  } else {
+    cpus = AllNUMANodeCPUs()[node];
+  }
+  SetCurrentThreadCPUAffinity(cpus);
+#endif
+}
 
-void NUMASetThreadNodeAffinity(int node) {}
+std::vector<int> NUMANodeCPUs(int node) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  if (node >= 0 && node < static_cast<int>(AllNUMANodeCPUs().size())) {
+    return AllNUMANodeCPUs()[node];
+  }
+#endif
+  return {};
+}
 
 int NUMAGetThreadNodeAffinity() {
+#if defined(__linux__) && !defined(__ANDROID__)
+  if (!NUMAEnabled()) return kNUMANoAffinity;
+  cpu_set_t cpuset;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &cpuset) != 0) {
+    return kNUMANoAffinity;
+  }
+  // The thread has affinity to a node if it may only run on CPUs of that
+  // node, however its affinity was set.
+  const std::vector<std::vector<int>>& node_cpus = AllNUMANodeCPUs();
+  const int num_cpus = CPU_COUNT(&cpuset);
+  for (int node = 0; node < static_cast<int>(node_cpus.size()); ++node) {
+    int num_node_cpus = 0;
+    for (int cpu : node_cpus[node]) {
+      if (CPU_ISSET(cpu, &cpuset)) ++num_node_cpus;
+    }
+    if (num_node_cpus > 0) {
+      return num_node_cpus == num_cpus ? node : kNUMANoAffinity;
+    }
+  }
+#endif
   return kNUMANoAffinity;
 }
 
@@ -143,12 +290,62 @@ void Free(void* ptr) {
 }
 
 void* NUMAMalloc(int node, size_t size, int minimum_alignment) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  if (NUMAEnabled()) {
+    // Maps whole pages, so that the policy of the mapping affects no other
+    // allocation, and trims the mapping to the requested alignment. This
+    // costs system calls, so callers such as the NUMA allocators of
+    // ProcessState ask for large regions and sub-allocate them.
+    const size_t bytes = RoundUpToPageSize(size);
+    const size_t alignment =
+        std::max(RoundUpToPageSize(1), static_cast<size_t>(minimum_alignment));
+    const size_t mapped_bytes = bytes + alignment - RoundUpToPageSize(1);
+    void* mapped = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) return nullptr;
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(mapped);
+    const uintptr_t aligned = (begin + alignment - 1) / alignment * alignment;
+    if (aligned > begin) munmap(mapped, aligned - begin);
+    const uintptr_t end = begin + mapped_bytes;
+    if (end > aligned + bytes) {
+      munmap(reinterpret_cast<void*>(aligned + bytes), end - aligned - bytes);
+    }
+    void* ptr = reinterpret_cast<void*>(aligned);
+    if (node >= 0 && node < NUMANumNodes()) {
+      constexpr int kBitsPerWord = 8 * sizeof(unsigned long);
+      std::vector<unsigned long> node_mask(node / kBitsPerWord + 1, 0);
+      node_mask[node / kBitsPerWord] = 1UL << (node % kBitsPerWord);
+      // Failing to bind only costs locality.
+      if (syscall(SYS_mbind, ptr, bytes, kMpolBind, node_mask.data(),
+                  node_mask.size() * kBitsPerWord + 1, 0) != 0) {
+        VLOG(1) << "mbind to NUMA node " << node << " failed: " << errno;
+      }
+    }
+    return ptr;
+  }
+#endif
   return AlignedMalloc(size, minimum_alignment);
 }
 
-void NUMAFree(void* ptr, size_t size) { Free(ptr); }
+void NUMAFree(void* ptr, size_t size) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  if (NUMAEnabled()) {
+    if (ptr != nullptr) munmap(ptr, RoundUpToPageSize(size));
+    return;
+  }
+#endif
+  Free(ptr);
+}
 
 int NUMAGetMemAffinity(const void* addr) {
+#if defined(__linux__) && !defined(__ANDROID__)
+  int node;
+  if (NUMAEnabled() &&
+      syscall(SYS_get_mempolicy, &node, nullptr, 0, addr,
+              kMpolFNode | kMpolFAddr) == 0) {
+    return node;
+  }
+#endif
   return kNUMANoAffinity;
 }
 
@@ -57,6 +57,18 @@ int NumSchedulableCPUs() {
   return system_info.dwNumberOfProcessors;
 }
 
+bool SetCurrentThreadCPUAffinity(const std::vector<int>& cpus) {
+  // Only the CPUs of the processor group of the thread can be selected.
+  DWORD_PTR mask = 0;
+  for (int cpu : cpus) {
+    if (cpu >= 0 && cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+      mask |= static_cast<DWORD_PTR>(1) << cpu;
+    }
+  }
+  if (mask == 0) return false;
+  return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
 void* AlignedMalloc(size_t size, int minimum_alignment) {
 #ifdef TENSORFLOW_USE_JEMALLOC
   void* ptr = NULL;
@@ -14,8 +14,13 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 
+#include <cstring>
 #include <vector>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature.pb_text.h"
 #include "tensorflow/core/framework/numeric_op.h"
@@ -24,9 +29,11 @@ limitations under the License.
 #include "tensorflow/core/lib/core/blocking_counter.h"
 #include "tensorflow/core/lib/core/casts.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/raw_coding.h"
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/protobuf.h"
 #include "tensorflow/core/util/presized_cuckoo_map.h"
@@ -60,6 +67,261 @@ constexpr uint8 kVarintTag(uint32 tag) { return (tag << 3) | 0; }
 constexpr uint8 kDelimitedTag(uint32 tag) { return (tag << 3) | 2; }
 constexpr uint8 kFixed32Tag(uint32 tag) { return (tag << 3) | 5; }
 
+template <typename T>
+class LimitedArraySlice {
+ public:
+  LimitedArraySlice(T* begin, size_t num_elements)
+      : current_(begin), end_(begin + num_elements) {}
+
+  // May return negative if there were push_back calls after slice was filled.
+  int64 EndDistance() const { return end_ - current_; }
+
+  // Attempts to push value to the back of this. If the slice has
+  // already been filled, this method has no effect on the underlying data, but
+  // it changes the number returned by EndDistance into negative values.
+  void push_back(T&& value) {
+    if (EndDistance() > 0) *current_ = std::move(value);
+    ++current_;
+  }
+
+  // Returns the storage for the next `n` values, or nullptr if they do not
+  // all fit, in which case only the number returned by EndDistance changes.
+  T* AppendUninitialized(size_t n) {
+    T* result = EndDistance() >= static_cast<int64>(n) ? current_ : nullptr;
+    current_ += n;
+    return result;
+  }
+
+ private:
+  T* current_;
+  T* end_;
+};
+
+template <typename T>
+T* AppendUninitialized(LimitedArraySlice<T>* slice, size_t n) {
+  return slice->AppendUninitialized(n);
+}
+
+template <typename T>
+T* AppendUninitialized(SmallVector<T>* vector, size_t n) {
+  const size_t size = vector->size();
+  vector->resize(size + n);
+  return vector->data() + size;
+}
+
+// Packed repeated fields are decoded straight from the serialized bytes rather
+// than value by value through a CodedInputStream: the number of values is
+// known before decoding, so the output grows once, little-endian floats are a
+// single copy, and runs of one-byte varints are widened with SIMD when the CPU
+// supports it.
+
+// Decodes the varint at `*ptr`, which must end before `end`.
+inline bool ReadVarint64(const uint8** ptr, const uint8* end, uint64* value) {
+  const uint8* p = *ptr;
+  uint64 result = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    const uint64 byte = *p++;
+    result |= (byte & 0x7F) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      *ptr = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Every varint ends with the one byte that does not have its high bit set.
+size_t CountVarintsScalar(const uint8* begin, const uint8* end) {
+  size_t count = 0;
+  for (const uint8* p = begin; p < end; ++p) {
+    count += *p < 0x80;
+  }
+  return count;
+}
+
+bool DecodeVarintsScalar(const uint8* begin, const uint8* end, int64* values) {
+  for (const uint8* p = begin; p < end;) {
+    uint64 value;
+    if (!ReadVarint64(&p, end, &value)) return false;
+    *values++ = static_cast<int64>(value);
+  }
+  return true;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TF_EXAMPLE_PARSING_SIMD 1
+
+__attribute__((target("sse4.1"))) size_t CountVarintsSse41(const uint8* begin,
+                                                            const uint8* end) {
+  size_t count = 0;
+  const uint8* p = begin;
+  for (; end - p >= 16; p += 16) {
+    const __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    count += 16 - __builtin_popcount(_mm_movemask_epi8(chunk));
+  }
+  return count + CountVarintsScalar(p, end);
+}
+
+template <int kOffset>
+__attribute__((target("sse4.1"))) inline void WidenBytesSse41(__m128i chunk,
+                                                              int64* values) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(values + kOffset),
+                   _mm_cvtepu8_epi64(_mm_srli_si128(chunk, kOffset)));
+}
+
+__attribute__((target("sse4.1"))) bool DecodeVarintsSse41(const uint8* begin,
+                                                          const uint8* end,
+                                                          int64* values) {
+  const uint8* p = begin;
+  while (end - p >= 16) {
+    const __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const uint32 continuation = _mm_movemask_epi8(chunk);
+    if (continuation == 0) {
+      // Sixteen one-byte varints.
+      WidenBytesSse41<0>(chunk, values);
+      WidenBytesSse41<2>(chunk, values);
+      WidenBytesSse41<4>(chunk, values);
+      WidenBytesSse41<6>(chunk, values);
+      WidenBytesSse41<8>(chunk, values);
+      WidenBytesSse41<10>(chunk, values);
+      WidenBytesSse41<12>(chunk, values);
+      WidenBytesSse41<14>(chunk, values);
+      p += 16;
+      values += 16;
+      continue;
+    }
+    // Copy the one-byte varints in front of the first longer one, then decode
+    // the rest of the chunk one varint at a time.
+    const uint8* chunk_end = p + 16;
+    for (int i = __builtin_ctz(continuation); i > 0; --i) {
+      *values++ = *p++;
+    }
+    while (p < chunk_end) {
+      uint64 value;
+      if (!ReadVarint64(&p, end, &value)) return false;
+      *values++ = static_cast<int64>(value);
+    }
+  }
+  return DecodeVarintsScalar(p, end, values);
+}
+
+__attribute__((target("avx2"))) size_t CountVarintsAvx2(const uint8* begin,
+                                                        const uint8* end) {
+  size_t count = 0;
+  const uint8* p = begin;
+  for (; end - p >= 32; p += 32) {
+    const __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    count += 32 - __builtin_popcount(_mm256_movemask_epi8(chunk));
+  }
+  return count + CountVarintsSse41(p, end);
+}
+
+template <int kOffset>
+__attribute__((target("avx2"))) inline void WidenBytesAvx2(__m128i chunk,
+                                                           int64* values) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + kOffset),
+                      _mm256_cvtepu8_epi64(_mm_srli_si128(chunk, kOffset)));
+}
+
+__attribute__((target("avx2"))) bool DecodeVarintsAvx2(const uint8* begin,
+                                                       const uint8* end,
+                                                       int64* values) {
+  const uint8* p = begin;
+  while (end - p >= 32) {
+    const __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const uint32 continuation = _mm256_movemask_epi8(chunk);
+    if (continuation == 0) {
+      // Thirty-two one-byte varints.
+      const __m128i low = _mm256_castsi256_si128(chunk);
+      const __m128i high = _mm256_extracti128_si256(chunk, 1);
+      WidenBytesAvx2<0>(low, values);
+      WidenBytesAvx2<4>(low, values);
+      WidenBytesAvx2<8>(low, values);
+      WidenBytesAvx2<12>(low, values);
+      WidenBytesAvx2<0>(high, values + 16);
+      WidenBytesAvx2<4>(high, values + 16);
+      WidenBytesAvx2<8>(high, values + 16);
+      WidenBytesAvx2<12>(high, values + 16);
+      p += 32;
+      values += 32;
+      continue;
+    }
+    const uint8* chunk_end = p + 32;
+    for (int i = __builtin_ctz(continuation); i > 0; --i) {
+      *values++ = *p++;
+    }
+    while (p < chunk_end) {
+      uint64 value;
+      if (!ReadVarint64(&p, end, &value)) return false;
+      *values++ = static_cast<int64>(value);
+    }
+  }
+  return DecodeVarintsSse41(p, end, values);
+}
+#endif  // defined(__x86_64__) && defined(__GNUC__)
+
+// Returns the varint decoders that the CPU supports, fastest first. The
+// scalar decoder is always last.
+std::vector<VarintDecoder> SupportedVarintDecoders() {
+  std::vector<VarintDecoder> decoders;
+#ifdef TF_EXAMPLE_PARSING_SIMD
+  if (port::TestCPUFeature(port::CPUFeature::AVX2)) {
+    decoders.push_back({"avx2", &CountVarintsAvx2, &DecodeVarintsAvx2});
+  }
+  if (port::TestCPUFeature(port::CPUFeature::SSE4_1)) {
+    decoders.push_back({"sse4.1", &CountVarintsSse41, &DecodeVarintsSse41});
+  }
+#endif
+  decoders.push_back({"scalar", &CountVarintsScalar, &DecodeVarintsScalar});
+  return decoders;
+}
+
+// Returns the fastest varint decoder that the CPU supports.
+const VarintDecoder& GetVarintDecoder() {
+  static const VarintDecoder decoder = SupportedVarintDecoders().front();
+  return decoder;
+}
+
+// Appends the varints packed into [begin, end) to `int64_list`.
+template <typename Result>
+bool ParsePackedVarints(const uint8* begin, const uint8* end,
+                        Result* int64_list) {
+  if (begin == end) return true;
+  // The last varint must end with the buffer.
+  if (end[-1] >= 0x80) return false;
+  const VarintDecoder& decoder = GetVarintDecoder();
+  const size_t count = decoder.count(begin, end);
+  int64* values = AppendUninitialized(int64_list, count);
+  // The values did not fit, which the caller detects.
+  if (values == nullptr) return true;
+  return decoder.decode(begin, end, values);
+}
+
+// Appends the little-endian floats packed into [begin, end) to `float_list`.
+template <typename Result>
+bool ParsePackedFloats(const uint8* begin, const uint8* end,
+                       Result* float_list) {
+  const size_t num_bytes = end - begin;
+  if (num_bytes % sizeof(float) != 0) return false;
+  const size_t count = num_bytes / sizeof(float);
+  float* values = AppendUninitialized(float_list, count);
+  if (values == nullptr) return true;
+  if (port::kLittleEndian) {
+    std::memcpy(values, begin, num_bytes);
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      values[i] = bit_cast<float>(
+          core::DecodeFixed32(reinterpret_cast<const char*>(begin) + 4 * i));
+    }
+  }
+  return true;
+}
+
 namespace parsed {
 
 // ParseDataType has to be called first, then appropriate ParseZzzzList.
@@ -159,15 +421,11 @@ class Feature {
         if (!stream.ExpectTag(kDelimitedTag(1))) return false;  // packed tag
         uint32 packed_length;
         if (!stream.ReadVarint32(&packed_length)) return false;
-        auto packed_limit = stream.PushLimit(packed_length);
-
-        while (!stream.ExpectAtEnd()) {
-          uint32 buffer32;
-          if (!stream.ReadLittleEndian32(&buffer32)) return false;
-          float_list->push_back(bit_cast<float>(buffer32));
+        const uint8* packed = PackedData(stream);
+        if (!stream.Skip(packed_length)) return false;
+        if (!ParsePackedFloats(packed, packed + packed_length, float_list)) {
+          return false;
         }
-
-        stream.PopLimit(packed_limit);
       } else {  // non-packed
         while (!stream.ExpectAtEnd()) {
           if (!stream.ExpectTag(kFixed32Tag(1))) return false;
@@ -201,15 +459,11 @@ class Feature {
         if (!stream.ExpectTag(kDelimitedTag(1))) return false;  // packed tag
         uint32 packed_length;
         if (!stream.ReadVarint32(&packed_length)) return false;
-        auto packed_limit = stream.PushLimit(packed_length);
-
-        while (!stream.ExpectAtEnd()) {
-          protobuf_uint64 n;  // There is no API for int64
-          if (!stream.ReadVarint64(&n)) return false;
-          int64_list->push_back(static_cast<int64>(n));
+        const uint8* packed = PackedData(stream);
+        if (!stream.Skip(packed_length)) return false;
+        if (!ParsePackedVarints(packed, packed + packed_length, int64_list)) {
+          return false;
         }
-
-        stream.PopLimit(packed_limit);
       } else {  // non-packed
         while (!stream.ExpectAtEnd()) {
           if (!stream.ExpectTag(kVarintTag(1))) return false;
@@ -226,6 +480,12 @@ class Feature {
   StringPiece GetSerialized() const { return serialized_; }
 
  private:
+  // Returns the position of `stream`, which reads `serialized_`.
+  const uint8* PackedData(const protobuf::io::CodedInputStream& stream) const {
+    return reinterpret_cast<const uint8*>(serialized_.data()) +
+           stream.CurrentPosition();
+  }
+
   // TODO(lew): Pair of uint8* would be more natural.
   StringPiece serialized_;
 };
@@ -342,6 +602,10 @@ bool ParseExample(StringPiece serialized, parsed::Example* example) {
 
 }  // namespace
 
+std::vector<VarintDecoder> TestVarintDecoders() {
+  return SupportedVarintDecoders();
+}
+
 bool TestFastParse(const string& serialized, Example* example) {
   DCHECK(example != nullptr);
   parsed::Example parsed_example;
@@ -445,28 +709,6 @@ struct SeededHasher {
   uint64 seed{0xDECAFCAFFE};
 };
 
-template <typename T>
-class LimitedArraySlice {
- public:
-  LimitedArraySlice(T* begin, size_t num_elements)
-      : current_(begin), end_(begin + num_elements) {}
-
-  // May return negative if there were push_back calls after slice was filled.
-  int64 EndDistance() const { return end_ - current_; }
-
-  // Attempts to push value to the back of this. If the slice has
-  // already been filled, this method has no effect on the underlying data, but
-  // it changes the number returned by EndDistance into negative values.
-  void push_back(T&& value) {
-    if (EndDistance() > 0) *current_ = std::move(value);
-    ++current_;
-  }
-
- private:
-  T* current_;
-  T* end_;
-};
-
 void LogDenseFeatureDataLoss(StringPiece feature_name) {
   LOG(WARNING) << "Data loss! Feature '" << feature_name
                << "' is present in multiple concatenated "
@@ -91,6 +91,20 @@ Status FastParseSingleExample(const FastParseSingleExampleConfig& config,
 // It is exported here as a convenient API to test parser part separately.
 bool TestFastParse(const string& serialized, Example* example);
 
+// Counts and decodes the varints packed into [begin, end). `count` counts
+// the bytes that end a varint; `decode` writes at most that many values and
+// returns false if the last varint is truncated or a varint is longer than
+// ten bytes.
+struct VarintDecoder {
+  const char* name;
+  size_t (*count)(const uint8* begin, const uint8* end);
+  bool (*decode)(const uint8* begin, const uint8* end, int64* values);
+};
+
+// Returns the varint decoders that the CPU supports, with the scalar one
+// last. Exported here to test the SIMD decoders against the scalar one.
+std::vector<VarintDecoder> TestVarintDecoders();
+
 }  // namespace example
 }  // namespace tensorflow
 
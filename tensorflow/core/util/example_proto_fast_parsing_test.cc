@@ -15,8 +15,13 @@ limitations under the License.
 
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 
+#include <limits>
+#include <vector>
+
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature.pb.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/protobuf.h"
@@ -168,6 +173,103 @@ TEST(FastParse, Packed) {
       "\x0a\x0d\x0a\x0b\x0a\x03\x61\x67\x65\x12\x04\x1a\x02\x08\x0d");
 }
 
+// Long packed lists go through the bulk decoders, including runs of one-byte
+// varints longer than a SIMD register and varints of every length.
+TEST(FastParse, LongPacked) {
+  Example example;
+  auto& features = *example.mutable_features()->mutable_feature();
+  auto* ids = features["ids"].mutable_int64_list();
+  auto* weights = features["weights"].mutable_float_list();
+  for (int64 i = 0; i < 1000; ++i) {
+    ids->add_value(i % 100 < 50
+                       ? i % 128
+                       : static_cast<int64>(static_cast<uint64>(i * 7919)
+                                            << (i % 50)));
+    ids->add_value(-i);
+    weights->add_value(i * 0.25f);
+  }
+  TestCorrectness(Serialize(example));
+}
+
+string EncodeVarints(const std::vector<int64>& values) {
+  string encoded;
+  for (int64 value : values) {
+    core::PutVarint64(&encoded, static_cast<uint64>(value));
+  }
+  return encoded;
+}
+
+// Decodes `encoded` with the scalar decoder and every SIMD decoder that the
+// CPU supports, and checks that they all return `expected`, or all fail if
+// `expected` is null.
+void ExpectVarintsDecodeTo(const string& encoded,
+                           const std::vector<int64>* expected) {
+  const uint8* begin = reinterpret_cast<const uint8*>(encoded.data());
+  const uint8* end = begin + encoded.size();
+  for (const VarintDecoder& decoder : TestVarintDecoders()) {
+    SCOPED_TRACE(decoder.name);
+    const size_t count = decoder.count(begin, end);
+    std::vector<int64> values(count);
+    if (expected == nullptr) {
+      EXPECT_FALSE(decoder.decode(begin, end, values.data()));
+    } else {
+      ASSERT_EQ(expected->size(), count);
+      EXPECT_TRUE(decoder.decode(begin, end, values.data()));
+      EXPECT_EQ(*expected, values);
+    }
+  }
+}
+
+TEST(VarintDecoders, EveryLength) {
+  std::vector<int64> values;
+  for (int shift = 0; shift < 64; shift += 7) {
+    values.push_back(static_cast<int64>((uint64{1} << shift) - 1));
+    values.push_back(static_cast<int64>(uint64{1} << shift));
+  }
+  // Negative values take ten bytes.
+  values.push_back(-1);
+  values.push_back(std::numeric_limits<int64>::min());
+  const string encoded = EncodeVarints(values);
+  ExpectVarintsDecodeTo(encoded, &values);
+
+  // Multi-byte varints that straddle a 16- or 32-byte chunk.
+  for (int offset = 0; offset < 40; ++offset) {
+    std::vector<int64> shifted(offset, 1);
+    shifted.insert(shifted.end(), values.begin(), values.end());
+    shifted.insert(shifted.end(), 40, 1);
+    ExpectVarintsDecodeTo(EncodeVarints(shifted), &shifted);
+  }
+}
+
+TEST(VarintDecoders, Random) {
+  random::PhiloxRandom philox(1337);
+  random::SimplePhilox rng(&philox);
+  for (int run = 0; run < 500; ++run) {
+    std::vector<int64> values(rng.Uniform(200));
+    for (int64& value : values) {
+      // Mostly runs of one-byte varints, as in lists of small ids.
+      value = rng.OneIn(4)
+                  ? static_cast<int64>(rng.Rand64() >> rng.Uniform(64))
+                  : rng.Uniform(128);
+    }
+    ExpectVarintsDecodeTo(EncodeVarints(values), &values);
+  }
+}
+
+TEST(VarintDecoders, RejectMalformedVarints) {
+  for (int offset = 0; offset < 40; ++offset) {
+    const string prefix = EncodeVarints(std::vector<int64>(offset, 1));
+    // A ten-byte varint cut short anywhere.
+    const string full = prefix + EncodeVarints({-1});
+    for (size_t size = prefix.size() + 1; size < full.size(); ++size) {
+      ExpectVarintsDecodeTo(full.substr(0, size), nullptr);
+    }
+    // An eleven-byte varint.
+    ExpectVarintsDecodeTo(prefix + string(10, '\x80') + string(1, '\x01'),
+                          nullptr);
+  }
+}
+
 TEST(FastParse, EmptyFeatures) {
   Example example;
   example.mutable_features();
@@ -346,6 +448,37 @@ TEST(TestFastParseExample, Empty) {
   EXPECT_TRUE(status.ok()) << status;
 }
 
+TEST(TestFastParseExample, DenseLongPacked) {
+  constexpr int64 kNumValues = 100;
+  Example example;
+  auto* ids = (*example.mutable_features()->mutable_feature())["ids"]
+                  .mutable_int64_list();
+  for (int64 i = 0; i < kNumValues; ++i) {
+    ids->add_value(i < kNumValues / 2 ? i : i << 20);
+  }
+  const string serialized = Serialize(example);
+
+  Result result;
+  FastParseExampleConfig config;
+  config.dense.push_back({"ids", DT_INT64, TensorShape({kNumValues}),
+                          Tensor(DT_INT64, TensorShape({0})),
+                          /*variable_length=*/false, kNumValues});
+  TF_ASSERT_OK(FastParseExample(config, {serialized, serialized}, {}, nullptr,
+                                &result));
+  ASSERT_EQ(1, result.dense_values.size());
+  auto values = result.dense_values[0].matrix<int64>();
+  for (int64 i = 0; i < kNumValues; ++i) {
+    EXPECT_EQ(ids->value(i), values(0, i));
+    EXPECT_EQ(ids->value(i), values(1, i));
+  }
+
+  // A list longer than the dense shape is an error rather than a truncation.
+  ids->add_value(0);
+  EXPECT_FALSE(FastParseExample(config, {Serialize(example)}, {}, nullptr,
+                                &result)
+                   .ok());
+}
+
 }  // namespace
 }  // namespace example
 }  // namespace tensorflow
@@ -21,6 +21,7 @@ limitations under the License.
 #include <memory>
 #include <utility>
 
+#include "tensorflow/core/framework/allocation_description.pb.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb_text.h"
@@ -40,6 +41,7 @@ limitations under the License.
 #include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/io/table_builder.h"
 #include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/util/saved_tensor_slice_util.h"
 #include "tensorflow/core/util/tensor_slice_util.h"
@@ -59,6 +61,50 @@ static const int kBufferSize = 1024 * 1024;
 // bundle.
 const char* const kHeaderEntryKey = "";
 
+// Suffixes of the keys of the entries that hold the indices and the values of
+// the rows of a delta, after the key of its entry.
+const char* const kDeltaIndicesSuffix = "/.DELTA_INDICES";
+const char* const kDeltaRowsSuffix = "/.DELTA_ROWS";
+
+bool IsDeltaDataKey(StringPiece key) {
+  return str_util::EndsWith(key, kDeltaIndicesSuffix) ||
+         str_util::EndsWith(key, kDeltaRowsSuffix);
+}
+
+// A buffer for tensor data in a read-only mapping of a data file, which it
+// keeps alive.  It does not own its memory, so that kernels never reuse it for
+// an output.
+class MappedBundleTensorBuffer : public TensorBuffer {
+ public:
+  static Tensor MakeTensor(DataType dtype, const TensorShape& shape,
+                           const char* data, size_t size,
+                           std::shared_ptr<ReadOnlyMemoryRegion> region) {
+    MappedBundleTensorBuffer* buffer =
+        new MappedBundleTensorBuffer(data, size, std::move(region));
+    Tensor tensor(dtype, shape, buffer);
+    buffer->Unref();
+    return tensor;
+  }
+
+  void* data() const override { return const_cast<char*>(data_); }
+  size_t size() const override { return size_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("MappedBundleFile");
+  }
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  MappedBundleTensorBuffer(const char* data, size_t size,
+                           std::shared_ptr<ReadOnlyMemoryRegion> region)
+      : data_(data), size_(size), region_(std::move(region)) {}
+
+  const char* const data_;
+  const size_t size_;
+  const std::shared_ptr<ReadOnlyMemoryRegion> region_;
+};
+
 namespace {
 
 // Reads "num_elements" string elements from file[offset, offset+size) into the
@@ -178,6 +224,15 @@ Status ReadVariantTensor(io::InputBuffer* buffered_file, Tensor* ret,
   return Status::OK();
 }
 
+// Returns true iff "ptr" is aligned as Eigen requires for tensor data.
+bool IsAlignedForTensor(const void* ptr) {
+#if EIGEN_MAX_ALIGN_BYTES == 0
+  return true;
+#else
+  return reinterpret_cast<intptr_t>(ptr) % EIGEN_MAX_ALIGN_BYTES == 0;
+#endif
+}
+
 char* GetBackingBuffer(const Tensor& val) {
   CHECK(DataTypeCanUseMemcpy(val.dtype())) << val.dtype();
   return const_cast<char*>(val.tensor_data().data());
@@ -365,6 +420,59 @@ Status PadAlignment(FileOutputBuffer* out, int alignment, int64* size) {
   return status;
 }
 
+// Overwrites the rows `indices` of `val` with `rows`, which hold the rows of
+// a delta stored under `key`.
+Status ApplyDeltaRows(StringPiece key, const Tensor& indices,
+                      const Tensor& rows, Tensor* val) {
+  if (indices.dtype() != DT_INT64 ||
+      !TensorShapeUtils::IsVector(indices.shape()) ||
+      rows.dtype() != val->dtype() || rows.dims() != val->dims() ||
+      rows.dim_size(0) != indices.NumElements()) {
+    return errors::DataLoss("Invalid delta of ", key, ": indices ",
+                            indices.shape().DebugString(), " and rows ",
+                            rows.shape().DebugString(), " for a tensor of ",
+                            val->shape().DebugString());
+  }
+  for (int d = 1; d < val->dims(); ++d) {
+    if (rows.dim_size(d) != val->dim_size(d)) {
+      return errors::DataLoss("Invalid delta of ", key, ": rows ",
+                              rows.shape().DebugString(),
+                              " for a tensor of ", val->shape().DebugString());
+    }
+  }
+  const int64 num_rows = val->dim_size(0);
+  const int64 row_size = num_rows == 0 ? 0 : val->NumElements() / num_rows;
+  const auto indices_vec = indices.vec<int64>();
+  for (int64 i = 0; i < indices_vec.size(); ++i) {
+    if (indices_vec(i) < 0 || indices_vec(i) >= num_rows) {
+      return errors::DataLoss("Invalid delta of ", key, ": row ",
+                              indices_vec(i), " is not in [0, ", num_rows,
+                              ")");
+    }
+  }
+
+  if (DataTypeCanUseMemcpy(val->dtype())) {
+    const int64 row_bytes = row_size * DataTypeSize(val->dtype());
+    const char* src = rows.tensor_data().data();
+    char* dst = const_cast<char*>(val->tensor_data().data());
+    for (int64 i = 0; i < indices_vec.size(); ++i) {
+      memcpy(dst + indices_vec(i) * row_bytes, src + i * row_bytes, row_bytes);
+    }
+  } else if (val->dtype() == DT_STRING) {
+    const auto src = rows.flat<string>();
+    auto dst = val->flat<string>();
+    for (int64 i = 0; i < indices_vec.size(); ++i) {
+      for (int64 j = 0; j < row_size; ++j) {
+        dst(indices_vec(i) * row_size + j) = src(i * row_size + j);
+      }
+    }
+  } else {
+    return errors::Unimplemented("Deltas of ", DataTypeString(val->dtype()),
+                                 " tensors are not supported");
+  }
+  return Status::OK();
+}
+
 }  // namespace
 
 BundleWriter::BundleWriter(Env* env, StringPiece prefix, const Options& options)
@@ -440,6 +548,17 @@ Status BundleWriter::AddSlice(StringPiece full_tensor_key,
     return Add(full_tensor_key, slice_tensor);
   }
 
+  // The slice itself is handled by a regular Add(), which includes adding its
+  // own metadata entry, and writing out the slice's values.
+  const string slice_name = AddSliceToFullTensorEntry(
+      full_tensor_key, full_tensor_shape, slice_spec, slice_tensor.dtype());
+  status_ = Add(slice_name, slice_tensor);
+  return status_;
+}
+
+string BundleWriter::AddSliceToFullTensorEntry(
+    StringPiece full_tensor_key, const TensorShape& full_tensor_shape,
+    const TensorSlice& slice_spec, DataType dtype) {
   // Inserts/updates the full tensor's metadata entry.
   //
   // In the case of a sharded save, MergeBundles() is responsible for merging
@@ -448,7 +567,7 @@ Status BundleWriter::AddSlice(StringPiece full_tensor_key,
   const string full_tensor_key_string = std::string(full_tensor_key);
   BundleEntryProto* full_entry = &entries_[full_tensor_key_string];
   if (full_entry->dtype() != DT_INVALID) {
-    CHECK_EQ(full_entry->dtype(), slice_tensor.dtype());
+    CHECK_EQ(full_entry->dtype(), dtype);
   }
   if (full_entry->has_shape()) {
     CHECK(TensorShape(full_entry->shape()) == full_tensor_shape);
@@ -456,17 +575,86 @@ Status BundleWriter::AddSlice(StringPiece full_tensor_key,
 
   // Populates dtype, shape, and slices.  Intentionally leaving out shard_id and
   // offset, which do not make sense for this full tensor entry.
-  full_entry->set_dtype(slice_tensor.dtype());
+  full_entry->set_dtype(dtype);
   full_tensor_shape.AsProto(full_entry->mutable_shape());
   TensorSliceProto* slice_proto = full_entry->add_slices();
   slice_spec.AsProto(slice_proto);
 
-  // The slice itself is handled by a regular Add(), which includes adding its
-  // own metadata entry, and writing out the slice's values.
-  const string slice_name =
-      checkpoint::EncodeTensorNameSlice(full_tensor_key_string, slice_spec);
-  status_ = Add(slice_name, slice_tensor);
-  return status_;
+  return checkpoint::EncodeTensorNameSlice(full_tensor_key_string, slice_spec);
+}
+
+Status BundleWriter::AddDelta(StringPiece key, const TensorShape& shape,
+                              StringPiece base_prefix, const Tensor& indices,
+                              const Tensor& rows) {
+  if (!status_.ok()) return status_;
+  CHECK_NE(key, kHeaderEntryKey);
+  const string key_string = std::string(key);
+  if (entries_.find(key_string) != entries_.end()) {
+    status_ = errors::InvalidArgument("Adding duplicate key: ", key);
+    return status_;
+  }
+  if (base_prefix.empty()) {
+    return errors::InvalidArgument("The delta of ", key,
+                                   " has no base bundle");
+  }
+  if (!DataTypeCanUseMemcpy(rows.dtype()) && rows.dtype() != DT_STRING) {
+    return errors::InvalidArgument("Deltas of ", DataTypeString(rows.dtype()),
+                                   " tensors are not supported");
+  }
+  if (indices.dtype() != DT_INT64 ||
+      !TensorShapeUtils::IsVector(indices.shape()) || shape.dims() == 0 ||
+      rows.dims() != shape.dims() ||
+      rows.dim_size(0) != indices.NumElements()) {
+    return errors::InvalidArgument(
+        "The delta of ", key, " must have int64 indices of shape [n] and rows "
+        "of shape [n, ...], got ", DataTypeString(indices.dtype()), " ",
+        indices.shape().DebugString(), " and ", rows.shape().DebugString());
+  }
+  for (int d = 1; d < shape.dims(); ++d) {
+    if (rows.dim_size(d) != shape.dim_size(d)) {
+      return errors::InvalidArgument("The rows of the delta of ", key,
+                                     " have shape ",
+                                     rows.shape().DebugString(),
+                                     " which does not match the tensor shape ",
+                                     shape.DebugString());
+    }
+  }
+  const auto indices_vec = indices.vec<int64>();
+  for (int64 i = 0; i < indices_vec.size(); ++i) {
+    if (indices_vec(i) < 0 || indices_vec(i) >= shape.dim_size(0)) {
+      return errors::InvalidArgument("Row ", indices_vec(i),
+                                     " of the delta of ", key,
+                                     " is not in [0, ", shape.dim_size(0), ")");
+    }
+  }
+
+  TF_RETURN_IF_ERROR(Add(strings::StrCat(key, kDeltaIndicesSuffix), indices));
+  TF_RETURN_IF_ERROR(Add(strings::StrCat(key, kDeltaRowsSuffix), rows));
+  BundleEntryProto* entry = &entries_[key_string];
+  entry->set_dtype(rows.dtype());
+  shape.AsProto(entry->mutable_shape());
+  entry->set_delta_base(std::string(base_prefix));
+  return Status::OK();
+}
+
+Status BundleWriter::AddSliceDelta(StringPiece full_tensor_key,
+                                   const TensorShape& full_tensor_shape,
+                                   const TensorSlice& slice_spec,
+                                   StringPiece base_prefix,
+                                   const Tensor& indices, const Tensor& rows) {
+  if (!status_.ok()) return status_;
+  CHECK_NE(full_tensor_key, kHeaderEntryKey);
+
+  if (IsFullSlice(slice_spec, full_tensor_shape)) {
+    return AddDelta(full_tensor_key, full_tensor_shape, base_prefix, indices,
+                    rows);
+  }
+  TensorShape slice_shape;
+  TF_RETURN_IF_ERROR(slice_spec.SliceTensorShape(full_tensor_shape,
+                                                 &slice_shape));
+  const string slice_name = AddSliceToFullTensorEntry(
+      full_tensor_key, full_tensor_shape, slice_spec, rows.dtype());
+  return AddDelta(slice_name, slice_shape, base_prefix, indices, rows);
 }
 
 // TODO(zongheng): on metadata write failure or !status_.ok(), consider removing
@@ -863,7 +1051,11 @@ Status BundleReader::Lookup(StringPiece key, Tensor* val) {
   BundleEntryProto entry;
   TF_RETURN_IF_ERROR(GetBundleEntryProto(key, &entry));
 
-  if (entry.slices().empty()) {
+  if (!entry.delta_base().empty()) {
+    return GetDeltaValue(
+        key, entry, key,
+        /* a full slice */ TensorSlice(TensorShape(entry.shape()).dims()), val);
+  } else if (entry.slices().empty()) {
     return GetValue(entry, val);
   } else {
     return GetSliceValue(
@@ -872,6 +1064,73 @@ Status BundleReader::Lookup(StringPiece key, Tensor* val) {
   }
 }
 
+Status BundleReader::LookupMapped(StringPiece key, Tensor* val) {
+  CHECK(val != nullptr);
+  BundleEntryProto entry;
+  TF_RETURN_IF_ERROR(GetBundleEntryProto(key, &entry));
+  const TensorShape shape(entry.shape());
+
+  if (entry.slices().empty() && entry.delta_base().empty() &&
+      DataTypeCanUseMemcpy(entry.dtype())) {
+    std::shared_ptr<ReadOnlyMemoryRegion> region;
+    TF_RETURN_IF_ERROR(GetMappedDataFile(entry.shard_id(), &region));
+    if (region != nullptr &&
+        IsAlignedForTensor(static_cast<const char*>(region->data()) +
+                           entry.offset())) {
+      const size_t expected_size =
+          shape.num_elements() * DataTypeSize(entry.dtype());
+      if (entry.size() != expected_size) {
+        return errors::DataLoss("Invalid size in bundle entry: key ", key,
+                                "; stored size ", entry.size(),
+                                "; expected size ", expected_size);
+      }
+      if (entry.offset() + entry.size() > region->length()) {
+        return errors::DataLoss("Data for key ", key,
+                                " extends past the end of data file ",
+                                DataFilename(prefix_, entry.shard_id(),
+                                             num_shards_));
+      }
+      const char* data =
+          static_cast<const char*>(region->data()) + entry.offset();
+      const uint32 actual_crc32c = crc32c::Value(data, entry.size());
+      if (crc32c::Unmask(entry.crc32c()) != actual_crc32c) {
+        return errors::DataLoss(
+            "Checksum does not match: stored ",
+            strings::Printf("%08u", crc32c::Unmask(entry.crc32c())),
+            " vs. calculated on the restored bytes ", actual_crc32c);
+      }
+      *val = MappedBundleTensorBuffer::MakeTensor(
+          entry.dtype(), shape, data, entry.size(), std::move(region));
+      return Status::OK();
+    }
+  }
+
+  *val = Tensor(entry.dtype(), shape);
+  if (!entry.delta_base().empty()) {
+    return GetDeltaValue(key, entry, key,
+                         /* a full slice */ TensorSlice(shape.dims()), val);
+  } else if (entry.slices().empty()) {
+    return GetValue(entry, val);
+  } else {
+    return GetSliceValue(key, entry,
+                         /* a full slice */ TensorSlice(shape.dims()), val);
+  }
+}
+
+Status BundleReader::GetMappedDataFile(
+    int32 shard_id, std::shared_ptr<ReadOnlyMemoryRegion>* region) {
+  auto it = mapped_data_.find(shard_id);
+  if (it == mapped_data_.end()) {
+    std::unique_ptr<ReadOnlyMemoryRegion> new_region;
+    Status s = env_->NewReadOnlyMemoryRegionFromFile(
+        DataFilename(prefix_, shard_id, num_shards_), &new_region);
+    if (!s.ok() && !errors::IsUnimplemented(s)) return s;
+    it = mapped_data_.emplace(shard_id, std::move(new_region)).first;
+  }
+  *region = it->second;
+  return Status::OK();
+}
+
 Status BundleReader::ReadCurrent(Tensor* val) {
   CHECK(val != nullptr);
   BundleEntryProto entry;
@@ -881,7 +1140,11 @@ Status BundleReader::ReadCurrent(Tensor* val) {
                             ProtoShortDebugString(entry.shape()));
   }
 
-  if (entry.slices().empty()) {
+  if (!entry.delta_base().empty()) {
+    return GetDeltaValue(
+        iter_->key(), entry, iter_->key(),
+        /* a full slice */ TensorSlice(TensorShape(entry.shape()).dims()), val);
+  } else if (entry.slices().empty()) {
     return GetValue(entry, val);
   } else {
     return GetSliceValue(
@@ -958,12 +1221,11 @@ Status BundleReader::GetSliceValue(StringPiece full_tensor_key,
 
     // We already have the entry for the full tensor, so don't query again if
     // the slice is full.
+    string stored_slice_key = full_tensor_key_string;
     if (!stored_slice.IsFull()) {
-      const string encoded_stored_slice_name =
-          checkpoint::EncodeTensorNameSlice(full_tensor_key_string,
-                                            stored_slice);
-      status_ =
-          GetBundleEntryProto(encoded_stored_slice_name, &stored_slice_entry);
+      stored_slice_key = checkpoint::EncodeTensorNameSlice(
+          full_tensor_key_string, stored_slice);
+      status_ = GetBundleEntryProto(stored_slice_key, &stored_slice_entry);
       if (!status_.ok()) return status_;
     }
 
@@ -984,13 +1246,23 @@ Status BundleReader::GetSliceValue(StringPiece full_tensor_key,
       VLOG(1) << "Optimized for common case: directly copying into "
                  "pre-allocated buffer; spec: "
               << slice_spec.DebugString();
+      if (!stored_slice_entry.delta_base().empty()) {
+        return GetDeltaValue(stored_slice_key, stored_slice_entry,
+                             full_tensor_key, stored_slice, val);
+      }
       status_ = GetValue(stored_slice_entry, val);
       return status_;
     }
 
     Tensor stored_slice_tensor(stored_slice_entry.dtype(), stored_slice_shape);
-    status_ = GetValue(stored_slice_entry, &stored_slice_tensor);
-    if (!status_.ok()) return status_;
+    if (!stored_slice_entry.delta_base().empty()) {
+      TF_RETURN_IF_ERROR(GetDeltaValue(stored_slice_key, stored_slice_entry,
+                                       full_tensor_key, stored_slice,
+                                       &stored_slice_tensor));
+    } else {
+      status_ = GetValue(stored_slice_entry, &stored_slice_tensor);
+      if (!status_.ok()) return status_;
+    }
 
     // Copies the intersection over.
     const DataType common_dtype = full_tensor_entry.dtype();
@@ -1024,6 +1296,66 @@ Status BundleReader::GetSliceValue(StringPiece full_tensor_key,
   return Status::OK();
 }
 
+Status BundleReader::GetDeltaValue(StringPiece key,
+                                   const BundleEntryProto& entry,
+                                   StringPiece full_tensor_key,
+                                   const TensorSlice& slice_spec, Tensor* val) {
+  const TensorShape shape(entry.shape());
+  if (val->NumElements() == 0) {
+    *val = Tensor(entry.dtype(), shape);
+  }
+  if (val->dtype() != entry.dtype() || val->shape() != shape) {
+    return errors::InvalidArgument(
+        "The delta of ", key, " has dtype ", DataTypeString(entry.dtype()),
+        " and shape ", shape.DebugString(), " but the output tensor has ",
+        DataTypeString(val->dtype()), " and ", val->shape().DebugString());
+  }
+
+  // Reads the tensor (or the slice of it) from the base bundle, which may
+  // itself hold a delta of it, and then overwrites the rows of this delta.
+  // The keys are copied first since they may point into "iter_".
+  const string key_string = std::string(key);
+  BundleReader* base;
+  TF_RETURN_IF_ERROR(GetBaseReader(entry.delta_base(), &base));
+  TF_RETURN_IF_ERROR(base->LookupSlice(full_tensor_key, slice_spec, val));
+
+  Tensor indices;
+  Tensor rows;
+  TF_RETURN_IF_ERROR(
+      Lookup(strings::StrCat(key_string, kDeltaIndicesSuffix), &indices));
+  TF_RETURN_IF_ERROR(
+      Lookup(strings::StrCat(key_string, kDeltaRowsSuffix), &rows));
+  return ApplyDeltaRows(key_string, indices, rows, val);
+}
+
+Status BundleReader::GetBaseReader(const string& base_prefix,
+                                   BundleReader** base) {
+  // A base prefix without a directory is relative to the directory of this
+  // bundle, so that a chain of checkpoints can be moved as a whole.
+  string prefix = base_prefix;
+  if (io::Dirname(base_prefix).empty()) {
+    prefix = io::JoinPath(io::Dirname(prefix_), base_prefix);
+  }
+  if (prefix == prefix_) {
+    return errors::DataLoss("Bundle ", prefix_, " is its own delta base");
+  }
+  if (std::find(delta_chain_.begin(), delta_chain_.end(), prefix) !=
+      delta_chain_.end()) {
+    return errors::DataLoss("The delta base ", prefix, " of bundle ", prefix_,
+                            " is a delta from it, directly or indirectly");
+  }
+  auto it = base_readers_.find(prefix);
+  if (it == base_readers_.end()) {
+    std::unique_ptr<BundleReader> reader(new BundleReader(env_, prefix));
+    TF_RETURN_IF_ERROR(reader->status());
+    reader->delta_chain_ = delta_chain_;
+    reader->delta_chain_.push_back(prefix_);
+    it = base_readers_.emplace(prefix, std::move(reader)).first;
+  }
+  *base = it->second.get();
+  return Status::OK();
+}
+
 bool BundleReader::Contains(StringPiece key) {
   Seek(key);
   return Valid() && (this->key() == key);
@@ -1049,6 +1381,7 @@ string BundleReader::DebugString() {
   BundleEntryProto entry;
   Seek(kHeaderEntryKey);
   for (Next(); Valid(); Next()) {
+    if (IsDeltaDataKey(key())) continue;
     CHECK(entry.ParseFromArray(value().data(), value().size()));
     if (entry.slices_size() > 0) continue;  // Slice of some partitioned var.
 
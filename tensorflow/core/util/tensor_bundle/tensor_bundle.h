@@ -64,8 +64,10 @@ limitations under the License.
 #include "tensorflow/core/protobuf/tensor_bundle.pb.h"
 
 #include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
@@ -99,6 +101,11 @@ extern const int kTensorBundleVersion;
 // corresponding value is a BundleHeaderProto.
 extern const char* const kHeaderEntryKey;
 
+// Returns true if "key" is the key of an entry that holds the indices or the
+// rows of a tensor stored as a delta (see BundleWriter::AddDelta()), rather
+// than a tensor of its own.  Listings of the tensors of a bundle skip these.
+bool IsDeltaDataKey(StringPiece key);
+
 // Builds a string-string table of tensor names to BundleEntryProto (metadata).
 //
 // On construction, attempts to create a directory given by the dirname of
@@ -140,12 +147,37 @@ class BundleWriter {
                   const TensorShape& full_tensor_shape,
                   const TensorSlice& slice_spec, const Tensor& slice_tensor);
 
+  // Incremental checkpoints support.
+  // Adds the tensor "key", of shape "shape", as a delta from its value in the
+  // bundle "base_prefix": only the "rows" at the int64 "indices", i.e. its
+  // slices along the first dimension, are stored, and the other rows are read
+  // from the base bundle, which may itself store the tensor as a delta.  See
+  // BundleEntryProto::delta_base.
+  Status AddDelta(StringPiece key, const TensorShape& shape,
+                  StringPiece base_prefix, const Tensor& indices,
+                  const Tensor& rows);
+
+  // Like AddSlice(), adds the slice "slice_spec" of the tensor
+  // "full_tensor_key" as a delta, with "indices" relative to the start of the
+  // slice.
+  Status AddSliceDelta(StringPiece full_tensor_key,
+                       const TensorShape& full_tensor_shape,
+                       const TensorSlice& slice_spec, StringPiece base_prefix,
+                       const Tensor& indices, const Tensor& rows);
+
   // Finishes the writer and flushes.
   Status Finish() TF_MUST_USE_RESULT;
 
   Status status() const { return status_; }
 
  private:
+  // Adds "slice_spec" to the entry of the partitioned tensor
+  // "full_tensor_key", and returns the key of the entry of the slice.
+  string AddSliceToFullTensorEntry(StringPiece full_tensor_key,
+                                   const TensorShape& full_tensor_shape,
+                                   const TensorSlice& slice_spec,
+                                   DataType dtype);
+
   Env* const env_;  // Not owned.
   const Options options_;
   const string prefix_;
@@ -206,6 +238,8 @@ class BundleReader {
 
   // Looks up the tensor keyed by "key".  If "key" refers to a partitioned
   // tensor, attempts to look up the full contents using all stored slices.
+  // Tensors and slices stored as deltas (see BundleWriter::AddDelta()) are
+  // read from their base bundles, with the stored rows replaced.
   //
   // Caller must make sure "val" has the same shape and dtype as the
   // corresponding contents, so that its buffer can be filled without needing
@@ -218,6 +252,23 @@ class BundleReader {
   // REQUIRES: status().ok()
   Status Lookup(StringPiece key, Tensor* val) TF_MUST_USE_RESULT;
 
+  // Looks up the tensor keyed by "key", without requiring "val" to be
+  // allocated.  If the tensor is stored whole, its dtype can be memcpy'ed and
+  // its data is aligned to EIGEN_MAX_ALIGN_BYTES in the data file (see
+  // BundleWriter::Options::data_alignment), "*val" is backed directly by a
+  // read-only memory mapping of the data file, if the file system supports
+  // it.  Such a tensor does not own its memory, so kernels never forward it
+  // to an output that they write into.  In particular, assigning it to a
+  // variable copies it, so mapping only avoids a copy for consumers that read
+  // the tensor, not when restoring variables.  Otherwise, the tensor is read
+  // into a newly allocated "*val" as by Lookup().
+  //
+  // The data file must not be modified while the returned tensor is alive.
+  //
+  // Validates the stored crc32c checksum against the restored bytes.
+  // REQUIRES: status().ok()
+  Status LookupMapped(StringPiece key, Tensor* val) TF_MUST_USE_RESULT;
+
   // Looks up the tensor pointed to by the internal iterator.
   //
   // On error, "val" may contain nonsense data.
@@ -274,6 +325,24 @@ class BundleReader {
   Status GetValue(const BundleEntryProto& entry,
                   Tensor* val) TF_MUST_USE_RESULT;
 
+  // Sets "*region" to a read-only mapping of the data file "shard_id", or to
+  // nullptr if the file system does not support mapping it.
+  Status GetMappedDataFile(int32 shard_id,
+                           std::shared_ptr<ReadOnlyMemoryRegion>* region)
+      TF_MUST_USE_RESULT;
+
+  // Reads the value described by "entry", keyed by "key", which stores the
+  // tensor "full_tensor_key", or its slice "slice_spec" unless full, as a
+  // delta.  Usage for "val" follows the comment of "Lookup()".
+  Status GetDeltaValue(StringPiece key, const BundleEntryProto& entry,
+                       StringPiece full_tensor_key,
+                       const TensorSlice& slice_spec,
+                       Tensor* val) TF_MUST_USE_RESULT;
+
+  // Sets "*base" to a reader of the base bundle "base_prefix" of a delta.
+  Status GetBaseReader(const string& base_prefix,
+                       BundleReader** base) TF_MUST_USE_RESULT;
+
   // Reads the slice described by "slice_spec".  The corresponding full tensor
   // has key "ful_tensor_key" and metadata proto "full_tensor_entry".
   // REQUIRES: full_tensor_entry.slices_size() > 0
@@ -291,11 +360,22 @@ class BundleReader {
   table::Iterator* iter_;
   // Owned the InputBuffer objects and their underlying RandomAccessFile's.
   std::unordered_map<int32, io::InputBuffer*> data_;
+  // Read-only mappings of the data files, or nullptr for the files that could
+  // not be mapped.  Populated on-demand by LookupMapped().
+  std::unordered_map<int32, std::shared_ptr<ReadOnlyMemoryRegion>>
+      mapped_data_;
 
   // Maps each partitioned tensor's key to its stored slices (represented in a
   // TensorSliceSet).  Populated on-demand.
   std::unordered_map<string, checkpoint::TensorSliceSet*> tensor_slices_;
 
+  // Readers of the base bundles of the deltas, by prefix.  Populated
+  // on-demand.
+  std::unordered_map<string, std::unique_ptr<BundleReader>> base_readers_;
+  // The prefixes of the bundles whose deltas led to this one, if it was
+  // opened as a delta base, so that a cycle of delta bases is detected.
+  std::vector<string> delta_chain_;
+
   // Expected number of data file shards in the bundle.  Extracted by reading
   // the header entry in the metadata table.
   int num_shards_;
@@ -18,6 +18,7 @@ limitations under the License.
 #include <random>
 #include <vector>
 
+#include "tensorflow/core/framework/tensor_description.pb.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/framework/variant.h"
@@ -671,6 +672,229 @@ TEST(TensorBundleTest, Checksum) {
   }
 }
 
+// Returns the name of the allocator of the buffer of `val`.
+string AllocatorName(const Tensor& val) {
+  TensorDescription description;
+  val.FillDescription(&description);
+  return description.allocation_description().allocator_name();
+}
+
+TEST(TensorBundleTest, LookupMapped) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 64;
+    BundleWriter writer(Env::Default(), Prefix("mapped"), opts);
+    TF_EXPECT_OK(writer.Add("bool", Constant(true, TensorShape({3}))));
+    TF_EXPECT_OK(writer.Add("float", Constant_2x3<float>(1.5f)));
+    TF_EXPECT_OK(writer.Add("int64", Constant_2x3<int64>(7)));
+    TF_EXPECT_OK(writer.Add("strings", test::AsTensor<string>({"a", "bc"})));
+    TF_EXPECT_OK(writer.AddSlice("slice", TensorShape({4}),
+                                 TensorSlice::ParseOrDie("0,2"),
+                                 test::AsTensor<float>({1.f, 2.f})));
+    TF_EXPECT_OK(writer.AddSlice("slice", TensorShape({4}),
+                                 TensorSlice::ParseOrDie("2,2"),
+                                 test::AsTensor<float>({3.f, 4.f})));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader reader(Env::Default(), Prefix("mapped"));
+  TF_ASSERT_OK(reader.status());
+  Tensor val;
+  TF_ASSERT_OK(reader.LookupMapped("float", &val));
+  test::ExpectTensorEqual<float>(Constant_2x3<float>(1.5f), val);
+  if (AllocatorName(val) != "MappedBundleFile") {
+    LOG(INFO) << "Read-only memory regions are not supported; skipping the "
+                 "checks of the mapped tensors.";
+  } else {
+    TF_ASSERT_OK(reader.LookupMapped("int64", &val));
+    test::ExpectTensorEqual<int64>(Constant_2x3<int64>(7), val);
+    EXPECT_EQ("MappedBundleFile", AllocatorName(val));
+  }
+  // Strings and slices are read into allocated tensors.
+  TF_ASSERT_OK(reader.LookupMapped("strings", &val));
+  test::ExpectTensorEqual<string>(test::AsTensor<string>({"a", "bc"}), val);
+  EXPECT_NE("MappedBundleFile", AllocatorName(val));
+  TF_ASSERT_OK(reader.LookupMapped("slice", &val));
+  test::ExpectTensorEqual<float>(test::AsTensor<float>({1.f, 2.f, 3.f, 4.f}),
+                                 val);
+  EXPECT_NE("MappedBundleFile", AllocatorName(val));
+  TF_ASSERT_OK(reader.LookupMapped("bool", &val));
+  test::ExpectTensorEqual<bool>(Constant(true, TensorShape({3})), val);
+  EXPECT_TRUE(errors::IsNotFound(reader.LookupMapped("nonexist", &val)));
+}
+
+TEST(TensorBundleTest, LookupMappedUnaligned) {
+  {
+    BundleWriter writer(Env::Default(), Prefix("mapped_unaligned"));
+    TF_EXPECT_OK(writer.Add("a", Constant(true, TensorShape({1}))));
+    TF_EXPECT_OK(writer.Add("b", Constant_2x3<float>(2.f)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader reader(Env::Default(), Prefix("mapped_unaligned"));
+  TF_ASSERT_OK(reader.status());
+  // "b" starts one byte into the data file, so it is copied.
+  Tensor val;
+  TF_ASSERT_OK(reader.LookupMapped("b", &val));
+  test::ExpectTensorEqual<float>(Constant_2x3<float>(2.f), val);
+  EXPECT_NE("MappedBundleFile", AllocatorName(val));
+}
+
+TEST(TensorBundleTest, LookupMappedChecksum) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 64;
+    BundleWriter writer(Env::Default(), Prefix("mapped_checksum"), opts);
+    TF_EXPECT_OK(writer.Add("foo", Constant_2x3<float>(1.f)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  const string datafile = DataFilename(Prefix("mapped_checksum"), 0, 1);
+  string data;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), datafile, &data));
+  data[0] = ~data[0];
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), datafile, data));
+
+  BundleReader reader(Env::Default(), Prefix("mapped_checksum"));
+  TF_ASSERT_OK(reader.status());
+  Tensor val;
+  Status status = reader.LookupMapped("foo", &val);
+  EXPECT_TRUE(errors::IsDataLoss(status));
+  EXPECT_TRUE(
+      str_util::StrContains(status.ToString(), "Checksum does not match"));
+}
+
+TEST(TensorBundleTest, Deltas) {
+  const TensorShape kShape({4, 3});
+  // The base holds all rows, the first delta rows 1 and 3 relative to the
+  // directory of the bundle, and the second delta row 3 again.
+  {
+    BundleWriter writer(Env::Default(), Prefix("delta/base"));
+    TF_ASSERT_OK(writer.Add("foo", Constant<float>(0.f, kShape)));
+    TF_ASSERT_OK(writer.Add("bar", Constant<string>("a", kShape)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  {
+    BundleWriter writer(Env::Default(), Prefix("delta/delta1"));
+    TF_ASSERT_OK(writer.AddDelta("foo", kShape, "base",
+                                 test::AsTensor<int64>({1, 3}),
+                                 Constant<float>(1.f, TensorShape({2, 3}))));
+    TF_ASSERT_OK(writer.AddDelta("bar", kShape, "base",
+                                 test::AsTensor<int64>({0}),
+                                 Constant<string>("b", TensorShape({1, 3}))));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  {
+    BundleWriter writer(Env::Default(), Prefix("delta/delta2"));
+    TF_ASSERT_OK(writer.AddDelta("foo", kShape, Prefix("delta/delta1"),
+                                 test::AsTensor<int64>({3}),
+                                 Constant<float>(2.f, TensorShape({1, 3}))));
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  Tensor expected_foo(DT_FLOAT, kShape);
+  test::FillValues<float>(&expected_foo,
+                          {0, 0, 0, 1, 1, 1, 0, 0, 0, 2, 2, 2});
+  {
+    BundleReader reader(Env::Default(), Prefix("delta/delta2"));
+    TF_ASSERT_OK(reader.status());
+    Expect<float>(&reader, "foo", expected_foo);
+
+    Tensor val;
+    TF_ASSERT_OK(reader.LookupMapped("foo", &val));
+    test::ExpectTensorEqual<float>(val, expected_foo);
+
+    // Reads rows 1 and 2 only.
+    Tensor slice_val(DT_FLOAT, TensorShape({2, 3}));
+    TF_ASSERT_OK(reader.LookupSlice("foo", TensorSlice::ParseOrDie("1,2:-"),
+                                    &slice_val));
+    test::ExpectTensorEqual<float>(
+        slice_val, test::AsTensor<float>({1, 1, 1, 0, 0, 0}, {2, 3}));
+  }
+  {
+    BundleReader reader(Env::Default(), Prefix("delta/delta1"));
+    TF_ASSERT_OK(reader.status());
+    Tensor expected_bar(DT_STRING, kShape);
+    test::FillValues<string>(&expected_bar, {"b", "b", "b", "a", "a", "a",
+                                             "a", "a", "a", "a", "a", "a"});
+    Expect<string>(&reader, "bar", expected_bar);
+
+    // The indices and rows of the deltas are not listed as tensors.
+    EXPECT_EQ("bar (DT_STRING) [4,3]\nfoo (DT_FLOAT) [4,3]\n",
+              reader.DebugString());
+  }
+}
+
+TEST(TensorBundleTest, SliceDeltas) {
+  const TensorShape kFullShape({4, 2});
+  const TensorSlice kSlice1 = TensorSlice::ParseOrDie("0,2:-");
+  const TensorSlice kSlice2 = TensorSlice::ParseOrDie("2,2:-");
+  {
+    BundleWriter writer(Env::Default(), Prefix("slice_delta_base"));
+    TF_ASSERT_OK(writer.AddSlice("foo", kFullShape, kSlice1,
+                                 Constant<float>(0.f, TensorShape({2, 2}))));
+    TF_ASSERT_OK(writer.AddSlice("foo", kFullShape, kSlice2,
+                                 Constant<float>(0.f, TensorShape({2, 2}))));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  {
+    // The indices of a delta of a slice are relative to the slice.
+    BundleWriter writer(Env::Default(), Prefix("slice_delta"));
+    TF_ASSERT_OK(writer.AddSliceDelta(
+        "foo", kFullShape, kSlice1, Prefix("slice_delta_base"),
+        test::AsTensor<int64>({1}), Constant<float>(1.f, TensorShape({1, 2}))));
+    TF_ASSERT_OK(writer.AddSlice("foo", kFullShape, kSlice2,
+                                 Constant<float>(2.f, TensorShape({2, 2}))));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader reader(Env::Default(), Prefix("slice_delta"));
+  TF_ASSERT_OK(reader.status());
+  Tensor val(DT_FLOAT, kFullShape);
+  TF_ASSERT_OK(reader.Lookup("foo", &val));
+  test::ExpectTensorEqual<float>(
+      val, test::AsTensor<float>({0, 0, 1, 1, 2, 2, 2, 2}, kFullShape));
+}
+
+TEST(TensorBundleTest, DeltaErrors) {
+  const TensorShape kShape({4, 3});
+  BundleWriter writer(Env::Default(), Prefix("delta_errors"));
+  const Tensor indices = test::AsTensor<int64>({1});
+  const Tensor rows = Constant<float>(1.f, TensorShape({1, 3}));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      writer.AddDelta("foo", kShape, "", indices, rows)));
+  EXPECT_TRUE(errors::IsInvalidArgument(writer.AddDelta(
+      "foo", kShape, "base", test::AsTensor<int32>({1}), rows)));
+  EXPECT_TRUE(errors::IsInvalidArgument(writer.AddDelta(
+      "foo", kShape, "base", test::AsTensor<int64>({4}), rows)));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      writer.AddDelta("foo", kShape, "base", indices,
+                      Constant<float>(1.f, TensorShape({1, 2})))));
+  TF_ASSERT_OK(writer.AddDelta("foo", kShape, "missing_base", indices, rows));
+  TF_ASSERT_OK(writer.Finish());
+
+  BundleReader reader(Env::Default(), Prefix("delta_errors"));
+  TF_ASSERT_OK(reader.status());
+  Tensor val;
+  EXPECT_TRUE(errors::IsNotFound(reader.Lookup("foo", &val)));
+}
+
+TEST(TensorBundleTest, DeltaBaseCycle) {
+  const TensorShape kShape({4, 3});
+  // "cycle_a" is a delta from "cycle_b", which is a delta from "cycle_a".
+  for (const auto& bundle_and_base : {std::make_pair("cycle_a", "cycle_b"),
+                                      std::make_pair("cycle_b", "cycle_a")}) {
+    BundleWriter writer(Env::Default(), Prefix(bundle_and_base.first));
+    TF_ASSERT_OK(writer.AddDelta("foo", kShape, bundle_and_base.second,
+                                 test::AsTensor<int64>({1}),
+                                 Constant<float>(1.f, TensorShape({1, 3}))));
+    TF_ASSERT_OK(writer.Finish());
+  }
+
+  for (const char* bundle : {"cycle_a", "cycle_b"}) {
+    BundleReader reader(Env::Default(), Prefix(bundle));
+    TF_ASSERT_OK(reader.status());
+    Tensor val;
+    EXPECT_TRUE(errors::IsDataLoss(reader.Lookup("foo", &val)));
+  }
+}
+
 TEST(TensorBundleTest, Endianness) {
   BundleWriter writer(Env::Default(), Prefix("end"));
   TF_EXPECT_OK(writer.Add("key", Constant_2x3<float>(1.0)));
@@ -15,11 +15,246 @@ limitations under the License.
 
 #include "tensorflow/core/util/work_sharder.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <typeinfo>
+
+#include "tensorflow/core/lib/core/bits.h"
 #include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/abi.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
+namespace {
+
+#if defined(__GXX_RTTI) || defined(_CPPRTTI)
+#define TF_SHARD_HAS_RTTI 1
+#endif
+
+// A fixed-size, lock-free hash table of learned costs. Shard() runs on the
+// hot path of many kernels, so looking up and updating an estimate must not
+// take a lock.
+class ShardCostTable {
+ public:
+  // Costs are kept in fixed point so that units that take less than a
+  // nanosecond each can be told apart.
+  static constexpr int64 kCostScale = 256;
+
+  struct Slot {
+    // kEmpty, kClaimed while the other fields are being written, or a key
+    // with kKeyBit set once they are valid.
+    std::atomic<uint64> key{kEmpty};
+    const std::type_info* work_type = nullptr;
+    int64 cost_per_unit = 0;
+    int log2_total = 0;
+    // The estimate scaled by kCostScale, or 0 if nothing was measured yet.
+    std::atomic<int64> scaled_cost{0};
+    std::atomic<int64> num_samples{0};
+
+    // Returns the cost per unit to shard with.
+    int64 CostPerUnit(int64 default_cost) const {
+      const int64 scaled = scaled_cost.load(std::memory_order_relaxed);
+      if (scaled == 0) return default_cost;
+      return std::max<int64>(1, (scaled + kCostScale - 1) / kCostScale);
+    }
+
+    // Adds a sample of "units" of work that took "nanos" altogether.
+    void Record(int64 units, int64 nanos) {
+      const int64 sample =
+          std::max<int64>(1, nanos * kCostScale / std::max<int64>(1, units));
+      const int64 old = scaled_cost.load(std::memory_order_relaxed);
+      // Concurrent updates may get lost, which only slows learning down.
+      scaled_cost.store(old == 0 ? sample : old + (sample - old) / 4,
+                        std::memory_order_relaxed);
+      num_samples.fetch_add(1, std::memory_order_relaxed);
+    }
+  };
+
+  static ShardCostTable* Global() {
+    static ShardCostTable* table = new ShardCostTable;
+    return table;
+  }
+
+  // Returns the slot for the given kind of work, adding it if needed, or
+  // nullptr if the table is full around it.
+  Slot* Find(const std::type_info& work_type, int64 cost_per_unit,
+             int64 total) {
+    const int log2_total = Log2Floor64(static_cast<uint64>(total));
+    const uint64 key =
+        Hash64Combine(Hash64Combine(work_type.hash_code(),
+                                    static_cast<uint64>(cost_per_unit)),
+                      log2_total) |
+        kKeyBit;
+    for (int probe = 0; probe < kMaxProbes; ++probe) {
+      Slot* slot = &slots_[(key + probe) % kNumSlots];
+      uint64 current = WaitUntilPublished(slot);
+      if (current == key) return slot;
+      if (current != kEmpty) continue;
+      if (!slot->key.compare_exchange_strong(current, kClaimed,
+                                             std::memory_order_relaxed,
+                                             std::memory_order_relaxed)) {
+        // Another thread is adding a key here, which may be the same one.
+        if (WaitUntilPublished(slot) == key) return slot;
+        continue;
+      }
+      slot->work_type = &work_type;
+      slot->cost_per_unit = cost_per_unit;
+      slot->log2_total = log2_total;
+      slot->key.store(key, std::memory_order_release);
+      return slot;
+    }
+    return nullptr;
+  }
+
+  // Forgets all estimates. Must not be called concurrently with Find().
+  void Clear() {
+    for (int i = 0; i < kNumSlots; ++i) {
+      Slot& slot = slots_[i];
+      slot.key.store(kEmpty, std::memory_order_relaxed);
+      slot.scaled_cost.store(0, std::memory_order_relaxed);
+      slot.num_samples.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::vector<ShardCostEstimate> Estimates() const {
+    std::vector<ShardCostEstimate> estimates;
+    for (int i = 0; i < kNumSlots; ++i) {
+      const Slot& slot = slots_[i];
+      if ((slot.key.load(std::memory_order_acquire) & kKeyBit) == 0) continue;
+      const int64 scaled = slot.scaled_cost.load(std::memory_order_relaxed);
+      if (scaled == 0) continue;
+      ShardCostEstimate estimate;
+      estimate.work_type = port::MaybeAbiDemangle(slot.work_type->name());
+      estimate.cost_per_unit = slot.cost_per_unit;
+      estimate.min_total = int64{1} << slot.log2_total;
+      estimate.measured_cost_per_unit =
+          static_cast<double>(scaled) / kCostScale;
+      estimate.num_samples = slot.num_samples.load(std::memory_order_relaxed);
+      estimates.push_back(std::move(estimate));
+    }
+    return estimates;
+  }
+
+ private:
+  static constexpr uint64 kEmpty = 0;
+  static constexpr uint64 kClaimed = 1;
+  static constexpr uint64 kKeyBit = uint64{1} << 63;
+  static constexpr int kNumSlots = 4096;
+  static constexpr int kMaxProbes = 16;
+
+  ShardCostTable() {}
+
+  // Returns the key of "slot" once it is not kClaimed anymore. Claims are
+  // only held for a few stores, so this spins rather than blocks.
+  static uint64 WaitUntilPublished(Slot* slot) {
+    uint64 current = slot->key.load(std::memory_order_acquire);
+    while (TF_PREDICT_FALSE(current == kClaimed)) {
+      std::this_thread::yield();
+      current = slot->key.load(std::memory_order_acquire);
+    }
+    return current;
+  }
+
+  Slot slots_[kNumSlots];
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ShardCostTable);
+};
+
+constexpr int64 ShardCostTable::kCostScale;
+constexpr uint64 ShardCostTable::kEmpty;
+constexpr uint64 ShardCostTable::kClaimed;
+constexpr uint64 ShardCostTable::kKeyBit;
+
+std::atomic<bool>* AdaptiveShardingFlag() {
+  static std::atomic<bool>* flag = []() {
+    bool enabled = false;
+    Status s = ReadBoolFromEnvVar("TF_ADAPTIVE_SHARDING", false, &enabled);
+    if (!s.ok()) LOG(ERROR) << s;
+    return new std::atomic<bool>(enabled);
+  }();
+  return flag;
+}
+
+int64 SteadyNowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::atomic<int64 (*)()> now_nanos_fn(&SteadyNowNanos);
+
+int64 NowNanos() { return now_nanos_fn.load(std::memory_order_relaxed)(); }
+
+// Shards "work" without adapting "cost_per_unit".
+void ShardWithCost(int max_parallelism, thread::ThreadPool* workers,
+                   int64 total, int64 cost_per_unit,
+                   const std::function<void(int64, int64)>& work) {
+  if (max_parallelism <= 1) {
+    // Just inline the whole work since we only have 1 thread (core).
+    work(0, total);
+    return;
+  }
+  if (max_parallelism >= workers->NumThreads()) {
+    workers->ParallelFor(total, cost_per_unit, work);
+    return;
+  }
+  Sharder::Do(total, cost_per_unit, work,
+              [&workers](Sharder::Closure c) { workers->Schedule(c); },
+              max_parallelism);
+}
+
+}  // namespace
+
+void SetAdaptiveSharding(bool enabled) {
+  AdaptiveShardingFlag()->store(enabled, std::memory_order_relaxed);
+}
+
+bool AdaptiveShardingEnabled() {
+#ifdef TF_SHARD_HAS_RTTI
+  return AdaptiveShardingFlag()->load(std::memory_order_relaxed);
+#else
+  return false;
+#endif
+}
+
+void ResetAdaptiveShardingForTesting(int64 (*now_nanos)()) {
+  now_nanos_fn.store(now_nanos != nullptr ? now_nanos : &SteadyNowNanos,
+                     std::memory_order_relaxed);
+  ShardCostTable::Global()->Clear();
+}
+
+std::vector<ShardCostEstimate> GetShardCostEstimates() {
+  std::vector<ShardCostEstimate> estimates =
+      ShardCostTable::Global()->Estimates();
+  std::sort(estimates.begin(), estimates.end(),
+            [](const ShardCostEstimate& a, const ShardCostEstimate& b) {
+              if (a.work_type != b.work_type) return a.work_type < b.work_type;
+              if (a.cost_per_unit != b.cost_per_unit) {
+                return a.cost_per_unit < b.cost_per_unit;
+              }
+              return a.min_total < b.min_total;
+            });
+  return estimates;
+}
+
+string ShardCostEstimatesDebugString() {
+  string result;
+  for (const ShardCostEstimate& e : GetShardCostEstimates()) {
+    strings::StrAppend(&result, e.work_type, " cost_per_unit=",
+                       e.cost_per_unit, " total=[", e.min_total, ", ",
+                       2 * e.min_total, ") measured=",
+                       e.measured_cost_per_unit, "ns samples=", e.num_samples,
+                       "\n");
+  }
+  return result;
+}
+
 /* ABSL_CONST_INIT */ thread_local int per_thread_max_parallism = 1000000;
 
 void SetPerThreadMaxParallelism(int max_parallelism) {
@@ -36,18 +271,29 @@ void Shard(int max_parallelism, thread::ThreadPool* workers, int64 total,
     return;
   }
   max_parallelism = std::min(max_parallelism, GetPerThreadMaxParallelism());
-  if (max_parallelism <= 1) {
-    // Just inline the whole work since we only have 1 thread (core).
-    work(0, total);
-    return;
+  ShardCostTable::Slot* slot = nullptr;
+#ifdef TF_SHARD_HAS_RTTI
+  if (AdaptiveShardingEnabled()) {
+    slot = ShardCostTable::Global()->Find(work.target_type(), cost_per_unit,
+                                          total);
   }
-  if (max_parallelism >= workers->NumThreads()) {
-    workers->ParallelFor(total, cost_per_unit, work);
+#endif
+  if (slot == nullptr) {
+    ShardWithCost(max_parallelism, workers, total, cost_per_unit, work);
     return;
   }
-  Sharder::Do(total, cost_per_unit, work,
-              [&workers](Sharder::Closure c) { workers->Schedule(c); },
-              max_parallelism);
+  // Sum up the time spent in every shard, whichever thread runs it, so that
+  // the estimate does not depend on how many shards ran in parallel.
+  std::atomic<int64> busy_nanos(0);
+  ShardWithCost(max_parallelism, workers, total,
+                slot->CostPerUnit(cost_per_unit),
+                [&work, &busy_nanos](int64 start, int64 limit) {
+                  const int64 start_nanos = NowNanos();
+                  work(start, limit);
+                  busy_nanos.fetch_add(NowNanos() - start_nanos,
+                                       std::memory_order_relaxed);
+                });
+  slot->Record(total, busy_nanos.load(std::memory_order_relaxed));
 }
 
 void Sharder::Do(int64 total, int64 cost_per_unit, const Work& work,
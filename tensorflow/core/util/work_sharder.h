@@ -17,6 +17,7 @@ limitations under the License.
 #define TENSORFLOW_UTIL_WORK_SHARDER_H_
 
 #include <functional>
+#include <vector>
 
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/platform/types.h"
@@ -47,6 +48,10 @@ namespace tensorflow {
 // call SetMaxParallelism() so that all Shard() calls later limits the
 // thread parallelism.
 //
+// If adaptive sharding is enabled (see SetAdaptiveSharding()), Shard()
+// measures how long each unit of work actually takes and uses the measured
+// cost instead of "cost_per_unit" in later calls with the same kind of work.
+//
 // REQUIRES: max_parallelism >= 0
 // REQUIRES: workers != nullptr
 // REQUIRES: total >= 0
@@ -54,6 +59,47 @@ namespace tensorflow {
 void Shard(int max_parallelism, thread::ThreadPool* workers, int64 total,
            int64 cost_per_unit, std::function<void(int64, int64)> work);
 
+// Enables or disables adaptive sharding for all later Shard() calls. It is
+// enabled at startup iff the environment variable TF_ADAPTIVE_SHARDING is
+// "true" or "1".
+//
+// Adaptive sharding keeps an estimate of the cost per unit, in nanoseconds,
+// for every kind of work and power-of-two bucket of "total". The kind of
+// work is the type of the callable passed to Shard(), which identifies the
+// lambda, and so the kernel, that called it. The estimate is a moving
+// average of the time spent in work() divided by the number of units, and
+// replaces "cost_per_unit" as soon as there is one. Adaptive sharding
+// requires RTTI and is a no-op without it.
+void SetAdaptiveSharding(bool enabled);
+bool AdaptiveShardingEnabled();
+
+// A cost per unit learned by adaptive sharding.
+struct ShardCostEstimate {
+  // The demangled type name of the work callable.
+  string work_type;
+  // The cost per unit passed to Shard().
+  int64 cost_per_unit = 0;
+  // The estimate applies to calls with min_total <= total < 2 * min_total.
+  int64 min_total = 0;
+  // The measured cost per unit, in nanoseconds.
+  double measured_cost_per_unit = 0;
+  // The number of Shard() calls that contributed to the estimate.
+  int64 num_samples = 0;
+};
+
+// Returns the costs learned so far, e.g. to dump them for inspection.
+std::vector<ShardCostEstimate> GetShardCostEstimates();
+
+// Like GetShardCostEstimates(), but returns one human-readable line per
+// estimate.
+string ShardCostEstimatesDebugString();
+
+// For testing only. Forgets the costs learned so far, and makes adaptive
+// sharding read the time in nanoseconds from "now_nanos" instead of the
+// steady clock, unless it is nullptr. Must not be called concurrently with
+// Shard().
+void ResetAdaptiveShardingForTesting(int64 (*now_nanos)());
+
 // Each thread has an associated option to express the desired maximum
 // parallelism. Its default is a very large quantity.
 //
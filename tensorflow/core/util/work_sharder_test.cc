@@ -89,6 +89,92 @@ TEST(Shard, OverflowTest) {
   }
 }
 
+// Returns the number of shards "work" was split into.
+template <typename Work>
+int64 CountShards(thread::ThreadPool* threads, int max_parallelism,
+                  int64 total, int64 cost_per_unit, const Work& work) {
+  std::atomic<int64> num_shards(0);
+  std::atomic<int64> num_done_work(0);
+  Shard(max_parallelism, threads, total, cost_per_unit,
+        [&](int64 start, int64 limit) {
+          ++num_shards;
+          num_done_work += limit - start;
+          work(start, limit);
+        });
+  EXPECT_EQ(num_done_work.load(), total);
+  return num_shards;
+}
+
+// The clock adaptive sharding measures the work with. The work advances it
+// explicitly, so that the learned costs do not depend on the machine.
+std::atomic<int64> fake_nanos(0);
+int64 FakeNowNanos() { return fake_nanos.load(); }
+
+TEST(Shard, AdaptiveStopsOversharding) {
+  thread::ThreadPool threads(Env::Default(), "test", 16);
+  ResetAdaptiveShardingForTesting(&FakeNowNanos);
+  SetAdaptiveSharding(true);
+  ASSERT_TRUE(AdaptiveShardingEnabled());
+  auto cheap = [](int64 start, int64 limit) {};
+  // The cost per unit is overestimated by orders of magnitude.
+  EXPECT_EQ(8, CountShards(&threads, 8, 1000, 1000000000, cheap));
+  EXPECT_EQ(1, CountShards(&threads, 8, 1000, 1000000000, cheap));
+  // Calls with a different bucket of "total" are learned separately.
+  EXPECT_EQ(8, CountShards(&threads, 8, 100, 1000000000, cheap));
+
+  bool found = false;
+  for (const ShardCostEstimate& e : GetShardCostEstimates()) {
+    if (e.cost_per_unit != 1000000000 || e.min_total != 512) continue;
+    found = true;
+    EXPECT_EQ(2, e.num_samples);
+    EXPECT_GT(e.measured_cost_per_unit, 0);
+    EXPECT_LT(e.measured_cost_per_unit, 1);
+  }
+  EXPECT_TRUE(found);
+  EXPECT_NE(string::npos, ShardCostEstimatesDebugString().find(
+                              "cost_per_unit=1000000000 total=[512, 1024)"));
+  SetAdaptiveSharding(false);
+  ResetAdaptiveShardingForTesting(nullptr);
+}
+
+TEST(Shard, AdaptiveStopsRunningSerially) {
+  thread::ThreadPool threads(Env::Default(), "test", 16);
+  ResetAdaptiveShardingForTesting(&FakeNowNanos);
+  SetAdaptiveSharding(true);
+  auto expensive = [](int64 start, int64 limit) {
+    fake_nanos += 10000 * (limit - start);
+  };
+  // The cost per unit is underestimated by orders of magnitude.
+  EXPECT_EQ(1, CountShards(&threads, 8, 100, 1, expensive));
+  EXPECT_EQ(8, CountShards(&threads, 8, 100, 1, expensive));
+  SetAdaptiveSharding(false);
+  ResetAdaptiveShardingForTesting(nullptr);
+}
+
+TEST(Shard, AdaptiveConcurrentFirstCalls) {
+  thread::ThreadPool threads(Env::Default(), "test", 16);
+  ResetAdaptiveShardingForTesting(&FakeNowNanos);
+  SetAdaptiveSharding(true);
+  auto work = [](int64 start, int64 limit) {};
+  // Many threads add the same key at once; they must all find one slot.
+  {
+    thread::ThreadPool callers(Env::Default(), "callers", 8);
+    for (int i = 0; i < 64; ++i) {
+      callers.Schedule(
+          [&threads, &work]() { CountShards(&threads, 1, 100, 7, work); });
+    }
+  }
+  int num_found = 0;
+  for (const ShardCostEstimate& e : GetShardCostEstimates()) {
+    if (e.cost_per_unit != 7) continue;
+    ++num_found;
+    EXPECT_EQ(64, e.num_samples);
+  }
+  EXPECT_EQ(1, num_found);
+  SetAdaptiveSharding(false);
+  ResetAdaptiveShardingForTesting(nullptr);
+}
+
 void BM_Sharding(int iters, int arg) {
   thread::ThreadPool threads(Env::Default(), "test", 16);
   const int64 total = 1LL << 30;
@@ -100,5 +186,18 @@ void BM_Sharding(int iters, int arg) {
 }
 BENCHMARK(BM_Sharding)->Range(1, 128);
 
+void BM_AdaptiveSharding(int iters, int arg) {
+  thread::ThreadPool threads(Env::Default(), "test", 16);
+  SetAdaptiveSharding(true);
+  const int64 total = 1LL << 30;
+  auto lambda = [](int64 start, int64 limit) {};
+  auto work = std::cref(lambda);
+  for (; iters > 0; iters -= arg) {
+    Shard(arg - 1, &threads, total, 1, work);
+  }
+  SetAdaptiveSharding(false);
+}
+BENCHMARK(BM_AdaptiveSharding)->Range(1, 128);
+
 }  // namespace
 }  // namespace tensorflow
@@ -17,6 +17,7 @@ from __future__ import absolute_import
 from __future__ import division
 from __future__ import print_function
 
+import json
 import os
 import warnings
 
@@ -25,6 +26,7 @@ import numpy as np
 from tensorflow.core.protobuf import cluster_pb2
 from tensorflow.core.protobuf import config_pb2
 from tensorflow.python.client import session
+from tensorflow.python.client import timeline
 from tensorflow.python.compat import compat as forward_compat
 from tensorflow.python.data.ops import dataset_ops
 from tensorflow.python.data.ops import iterator_ops
@@ -289,6 +291,128 @@ class IteratorTest(test.TestCase):
                                    "iterator has not been initialized"):
         sess.run(get_next)
 
+  def testIteratorStepStats(self):
+    iterator = (
+        dataset_ops.Dataset.range(10).map(lambda x: x * x).prefetch(1)
+        .map(lambda x: x).make_one_shot_iterator())
+    get_next = iterator.get_next()
+
+    def traced_node_stats(sess, expected):
+      run_options = config_pb2.RunOptions(
+          trace_level=config_pb2.RunOptions.FULL_TRACE)
+      run_metadata = config_pb2.RunMetadata()
+      self.assertEqual(
+          expected, sess.run(get_next, options=run_options,
+                             run_metadata=run_metadata))
+      tf_data_stats = [
+          dev_stats for dev_stats in run_metadata.step_stats.dev_stats
+          if dev_stats.device.endswith("/tf_data")
+      ]
+      self.assertEqual(1, len(tf_data_stats))
+      return {
+          node_stats.node_name: node_stats
+          for node_stats in tf_data_stats[0].node_stats
+      }
+
+    with self.test_session() as sess:
+      for _ in range(5):
+        sess.run(get_next)
+      first_stats = traced_node_stats(sess, 25)
+      sess.run(get_next)
+      second_stats = traced_node_stats(sess, 49)
+
+    for node_stats in [first_stats, second_stats]:
+      # The iterators below the prefetch run in the background, and only
+      # appear if they produced an element during the traced step.
+      self.assertLessEqual(
+          set(["Iterator::Map", "Iterator::Map::Prefetch"]),
+          set(node_stats.keys()))
+      self.assertLessEqual(
+          set(node_stats.keys()),
+          set(["Iterator::Map", "Iterator::Map::Prefetch",
+               "Iterator::Map::Prefetch::Map",
+               "Iterator::Map::Prefetch::Map::Range"]))
+      # Each traced step only reports its own element.
+      self.assertTrue(node_stats["Iterator::Map"].timeline_label.startswith(
+          "Iterator::Map = Map(elements=1,"))
+      self.assertIn("average_buffered=",
+                    node_stats["Iterator::Map::Prefetch"].timeline_label)
+
+  def testIteratorStepStatsInChromeTrace(self):
+    iterator = (
+        dataset_ops.Dataset.range(10).map(lambda x: x * x).prefetch(1)
+        .make_one_shot_iterator())
+    get_next = iterator.get_next()
+
+    with self.test_session() as sess:
+      self.assertEqual(0, sess.run(get_next))
+      run_options = config_pb2.RunOptions(
+          trace_level=config_pb2.RunOptions.FULL_TRACE)
+      run_metadata = config_pb2.RunMetadata()
+      self.assertEqual(
+          1, sess.run(get_next, options=run_options,
+                      run_metadata=run_metadata))
+
+    trace = json.loads(
+        timeline.Timeline(run_metadata.step_stats)
+        .generate_chrome_trace_format(show_memory=True))
+    process_names = {
+        event["pid"]: event["args"]["name"]
+        for event in trace["traceEvents"]
+        if event["ph"] == "M" and event["name"] == "process_name"
+    }
+    tf_data_events = {
+        event["args"]["name"]: event
+        for event in trace["traceEvents"]
+        if event["ph"] == "X" and
+        process_names[event["pid"]].endswith("/tf_data Compute")
+    }
+    # Each stage of the pipeline is a slice named after its type, with its
+    # statistics as arguments.
+    self.assertIn("Iterator::Prefetch", tf_data_events)
+    prefetch_event = tf_data_events["Iterator::Prefetch"]
+    self.assertEqual("Prefetch", prefetch_event["name"])
+    self.assertEqual("Op", prefetch_event["cat"])
+    self.assertIn("elements=1", prefetch_event["args"].values())
+    self.assertTrue(
+        any(arg.startswith("average_buffered=")
+            for arg in prefetch_event["args"].values()))
+    # The op that got the element is traced as well.
+    self.assertTrue(
+        any(event["ph"] == "X" and
+            event["args"].get("op") == "IteratorGetNext"
+            for event in trace["traceEvents"]))
+
+  def testAutotunedIteratorsCreatedInGetNextJoinTheModel(self):
+    # `repeat()` creates the iterator of its input again in GetNext() at the
+    # end of each epoch. The new iterator must still be tuned and traced.
+    iterator = (
+        dataset_ops.Dataset.range(4)
+        .map(lambda x: x * x, num_parallel_calls=-1)  # tf.contrib.data.AUTOTUNE
+        .repeat(2).make_one_shot_iterator())
+    get_next = iterator.get_next()
+
+    with self.test_session() as sess:
+      for expected in [0, 1, 4, 9, 0]:
+        self.assertEqual(expected, sess.run(get_next))
+      run_options = config_pb2.RunOptions(
+          trace_level=config_pb2.RunOptions.FULL_TRACE)
+      run_metadata = config_pb2.RunMetadata()
+      self.assertEqual(
+          1, sess.run(get_next, options=run_options,
+                      run_metadata=run_metadata))
+
+    node_stats = {
+        node_stats.node_name: node_stats
+        for dev_stats in run_metadata.step_stats.dev_stats
+        if dev_stats.device.endswith("/tf_data")
+        for node_stats in dev_stats.node_stats
+    }
+    self.assertIn("Iterator::Repeat::ParallelMap", node_stats)
+    self.assertIn(
+        "parallelism=",
+        node_stats["Iterator::Repeat::ParallelMap"].timeline_label)
+
   def testReinitializableIterator(self):
     dataset_3 = dataset_ops.Dataset.from_tensors(
         constant_op.constant([1, 2, 3]))
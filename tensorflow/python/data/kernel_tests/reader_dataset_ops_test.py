@@ -781,6 +781,62 @@ class TFRecordDatasetTest(test.TestCase):
       with self.assertRaises(errors.OutOfRangeError):
         sess.run(next_element)
 
+  def _readWithMmap(self, filenames):
+    """Reads `filenames` with TF_RECORD_DATASET_MMAP set.
+
+    Returns the records read before the end of the input or the first error,
+    and the error, if any.
+    """
+    records = []
+    with test.mock.patch.dict(os.environ, {"TF_RECORD_DATASET_MMAP": "1"}):
+      with self.test_session() as sess:
+        sess.run(self.init_op, feed_dict={self.filenames: filenames})
+        try:
+          while True:
+            records.append(sess.run(self.get_next))
+        except errors.OutOfRangeError:
+          return records, None
+        except errors.OpError as e:
+          return records, e
+
+  def testReadWithMmap(self):
+    records, error = self._readWithMmap(self.test_filenames)
+    self.assertIsNone(error)
+    self.assertAllEqual([
+        self._record(j, i)
+        for j in range(self._num_files)
+        for i in range(self._num_records)
+    ], records)
+
+  def testReadTruncatedFileWithMmap(self):
+    with open(self.test_filenames[0], "rb") as f:
+      contents = f.read()
+    truncated = os.path.join(self.get_temp_dir(), "tf_record.truncated")
+    with open(truncated, "wb") as f:
+      # Cut the last record in half.
+      f.write(contents[:-10])
+    records, error = self._readWithMmap([truncated])
+    self.assertIsInstance(error, errors.DataLossError)
+    self.assertIn("truncated record", str(error))
+    self.assertAllEqual(
+        [self._record(0, i) for i in range(self._num_records - 1)], records)
+
+  def testReadCorruptFileWithMmap(self):
+    with open(self.test_filenames[0], "rb") as f:
+      contents = bytearray(f.read())
+    # Every record is a 12 byte header, its data, and a 4 byte footer.
+    record_size = 12 + len(self._record(0, 0)) + 4
+    corrupt_record = 3
+    contents[corrupt_record * record_size + 12] ^= 0xff
+    corrupt = os.path.join(self.get_temp_dir(), "tf_record.corrupt")
+    with open(corrupt, "wb") as f:
+      f.write(contents)
+    records, error = self._readWithMmap([corrupt])
+    self.assertIsInstance(error, errors.DataLossError)
+    self.assertIn("corrupted record", str(error))
+    self.assertAllEqual(
+        [self._record(0, i) for i in range(corrupt_record)], records)
+
   def testReadFromDatasetOfFiles(self):
     files = dataset_ops.Dataset.from_tensor_slices(self.test_filenames)
     d = readers.TFRecordDataset(files)
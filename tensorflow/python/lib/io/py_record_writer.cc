@@ -29,7 +29,23 @@ PyRecordWriter::PyRecordWriter() {}
 
 PyRecordWriter* PyRecordWriter::New(const string& filename,
                                     const string& compression_type_string,
-                                    TF_Status* out_status) {
+                                    bool write_index, TF_Status* out_status) {
+  if (write_index) {
+    // The writer owns the files, so that it can close the index with them.
+    std::unique_ptr<RecordWriter> indexed_writer;
+    Status s = RecordWriter::NewIndexed(
+        Env::Default(), filename,
+        RecordWriterOptions::CreateRecordWriterOptions(compression_type_string),
+        &indexed_writer);
+    if (!s.ok()) {
+      Set_TF_Status_from_Status(out_status, s);
+      return nullptr;
+    }
+    PyRecordWriter* writer = new PyRecordWriter;
+    writer->writer_ = std::move(indexed_writer);
+    return writer;
+  }
+
   std::unique_ptr<WritableFile> file;
   Status s = Env::Default()->NewWritableFile(filename, &file);
   if (!s.ok()) {
@@ -70,6 +86,7 @@ void PyRecordWriter::Close(TF_Status* out_status) {
     return;
   }
   writer_.reset(nullptr);
+  if (file_ == nullptr) return;
   s = file_->Close();
   if (!s.ok()) {
     Set_TF_Status_from_Status(out_status, s);
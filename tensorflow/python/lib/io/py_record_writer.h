@@ -38,9 +38,12 @@ class PyRecordWriter {
  public:
   // TODO(vrv): make this take a shared proto to configure
   // the compression options.
+  //
+  // If "write_index" is true, also writes an index of the records next to
+  // "filename" (see io::RecordWriter::NewIndexed()).
   static PyRecordWriter* New(const string& filename,
                              const string& compression_type_string,
-                             TF_Status* out_status);
+                             bool write_index, TF_Status* out_status);
   ~PyRecordWriter();
 
   bool WriteRecord(tensorflow::StringPiece record);
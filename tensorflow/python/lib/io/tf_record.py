@@ -95,21 +95,27 @@ class TFRecordWriter(object):
   """
 
   # TODO(josh11b): Support appending?
-  def __init__(self, path, options=None):
+  def __init__(self, path, options=None, write_index=False):
     """Opens file `path` and creates a `TFRecordWriter` writing to it.
 
     Args:
       path: The path to the TFRecords file.
       options: (optional) A TFRecordOptions object.
+      write_index: (optional) If True, also writes an index of the records to
+        `path + ".index"`, which lets `tf.data.TFRecordDataset` skip records
+        without reading them. Only supported without compression.
 
     Raises:
       IOError: If `path` cannot be opened for writing.
+      InvalidArgumentError: If `write_index` is True and `options` enable
+        compression.
     """
     compression_type = TFRecordOptions.get_compression_type_string(options)
 
     with errors.raise_exception_on_not_ok_status() as status:
       self._writer = pywrap_tensorflow.PyRecordWriter_New(
-          compat.as_bytes(path), compat.as_bytes(compression_type), status)
+          compat.as_bytes(path), compat.as_bytes(compression_type),
+          bool(write_index), status)
 
   def __enter__(self):
     """Enter a `with` block."""
@@ -188,6 +188,23 @@ class TFRecordWriterTest(TFCompressionTestCase):
     ]
     self._AssertFilesEqual(uncompressed_files, files, True)
 
+  def testWriteIndex(self):
+    records = [self._Record(0, i) for i in range(self._num_records)]
+    fn = os.path.join(self.get_temp_dir(), "tfrecord_indexed")
+    with tf_record.TFRecordWriter(fn, write_index=True) as writer:
+      for r in records:
+        writer.write(r)
+    # The records are the same as without an index.
+    self._AssertFilesEqual([fn], [self._WriteRecordsToFile(records)], True)
+    # Each record has a 16 byte entry, and the footer takes 24 bytes.
+    self.assertEqual(16 * len(records) + 24, os.path.getsize(fn + ".index"))
+
+  def testWriteIndexRequiresNoCompression(self):
+    options = tf_record.TFRecordOptions(TFRecordCompressionType.ZLIB)
+    fn = os.path.join(self.get_temp_dir(), "tfrecord_indexed.z")
+    with self.assertRaises(errors_impl.InvalidArgumentError):
+      tf_record.TFRecordWriter(fn, options=options, write_index=True)
+
 
 class TFRecordWriterZlibTest(TFCompressionTestCase):
 
@@ -249,7 +249,12 @@ class HashTable(InitializableLookupTableBase):
   ```
   """
 
-  def __init__(self, initializer, default_value, shared_name=None, name=None):
+  def __init__(self,
+               initializer,
+               default_value,
+               shared_name=None,
+               name=None,
+               use_flat_hash_map=False):
     """Creates a non-initialized `HashTable` object.
 
     Creates a table, the type of its keys and values are specified by the
@@ -264,6 +269,8 @@ class HashTable(InitializableLookupTableBase):
       shared_name: If non-empty, this table will be shared under
         the given name across multiple sessions.
       name: A name for the operation (optional).
+      use_flat_hash_map: If True, the table is an open-addressing hash map,
+        which is faster to look up in for large tables.
 
     Returns:
       A `HashTable` object.
@@ -274,6 +281,7 @@ class HashTable(InitializableLookupTableBase):
           shared_name=shared_name,
           key_dtype=initializer.key_dtype,
           value_dtype=initializer.value_dtype,
+          use_flat_hash_map=use_flat_hash_map,
           name=scope)
 
       super(HashTable, self).__init__(table_ref, default_value, initializer)
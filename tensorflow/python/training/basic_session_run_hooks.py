@@ -468,6 +468,11 @@ class CheckpointSaverHook(session_run_hook.SessionRunHook):
     last_step = session.run(self._global_step_tensor)
     if last_step != self._timer.last_triggered_step():
       self._save(session, last_step)
+    # Records the last checkpoint if it is being written in the background.
+    wait_for_pending_save = getattr(self._get_saver(), "wait_for_pending_save",
+                                    None)
+    if wait_for_pending_save is not None:
+      wait_for_pending_save(session)
     for l in self._listeners:
       l.end(session, last_step)
 
@@ -856,6 +856,16 @@ def _get_saver_or_default():
   return saver
 
 
+def _async_save_enabled():
+  """Returns whether SaveV2 writes checkpoints in the background.
+
+  SaveV2 and MergeV2Checkpoints do so when the environment variable
+  TF_CHECKPOINT_ASYNC_SAVE is set to "1" or "true".
+  """
+  value = os.environ.get("TF_CHECKPOINT_ASYNC_SAVE", "")
+  return value.lower() in ("1", "true")
+
+
 def _GetCheckpointFilename(save_dir, latest_filename):
   """Returns a filename for storing the CheckpointState.
 
@@ -1274,6 +1284,10 @@ class Saver(object):
     self._filename = filename
     self._last_checkpoints = []
     self._checkpoints_to_be_deleted = []
+    # The checkpoint last saved in the background, to be recorded once it has
+    # been written, and the op that waits for the write.
+    self._pending_save = None
+    self._wait_for_save_op = None
     if context.executing_eagerly():
       self._next_checkpoint_time = (
           time.time() + self._keep_checkpoint_every_n_hours * 3600)
@@ -1345,6 +1359,19 @@ class Saver(object):
       # Set in __init__ when executing eagerly.
       self._next_checkpoint_time = (
           time.time() + self.saver_def.keep_checkpoint_every_n_hours * 3600)
+      if self._saves_in_background():
+        self._build_wait_for_save_op(ops.get_default_graph())
+
+  def _build_wait_for_save_op(self, graph):
+    """Builds the op that waits for the write of the checkpoint fed as the
+    filename, unless it has already been built."""
+    if self._wait_for_save_op is not None:
+      return
+    with graph.as_default():
+      filename_tensor = graph.as_graph_element(
+          self.saver_def.filename_tensor_name)
+      self._wait_for_save_op = gen_io_ops.wait_for_checkpoint_v2(
+          filename_tensor, name="wait_for_save")
 
   def _check_saver_def(self):
     if not isinstance(self.saver_def, saver_pb2.SaverDef):
@@ -1385,6 +1412,26 @@ class Saver(object):
     if len(self._last_checkpoints) > self.saver_def.max_to_keep:
       self._checkpoints_to_be_deleted.append(self._last_checkpoints.pop(0))
 
+  def _RecordWrittenCheckpoint(self, model_checkpoint_path, save_dir,
+                               latest_filename, meta_graph_suffix):
+    """Updates the checkpoint state and deletes old checkpoints."""
+    self._RecordLastCheckpoint(model_checkpoint_path)
+    _update_checkpoint_state(
+        save_dir=save_dir,
+        model_checkpoint_path=model_checkpoint_path,
+        all_model_checkpoint_paths=self.last_checkpoints,
+        latest_filename=latest_filename,
+        save_relative_paths=self._save_relative_paths)
+    self._MaybeDeleteOldCheckpoints(meta_graph_suffix=meta_graph_suffix)
+
+  def _saves_in_background(self):
+    """Returns whether `save()` returns before the checkpoint is written."""
+    if context.executing_eagerly():
+      version = self._write_version
+    else:
+      version = self.saver_def.version
+    return version == saver_pb2.SaverDef.V2 and _async_save_enabled()
+
   def _MaybeDeleteOldCheckpoints(self, meta_graph_suffix="meta"):
     """Deletes old checkpoints if necessary.
 
@@ -1538,6 +1585,9 @@ class Saver(object):
     The method returns the path prefix of the newly created checkpoint files.
     This string can be passed directly to a call to `restore()`.
 
+    If the checkpoint is written in the background, the checkpoint state is
+    only updated once it has been written. See `wait_for_pending_save()`.
+
     Args:
       sess: A Session to use to save the variables.
       save_path: String.  Prefix of filenames created for the checkpoint.
@@ -1609,26 +1659,29 @@ class Saver(object):
 
     save_path_parent = os.path.dirname(save_path)
     if not self._is_empty:
+      self.wait_for_pending_save(sess)
       try:
         if context.executing_eagerly():
           self._build_eager(
               checkpoint_file, build_save=True, build_restore=False)
           model_checkpoint_path = self.saver_def.save_tensor_name
         else:
+          if self._saves_in_background():
+            # A Saver created from a `saver_def` may not have been built.
+            self._build_wait_for_save_op(sess.graph)
           model_checkpoint_path = sess.run(
               self.saver_def.save_tensor_name,
               {self.saver_def.filename_tensor_name: checkpoint_file})
 
         model_checkpoint_path = compat.as_str(model_checkpoint_path)
         if write_state:
-          self._RecordLastCheckpoint(model_checkpoint_path)
-          _update_checkpoint_state(
-              save_dir=save_path_parent,
-              model_checkpoint_path=model_checkpoint_path,
-              all_model_checkpoint_paths=self.last_checkpoints,
-              latest_filename=latest_filename,
-              save_relative_paths=self._save_relative_paths)
-          self._MaybeDeleteOldCheckpoints(meta_graph_suffix=meta_graph_suffix)
+          written_checkpoint = (model_checkpoint_path, save_path_parent,
+                                latest_filename, meta_graph_suffix)
+          if self._saves_in_background():
+            # The checkpoint state must only name written checkpoints.
+            self._pending_save = written_checkpoint
+          else:
+            self._RecordWrittenCheckpoint(*written_checkpoint)
       except (errors.FailedPreconditionError, errors.NotFoundError) as exc:
         if not gfile.IsDirectory(save_path_parent):
           exc = ValueError(
@@ -1649,6 +1702,31 @@ class Saver(object):
     else:
       return model_checkpoint_path
 
+  def wait_for_pending_save(self, sess):
+    """Waits for the checkpoint being written in the background, if any.
+
+    With the environment variable `TF_CHECKPOINT_ASYNC_SAVE` set to "1",
+    `save()` returns before the checkpoint has been written. It updates the
+    checkpoint state file and deletes old checkpoints once the write is
+    done, at the start of the next `save()` or in this method, which should
+    be called after the last `save()`.
+
+    Args:
+      sess: A Session to use to wait for the write.
+
+    Raises:
+      errors.OpError: If the checkpoint could not be written.
+    """
+    if self._pending_save is None:
+      return
+    pending_save, self._pending_save = self._pending_save, None
+    if context.executing_eagerly():
+      gen_io_ops.wait_for_checkpoint_v2(pending_save[0])
+    else:
+      sess.run(self._wait_for_save_op,
+               {self.saver_def.filename_tensor_name: pending_save[0]})
+    self._RecordWrittenCheckpoint(*pending_save)
+
   def export_meta_graph(self,
                         filename=None,
                         collection_list=None,
@@ -57,6 +57,7 @@ from tensorflow.python.lib.io import file_io
 from tensorflow.python.ops import array_ops
 from tensorflow.python.ops import control_flow_ops
 from tensorflow.python.ops import data_flow_ops
+from tensorflow.python.ops import gen_io_ops
 from tensorflow.python.ops import gradients_impl
 from tensorflow.python.ops import math_ops
 from tensorflow.python.ops import nn_ops
@@ -1386,6 +1387,65 @@ class MaxToKeepTest(test.TestCase):
       self.assertTrue(saver_module.checkpoint_exists(s1))
       self.assertFalse(gfile.Exists(saver_module._meta_graph_filename(s1)))
 
+  def testAsyncSave(self):
+    save_dir = self._get_test_dir("async_save")
+
+    os.environ["TF_CHECKPOINT_ASYNC_SAVE"] = "1"
+    try:
+      with self.test_session() as sess:
+        v = variables.Variable(10.0, name="v")
+        save = saver_module.Saver({"v": v}, sharded=True, max_to_keep=1)
+        variables.global_variables_initializer().run()
+
+        s1 = save.save(sess, os.path.join(save_dir, "s1"))
+        # A checkpoint is recorded once it has been written.
+        self.assertEqual([], save.last_checkpoints)
+        self.assertIsNone(saver_module.get_checkpoint_state(save_dir))
+
+        s2 = save.save(sess, os.path.join(save_dir, "s2"))
+        self.assertEqual([s1], save.last_checkpoints)
+        self.assertCheckpointState(
+            model_checkpoint_path=s1,
+            all_model_checkpoint_paths=[s1],
+            save_dir=save_dir)
+
+        save.wait_for_pending_save(sess)
+        self.assertEqual([s2], save.last_checkpoints)
+        self.assertFalse(saver_module.checkpoint_exists(s1))
+        self.assertTrue(saver_module.checkpoint_exists(s2))
+        self.assertCheckpointState(
+            model_checkpoint_path=s2,
+            all_model_checkpoint_paths=[s2],
+            save_dir=save_dir)
+    finally:
+      del os.environ["TF_CHECKPOINT_ASYNC_SAVE"]
+
+  def testAsyncSaveFromSaverDef(self):
+    save_dir = self._get_test_dir("async_save_from_saver_def")
+
+    with self.test_session() as sess:
+      v = variables.Variable(10.0, name="v")
+      saver_def = saver_module.Saver({"v": v}).as_saver_def()
+      variables.global_variables_initializer().run()
+
+      os.environ["TF_CHECKPOINT_ASYNC_SAVE"] = "1"
+      try:
+        # The Saver is never built, so `save()` builds the wait for the write.
+        save = saver_module.Saver(saver_def=saver_def, defer_build=True)
+        s1 = save.save(sess, os.path.join(save_dir, "s1"))
+        self.assertEqual([], save.last_checkpoints)
+        self.assertIsNone(saver_module.get_checkpoint_state(save_dir))
+
+        save.wait_for_pending_save(sess)
+        self.assertEqual([s1], save.last_checkpoints)
+        self.assertTrue(saver_module.checkpoint_exists(s1))
+        self.assertCheckpointState(
+            model_checkpoint_path=s1,
+            all_model_checkpoint_paths=[s1],
+            save_dir=save_dir)
+      finally:
+        del os.environ["TF_CHECKPOINT_ASYNC_SAVE"]
+
 
 class KeepCheckpointEveryNHoursTest(test.TestCase):
 
@@ -2551,6 +2611,32 @@ class CheckpointReaderTest(test.TestCase):
 class CheckpointReaderForV2Test(CheckpointReaderTest):
   _WRITE_VERSION = saver_pb2.SaverDef.V2
 
+  def testDeltas(self):
+    v = resource_variable_ops.ResourceVariable(
+        [[1., 2.], [3., 4.]], dtype=dtypes.float32, name="v")
+    prefix = array_ops.placeholder(dtypes.string)
+    base_prefix = array_ops.placeholder(dtypes.string)
+    save = gen_io_ops.save_delta_v2(prefix, base_prefix, ["v"], [""],
+                                    [v.handle])
+    update = resource_variable_ops.resource_scatter_update(
+        v.handle, [1], [[5., 6.]])
+    base_path = os.path.join(self.get_temp_dir(), "ckpt_delta_base")
+    delta_path = os.path.join(self.get_temp_dir(), "ckpt_delta")
+    with self.test_session() as sess:
+      sess.run(v.initializer)
+      sess.run(save, {prefix: base_path, base_prefix: ""})
+      sess.run(update)
+      # Saves row 1 only.
+      sess.run(save, {prefix: delta_path, base_prefix: base_path})
+
+      reader = pywrap_tensorflow.NewCheckpointReader(delta_path)
+      # The indices and rows of the delta are not listed as tensors.
+      self.assertEqual({"v": [2, 2]}, reader.get_variable_to_shape_map())
+      self.assertEqual({"v": dtypes.float32},
+                       reader.get_variable_to_dtype_map())
+      self.assertFalse(compat.as_bytes("DELTA") in reader.debug_string())
+      self.assertAllEqual([[1., 2.], [5., 6.]], reader.get_tensor("v"))
+
 
 class WriteGraphTest(test.TestCase):
 